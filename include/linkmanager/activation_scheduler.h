@@ -0,0 +1,120 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_ACTIVATION_SCHEDULER_H
+#define LINKMANAGER_ACTIVATION_SCHEDULER_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <linkmanager/api/event_loop.h>
+#include <linkmanager/module_registry.h>
+
+namespace linkmanager {
+
+/**
+ * Activates links concurrently.
+ *
+ * link::set_active() is asynchronous by contract, but implementations are
+ * allowed to block. The scheduler therefore calls it from a small pool of
+ * worker threads, bounded by the concurrency limit, while deadlines, retries
+ * and bookkeeping run on the event loop thread.
+ *
+ * Bringing up N links thus takes roughly as long as the slowest link (given
+ * enough concurrency), rather than the sum of all of them.
+ */
+class activation_scheduler
+{
+public:
+  using link_ptr = std::shared_ptr<api::modules::link>;
+
+  struct options
+  {
+    // Maximum number of activations in flight at any time. An attempt that
+    // timed out stays in flight until its set_active() call returns.
+    std::size_t               max_concurrent = 4;
+
+    // Each attempt must complete within the deadline, or it is considered
+    // failed.
+    std::chrono::milliseconds deadline = std::chrono::seconds{60};
+
+    // Failed attempts are retried up to this many attempts in total, with
+    // an exponential backoff between attempts.
+    unsigned                  max_attempts = 3;
+    std::chrono::milliseconds initial_backoff = std::chrono::seconds{1};
+    std::chrono::milliseconds max_backoff = std::chrono::seconds{30};
+    unsigned                  backoff_factor = 2;
+  };
+
+  /**
+   * Per-link outcome and phase timings.
+   *
+   * - queued is the time spent waiting for a free slot.
+   * - activating is the time spent in attempts, summed across attempts.
+   * - backoff is the time spent waiting between attempts.
+   */
+  struct link_report
+  {
+    std::string               module;
+    std::string               link;
+    bool                      active = false;
+    unsigned                  attempts = 0;
+    unsigned                  timeouts = 0;
+    std::chrono::nanoseconds  queued = {};
+    std::chrono::nanoseconds  activating = {};
+    std::chrono::nanoseconds  backoff = {};
+    std::chrono::nanoseconds  total = {};
+  };
+
+  struct report
+  {
+    std::vector<link_report>  links;
+    std::chrono::nanoseconds  elapsed = {};
+
+    std::size_t succeeded() const;
+  };
+
+  using completion_callback = std::function<void (report const &)>;
+
+  /**
+   * The event loop must outlive the scheduler. Construction may raise
+   * std::invalid_argument for nonsensical options.
+   *
+   * Destruction waits for set_active() calls that are still in progress.
+   */
+  explicit activation_scheduler(api::event_loop & loop);
+  activation_scheduler(api::event_loop & loop, options const & opts);
+  ~activation_scheduler();
+
+  /**
+   * Activate every link of every module in the registry. The completion
+   * callback is invoked on the event loop thread once every link is either
+   * active or has exhausted its attempts.
+   *
+   * A run must complete before the next one can be started; otherwise
+   * std::logic_error is raised.
+   */
+  void activate_all(module_registry const & registry, completion_callback callback);
+
+  /**
+   * As above, but for an explicit list of (module name, link) pairs.
+   */
+  using link_list = std::vector<std::pair<std::string, link_ptr>>;
+  void activate(link_list links, completion_callback callback);
+
+  /**
+   * Returns true while a run is in progress.
+   */
+  bool busy() const;
+
+private:
+  struct state;
+  std::shared_ptr<state>  m_state;
+};
+
+} // namespace linkmanager
+
+#endif // guard
@@ -0,0 +1,82 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_API_EVENT_LOOP_H
+#define LINKMANAGER_API_EVENT_LOOP_H
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+
+namespace linkmanager::api {
+
+/**
+ * The event_loop is the interface the daemon's run loop exposes to link
+ * modules. Modules that need to wait on file descriptors (device nodes,
+ * sockets) or run periodic work register them here instead of spawning
+ * their own threads.
+ *
+ * All callbacks are invoked on the thread running the loop, so they must not
+ * block. Registration functions and post() may be called from any thread.
+ */
+class event_loop
+{
+public:
+  virtual ~event_loop() = default;
+
+  /**
+   * Registrations are identified by handles; a handle of zero is never
+   * returned for a successful registration.
+   */
+  using handle = std::uint64_t;
+  static constexpr handle INVALID_HANDLE = 0;
+
+  /**
+   * I/O events; these may be combined.
+   */
+  enum io_events : std::uint32_t
+  {
+    IO_READ   = 1 << 0,
+    IO_WRITE  = 1 << 1,
+    IO_ERROR  = 1 << 2,
+  };
+
+  using io_callback = std::function<void (int fd, std::uint32_t events)>;
+  using timer_callback = std::function<void ()>;
+  using task = std::function<void ()>;
+
+  /**
+   * Watch a file descriptor for the given io_events. The file descriptor
+   * remains owned by the caller, and must stay open until the registration is
+   * removed.
+   *
+   * Returns INVALID_HANDLE if the descriptor could not be watched.
+   */
+  virtual handle add_fd(int fd, std::uint32_t events, io_callback callback) = 0;
+
+  /**
+   * Add a timer. The callback is first invoked after the initial delay, and
+   * then every interval. An interval of zero makes this a one-shot timer,
+   * which is removed automatically after it fired.
+   *
+   * Returns INVALID_HANDLE if the timer could not be created.
+   */
+  virtual handle add_timer(std::chrono::nanoseconds initial,
+      std::chrono::nanoseconds interval, timer_callback callback) = 0;
+
+  /**
+   * Remove a registration. Callbacks for the handle are not invoked after
+   * this returns, unless remove() is called from another thread while the
+   * callback is already running.
+   */
+  virtual void remove(handle h) = 0;
+
+  /**
+   * Run a task on the loop thread at the next opportunity.
+   */
+  virtual void post(task t) = 0;
+};
+
+} // namespace linkmanager::api
+
+#endif // guard
@@ -4,6 +4,9 @@
 #ifndef LINKMANAGER_API_MODULES_DEVICE_H
 #define LINKMANAGER_API_MODULES_DEVICE_H
 
+#include <chrono>
+#include <cstdint>
+#include <list>
 #include <string>
 #include <functional>
 
@@ -55,7 +58,24 @@ public:
   using network_list = std::list<liberate::net::network>;
   virtual network_list get_networks() const = 0;
 
-  // TODO need more here? Yes, something for reporting metrics!
+  /**
+   * Link metrics, as far as the device can measure or estimate them. Zero
+   * means unknown. The scheduler weighs devices by these, so they should be
+   * cheap to query; it asks periodically, from the event loop thread.
+   */
+  struct metrics
+  {
+    // Usable capacity, in bits per second
+    std::uint64_t             capacity_bps = 0;
+
+    // Round trip time
+    std::chrono::microseconds rtt = {};
+  };
+
+  virtual metrics get_metrics() const
+  {
+    return {};
+  }
 };
 
 } // namespace linkmanager::api::modules
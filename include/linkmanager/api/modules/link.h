@@ -67,7 +67,7 @@ public:
   virtual void set_active(bool new_status, activation_callback callback) = 0;
 
   // ************************CUSTOM*************************************
-  virtual void registerDevice();
+  virtual void registerDevice() {}
   // *******************************************************************
 
   /**
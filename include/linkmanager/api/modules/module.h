@@ -10,6 +10,8 @@
 
 #include <nlohmann/json.hpp>
 
+#include <linkmanager/api/event_loop.h>
+
 namespace linkmanager::api::modules {
 
 /**
@@ -49,8 +51,17 @@ public:
 
   // TODO include some kind of hang detection function here
 
+  /**
+   * Attach to the daemon's event loop. Modules that need to watch device
+   * file descriptors or run periodic work register them with the loop here,
+   * rather than running threads of their own. The default does nothing.
+   */
+  virtual void attach_event_loop(event_loop & loop [[maybe_unused]])
+  {
+  }
+
   // ************************CUSTOM*************************************
-  virtual void registerLink();
+  virtual void registerLink() {}
   // *******************************************************************
 
   /**
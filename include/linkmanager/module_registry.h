@@ -5,17 +5,26 @@
 #define LINKMANAGER_MODULE_REGISTRY_H
 
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <memory>
 #include <exception>
 #include <filesystem>
+#include <string_view>
 
 #include <linkmanager/api/modules.h>
+#include <linkmanager/plugin_discovery.h>
+#include <linkmanager/rcu.h>
 
 namespace linkmanager {
 
 /**
  * Link module registry
+ *
+ * Registration is serialized internally. Every registration publishes a new,
+ * immutable snapshot of the registered modules, which any thread can read
+ * without taking locks; see snapshot().
  */
 class module_registry
 {
@@ -26,6 +35,51 @@ public:
     link_module_ptr
   >;
 
+  /**
+   * Immutable view of the registered modules at one point in time. Entries
+   * are stored contiguously and sorted by name; the version increases with
+   * every registration.
+   */
+  struct module_snapshot
+  {
+    struct entry
+    {
+      std::string     name;
+      link_module_ptr module;
+    };
+    using entry_list = std::vector<entry>;
+
+    std::uint64_t version = 0;
+    entry_list    entries = {};
+
+    inline entry_list::const_iterator begin() const
+    {
+      return entries.begin();
+    }
+
+    inline entry_list::const_iterator end() const
+    {
+      return entries.end();
+    }
+
+    inline std::size_t size() const
+    {
+      return entries.size();
+    }
+
+    /**
+     * Binary search by name; returns nullptr if no such module exists.
+     */
+    link_module_ptr find(std::string_view name) const;
+  };
+
+  using snapshot_guard = rcu_cell<module_snapshot>::read_guard;
+
+  module_registry();
+
+  module_registry(module_registry const &) = delete;
+  module_registry & operator=(module_registry const &) = delete;
+
   /**
    * Register link module.
    *
@@ -36,28 +90,59 @@ public:
 
   /**
    * Return information about registered modules.
+   *
+   * The map is not synchronized with registration; use it only from the
+   * thread that registers modules. Other threads should use snapshot().
    */
   module_map const & modules() const;
 
+  /**
+   * Return the current snapshot of registered modules, without locking.
+   * The snapshot stays valid while the guard lives; keep guards short-lived,
+   * as registration waits for them. Copy module pointers out of the snapshot
+   * to keep using them beyond that.
+   */
+  snapshot_guard snapshot() const noexcept;
+
+  /**
+   * The number of registered modules, as of the current snapshot; safe to
+   * call from any thread.
+   */
   inline std::size_t size() const
   {
-    return modules().size();
+    return snapshot()->size();
   }
 
   inline bool empty() const
   {
-    return modules().empty();
+    return snapshot()->entries.empty();
   }
 
   /**
    * Load DSO modules from the following path. Any file will be considered,
    * but the convention is to name them <somethign>_plugin.so
+   *
+   * Files are inspected and loaded in parallel, but plugins are initialized
+   * in path order.
    */
   void load_modules(std::filesystem::path path);
 
+  /**
+   * Use a persistent plugin index at the given path, so that unchanged files
+   * need not be inspected again on the next start. The index is loaded
+   * immediately, and saved after each load_modules() call.
+   */
+  void set_plugin_index(std::filesystem::path index_file);
+
 
 private:
-  module_map  m_modules;
+  std::mutex                m_mutex;
+  module_map                m_modules;
+  std::uint64_t             m_version = 0;
+  rcu_cell<module_snapshot> m_snapshot;
+
+  plugin_index              m_index;
+  std::filesystem::path     m_index_file;
 };
 
 
@@ -0,0 +1,115 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_PLUGIN_DISCOVERY_H
+#define LINKMANAGER_PLUGIN_DISCOVERY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace linkmanager {
+
+/**
+ * Symbol every plugin must export; see linkmanager/api/modules/plugin.h
+ */
+static constexpr char const * PLUGIN_INIT_SYMBOL = "init_link_plugin";
+
+/**
+ * Check whether the file is an ELF shared object of this process' word size
+ * and byte order, that defines the given symbol in its dynamic symbol table.
+ * The file is mapped and inspected, but not loaded.
+ *
+ * Objects without section headers cannot be inspected this way; for those,
+ * true is returned, leaving the decision to dlopen().
+ */
+bool elf_exports_symbol(std::filesystem::path const & file, char const * symbol);
+
+
+/**
+ * Persistent index of plugin discovery results, keyed by path, modification
+ * time and size. Unchanged files need not be inspected again on the next
+ * start.
+ *
+ * Lookups and updates are thread-safe.
+ */
+class plugin_index
+{
+public:
+  struct key
+  {
+    std::int64_t  mtime = 0;
+    std::uint64_t size = 0;
+  };
+
+  /**
+   * Load the index from the given file. A missing or unreadable file, or one
+   * in an unknown format, results in an empty index.
+   */
+  void load(std::filesystem::path const & file);
+
+  /**
+   * Save the index to the given file, if it changed since loading. Returns
+   * false if the file could not be written.
+   */
+  bool save(std::filesystem::path const & file);
+
+  /**
+   * Returns 1 if the file is known to be a plugin, 0 if it is known not to be,
+   * and -1 if it is unknown or changed.
+   */
+  int lookup(std::string const & path, key const & k) const;
+
+  void update(std::string const & path, key const & k, bool is_plugin);
+
+  /**
+   * Drop entries within the directory that are not in the given set of
+   * paths, i.e. files that were deleted.
+   */
+  void prune(std::filesystem::path const & dir,
+      std::vector<std::string> const & present);
+
+  std::size_t size() const;
+
+private:
+  struct entry
+  {
+    key   k;
+    bool  is_plugin;
+  };
+
+  mutable std::mutex                      m_mutex;
+  std::unordered_map<std::string, entry>  m_entries;
+  bool                                    m_dirty = false;
+};
+
+
+/**
+ * Find plugin candidates in a directory: regular files (or symlinks to them)
+ * that export PLUGIN_INIT_SYMBOL. Files are inspected on up to the given
+ * number of worker threads (0 picks the hardware concurrency); the index, if
+ * given, is consulted and updated.
+ *
+ * The result is sorted by path, so that plugins register in a deterministic
+ * order.
+ */
+std::vector<std::filesystem::path>
+discover_plugins(std::filesystem::path const & dir, plugin_index * index,
+    std::size_t workers = 0);
+
+
+/**
+ * dlopen() the candidates on up to the given number of worker threads. The
+ * result holds one handle per candidate, in the same order; failed loads
+ * yield nullptr.
+ */
+std::vector<void *>
+open_plugins(std::vector<std::filesystem::path> const & candidates,
+    std::size_t workers = 0);
+
+} // namespace linkmanager
+
+#endif // guard
@@ -0,0 +1,170 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_RCU_H
+#define LINKMANAGER_RCU_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace linkmanager {
+
+/**
+ * Read-copy-update domain.
+ *
+ * Readers enter and leave read-side critical sections without taking locks;
+ * they merely bump a counter. Counters are striped across cache lines by
+ * thread, so that readers on different cores do not contend.
+ *
+ * Writers call synchronize() after unpublishing data, which waits until all
+ * readers that might still see it have left their critical sections. This
+ * uses two counter phases, as in sleepable RCU, so that a reader that stalls
+ * between sampling the phase and announcing itself cannot be missed.
+ */
+class rcu_domain
+{
+public:
+  struct token
+  {
+    void *    stripe = nullptr;
+    unsigned  phase = 0;
+  };
+
+  rcu_domain() = default;
+  rcu_domain(rcu_domain const &) = delete;
+  rcu_domain & operator=(rcu_domain const &) = delete;
+
+  token enter() const noexcept;
+  void leave(token const & tok) const noexcept;
+
+  /**
+   * Wait for all read-side critical sections that started before this call
+   * to end. Must not be called from within a critical section.
+   */
+  void synchronize();
+
+private:
+  static constexpr std::size_t STRIPES = 32;
+
+  struct alignas(64) stripe
+  {
+    std::atomic<std::uint64_t>  count[2] = {};
+  };
+
+  stripe * stripe_for_thread() const noexcept;
+  void wait_for_phase(unsigned phase) const;
+
+  mutable stripe              m_stripes[STRIPES];
+  std::atomic<unsigned>       m_phase = 0;
+  std::mutex                  m_sync_mutex;
+};
+
+
+
+/**
+ * A pointer to an immutable T that can be read without locks, and replaced
+ * by publishing a new version.
+ *
+ * Readers hold a read_guard for as long as they access the value; guards
+ * are meant to be short-lived, since writers wait for them. Writers are
+ * serialized among themselves.
+ */
+template <typename T>
+class rcu_cell
+{
+public:
+  class read_guard
+  {
+  public:
+    inline read_guard(read_guard && other) noexcept
+      : m_domain{other.m_domain}
+      , m_token{other.m_token}
+      , m_value{other.m_value}
+    {
+      other.m_domain = nullptr;
+    }
+
+    read_guard(read_guard const &) = delete;
+    read_guard & operator=(read_guard const &) = delete;
+    read_guard & operator=(read_guard &&) = delete;
+
+    inline ~read_guard()
+    {
+      if (m_domain) {
+        m_domain->leave(m_token);
+      }
+    }
+
+    inline T const & operator*() const noexcept
+    {
+      return *m_value;
+    }
+
+    inline T const * operator->() const noexcept
+    {
+      return m_value;
+    }
+
+    inline T const * get() const noexcept
+    {
+      return m_value;
+    }
+
+  private:
+    friend class rcu_cell;
+
+    inline explicit read_guard(rcu_domain const & domain,
+        std::atomic<T const *> const & ptr) noexcept
+      : m_domain{&domain}
+      , m_token{domain.enter()}
+      , m_value{ptr.load(std::memory_order_seq_cst)}
+    {
+    }
+
+    rcu_domain const *  m_domain;
+    rcu_domain::token   m_token;
+    T const *           m_value;
+  };
+
+
+  inline explicit rcu_cell(std::unique_ptr<T const> initial)
+    : m_value{initial.release()}
+  {
+  }
+
+  inline ~rcu_cell()
+  {
+    delete m_value.load();
+  }
+
+  rcu_cell(rcu_cell const &) = delete;
+  rcu_cell & operator=(rcu_cell const &) = delete;
+
+  inline read_guard read() const noexcept
+  {
+    return read_guard{m_domain, m_value};
+  }
+
+  /**
+   * Replace the value. Returns once no reader can see the previous value
+   * any longer, which is then destroyed.
+   */
+  inline void publish(std::unique_ptr<T const> next)
+  {
+    std::lock_guard<std::mutex> lock{m_write_mutex};
+    auto old = m_value.exchange(next.release(), std::memory_order_seq_cst);
+    m_domain.synchronize();
+    delete old;
+  }
+
+private:
+  rcu_domain              m_domain;
+  std::atomic<T const *>  m_value;
+  std::mutex              m_write_mutex;
+};
+
+} // namespace linkmanager
+
+#endif // guard
@@ -0,0 +1,126 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_REACTOR_H
+#define LINKMANAGER_REACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <initializer_list>
+
+#include <linkmanager/api/event_loop.h>
+
+namespace linkmanager {
+
+/**
+ * Event-driven reactor for the daemon run loop.
+ *
+ * A single epoll instance multiplexes all file descriptors registered with
+ * it; timers are backed by timerfds and signals by a signalfd, so that the
+ * loop thread only ever blocks in epoll_wait() and consumes no CPU while
+ * idle.
+ *
+ * Construction may raise std::system_error if the kernel objects cannot be
+ * created.
+ */
+class reactor : public api::event_loop
+{
+public:
+  using clock = std::chrono::steady_clock;
+  using signal_callback = std::function<void (int signo)>;
+
+  /**
+   * Dispatch statistics. Latency is measured from the time epoll_wait()
+   * returned with an event to the time its handler is entered; for timers,
+   * it is measured from the scheduled expiry instead.
+   */
+  struct statistics
+  {
+    std::uint64_t             wakeups = 0;
+    std::uint64_t             dispatched = 0;
+    std::chrono::nanoseconds  total_latency = {};
+    std::chrono::nanoseconds  max_latency = {};
+
+    inline std::chrono::nanoseconds mean_latency() const
+    {
+      if (!dispatched) {
+        return {};
+      }
+      return total_latency / dispatched;
+    }
+  };
+
+  reactor();
+  virtual ~reactor();
+
+  reactor(reactor const &) = delete;
+  reactor & operator=(reactor const &) = delete;
+
+  // api::event_loop implementation
+  virtual handle add_fd(int fd, std::uint32_t events, io_callback callback) final;
+  virtual handle add_timer(std::chrono::nanoseconds initial,
+      std::chrono::nanoseconds interval, timer_callback callback) final;
+  virtual void remove(handle h) final;
+  virtual void post(task t) final;
+
+  /**
+   * Deliver the given signals via the loop. The signals are blocked in the
+   * calling thread; call this before any other threads are started, so that
+   * they inherit the signal mask.
+   *
+   * May only be called once per reactor.
+   */
+  handle add_signals(std::initializer_list<int> signals, signal_callback callback);
+
+  /**
+   * Run the loop until stop() is called. If stop() was called before run(),
+   * run() returns immediately.
+   */
+  void run();
+
+  /**
+   * Run a single iteration, waiting at most for the given timeout (a negative
+   * timeout waits indefinitely). Returns the number of handlers dispatched.
+   */
+  std::size_t run_once(std::chrono::milliseconds timeout);
+
+  /**
+   * Make run() return. Thread-safe.
+   */
+  void stop();
+
+  /**
+   * Number of active registrations.
+   */
+  std::size_t size() const;
+
+  statistics stats() const;
+
+private:
+  struct registration;
+  using registration_ptr = std::shared_ptr<registration>;
+
+  handle add_registration(registration_ptr reg, std::uint32_t epoll_events);
+  void dispatch(registration_ptr const & reg, std::uint32_t events,
+      clock::time_point woken);
+  void run_tasks();
+  void wake();
+
+  int                                             m_epoll = -1;
+  int                                             m_wakeup = -1;
+  std::atomic<bool>                               m_stop = false;
+  std::atomic<handle>                             m_next_handle = 1;
+
+  mutable std::mutex                              m_mutex;
+  std::unordered_map<handle, registration_ptr>    m_registrations;
+  std::vector<task>                               m_tasks;
+  statistics                                      m_stats;
+};
+
+} // namespace linkmanager
+
+#endif // guard
@@ -0,0 +1,110 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_SPSC_QUEUE_H
+#define LINKMANAGER_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace linkmanager {
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * push() and pop() never block and never allocate; push() fails when the
+ * queue is full. The capacity is rounded up to a power of two. Producer and
+ * consumer indices live on separate cache lines, and each side keeps a
+ * cached copy of the other's index, so that the shared index is only read
+ * when the cached one suggests the queue is full or empty.
+ *
+ * T must be default constructible and move assignable; popped slots are
+ * reset to T{}, so that resources held by an element are released when it
+ * is popped, not when its slot is reused.
+ */
+template <typename T>
+class spsc_queue
+{
+public:
+  inline explicit spsc_queue(std::size_t capacity)
+  {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_slots.resize(size);
+    m_mask = size - 1;
+  }
+
+  spsc_queue(spsc_queue const &) = delete;
+  spsc_queue & operator=(spsc_queue const &) = delete;
+
+  /**
+   * Producer side. Returns false, leaving value untouched, if the queue is
+   * full.
+   */
+  inline bool push(T && value)
+  {
+    auto const tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head_cache > m_mask) {
+      m_head_cache = m_head.load(std::memory_order_acquire);
+      if (tail - m_head_cache > m_mask) {
+        return false;
+      }
+    }
+    m_slots[tail & m_mask] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer side. Returns false if the queue is empty.
+   */
+  inline bool pop(T & value)
+  {
+    auto const head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail_cache) {
+      m_tail_cache = m_tail.load(std::memory_order_acquire);
+      if (head == m_tail_cache) {
+        return false;
+      }
+    }
+    auto & slot = m_slots[head & m_mask];
+    value = std::move(slot);
+    slot = T{};
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  inline std::size_t capacity() const
+  {
+    return m_slots.size();
+  }
+
+  /**
+   * Number of queued elements; exact only when called from the producer or
+   * consumer while the other side is idle.
+   */
+  inline std::size_t size() const
+  {
+    auto const head = m_head.load(std::memory_order_acquire);
+    return m_tail.load(std::memory_order_acquire) - head;
+  }
+
+private:
+  std::vector<T>  m_slots;
+  std::size_t     m_mask = 0;
+
+  // Consumer
+  alignas(64) std::atomic<std::size_t>  m_head = 0;
+  std::size_t                           m_tail_cache = 0;
+
+  // Producer
+  alignas(64) std::atomic<std::size_t>  m_tail = 0;
+  std::size_t                           m_head_cache = 0;
+};
+
+} // namespace linkmanager
+
+#endif // guard
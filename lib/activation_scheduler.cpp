@@ -0,0 +1,487 @@
+/*
+ *
+ */
+#include <linkmanager/activation_scheduler.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <liberate/logging.h>
+
+namespace linkmanager {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+} // anonymous namespace
+
+
+struct activation_scheduler::state
+  : public std::enable_shared_from_this<activation_scheduler::state>
+{
+  struct entry
+  {
+    link_ptr                  link;
+    link_report               report = {};
+
+    // The token of the current attempt, if any. Tokens are never reused, so
+    // that a late completion of a timed out attempt - of this run or an
+    // earlier one - is not mistaken for the current one.
+    std::uint64_t             attempt = 0;
+
+    clock::time_point         queued_since = {};
+    clock::time_point         attempt_start = {};
+    clock::time_point         backoff_start = {};
+    api::event_loop::handle   timer = api::event_loop::INVALID_HANDLE;
+  };
+
+  api::event_loop &         loop;
+  options                   opts;
+
+  // Worker pool; set_active() runs here, since it may block.
+  std::mutex                pool_mutex;
+  std::condition_variable   pool_cond;
+  std::deque<std::function<void ()>>  jobs;
+  bool                      shutdown = false;
+  std::vector<std::thread>  workers;
+
+  // Run state; only touched on the loop thread.
+  std::atomic<bool>         running = false;
+  std::vector<entry>        entries;
+  std::deque<std::size_t>   pending;
+  std::uint64_t             next_attempt = 0;
+
+  // An attempt holds its slot until it has concluded, and its set_active()
+  // call has returned; a timed out call may still be blocking a worker, and
+  // may do so beyond the end of the run. Holds count what is left of both.
+  std::unordered_map<std::uint64_t, int>  holds;
+  std::size_t               in_flight = 0;
+  std::size_t               remaining = 0;
+  clock::time_point         run_start = {};
+  completion_callback       callback;
+
+  inline state(api::event_loop & _loop, options const & _opts)
+    : loop{_loop}
+    , opts{_opts}
+  {
+  }
+
+
+  void start_workers()
+  {
+    for (std::size_t i = 0 ; i < opts.max_concurrent ; ++i) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+
+
+  void stop_workers()
+  {
+    {
+      std::lock_guard<std::mutex> lock{pool_mutex};
+      shutdown = true;
+    }
+    pool_cond.notify_all();
+    for (auto & w : workers) {
+      w.join();
+    }
+    workers.clear();
+  }
+
+
+  void work()
+  {
+    while (true) {
+      std::function<void ()> job;
+      {
+        std::unique_lock<std::mutex> lock{pool_mutex};
+        pool_cond.wait(lock, [this]() { return shutdown || !jobs.empty(); });
+        if (shutdown) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+
+  void submit(std::function<void ()> job)
+  {
+    {
+      std::lock_guard<std::mutex> lock{pool_mutex};
+      jobs.push_back(std::move(job));
+    }
+    pool_cond.notify_one();
+  }
+
+
+  /**
+   * Post a completion to the loop thread, unless the scheduler is gone.
+   */
+  static void post_done(std::weak_ptr<state> weak, std::size_t idx,
+      std::uint64_t attempt, bool success)
+  {
+    auto self = weak.lock();
+    if (!self) {
+      return;
+    }
+    self->loop.post([weak, idx, attempt, success]()
+        {
+          auto s = weak.lock();
+          if (s) {
+            s->on_done(idx, attempt, success, false);
+          }
+        });
+  }
+
+
+  /**
+   * Post the return of a set_active() call to the loop thread, unless the
+   * scheduler is gone.
+   */
+  static void post_returned(std::weak_ptr<state> weak, std::uint64_t attempt)
+  {
+    auto self = weak.lock();
+    if (!self) {
+      return;
+    }
+    self->loop.post([weak, attempt]()
+        {
+          auto s = weak.lock();
+          if (s) {
+            s->release(attempt);
+          }
+        });
+  }
+
+
+  void begin(link_list && links, completion_callback && cb)
+  {
+    run_start = clock::now();
+    callback = std::move(cb);
+
+    entries.clear();
+    entries.resize(links.size());
+    for (std::size_t i = 0 ; i < links.size() ; ++i) {
+      auto & e = entries[i];
+      e.link = links[i].second;
+      e.report.module = links[i].first;
+      e.report.link = e.link->name();
+      e.queued_since = run_start;
+      pending.push_back(i);
+    }
+    remaining = entries.size();
+
+    if (!remaining) {
+      complete();
+      return;
+    }
+    pump();
+  }
+
+
+  void pump()
+  {
+    while (in_flight < opts.max_concurrent && !pending.empty()) {
+      auto idx = pending.front();
+      pending.pop_front();
+      start_attempt(idx);
+    }
+  }
+
+
+  void start_attempt(std::size_t idx)
+  {
+    auto & e = entries[idx];
+    auto now = clock::now();
+    e.report.queued += now - e.queued_since;
+    e.report.attempts += 1;
+    e.attempt_start = now;
+    e.attempt = ++next_attempt;
+    holds[e.attempt] = 2;
+    ++in_flight;
+
+    std::weak_ptr<state> weak = shared_from_this();
+    auto attempt = e.attempt;
+
+    LIBLOG_DEBUG("Activating " << e.report.module << "/" << e.report.link
+        << ", attempt " << e.report.attempts << "/" << opts.max_attempts);
+
+    e.timer = loop.add_timer(opts.deadline, std::chrono::nanoseconds{0},
+        [weak, idx, attempt]()
+        {
+          auto s = weak.lock();
+          if (s) {
+            s->on_done(idx, attempt, false, true);
+          }
+        });
+
+    submit([weak, idx, attempt, link = e.link]()
+        {
+          try {
+            link->set_active(true,
+                [weak, idx, attempt](api::modules::link &, bool success)
+                {
+                  post_done(weak, idx, attempt, success);
+                });
+          } catch (std::exception const & ex) {
+            LIBLOG_ERROR("Activating " << link->name() << " raised: " << ex.what());
+            post_done(weak, idx, attempt, false);
+          } catch (...) {
+            LIBLOG_ERROR("Activating " << link->name() << " raised an unknown error.");
+            post_done(weak, idx, attempt, false);
+          }
+          post_returned(weak, attempt);
+        });
+  }
+
+
+  /**
+   * Drop one hold of the attempt; the last frees its slot.
+   */
+  void release(std::uint64_t attempt)
+  {
+    auto iter = holds.find(attempt);
+    if (iter == holds.end()) {
+      return;
+    }
+    if (--iter->second > 0) {
+      return;
+    }
+    holds.erase(iter);
+    --in_flight;
+    pump();
+  }
+
+
+  std::chrono::milliseconds backoff_for(unsigned attempts) const
+  {
+    auto backoff = opts.initial_backoff;
+    for (unsigned i = 1 ; i < attempts && backoff < opts.max_backoff ; ++i) {
+      backoff *= opts.backoff_factor;
+    }
+    return std::min(backoff, opts.max_backoff);
+  }
+
+
+  void on_done(std::size_t idx, std::uint64_t attempt, bool success, bool timed_out)
+  {
+    if (idx >= entries.size()) {
+      return;
+    }
+    auto & e = entries[idx];
+    if (!attempt || attempt != e.attempt) {
+      return;
+    }
+    e.attempt = 0;
+
+    // The one-shot deadline timer removes itself when it fires.
+    if (!timed_out) {
+      loop.remove(e.timer);
+    }
+    e.timer = api::event_loop::INVALID_HANDLE;
+
+    auto now = clock::now();
+    e.report.activating += now - e.attempt_start;
+
+    if (success) {
+      e.report.active = true;
+      finish(idx, now);
+    }
+    else {
+      if (timed_out) {
+        e.report.timeouts += 1;
+      }
+
+      if (e.report.attempts < opts.max_attempts) {
+        auto backoff = backoff_for(e.report.attempts);
+        LIBLOG_WARN("Activating " << e.report.module << "/" << e.report.link
+            << (timed_out ? " timed out" : " failed") << "; retrying in "
+            << backoff.count() << "ms.");
+
+        e.backoff_start = now;
+        std::weak_ptr<state> weak = shared_from_this();
+        e.timer = loop.add_timer(backoff, std::chrono::nanoseconds{0},
+            [weak, idx]()
+            {
+              auto s = weak.lock();
+              if (s) {
+                s->after_backoff(idx);
+              }
+            });
+      }
+      else {
+        LIBLOG_ERROR("Activating " << e.report.module << "/" << e.report.link
+            << " failed after " << e.report.attempts << " attempt(s).");
+        finish(idx, now);
+      }
+    }
+
+    release(attempt);
+  }
+
+
+  void after_backoff(std::size_t idx)
+  {
+    auto & e = entries[idx];
+    auto now = clock::now();
+    e.timer = api::event_loop::INVALID_HANDLE;
+    e.report.backoff += now - e.backoff_start;
+    e.queued_since = now;
+    pending.push_back(idx);
+    pump();
+  }
+
+
+  void finish(std::size_t idx, clock::time_point now)
+  {
+    entries[idx].report.total = now - run_start;
+    if (--remaining == 0) {
+      complete();
+    }
+  }
+
+
+  void complete()
+  {
+    report r;
+    r.elapsed = clock::now() - run_start;
+    r.links.reserve(entries.size());
+    for (auto & e : entries) {
+      r.links.push_back(e.report);
+    }
+    entries.clear();
+
+    auto cb = std::move(callback);
+    callback = {};
+    running = false;
+
+    if (cb) {
+      cb(r);
+    }
+  }
+
+
+  void cancel_timers()
+  {
+    for (auto & e : entries) {
+      if (e.timer != api::event_loop::INVALID_HANDLE) {
+        loop.remove(e.timer);
+      }
+    }
+  }
+};
+
+
+
+std::size_t
+activation_scheduler::report::succeeded() const
+{
+  std::size_t ret = 0;
+  for (auto & l : links) {
+    if (l.active) {
+      ++ret;
+    }
+  }
+  return ret;
+}
+
+
+
+activation_scheduler::activation_scheduler(api::event_loop & loop)
+  : activation_scheduler{loop, options{}}
+{
+}
+
+
+
+activation_scheduler::activation_scheduler(api::event_loop & loop,
+    options const & opts)
+{
+  if (!opts.max_concurrent) {
+    throw std::invalid_argument("Concurrency limit must be at least 1.");
+  }
+  if (!opts.max_attempts) {
+    throw std::invalid_argument("Must make at least one activation attempt.");
+  }
+  if (!opts.backoff_factor) {
+    throw std::invalid_argument("Backoff factor must be at least 1.");
+  }
+  if (opts.deadline.count() <= 0) {
+    throw std::invalid_argument("Activation deadline must be positive.");
+  }
+
+  m_state = std::make_shared<state>(loop, opts);
+  m_state->start_workers();
+}
+
+
+
+activation_scheduler::~activation_scheduler()
+{
+  m_state->cancel_timers();
+  m_state->stop_workers();
+}
+
+
+
+void
+activation_scheduler::activate_all(module_registry const & registry,
+    completion_callback callback)
+{
+  // Copy the modules out, so as not to hold up registration while querying
+  // links.
+  std::vector<module_registry::module_snapshot::entry> modules;
+  {
+    auto snap = registry.snapshot();
+    modules = snap->entries;
+  }
+
+  link_list links;
+  for (auto const & [name, mod] : modules) {
+    for (auto const & link : mod->links()) {
+      if (link) {
+        links.emplace_back(name, link);
+      }
+    }
+  }
+  activate(std::move(links), std::move(callback));
+}
+
+
+
+void
+activation_scheduler::activate(link_list links, completion_callback callback)
+{
+  if (m_state->running.exchange(true)) {
+    throw std::logic_error("An activation run is already in progress.");
+  }
+
+  std::weak_ptr<state> weak = m_state;
+  m_state->loop.post(
+      [weak, links = std::move(links), callback = std::move(callback)]() mutable
+      {
+        auto s = weak.lock();
+        if (s) {
+          s->begin(std::move(links), std::move(callback));
+        }
+      });
+}
+
+
+
+bool
+activation_scheduler::busy() const
+{
+  return m_state->running;
+}
+
+} // namespace linkmanager
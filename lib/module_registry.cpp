@@ -5,8 +5,30 @@
 
 #include <dlfcn.h>
 
+#include <algorithm>
+
 namespace linkmanager {
 
+module_registry::link_module_ptr
+module_registry::module_snapshot::find(std::string_view name) const
+{
+  auto iter = std::lower_bound(entries.begin(), entries.end(), name,
+      [](entry const & e, std::string_view n) { return e.name < n; });
+  if (iter == entries.end() || iter->name != name) {
+    return {};
+  }
+  return iter->module;
+}
+
+
+
+module_registry::module_registry()
+  : m_snapshot{std::make_unique<module_snapshot>()}
+{
+}
+
+
+
 void
 module_registry::register_module(link_module_ptr module, std::string name_override /* = {} */)
 {
@@ -19,12 +41,23 @@ module_registry::register_module(link_module_ptr module, std::string name_overri
     name = name_override;
   }
 
+  std::lock_guard<std::mutex> lock{m_mutex};
+
   auto iter = m_modules.find(name);
   if (iter != m_modules.end()) {
     throw std::invalid_argument("Module already registered: " + name);
   }
 
   m_modules[name] = module;
+
+  // The map is ordered, so the snapshot comes out sorted by name.
+  auto snap = std::make_unique<module_snapshot>();
+  snap->version = ++m_version;
+  snap->entries.reserve(m_modules.size());
+  for (auto const & [n, m] : m_modules) {
+    snap->entries.push_back({n, m});
+  }
+  m_snapshot.publish(std::move(snap));
 }
 
 
@@ -37,6 +70,14 @@ module_registry::modules() const
 
 
 
+module_registry::snapshot_guard
+module_registry::snapshot() const noexcept
+{
+  return m_snapshot.read();
+}
+
+
+
 void
 module_registry::load_modules(std::filesystem::path path)
 {
@@ -46,22 +87,22 @@ module_registry::load_modules(std::filesystem::path path)
     throw std::invalid_argument("Path is not a directory!");
   }
 
-  for (auto const & entry : fs::directory_iterator{path}) {
-    // We consider regular files and symlinks - if the symlink points to
-    // something bad, dlopen() will catch it.
-    if (!fs::is_regular_file(entry) && !fs::is_symlink(entry)) {
-      continue;
-    }
+  auto index = m_index_file.empty() ? nullptr : &m_index;
+  auto candidates = discover_plugins(path, index);
 
-    // Try opening via dlopen - this could fail for a number of reasons.
-    auto handle = dlopen(entry.path().c_str(), RTLD_LAZY);
+  // Loading is the expensive part, and dlopen() is thread-safe. Candidates
+  // have already been vetted, so failures here are rare.
+  auto handles = open_plugins(candidates);
+
+  for (std::size_t i = 0 ; i < candidates.size() ; ++i) {
+    auto handle = handles[i];
     if (!handle) {
       // Could not dlopen(), silently ignore!
       continue;
     }
 
     // Find init function
-    init_link_plugin_t init_func = reinterpret_cast<init_link_plugin_t>(dlsym(handle, "init_link_plugin"));
+    init_link_plugin_t init_func = reinterpret_cast<init_link_plugin_t>(dlsym(handle, PLUGIN_INIT_SYMBOL));
     if (!init_func) {
       // No init function; dlclose() and ignore.
       dlclose(handle);
@@ -76,6 +117,19 @@ module_registry::load_modules(std::filesystem::path path)
       dlclose(handle);
     }
   }
+
+  if (index) {
+    index->save(m_index_file);
+  }
+}
+
+
+
+void
+module_registry::set_plugin_index(std::filesystem::path index_file)
+{
+  m_index_file = index_file;
+  m_index.load(m_index_file);
 }
 
 } // namespace linkmanager
@@ -0,0 +1,416 @@
+/*
+ *
+ */
+#include <linkmanager/plugin_discovery.h>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace linkmanager {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+static constexpr char const * INDEX_MAGIC = "linkmanager-plugin-index";
+static constexpr int INDEX_VERSION = 1;
+
+
+/**
+ * Read a T from the mapped file at the given offset; the mapping carries no
+ * alignment guarantees for arbitrary offsets.
+ */
+template <typename T>
+inline bool
+read_at(std::uint8_t const * data, std::size_t size, std::uint64_t offset, T & out)
+{
+  if (offset > size || size - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&out, data + offset, sizeof(T));
+  return true;
+}
+
+
+template <typename Ehdr, typename Shdr, typename Sym>
+bool
+scan_dynsym(std::uint8_t const * data, std::size_t size, char const * symbol)
+{
+  Ehdr eh;
+  if (!read_at(data, size, 0, eh)) {
+    return false;
+  }
+  if (eh.e_type != ET_DYN) {
+    return false;
+  }
+
+  // Without section headers we cannot tell cheaply; let dlopen() decide.
+  if (!eh.e_shoff || !eh.e_shnum) {
+    return true;
+  }
+  if (eh.e_shentsize != sizeof(Shdr)) {
+    return false;
+  }
+
+  auto symlen = std::strlen(symbol);
+
+  for (std::size_t i = 0 ; i < eh.e_shnum ; ++i) {
+    Shdr sh;
+    if (!read_at(data, size, eh.e_shoff + i * sizeof(Shdr), sh)) {
+      return false;
+    }
+    if (sh.sh_type != SHT_DYNSYM || !sh.sh_entsize) {
+      continue;
+    }
+
+    Shdr strtab;
+    if (sh.sh_link >= eh.e_shnum
+        || !read_at(data, size, eh.e_shoff + sh.sh_link * sizeof(Shdr), strtab)) {
+      return false;
+    }
+    if (strtab.sh_offset > size || size - strtab.sh_offset < strtab.sh_size) {
+      return false;
+    }
+    auto strings = reinterpret_cast<char const *>(data + strtab.sh_offset);
+
+    auto count = sh.sh_size / sh.sh_entsize;
+    for (std::size_t j = 0 ; j < count ; ++j) {
+      Sym sym;
+      if (!read_at(data, size, sh.sh_offset + j * sh.sh_entsize, sym)) {
+        return false;
+      }
+      if (sym.st_shndx == SHN_UNDEF) {
+        continue;
+      }
+      if (sym.st_name + symlen >= strtab.sh_size) {
+        continue;
+      }
+      if (0 == std::memcmp(strings + sym.st_name, symbol, symlen + 1)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+template <typename F>
+void
+parallel_for(std::size_t count, std::size_t workers, F && func)
+{
+  if (!workers) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers = std::min(workers, count);
+
+  if (workers <= 1) {
+    for (std::size_t i = 0 ; i < count ; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  // Work is handed out one item at a time, since inspection cost varies
+  // wildly between cached, small and large files.
+  std::atomic<std::size_t> next = 0;
+  std::vector<std::thread> threads;
+  threads.reserve(workers);
+  for (std::size_t w = 0 ; w < workers ; ++w) {
+    threads.emplace_back([&]()
+        {
+          std::size_t i;
+          while ((i = next.fetch_add(1)) < count) {
+            func(i);
+          }
+        });
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+}
+
+} // anonymous namespace
+
+
+bool
+elf_exports_symbol(fs::path const & file, char const * symbol)
+{
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+      || static_cast<std::size_t>(st.st_size) < EI_NIDENT) {
+    ::close(fd);
+    return false;
+  }
+
+  // Check the identification bytes before mapping anything.
+  unsigned char ident[EI_NIDENT];
+  if (::pread(fd, ident, sizeof(ident), 0) != sizeof(ident)
+      || std::memcmp(ident, ELFMAG, SELFMAG) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  static constexpr unsigned char host_data = ELFDATA2LSB;
+#else
+  static constexpr unsigned char host_data = ELFDATA2MSB;
+#endif
+  static constexpr unsigned char host_class =
+    (sizeof(void *) == 8) ? ELFCLASS64 : ELFCLASS32;
+  if (ident[EI_DATA] != host_data || ident[EI_CLASS] != host_class) {
+    ::close(fd);
+    return false;
+  }
+
+  auto size = static_cast<std::size_t>(st.st_size);
+  void * map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  auto data = static_cast<std::uint8_t const *>(map);
+  bool ret;
+  if (host_class == ELFCLASS64) {
+    ret = scan_dynsym<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(data, size, symbol);
+  }
+  else {
+    ret = scan_dynsym<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(data, size, symbol);
+  }
+
+  ::munmap(map, size);
+  return ret;
+}
+
+
+
+void
+plugin_index::load(fs::path const & file)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_entries.clear();
+  m_dirty = false;
+
+  std::ifstream in{file};
+  if (!in) {
+    return;
+  }
+
+  std::string magic;
+  int version = 0;
+  in >> magic >> version;
+  if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+    return;
+  }
+
+  entry e;
+  std::string path;
+  int is_plugin;
+  while (in >> e.k.mtime >> e.k.size >> is_plugin) {
+    in.get(); // Separator; paths may contain spaces.
+    if (!std::getline(in, path) || path.empty()) {
+      break;
+    }
+    e.is_plugin = (is_plugin != 0);
+    m_entries[path] = e;
+  }
+}
+
+
+
+bool
+plugin_index::save(fs::path const & file)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  if (!m_dirty) {
+    return true;
+  }
+
+  // Write to a temporary file and rename, so that a crash cannot leave a
+  // truncated index behind.
+  auto tmp = file;
+  tmp += ".tmp";
+  {
+    std::ofstream out{tmp, std::ios::trunc};
+    if (!out) {
+      return false;
+    }
+    out << INDEX_MAGIC << " " << INDEX_VERSION << "\n";
+    for (auto const & [path, e] : m_entries) {
+      out << e.k.mtime << " " << e.k.size << " " << (e.is_plugin ? 1 : 0)
+        << " " << path << "\n";
+    }
+    if (!out) {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmp, file, ec);
+  if (ec) {
+    return false;
+  }
+  m_dirty = false;
+  return true;
+}
+
+
+
+int
+plugin_index::lookup(std::string const & path, key const & k) const
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto iter = m_entries.find(path);
+  if (iter == m_entries.end()) {
+    return -1;
+  }
+  if (iter->second.k.mtime != k.mtime || iter->second.k.size != k.size) {
+    return -1;
+  }
+  return iter->second.is_plugin ? 1 : 0;
+}
+
+
+
+void
+plugin_index::update(std::string const & path, key const & k, bool is_plugin)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_entries[path] = entry{k, is_plugin};
+  m_dirty = true;
+}
+
+
+
+void
+plugin_index::prune(fs::path const & dir, std::vector<std::string> const & present)
+{
+  auto prefix = (dir / "").string();
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  for (auto iter = m_entries.begin() ; iter != m_entries.end() ; ) {
+    auto const & path = iter->first;
+    if (path.compare(0, prefix.size(), prefix) == 0
+        && path.find('/', prefix.size()) == std::string::npos
+        && !std::binary_search(present.begin(), present.end(), path)) {
+      iter = m_entries.erase(iter);
+      m_dirty = true;
+    }
+    else {
+      ++iter;
+    }
+  }
+}
+
+
+
+std::size_t
+plugin_index::size() const
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_entries.size();
+}
+
+
+
+std::vector<fs::path>
+discover_plugins(fs::path const & dir, plugin_index * index,
+    std::size_t workers /* = 0 */)
+{
+  struct candidate
+  {
+    std::string       path;
+    plugin_index::key key;
+    bool              is_plugin = false;
+  };
+
+  // Collect files first; directory iteration itself is cheap.
+  std::vector<candidate> files;
+  for (auto const & entry : fs::directory_iterator{dir}) {
+    // We consider regular files and symlinks to them.
+    std::error_code ec;
+    auto st = fs::status(entry.path(), ec);
+    if (ec || !fs::is_regular_file(st)) {
+      continue;
+    }
+
+    candidate c;
+    c.path = entry.path().string();
+    c.key.mtime = fs::last_write_time(entry.path(), ec).time_since_epoch().count();
+    if (ec) {
+      continue;
+    }
+    c.key.size = fs::file_size(entry.path(), ec);
+    if (ec) {
+      continue;
+    }
+    files.push_back(std::move(c));
+  }
+
+  std::sort(files.begin(), files.end(),
+      [](candidate const & a, candidate const & b) { return a.path < b.path; });
+
+  parallel_for(files.size(), workers, [&](std::size_t i)
+      {
+        auto & c = files[i];
+        if (index) {
+          auto known = index->lookup(c.path, c.key);
+          if (known >= 0) {
+            c.is_plugin = (known == 1);
+            return;
+          }
+        }
+
+        c.is_plugin = elf_exports_symbol(c.path, PLUGIN_INIT_SYMBOL);
+        if (index) {
+          index->update(c.path, c.key, c.is_plugin);
+        }
+      });
+
+  std::vector<fs::path> ret;
+  std::vector<std::string> present;
+  present.reserve(files.size());
+  for (auto const & c : files) {
+    present.push_back(c.path);
+    if (c.is_plugin) {
+      ret.push_back(c.path);
+    }
+  }
+
+  if (index) {
+    index->prune(dir, present);
+  }
+
+  return ret;
+}
+
+
+
+std::vector<void *>
+open_plugins(std::vector<fs::path> const & candidates, std::size_t workers /* = 0 */)
+{
+  std::vector<void *> handles(candidates.size(), nullptr);
+  parallel_for(candidates.size(), workers, [&](std::size_t i)
+      {
+        handles[i] = ::dlopen(candidates[i].c_str(), RTLD_LAZY);
+      });
+  return handles;
+}
+
+} // namespace linkmanager
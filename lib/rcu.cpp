@@ -0,0 +1,81 @@
+/*
+ *
+ */
+#include <linkmanager/rcu.h>
+
+#include <thread>
+
+namespace linkmanager {
+
+namespace {
+
+/**
+ * Threads are assigned stripes round-robin on first use.
+ */
+inline std::size_t
+thread_slot()
+{
+  static std::atomic<std::size_t> next = 0;
+  thread_local std::size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+  return slot;
+}
+
+} // anonymous namespace
+
+
+
+rcu_domain::stripe *
+rcu_domain::stripe_for_thread() const noexcept
+{
+  return &m_stripes[thread_slot() % STRIPES];
+}
+
+
+
+rcu_domain::token
+rcu_domain::enter() const noexcept
+{
+  auto s = stripe_for_thread();
+  auto phase = m_phase.load(std::memory_order_seq_cst) & 1;
+  s->count[phase].fetch_add(1, std::memory_order_seq_cst);
+  return token{s, phase};
+}
+
+
+
+void
+rcu_domain::leave(token const & tok) const noexcept
+{
+  auto s = static_cast<stripe *>(tok.stripe);
+  s->count[tok.phase].fetch_sub(1, std::memory_order_release);
+}
+
+
+
+void
+rcu_domain::synchronize()
+{
+  std::lock_guard<std::mutex> lock{m_sync_mutex};
+
+  // Flip the phase twice, waiting for readers of the old phase each time.
+  // A single flip is not enough: a reader may have sampled the phase before
+  // the previous grace period and only announce itself now.
+  for (int i = 0 ; i < 2 ; ++i) {
+    auto old = m_phase.fetch_add(1, std::memory_order_seq_cst) & 1;
+    wait_for_phase(old);
+  }
+}
+
+
+
+void
+rcu_domain::wait_for_phase(unsigned phase) const
+{
+  for (auto & s : m_stripes) {
+    while (s.count[phase].load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+} // namespace linkmanager
@@ -0,0 +1,482 @@
+/*
+ *
+ */
+#include <linkmanager/reactor.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <liberate/logging.h>
+
+namespace linkmanager {
+
+namespace {
+
+static constexpr int MAX_EVENTS = 64;
+
+inline timespec
+to_timespec(std::chrono::nanoseconds ns)
+{
+  auto secs = std::chrono::duration_cast<std::chrono::seconds>(ns);
+  timespec ts;
+  ts.tv_sec = static_cast<time_t>(secs.count());
+  ts.tv_nsec = static_cast<long>((ns - secs).count());
+  return ts;
+}
+
+
+inline std::uint32_t
+to_epoll_events(std::uint32_t events)
+{
+  std::uint32_t ret = 0;
+  if (events & api::event_loop::IO_READ) {
+    ret |= EPOLLIN;
+  }
+  if (events & api::event_loop::IO_WRITE) {
+    ret |= EPOLLOUT;
+  }
+  // EPOLLERR and EPOLLHUP are always reported.
+  return ret;
+}
+
+
+inline std::uint32_t
+from_epoll_events(std::uint32_t events)
+{
+  std::uint32_t ret = 0;
+  if (events & (EPOLLIN | EPOLLPRI)) {
+    ret |= api::event_loop::IO_READ;
+  }
+  if (events & EPOLLOUT) {
+    ret |= api::event_loop::IO_WRITE;
+  }
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    ret |= api::event_loop::IO_ERROR;
+  }
+  return ret;
+}
+
+} // anonymous namespace
+
+
+/**
+ * Registrations are shared between the registration map and a dispatch in
+ * progress, so that remove() from within a callback is safe. File descriptors
+ * the reactor created itself (timers, signals) are closed with the last
+ * reference.
+ */
+struct reactor::registration
+{
+  enum kind_t : std::uint8_t
+  {
+    KIND_IO,
+    KIND_TIMER,
+    KIND_SIGNAL,
+  };
+
+  kind_t                    kind;
+  int                       fd = -1;
+  bool                      owns_fd = false;
+  std::atomic<bool>         active = true;
+
+  io_callback               on_io = {};
+  timer_callback            on_timer = {};
+  signal_callback           on_signal = {};
+
+  std::chrono::nanoseconds  interval = {};
+  clock::time_point         expiry = {};
+
+  inline registration(kind_t _kind, int _fd, bool _owns_fd)
+    : kind{_kind}
+    , fd{_fd}
+    , owns_fd{_owns_fd}
+  {
+  }
+
+  inline ~registration()
+  {
+    if (owns_fd && fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+
+
+reactor::reactor()
+{
+  m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+  }
+
+  m_wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeup < 0) {
+    auto err = errno;
+    ::close(m_epoll);
+    throw std::system_error(err, std::generic_category(), "eventfd");
+  }
+
+  // The wakeup descriptor is the only one registered with a zero handle.
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = INVALID_HANDLE;
+  if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev) < 0) {
+    auto err = errno;
+    ::close(m_wakeup);
+    ::close(m_epoll);
+    throw std::system_error(err, std::generic_category(), "epoll_ctl");
+  }
+}
+
+
+
+reactor::~reactor()
+{
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (auto & [h, reg] : m_registrations) {
+      reg->active = false;
+    }
+    m_registrations.clear();
+  }
+  ::close(m_wakeup);
+  ::close(m_epoll);
+}
+
+
+
+reactor::handle
+reactor::add_registration(registration_ptr reg, std::uint32_t epoll_events)
+{
+  auto h = m_next_handle.fetch_add(1);
+
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_registrations[h] = reg;
+  }
+
+  epoll_event ev{};
+  ev.events = epoll_events;
+  ev.data.u64 = h;
+  if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, reg->fd, &ev) < 0) {
+    LIBLOG_ERROR("Cannot watch file descriptor " << reg->fd << ": "
+        << std::strerror(errno));
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_registrations.erase(h);
+    return INVALID_HANDLE;
+  }
+
+  return h;
+}
+
+
+
+reactor::handle
+reactor::add_fd(int fd, std::uint32_t events, io_callback callback)
+{
+  if (fd < 0 || !callback) {
+    return INVALID_HANDLE;
+  }
+
+  auto reg = std::make_shared<registration>(registration::KIND_IO, fd, false);
+  reg->on_io = std::move(callback);
+  return add_registration(reg, to_epoll_events(events));
+}
+
+
+
+reactor::handle
+reactor::add_timer(std::chrono::nanoseconds initial,
+    std::chrono::nanoseconds interval, timer_callback callback)
+{
+  if (!callback) {
+    return INVALID_HANDLE;
+  }
+
+  int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    LIBLOG_ERROR("Cannot create timer: " << std::strerror(errno));
+    return INVALID_HANDLE;
+  }
+
+  auto reg = std::make_shared<registration>(registration::KIND_TIMER, fd, true);
+  reg->on_timer = std::move(callback);
+  reg->interval = interval;
+
+  // A zero it_value disarms the timer, so the initial delay must be at
+  // least a nanosecond.
+  if (initial.count() <= 0) {
+    initial = std::chrono::nanoseconds{1};
+  }
+
+  itimerspec spec{};
+  spec.it_value = to_timespec(initial);
+  spec.it_interval = to_timespec(interval);
+  reg->expiry = clock::now() + initial;
+  if (::timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+    LIBLOG_ERROR("Cannot arm timer: " << std::strerror(errno));
+    return INVALID_HANDLE;
+  }
+
+  return add_registration(reg, EPOLLIN);
+}
+
+
+
+reactor::handle
+reactor::add_signals(std::initializer_list<int> signals, signal_callback callback)
+{
+  if (!callback) {
+    return INVALID_HANDLE;
+  }
+
+  sigset_t mask;
+  ::sigemptyset(&mask);
+  for (auto sig : signals) {
+    ::sigaddset(&mask, sig);
+  }
+
+  // Signals must be blocked for signalfd() to receive them.
+  auto err = ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+  if (err) {
+    LIBLOG_ERROR("Cannot block signals: " << std::strerror(err));
+    return INVALID_HANDLE;
+  }
+
+  int fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) {
+    LIBLOG_ERROR("Cannot create signalfd: " << std::strerror(errno));
+    return INVALID_HANDLE;
+  }
+
+  auto reg = std::make_shared<registration>(registration::KIND_SIGNAL, fd, true);
+  reg->on_signal = std::move(callback);
+  return add_registration(reg, EPOLLIN);
+}
+
+
+
+void
+reactor::remove(handle h)
+{
+  registration_ptr reg;
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto iter = m_registrations.find(h);
+    if (iter == m_registrations.end()) {
+      return;
+    }
+    reg = iter->second;
+    m_registrations.erase(iter);
+  }
+
+  reg->active = false;
+  ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, reg->fd, nullptr);
+}
+
+
+
+void
+reactor::post(task t)
+{
+  if (!t) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_tasks.push_back(std::move(t));
+  }
+  wake();
+}
+
+
+
+void
+reactor::wake()
+{
+  std::uint64_t one = 1;
+  auto ret [[maybe_unused]] = ::write(m_wakeup, &one, sizeof(one));
+}
+
+
+
+void
+reactor::stop()
+{
+  m_stop = true;
+  wake();
+}
+
+
+
+void
+reactor::run()
+{
+  while (!m_stop) {
+    run_once(std::chrono::milliseconds{-1});
+  }
+  m_stop = false;
+}
+
+
+
+std::size_t
+reactor::run_once(std::chrono::milliseconds timeout)
+{
+  epoll_event events[MAX_EVENTS];
+  int num = ::epoll_wait(m_epoll, events, MAX_EVENTS,
+      static_cast<int>(timeout.count()));
+  if (num < 0) {
+    if (errno != EINTR) {
+      LIBLOG_ERROR("epoll_wait failed: " << std::strerror(errno));
+    }
+    return 0;
+  }
+
+  auto woken = clock::now();
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    ++m_stats.wakeups;
+  }
+
+  std::size_t dispatched = 0;
+  for (int i = 0 ; i < num ; ++i) {
+    auto h = events[i].data.u64;
+    if (h == INVALID_HANDLE) {
+      std::uint64_t val;
+      auto ret [[maybe_unused]] = ::read(m_wakeup, &val, sizeof(val));
+      run_tasks();
+      continue;
+    }
+
+    registration_ptr reg;
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      auto iter = m_registrations.find(h);
+      if (iter == m_registrations.end()) {
+        // Removed by an earlier handler in this batch.
+        continue;
+      }
+      reg = iter->second;
+    }
+
+    dispatch(reg, events[i].events, woken);
+    ++dispatched;
+
+    if (reg->kind == registration::KIND_TIMER && reg->interval.count() <= 0) {
+      remove(h);
+    }
+  }
+
+  return dispatched;
+}
+
+
+
+void
+reactor::dispatch(registration_ptr const & reg, std::uint32_t events,
+    clock::time_point woken)
+{
+  if (!reg->active) {
+    return;
+  }
+
+  // Drain the kernel object first; spurious wakeups are not dispatched.
+  std::uint64_t expirations = 0;
+  signalfd_siginfo info{};
+  switch (reg->kind) {
+    case registration::KIND_TIMER:
+      if (::read(reg->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+      }
+      break;
+
+    case registration::KIND_SIGNAL:
+      if (::read(reg->fd, &info, sizeof(info)) != sizeof(info)) {
+        return;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  auto now = clock::now();
+  auto since = (reg->kind == registration::KIND_TIMER) ? reg->expiry : woken;
+  auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - since);
+  if (latency.count() < 0) {
+    latency = {};
+  }
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    ++m_stats.dispatched;
+    m_stats.total_latency += latency;
+    if (latency > m_stats.max_latency) {
+      m_stats.max_latency = latency;
+    }
+  }
+
+  switch (reg->kind) {
+    case registration::KIND_IO:
+      reg->on_io(reg->fd, from_epoll_events(events));
+      break;
+
+    case registration::KIND_TIMER:
+      reg->expiry += reg->interval * expirations;
+      reg->on_timer();
+      break;
+
+    case registration::KIND_SIGNAL:
+      do {
+        reg->on_signal(static_cast<int>(info.ssi_signo));
+      } while (reg->active
+          && ::read(reg->fd, &info, sizeof(info)) == sizeof(info));
+      break;
+  }
+}
+
+
+
+void
+reactor::run_tasks()
+{
+  std::vector<task> tasks;
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    tasks.swap(m_tasks);
+  }
+
+  for (auto & t : tasks) {
+    t();
+  }
+}
+
+
+
+std::size_t
+reactor::size() const
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_registrations.size();
+}
+
+
+
+reactor::statistics
+reactor::stats() const
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_stats;
+}
+
+} // namespace linkmanager
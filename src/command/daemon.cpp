@@ -1,36 +1,392 @@
 /*
- * 
+ *
  */
 #include "../build-config.h"
 
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
 
 #include <linkmanager/module_registry.h>
+#include <linkmanager/reactor.h>
+#include <linkmanager/activation_scheduler.h>
 
 #include "daemon.h"
+#include "../config/session_reloader.h"
+#include "../net/link_monitor.h"
+#include "../net/egress_scheduler.h"
 
 #include <liberate/logging.h>
 
 namespace linkmanager::command {
 namespace {
 
-static volatile bool keep_running = true;
+static constexpr auto STATS_INTERVAL = std::chrono::seconds{60};
+static constexpr std::size_t MAX_CONTROL_MESSAGE = 256;
 
-void signal_handler(int sig)
+// Each concurrent activation takes a worker thread.
+static constexpr std::int64_t MAX_CONCURRENT_ACTIVATIONS = 64;
+// A day, in milliseconds.
+static constexpr std::int64_t MAX_ACTIVATION_DELAY_MS = 86'400'000;
+
+
+/**
+ * A number from the section, or the fallback if it is not given. Raises
+ * std::invalid_argument if it is outside of [min, max].
+ */
+std::int64_t
+bounded_value(nlohmann::json const & section, char const * key, std::int64_t fallback,
+    std::int64_t min, std::int64_t max)
 {
-  if (sig == SIGINT) {
-    keep_running = false;
+  auto ret = section.value(key, fallback);
+  if (ret < min || ret > max) {
+    throw std::invalid_argument(std::string{key} + " must be between "
+        + std::to_string(min) + " and " + std::to_string(max) + ", not "
+        + std::to_string(ret) + ".");
   }
+  return ret;
 }
 
 
-inline void install_sigint_handler()
+/**
+ * Activation scheduler options from the optional "activation" section of the
+ * configuration file. Raises std::invalid_argument for values out of range.
+ */
+activation_scheduler::options
+activation_options(nlohmann::json const & config)
 {
-  auto res = ::signal(SIGINT, signal_handler);
-  if (res == SIG_ERR) {
-    LIBLOG_ERROR("Could not install signal handler; this will lead to unclean shutdowns.");
+  activation_scheduler::options ret;
+  if (!config.contains("activation")) {
+    return ret;
+  }
+
+  auto const & section = config["activation"];
+  if (!section.is_object()) {
+    throw std::invalid_argument("The activation section must be an object.");
+  }
+
+  ret.max_concurrent = static_cast<std::size_t>(bounded_value(section, "maxConcurrent",
+        static_cast<std::int64_t>(ret.max_concurrent), 1, MAX_CONCURRENT_ACTIVATIONS));
+  ret.max_attempts = static_cast<unsigned>(bounded_value(section, "maxAttempts",
+        ret.max_attempts, 1, 1000));
+  ret.deadline = std::chrono::milliseconds{bounded_value(section, "deadlineMs",
+      ret.deadline.count(), 1, MAX_ACTIVATION_DELAY_MS)};
+  ret.initial_backoff = std::chrono::milliseconds{bounded_value(section, "backoffMs",
+      ret.initial_backoff.count(), 0, MAX_ACTIVATION_DELAY_MS)};
+  ret.max_backoff = std::chrono::milliseconds{bounded_value(section, "maxBackoffMs",
+      ret.max_backoff.count(), ret.initial_backoff.count(), MAX_ACTIVATION_DELAY_MS)};
+  return ret;
+}
+
+
+/**
+ * Egress scheduler options from the "multipath" section of the
+ * configuration file.
+ */
+net::egress_scheduler::options
+multipath_options(nlohmann::json const & section)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  net::egress_scheduler::options ret;
+  if (section.value("family", std::string{"ipv4"}) == "ipv6") {
+    ret.family = AF_INET6;
+  }
+  ret.table = section.value("table", ret.table);
+  ret.metric = section.value("metric", ret.metric);
+  ret.group_id = section.value("nexthopId", ret.group_id);
+  ret.interval = milliseconds{section.value("intervalMs", ret.interval.count())};
+  ret.settle = milliseconds{section.value("settleMs", ret.settle.count())};
+  ret.min_weight_change = section.value("minWeightChange", ret.min_weight_change);
+  ret.reference_rtt = milliseconds{section.value("referenceRttMs",
+      duration_cast<milliseconds>(ret.reference_rtt).count())};
+  return ret;
+}
+
+
+void
+log_activation_report(activation_scheduler::report const & report)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  for (auto const & l : report.links) {
+    LIBLOG_INFO("Link " << l.module << "/" << l.link << " is "
+        << (l.active ? "active" : "inactive") << " after "
+        << l.attempts << " attempt(s): queued "
+        << duration_cast<milliseconds>(l.queued).count() << "ms, activating "
+        << duration_cast<milliseconds>(l.activating).count() << "ms, backoff "
+        << duration_cast<milliseconds>(l.backoff).count() << "ms, total "
+        << duration_cast<milliseconds>(l.total).count() << "ms.");
+  }
+  LIBLOG_INFO(report.succeeded() << "/" << report.links.size()
+      << " link(s) activated in "
+      << duration_cast<milliseconds>(report.elapsed).count() << "ms.");
+}
+
+
+
+/**
+ * Hands links to the activation scheduler, which takes one run at a time;
+ * links asked for during a run are activated in the next. Used on the loop
+ * thread only.
+ */
+class activation_queue
+{
+public:
+  explicit activation_queue(activation_scheduler & scheduler)
+    : m_scheduler{scheduler}
+  {
+  }
+
+  void activate_all(module_registry const & registry)
+  {
+    m_scheduler.activate_all(registry, [this](activation_scheduler::report const & report)
+        {
+          log_activation_report(report);
+          next();
+        });
+  }
+
+  void activate(activation_scheduler::link_list links)
+  {
+    m_waiting.insert(m_waiting.end(), links.begin(), links.end());
+    if (!m_scheduler.busy()) {
+      next();
+    }
+  }
+
+private:
+  void next()
+  {
+    if (m_waiting.empty()) {
+      return;
+    }
+    auto links = std::move(m_waiting);
+    m_waiting.clear();
+    m_scheduler.activate(std::move(links), [this](activation_scheduler::report const & report)
+        {
+          log_activation_report(report);
+          next();
+        });
+  }
+
+  activation_scheduler &          m_scheduler;
+  activation_scheduler::link_list m_waiting;
+};
+
+
+
+/**
+ * Open the control socket, a Unix seqpacket socket. A client sends a
+ * command as a single message, and receives a single message in reply.
+ * Only the daemon's user may connect.
+ */
+int open_control_socket(std::string const & path)
+{
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LIBLOG_ERROR("Control socket path is too long: " << path);
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  ::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    LIBLOG_ERROR("Could not create control socket: " << ::strerror(errno));
+    return -1;
+  }
+
+  // A socket left behind by a previous run would fail the bind; anything
+  // else at the path is not ours to remove.
+  struct stat st;
+  if (::lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      LIBLOG_ERROR("Control socket path exists, and is not a socket: " << path);
+      ::close(fd);
+      return -1;
+    }
+    ::unlink(path.c_str());
+  }
+
+  // The socket is created with permissions 0600.
+  auto mask = ::umask(0177);
+  int ret = ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  ::umask(mask);
+  if (ret < 0 || ::listen(fd, 4) < 0) {
+    LIBLOG_ERROR("Could not listen on control socket " << path << ": "
+        << ::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+/**
+ * Pass configuration changes on to the links carrying the sessions; links
+ * are named after their session, and are handed its settings from the new
+ * table. Links of added sessions are activated, if not active already. Links
+ * whose session did not change are not touched.
+ */
+void
+apply_session_changes(module_registry const & registry, activation_queue * activations,
+    config::session_table const & sessions, config::session_diff const & diff)
+{
+  if (diff.device_changed) {
+    LIBLOG_WARN("The module path or interface name changed; this takes a restart.");
+  }
+
+  // Copy the modules out, so as not to hold up registration while querying
+  // links.
+  std::vector<module_registry::module_snapshot::entry> modules;
+  {
+    auto snap = registry.snapshot();
+    modules = snap->entries;
+  }
+
+  // (module name, link) by link name
+  std::map<std::string, activation_scheduler::link_list::value_type> links;
+  for (auto const & [name, mod] : modules) {
+    for (auto const & l : mod->links()) {
+      if (l) {
+        links[l->name()] = {name, l};
+      }
+    }
+  }
+
+  for (auto const & change : diff.removed) {
+    LIBLOG_INFO("Session " << change.name << " (ID " << change.session_id << ") removed.");
+    auto iter = links.find(change.name);
+    if (iter != links.end() && iter->second.second->is_active()) {
+      iter->second.second->set_active(false, [](api::modules::link & l, bool)
+          {
+            LIBLOG_INFO("Link " << l.name() << " deactivated.");
+          });
+    }
+  }
+
+  // Returns the link if it took its new configuration.
+  auto reconfigure = [&](config::session_change const & change)
+    -> activation_scheduler::link_list::value_type const *
+  {
+    auto iter = links.find(change.name);
+    if (iter == links.end()) {
+      LIBLOG_DEBUG("No link for session " << change.name << "; nothing to reconfigure.");
+      return nullptr;
+    }
+    auto row = sessions.find(change.session_id);
+    if (!row) {
+      return nullptr;
+    }
+    if (!iter->second.second->configure(sessions.settings(*row))) {
+      LIBLOG_ERROR("Link " << change.name << " rejected its new configuration.");
+      return nullptr;
+    }
+    return &iter->second;
+  };
+
+  activation_scheduler::link_list added;
+  for (auto const & change : diff.added) {
+    LIBLOG_INFO("Session " << change.name << " (ID " << change.session_id << ") added.");
+    auto link = reconfigure(change);
+    if (link && !link->second->is_active()) {
+      added.push_back(*link);
+    }
+  }
+  if (!added.empty() && activations) {
+    activations->activate(std::move(added));
+  }
+
+  for (auto const & change : diff.changed) {
+    LIBLOG_INFO("Session " << change.name << " (ID " << change.session_id << ") changed:"
+        << ((change.changes & config::CHANGE_APN) ? " APN" : "")
+        << ((change.changes & config::CHANGE_AUTH) ? " auth" : "")
+        << ((change.changes & config::CHANGE_VLAN) ? " VLAN" : "")
+        << ((change.changes & config::CHANGE_ROUTE) ? " route" : "")
+        << ((change.changes & config::CHANGE_PIN) ? " PIN" : "")
+        << ((change.changes & config::CHANGE_NAME) ? " name" : ""));
+    reconfigure(change);
+  }
+}
+
+
+/**
+ * Reload the configuration file, and return a reply for the control
+ * socket. On failure, the running configuration is kept.
+ */
+std::string
+reload_sessions(config::session_reloader & reloader)
+{
+  if (reloader.filename().empty()) {
+    LIBLOG_WARN("Started without a configuration file; nothing to reload.");
+    return "error no configuration file";
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  try {
+    auto changes = reloader.reload();
+    auto elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    LIBLOG_INFO("Reloaded " << reloader.filename() << " in " << elapsed << "ms: "
+        << config::to_string(changes) << ".");
+    return "ok " + config::to_string(changes);
+  } catch (std::exception const & err) {
+    LIBLOG_ERROR("Reload failed; keeping the running configuration: " << err.what());
+    return std::string{"error "} + err.what();
+  }
+}
+
+
+/**
+ * Serve a control socket client: read its command, reply, and hang up.
+ */
+void
+serve_control_client(api::event_loop & loop, int client,
+    config::session_reloader & reloader)
+{
+  auto handle = std::make_shared<api::event_loop::handle>();
+  *handle = loop.add_fd(client, reactor::IO_READ,
+      [&loop, &reloader, handle](int fd, std::uint32_t)
+      {
+        char buf[MAX_CONTROL_MESSAGE];
+        auto len = ::recv(fd, buf, sizeof(buf), 0);
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          return;
+        }
+
+        if (len > 0) {
+          std::string command{buf, static_cast<std::size_t>(len)};
+          while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) {
+            command.pop_back();
+          }
+
+          std::string reply;
+          if (command == "reload") {
+            reply = reload_sessions(reloader);
+          }
+          else {
+            reply = "error unknown command: " + command;
+          }
+          ::send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+        }
+
+        loop.remove(*handle);
+        ::close(fd);
+      });
+  if (*handle == api::event_loop::INVALID_HANDLE) {
+    ::close(client);
   }
 }
 
@@ -47,17 +403,119 @@ daemon::run(options const & opts, module_registry & registry)
   // Log version informationd and status line
   LIBLOG_INFO("This is " LINKMANAGER_PACKAGE_NAME " version " LINKMANAGER_PACKAGE_VERSION);
 
-  // TODO
+  reactor loop;
+
+  // Set up once the scheduler is.
+  std::optional<activation_queue> activations;
+
+  // Sessions are reloaded from the configuration file on SIGHUP, or when
+  // asked via the control socket.
+  config::session_reloader sessions{opts.config_file, *opts.sessions,
+      [&registry, &activations](nlohmann::json const &, config::session_table const & table,
+          config::session_diff const & diff)
+      {
+        apply_session_changes(registry, activations ? &*activations : nullptr, table, diff);
+      }};
+
+  // Signals are delivered through the loop; this must happen before modules
+  // get a chance to start threads.
+  auto sig = loop.add_signals({SIGINT, SIGTERM, SIGHUP}, [&loop, &sessions](int signo)
+      {
+        if (signo == SIGHUP) {
+          LIBLOG_INFO("Received SIGHUP; reloading configuration.");
+          reload_sessions(sessions);
+          return;
+        }
+        LIBLOG_INFO("Received " << ::strsignal(signo) << ", shutting down.");
+        loop.stop();
+      });
+  if (sig == reactor::INVALID_HANDLE) {
+    LIBLOG_ERROR("Could not install signal handler; this will lead to unclean shutdowns.");
+  }
+
+  // Links are brought up concurrently, by worker threads that must not
+  // receive the signals.
+  std::optional<activation_scheduler> scheduler;
+  try {
+    scheduler.emplace(loop, activation_options(opts.config));
+  } catch (std::exception const & err) {
+    LIBLOG_ERROR("Invalid activation configuration: " << err.what());
+    return 2;
+  }
+
+  // Interfaces, their addresses and routes; link status checks and interface
+  // lookups are answered from here rather than with a system call each.
+  net::link_monitor links{loop};
+  if (links.start()) {
+    links.provide_interface_state();
+    links.subscribe({}, [](net::link_event const & ev)
+        {
+          LIBLOG_DEBUG("Link " << ev.name << " (" << ev.index << "): "
+              << net::to_string(ev.type));
+        });
+  }
+
+  // Control socket
+  int control_fd = -1;
+  std::string control_path = opts.config.value("controlSocket", std::string{});
+  if (!control_path.empty()) {
+    control_fd = open_control_socket(control_path);
+  }
+  if (control_fd >= 0) {
+    loop.add_fd(control_fd, reactor::IO_READ, [&loop, &sessions](int fd, std::uint32_t)
+        {
+          int client;
+          while ((client = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            serve_control_client(loop, client, sessions);
+          }
+        });
+  }
+
+  // Modules register their own device descriptors and timers.
+  for (auto & [name, mod] : registry.modules()) {
+    LIBLOG_DEBUG("Attaching module " << name << " to run loop.");
+    mod->attach_event_loop(loop);
+  }
+
+  // Bring up all links concurrently.
+  activations.emplace(*scheduler);
+  activations->activate_all(registry);
+
+  // Spread egress traffic across the devices of active links, if asked to.
+  net::netlink_nexthop_table nexthops;
+  std::optional<net::egress_scheduler> egress;
+  if (opts.config.contains("multipath")) {
+    try {
+      egress.emplace(loop, registry, links, nexthops, multipath_options(opts.config["multipath"]));
+      egress->start();
+    } catch (std::exception const & err) {
+      LIBLOG_ERROR("Invalid multipath configuration; running without: " << err.what());
+      egress.reset();
+    }
+  }
+
+  loop.add_timer(STATS_INTERVAL, STATS_INTERVAL, [&loop]()
+      {
+        auto stats = loop.stats();
+        LIBLOG_DEBUG("Run loop: " << stats.wakeups << " wakeups, "
+            << stats.dispatched << " events dispatched, latency mean "
+            << std::chrono::duration_cast<std::chrono::microseconds>(stats.mean_latency()).count()
+            << "us / max "
+            << std::chrono::duration_cast<std::chrono::microseconds>(stats.max_latency).count()
+            << "us");
+      });
 
   LIBLOG_INFO("Initialized, entering run loop.");
 
   // Run loop
-  install_sigint_handler();
-  while (keep_running) {
-    // TODO
-  }
+  loop.run();
   LIBLOG_INFO("Run loop ended.");
 
+  if (control_fd >= 0) {
+    ::close(control_fd);
+    ::unlink(control_path.c_str());
+  }
+
   return 0;
 }
 
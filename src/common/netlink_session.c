@@ -0,0 +1,545 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <linux/netlink.h>
+
+#include "netlink_session.h"
+#include "proc_util.h"
+
+#define NL_SESSION_RECV_BUF_SIZE	32768
+#define NL_SESSION_SOCK_BUF_SIZE	(256 * 1024)
+
+struct nlpending
+{
+	uint32_t nSeq;
+	FNNLCOMPLETION pfnComplete;
+	void* pContext;
+
+	// Reply data accumulated until the final ACK or NLMSG_DONE
+	char* pData;
+	size_t nLen;
+	size_t nCap;
+
+	struct nlpending* pNext;
+};
+
+struct nlsession
+{
+	int fd;
+	int wakefd;
+	uint32_t nPortId;
+	uint32_t nPeerId;
+	uint32_t nNextSeq;
+
+	FNNLCOMPLETION pfnNotify;
+	void* pNotifyContext;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	struct nlpending* pPending;
+};
+
+// Caller must hold the session mutex
+static struct nlpending* FindPending(struct nlsession* pSession, uint32_t nSeq, bool bRemove)
+{
+	struct nlpending** pp = &pSession->pPending;
+	while (*pp && (*pp)->nSeq != nSeq)
+		pp = &(*pp)->pNext;
+
+	struct nlpending* p = *pp;
+	if (p && bRemove)
+		*pp = p->pNext;
+
+	return p;
+}
+
+static void FreePending(struct nlpending* p)
+{
+	free(p->pData);
+	free(p);
+}
+
+static bool AppendReply(struct nlpending* p, const struct nlmsghdr* pnh)
+{
+	size_t len = NLMSG_ALIGN(pnh->nlmsg_len);
+	if (p->nLen + len > p->nCap)
+	{
+		size_t cap = p->nCap ? p->nCap * 2 : 4096;
+		while (cap < p->nLen + len)
+			cap *= 2;
+
+		char* pData = realloc(p->pData, cap);
+		if (pData == NULL)
+			return false;
+
+		p->pData = pData;
+		p->nCap = cap;
+	}
+
+	memcpy(p->pData + p->nLen, pnh, len);
+	p->nLen += len;
+	return true;
+}
+
+static void Complete(struct nlpending* p, int nError)
+{
+	if (p->pfnComplete)
+		p->pfnComplete(nError, p->pData, p->nLen, p->pContext);
+	FreePending(p);
+}
+
+static void HandleMessages(struct nlsession* pSession, char* pBuf, int nLen, bool bMulticast)
+{
+	struct nlmsghdr* pnh = (struct nlmsghdr*)pBuf;
+	for (; NLMSG_OK(pnh, (uint32_t)nLen); pnh = NLMSG_NEXT(pnh, nLen))
+	{
+		// Notifications may carry the port ID and sequence number of the
+		// request that caused them, so they are told apart by destination.
+		if (bMulticast || pnh->nlmsg_pid != pSession->nPortId || pnh->nlmsg_seq == 0)
+		{
+			if (pSession->pfnNotify)
+				pSession->pfnNotify(0, (const char*)pnh, pnh->nlmsg_len, pSession->pNotifyContext);
+			continue;
+		}
+
+		bool bFinal = pnh->nlmsg_type == NLMSG_ERROR || pnh->nlmsg_type == NLMSG_DONE;
+		int nError = 0;
+		if (pnh->nlmsg_type == NLMSG_ERROR)
+			nError = ((struct nlmsgerr*)NLMSG_DATA(pnh))->error;
+
+		pthread_mutex_lock(&pSession->mutex);
+		struct nlpending* p = FindPending(pSession, pnh->nlmsg_seq, bFinal);
+		if (p && !bFinal && !AppendReply(p, pnh))
+		{
+			dlog(eLOG_ERROR, "%s - out of memory for reply to seq %u\n", __FUNCTION__, pnh->nlmsg_seq);
+			FindPending(pSession, pnh->nlmsg_seq, true);
+			bFinal = true;
+			nError = -ENOMEM;
+		}
+		pthread_mutex_unlock(&pSession->mutex);
+
+		// Late replies to cancelled requests are dropped.
+		if (p && bFinal)
+			Complete(p, nError);
+	}
+}
+
+// The rest of a truncated reply is lost; rather than leave its request to
+// time out, complete it at once.
+static void HandleTruncated(struct nlsession* pSession, char* pBuf, size_t nLen, bool bMulticast)
+{
+	const struct nlmsghdr* pnh = (const struct nlmsghdr*)pBuf;
+	if (bMulticast || nLen < sizeof(struct nlmsghdr) ||
+		pnh->nlmsg_pid != pSession->nPortId || pnh->nlmsg_seq == 0)
+		return;
+
+	pthread_mutex_lock(&pSession->mutex);
+	struct nlpending* p = FindPending(pSession, pnh->nlmsg_seq, true);
+	pthread_mutex_unlock(&pSession->mutex);
+
+	if (p)
+		Complete(p, -EMSGSIZE);
+}
+
+static void* ReceiveThread(void* pArg)
+{
+	struct nlsession* pSession = (struct nlsession*)pArg;
+
+	char* pBuf = malloc(NL_SESSION_RECV_BUF_SIZE);
+	if (pBuf == NULL)
+	{
+		dlog(eLOG_ERROR, "%s - out of memory\n", __FUNCTION__);
+		return NULL;
+	}
+
+	struct pollfd fds[2] =
+	{
+		{ pSession->fd, POLLIN, 0 },
+		{ pSession->wakefd, POLLIN, 0 },
+	};
+
+	for (;;)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			dlog(eLOG_ERROR, "%s - poll error %d: %s\n", __FUNCTION__, errno, strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		struct sockaddr_nl addr;
+		struct iovec iov = { pBuf, NL_SESSION_RECV_BUF_SIZE };
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		ssize_t n = recvmsg(pSession->fd, &msg, MSG_DONTWAIT);
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+
+			// The socket buffer overflowed; notifications were lost, but the
+			// session remains usable.
+			if (errno == ENOBUFS)
+			{
+				dlog(eLOG_WARN, "%s - receive buffer overrun, messages lost\n", __FUNCTION__);
+				continue;
+			}
+
+			dlog(eLOG_ERROR, "%s - receive error %d: %s\n", __FUNCTION__, errno, strerror(errno));
+			break;
+		}
+
+		if (msg.msg_flags & MSG_TRUNC)
+		{
+			dlog(eLOG_WARN, "%s - truncated message dropped\n", __FUNCTION__);
+			HandleTruncated(pSession, pBuf, (size_t)n, addr.nl_groups != 0);
+			continue;
+		}
+
+		HandleMessages(pSession, pBuf, (int)n, addr.nl_groups != 0);
+	}
+
+	free(pBuf);
+	return NULL;
+}
+
+struct nlsession* NlSessionCreate(uint32_t nGroups, FNNLCOMPLETION pfnNotify, void* pNotifyContext)
+{
+	struct nlsession* pSession = calloc(1, sizeof(struct nlsession));
+	if (pSession == NULL)
+		return NULL;
+
+	pSession->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (pSession->fd < 0)
+	{
+		dlog(eLOG_ERROR, "%s - Create socket error %d: %s\n", __FUNCTION__, errno, strerror(errno));
+		free(pSession);
+		return NULL;
+	}
+
+	int nBufSize = NL_SESSION_SOCK_BUF_SIZE;
+	setsockopt(pSession->fd, SOL_SOCKET, SO_RCVBUF, &nBufSize, sizeof(nBufSize));
+
+	// A zero port ID lets the kernel pick a unique one.
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = nGroups;
+
+	socklen_t addrlen = sizeof(addr);
+	if (bind(pSession->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+		getsockname(pSession->fd, (struct sockaddr*)&addr, &addrlen) < 0)
+	{
+		dlog(eLOG_ERROR, "%s - Bind socket error %d: %s\n", __FUNCTION__, errno, strerror(errno));
+		close(pSession->fd);
+		free(pSession);
+		return NULL;
+	}
+
+	pSession->nPortId = addr.nl_pid;
+	pSession->nNextSeq = (uint32_t)time(NULL);
+	pSession->pfnNotify = pfnNotify;
+	pSession->pNotifyContext = pNotifyContext;
+
+	pSession->wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pSession->wakefd < 0)
+	{
+		dlog(eLOG_ERROR, "%s - eventfd error %d: %s\n", __FUNCTION__, errno, strerror(errno));
+		close(pSession->fd);
+		free(pSession);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pSession->mutex, NULL);
+
+	if (pthread_create(&pSession->thread, NULL, ReceiveThread, pSession) != 0)
+	{
+		dlog(eLOG_ERROR, "%s - Could not start receive thread\n", __FUNCTION__);
+		pthread_mutex_destroy(&pSession->mutex);
+		close(pSession->wakefd);
+		close(pSession->fd);
+		free(pSession);
+		return NULL;
+	}
+
+	return pSession;
+}
+
+void NlSessionDestroy(struct nlsession* pSession)
+{
+	if (pSession == NULL)
+		return;
+
+	uint64_t one = 1;
+	if (write(pSession->wakefd, &one, sizeof(one)) != sizeof(one))
+		dlog(eLOG_WARN, "%s - could not wake receive thread\n", __FUNCTION__);
+	pthread_join(pSession->thread, NULL);
+
+	pthread_mutex_lock(&pSession->mutex);
+	struct nlpending* p = pSession->pPending;
+	pSession->pPending = NULL;
+	pthread_mutex_unlock(&pSession->mutex);
+
+	while (p)
+	{
+		struct nlpending* pNext = p->pNext;
+		Complete(p, -ECANCELED);
+		p = pNext;
+	}
+
+	pthread_mutex_destroy(&pSession->mutex);
+	close(pSession->wakefd);
+	close(pSession->fd);
+	free(pSession);
+}
+
+static pthread_once_t gDefaultSessionOnce = PTHREAD_ONCE_INIT;
+static struct nlsession* gpDefaultSession = NULL;
+
+static void CreateDefaultSession(void)
+{
+	gpDefaultSession = NlSessionCreate(0, NULL, NULL);
+}
+
+struct nlsession* NlDefaultSession(void)
+{
+	pthread_once(&gDefaultSessionOnce, CreateDefaultSession);
+	return gpDefaultSession;
+}
+
+uint32_t NlSessionPortId(const struct nlsession* pSession)
+{
+	return pSession->nPortId;
+}
+
+void NlSessionSetPeer(struct nlsession* pSession, uint32_t nPortId)
+{
+	__atomic_store_n(&pSession->nPeerId, nPortId, __ATOMIC_RELEASE);
+}
+
+static uint32_t NextSeq(struct nlsession* pSession)
+{
+	uint32_t nSeq;
+	do
+		nSeq = __atomic_add_fetch(&pSession->nNextSeq, 1, __ATOMIC_RELAXED);
+	while (nSeq == 0);
+	return nSeq;
+}
+
+static int SendToKernel(struct nlsession* pSession, const void* pBuf, size_t nLen)
+{
+	struct sockaddr_nl kernel;
+	memset(&kernel, 0, sizeof(kernel));
+	kernel.nl_family = AF_NETLINK;
+	kernel.nl_pid = __atomic_load_n(&pSession->nPeerId, __ATOMIC_ACQUIRE);
+
+	if (sendto(pSession->fd, pBuf, nLen, 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0)
+	{
+		dlog(eLOG_ERROR, "NlSession - send error %d: %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+uint32_t NlSessionSubmit(struct nlsession* pSession, struct nlmsghdr* pReq,
+	FNNLCOMPLETION pfnComplete, void* pContext)
+{
+	void* ppContexts[1] = { pContext };
+	if (NlSessionSubmitBatch(pSession, (char*)pReq, pReq->nlmsg_len, pfnComplete, ppContexts, 1) != 1)
+		return 0;
+
+	return pReq->nlmsg_seq;
+}
+
+int NlSessionSubmitBatch(struct nlsession* pSession, char* pBuf, size_t nLen,
+	FNNLCOMPLETION pfnComplete, void* const* ppContexts, size_t nContexts)
+{
+	// Prepare all entries before registering any of them.
+	struct nlpending* pFirst = NULL;
+	struct nlpending* pLast = NULL;
+	size_t nCount = 0;
+
+	int nRemain = (int)nLen;
+	struct nlmsghdr* pnh = (struct nlmsghdr*)pBuf;
+	for (; NLMSG_OK(pnh, (uint32_t)nRemain); pnh = NLMSG_NEXT(pnh, nRemain))
+	{
+		struct nlpending* p = nCount < nContexts ? calloc(1, sizeof(struct nlpending)) : NULL;
+		if (p == NULL)
+		{
+			while (pFirst)
+			{
+				p = pFirst->pNext;
+				FreePending(pFirst);
+				pFirst = p;
+			}
+			errno = nCount < nContexts ? ENOMEM : EINVAL;
+			return -1;
+		}
+
+		pnh->nlmsg_flags |= (NLM_F_REQUEST | NLM_F_ACK);
+		pnh->nlmsg_seq = NextSeq(pSession);
+		pnh->nlmsg_pid = pSession->nPortId;
+
+		p->nSeq = pnh->nlmsg_seq;
+		p->pfnComplete = pfnComplete;
+		p->pContext = ppContexts[nCount];
+
+		if (pLast)
+			pLast->pNext = p;
+		else
+			pFirst = p;
+		pLast = p;
+		++nCount;
+	}
+
+	if (nCount == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Register before sending; replies may arrive before send() returns.
+	pthread_mutex_lock(&pSession->mutex);
+	pLast->pNext = pSession->pPending;
+	pSession->pPending = pFirst;
+	pthread_mutex_unlock(&pSession->mutex);
+
+	if (SendToKernel(pSession, pBuf, nLen) < 0)
+	{
+		int nErr = errno;
+		nRemain = (int)nLen;
+		pnh = (struct nlmsghdr*)pBuf;
+		for (; NLMSG_OK(pnh, (uint32_t)nRemain); pnh = NLMSG_NEXT(pnh, nRemain))
+			NlSessionCancel(pSession, pnh->nlmsg_seq);
+		errno = nErr;
+		return -1;
+	}
+
+	return (int)nCount;
+}
+
+bool NlSessionCancel(struct nlsession* pSession, uint32_t nSeq)
+{
+	pthread_mutex_lock(&pSession->mutex);
+	struct nlpending* p = FindPending(pSession, nSeq, true);
+	pthread_mutex_unlock(&pSession->mutex);
+
+	if (p == NULL)
+		return false;
+
+	FreePending(p);
+	return true;
+}
+
+struct nlwait
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool bDone;
+	int nError;
+	char* pBuf;
+	size_t sizeBuf;
+	size_t nRecv;
+};
+
+static void WaitCompletion(int nError, const char* pData, size_t nLen, void* pContext)
+{
+	struct nlwait* w = (struct nlwait*)pContext;
+
+	pthread_mutex_lock(&w->mutex);
+	w->nError = nError;
+	if (w->pBuf && pData)
+	{
+		w->nRecv = nLen < w->sizeBuf ? nLen : w->sizeBuf;
+		memcpy(w->pBuf, pData, w->nRecv);
+	}
+	w->bDone = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+int NlSessionTransact(struct nlsession* pSession, struct nlmsghdr* pReq, char* pBuf, size_t sizeBuf)
+{
+	if (pSession == NULL)
+	{
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	struct nlwait w;
+	memset(&w, 0, sizeof(w));
+	pthread_mutex_init(&w.mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&w.cond, &attr);
+	pthread_condattr_destroy(&attr);
+	w.pBuf = pBuf;
+	w.sizeBuf = sizeBuf;
+
+	uint32_t nSeq = NlSessionSubmit(pSession, pReq, WaitCompletion, &w);
+	if (nSeq == 0)
+	{
+		pthread_cond_destroy(&w.cond);
+		pthread_mutex_destroy(&w.mutex);
+		return -1;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += NL_SESSION_TIMEOUT_MS / 1000;
+	deadline.tv_nsec += (NL_SESSION_TIMEOUT_MS % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&w.mutex);
+	while (!w.bDone)
+	{
+		if (pthread_cond_timedwait(&w.cond, &w.mutex, &deadline) == ETIMEDOUT && !w.bDone)
+		{
+			// If cancelling fails, the completion is already running; it
+			// touches our stack, so wait for it regardless.
+			pthread_mutex_unlock(&w.mutex);
+			bool bCancelled = NlSessionCancel(pSession, nSeq);
+			pthread_mutex_lock(&w.mutex);
+			if (bCancelled)
+			{
+				w.nError = -ETIMEDOUT;
+				break;
+			}
+			while (!w.bDone)
+				pthread_cond_wait(&w.cond, &w.mutex);
+		}
+	}
+	pthread_mutex_unlock(&w.mutex);
+
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.mutex);
+
+	if (w.nError != 0)
+	{
+		errno = -w.nError;
+		return -1;
+	}
+
+	return (int)w.nRecv;
+}
@@ -6,7 +6,9 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include "netlink_session.h"
 
 #define VLAN_0_NAME "vlan.0"
 #define VLAN_1_NAME "vlan.1"
@@ -26,8 +28,76 @@ void SetRoute(int domain, const char *szInterface, bool bAdd, const char* dst, i
 void SetAdaptorAddress(int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen);
 int IsAdaptorUp(const char *szInterface);
 void SetAdaptorMtu(const char *szInterface, int mtu);
+
+// IsAdaptorUp() asks the kernel, unless a provider is set that already knows
+// the state of all interfaces, e.g. from monitoring link notifications. The
+// provider must return what IsAdaptorUp() would, and may be called from any
+// thread. Set NULL to ask the kernel again.
+typedef int (*FNADAPTORSTATE)(const char *szInterface);
+void NlSetAdaptorStateProvider(FNADAPTORSTATE pfnProvider);
+
+// Asynchronous variants; all requests share one netlink session, and are
+// processed by the kernel in submission order. Completions run on the
+// session's receive thread. Return 0 if the request was submitted, -1 if not,
+// in which case the completion is not invoked.
+int UpDownAdaptorInterfaceAsync(bool bUp, const char *szInterface, FNNLCOMPLETION pfnComplete, void* pContext);
+int SetRouteAsync(int domain, const char *szInterface, bool bAdd, const char* dst, int dstprefixlen, const char* gw,
+	FNNLCOMPLETION pfnComplete, void* pContext);
+int SetAdaptorAddressAsync(int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen,
+	FNNLCOMPLETION pfnComplete, void* pContext);
+int SetAdaptorMtuAsync(const char *szInterface, int mtu, FNNLCOMPLETION pfnComplete, void* pContext);
+
+// Batched configuration of one interface. Changes are sent with a single
+// sendmsg() when the batch is applied, and all acknowledgements are collected
+// together. If any change fails, the ones that took effect are rolled back,
+// again with a single sendmsg(), and -1 is returned. If the batch cannot be
+// sent at all, nothing took effect and nothing is rolled back. Addresses and
+// routes that already exist are left alone, and do not count as failures.
+// Adding changes returns -1 once the batch is full.
+//
+// Changes are applied in the order they are added; add the MTU and link
+// state first, then addresses, then routes.
+struct nlbatch;
+struct nlbatch* NlBatchCreate(const char* szInterface);
+void NlBatchFree(struct nlbatch* pBatch);
+int NlBatchSetMtu(struct nlbatch* pBatch, int mtu);
+int NlBatchUpAdaptor(struct nlbatch* pBatch);
+int NlBatchAddAddress(struct nlbatch* pBatch, int domain, const char *szIPAddress, int dstprefixlen);
+int NlBatchAddRoute(struct nlbatch* pBatch, int domain, const char* dst, int dstprefixlen, const char* gw);
+int NlBatchApply(struct nlbatch* pBatch);
+
+// Submit batches through this function instead of the default netlink
+// session, or through the session again if NULL; for testing. It behaves as
+// NlSessionSubmitBatch(), and must answer every request it accepts.
+typedef int (*FNNLBATCHSUBMIT)(char* pBuf, size_t nLen, FNNLCOMPLETION pfnComplete,
+	void* const* ppContexts, size_t nContexts);
+void NlBatchSetSubmitter(FNNLBATCHSUBMIT pfnSubmit);
+
 int AddVlan(const char* szInterface, const char* szVlanInterface, int nVlandId);
 int DeleteVlan(const char* szVlanInterface);
+
+// Nexthop objects (Linux 5.3 and later). A nexthop leaves through an
+// interface, via a gateway or, for point-to-point links, without one (gw is
+// NULL). A group spreads flows across its nexthops by weight, from 1 to
+// NL_NEXTHOP_MAX_WEIGHT. Setting an object with an existing ID replaces it
+// in place, so routes through a group follow its new members and weights at
+// once. Removing a nexthop removes it from its groups, and removing a group
+// removes the routes through it.
+//
+// Return 0 on success, -1 on failure.
+#define NL_NEXTHOP_MAX_WEIGHT	256
+struct nlnhmember
+{
+	uint32_t nId;
+	uint16_t nWeight;
+};
+int NlSetNexthop(uint32_t nId, int domain, const char* szInterface, const char* gw);
+int NlSetNexthopGroup(uint32_t nId, const struct nlnhmember* pMembers, size_t nCount);
+int NlDeleteNexthop(uint32_t nId);
+
+// Set the default route of a routing table, with the given metric, to a
+// nexthop or group.
+int NlSetDefaultRouteNexthop(int domain, uint32_t nTable, uint32_t nMetric, uint32_t nNexthopId);
 int AddQmiMuxIf(const char* szInterface, int nQmiMuxId);
 int EnableQmiMuxRawIp(const char* szInterface);
 int Mask2PrefixLenV4(unsigned int n);
@@ -0,0 +1,114 @@
+/*
+ *
+ */
+#include "session_diff.h"
+
+#include <sstream>
+
+namespace linkmanager::config {
+
+namespace {
+
+std::uint8_t
+compare(session_table const & before, std::size_t b,
+    session_table const & after, std::size_t a)
+{
+  std::uint8_t changes = CHANGE_NONE;
+
+  if (before.access_string(b) != after.access_string(a)
+      || before.ip_type(b) != after.ip_type(a)
+      || before.compression(b) != after.compression(a))
+  {
+    changes |= CHANGE_APN;
+  }
+
+  if (before.user_name(b) != after.user_name(a)
+      || before.password(b) != after.password(a)
+      || before.auth_protocol(b) != after.auth_protocol(a))
+  {
+    changes |= CHANGE_AUTH;
+  }
+
+  if (before.use_vlan(b) != after.use_vlan(a)
+      || before.vlan_name(b) != after.vlan_name(a)
+      || before.vlan_id(b) != after.vlan_id(a))
+  {
+    changes |= CHANGE_VLAN;
+  }
+
+  if (before.route_family(b) != after.route_family(a)
+      || before.route_dst(b) != after.route_dst(a)
+      || before.route_prefix_length(b) != after.route_prefix_length(a))
+  {
+    changes |= CHANGE_ROUTE;
+  }
+
+  if (before.sim_pin(b) != after.sim_pin(a)) {
+    changes |= CHANGE_PIN;
+  }
+
+  if (before.name(b) != after.name(a)) {
+    changes |= CHANGE_NAME;
+  }
+
+  return changes;
+}
+
+} // anonymous namespace
+
+
+
+session_diff
+diff(session_table const & before, session_table const & after)
+{
+  session_diff ret;
+  ret.device_changed = before.module_path() != after.module_path()
+    || before.interface_name() != after.interface_name();
+
+  // Both indices are sorted by session ID, so one merge pass matches them.
+  auto const & b = before.by_id();
+  auto const & a = after.by_id();
+  std::size_t bi = 0;
+  std::size_t ai = 0;
+  while (bi < b.size() || ai < a.size()) {
+    if (ai == a.size() || (bi < b.size() && b[bi].first < a[ai].first)) {
+      ret.removed.push_back({b[bi].first, std::string{before.name(b[bi].second)}, CHANGE_ALL});
+      ++bi;
+    }
+    else if (bi == b.size() || a[ai].first < b[bi].first) {
+      ret.added.push_back({a[ai].first, std::string{after.name(a[ai].second)}, CHANGE_ALL});
+      ++ai;
+    }
+    else {
+      auto changes = compare(before, b[bi].second, after, a[ai].second);
+      if (changes) {
+        ret.changed.push_back({a[ai].first, std::string{after.name(a[ai].second)}, changes});
+      }
+      else {
+        ++ret.unchanged;
+      }
+      ++bi;
+      ++ai;
+    }
+  }
+
+  return ret;
+}
+
+
+
+std::string
+to_string(session_diff const & diff)
+{
+  std::ostringstream os;
+  os << diff.added.size() << " added, "
+    << diff.removed.size() << " removed, "
+    << diff.changed.size() << " changed, "
+    << diff.unchanged << " unchanged";
+  if (diff.device_changed) {
+    os << ", device changed";
+  }
+  return os.str();
+}
+
+} // namespace linkmanager::config
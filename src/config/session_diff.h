@@ -0,0 +1,78 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_CONFIG_SESSION_DIFF_H
+#define LINKMANAGER_CONFIG_SESSION_DIFF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "session_table.h"
+
+namespace linkmanager::config {
+
+/**
+ * What changed about a session, as a bit mask. Fields are grouped by what a
+ * link has to redo to apply them.
+ */
+enum session_changes : std::uint8_t
+{
+  CHANGE_NONE   = 0,
+  CHANGE_APN    = 1 << 0, // accessString, ipType, compression
+  CHANGE_AUTH   = 1 << 1, // userName, password, authProtocol
+  CHANGE_VLAN   = 1 << 2, // useVlan, vlanName, vlanId
+  CHANGE_ROUTE  = 1 << 3, // route
+  CHANGE_PIN    = 1 << 4, // simPin
+  CHANGE_NAME   = 1 << 5, // the session's name in the configuration
+  CHANGE_ALL    = 0x3f,
+};
+
+
+/**
+ * A session added, removed or changed by a new configuration. Sessions are
+ * matched by session ID, which is what identifies them to the modem.
+ */
+struct session_change
+{
+  std::uint32_t   session_id = 0;
+  std::string     name;         // As last configured.
+  std::uint8_t    changes = CHANGE_NONE;
+};
+
+
+/**
+ * Difference between the running and a new session table.
+ */
+struct session_diff
+{
+  std::vector<session_change> added;
+  std::vector<session_change> removed;
+  std::vector<session_change> changed;
+  std::size_t                 unchanged = 0;
+
+  // The module path or interface name changed, which cannot be applied to
+  // a running modem.
+  bool                        device_changed = false;
+
+  inline bool empty() const noexcept
+  {
+    return added.empty() && removed.empty() && changed.empty() && !device_changed;
+  }
+};
+
+
+/**
+ * Compare two tables, in time linear in the number of sessions.
+ */
+session_diff diff(session_table const & before, session_table const & after);
+
+
+/**
+ * A short summary such as "1 added, 0 removed, 2 changed, 997 unchanged".
+ */
+std::string to_string(session_diff const & diff);
+
+} // namespace linkmanager::config
+
+#endif // guard
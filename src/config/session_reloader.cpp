@@ -0,0 +1,79 @@
+/*
+ *
+ */
+#include "session_reloader.h"
+
+#include <fstream>
+
+namespace linkmanager::config {
+
+session_reloader::session_reloader(std::string filename, session_table initial,
+    change_callback on_change)
+  : m_filename{std::move(filename)}
+  , m_on_change{std::move(on_change)}
+  , m_sessions{std::make_unique<session_table const>(std::move(initial))}
+{
+}
+
+
+
+session_diff
+session_reloader::reload()
+{
+  std::ifstream in{m_filename};
+  if (!in) {
+    throw std::runtime_error{"Cannot open " + m_filename};
+  }
+
+  // Sessions are compiled as they are read; only the rest of the
+  // configuration becomes a document.
+  nlohmann::json rest;
+  std::unique_ptr<session_table const> next;
+  try {
+    next = std::make_unique<session_table const>(session_table::compile(in, rest));
+  } catch (nlohmann::json::exception const & err) {
+    throw std::runtime_error{"Cannot parse " + m_filename + ": " + err.what()};
+  }
+  return replace(rest, std::move(next));
+}
+
+
+
+session_diff
+session_reloader::reload(nlohmann::json const & config)
+{
+  // Compile before taking the lock; an invalid configuration changes
+  // nothing.
+  return replace(config, std::make_unique<session_table const>(
+        session_table::compile(config)));
+}
+
+
+
+session_diff
+session_reloader::replace(nlohmann::json const & config,
+    std::unique_ptr<session_table const> next)
+{
+  std::lock_guard<std::mutex> lock{m_reload_mutex};
+  session_diff changes;
+  {
+    auto running = m_sessions.read();
+    changes = diff(*running, *next);
+  }
+
+  if (changes.empty()) {
+    return changes;
+  }
+
+  auto const & published = *next;
+  m_sessions.publish(std::move(next));
+
+  // The running table only changes under the lock, so the published one is
+  // still alive here.
+  if (m_on_change) {
+    m_on_change(config, published, changes);
+  }
+  return changes;
+}
+
+} // namespace linkmanager::config
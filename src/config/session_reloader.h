@@ -0,0 +1,79 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_CONFIG_SESSION_RELOADER_H
+#define LINKMANAGER_CONFIG_SESSION_RELOADER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <linkmanager/rcu.h>
+
+#include "session_diff.h"
+#include "session_table.h"
+
+namespace linkmanager::config {
+
+/**
+ * Holds the running session table, and replaces it when the configuration
+ * file changes, without a restart.
+ *
+ * reload() streams the file into a new table again, and diffs the result
+ * against the running table. Unless the new configuration is invalid, it is
+ * then published, and the change callback is told which sessions were
+ * added, removed or changed, and how; sessions that did not change are not
+ * mentioned, so their links can be left alone. The callback also gets the
+ * rest of the configuration; the sessions' settings are only in the table
+ * (see session_table::settings()).
+ *
+ * Readers access the running table lock-free, from any thread (see
+ * rcu_cell). Reloads are serialized; the callback is invoked on the thread
+ * that reloads, after the new table has been published.
+ */
+class session_reloader
+{
+public:
+  using change_callback = std::function<void (nlohmann::json const & config,
+      session_table const & sessions, session_diff const & diff)>;
+
+  session_reloader(std::string filename, session_table initial,
+      change_callback on_change = {});
+
+  /**
+   * Reload the configuration file. Raises config_error if the configuration
+   * is invalid, and std::runtime_error if the file cannot be read or parsed;
+   * the running table is then kept.
+   */
+  session_diff reload();
+
+  /**
+   * As above, from a configuration already parsed, which is passed on to the
+   * callback as it is.
+   */
+  session_diff reload(nlohmann::json const & config);
+
+  inline rcu_cell<session_table>::read_guard sessions() const noexcept
+  {
+    return m_sessions.read();
+  }
+
+  inline std::string const & filename() const noexcept
+  {
+    return m_filename;
+  }
+
+private:
+  session_diff replace(nlohmann::json const & config,
+      std::unique_ptr<session_table const> next);
+
+  std::string             m_filename;
+  change_callback         m_on_change;
+  std::mutex              m_reload_mutex;
+  rcu_cell<session_table> m_sessions;
+};
+
+} // namespace linkmanager::config
+
+#endif // guard
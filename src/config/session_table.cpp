@@ -0,0 +1,940 @@
+/*
+ *
+ */
+#include "session_table.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <net/if.h>
+
+namespace linkmanager::config {
+
+namespace {
+
+// Settings of a session, by key.
+enum class field : std::uint8_t
+{
+  ACCESS_STRING,
+  AUTH_PROTOCOL,
+  COMPRESSION,
+  IP_TYPE,
+  PASSWORD,
+  ROUTE,
+  ROUTE_DST,
+  ROUTE_DST_PREFIX_LENGTH,
+  SESSION_ID,
+  SIM_PIN,
+  USE_VLAN,
+  USER_NAME,
+  VLAN_ID,
+  VLAN_NAME,
+};
+
+// Sorted by key, for lookup by binary search.
+static constexpr std::pair<std::string_view, field> FIELDS[] = {
+  { "accessString",         field::ACCESS_STRING },
+  { "authProtocol",         field::AUTH_PROTOCOL },
+  { "compression",          field::COMPRESSION },
+  { "ipType",               field::IP_TYPE },
+  { "password",             field::PASSWORD },
+  { "route",                field::ROUTE },
+  { "routeDst",             field::ROUTE_DST },
+  { "routeDstPrefixLength", field::ROUTE_DST_PREFIX_LENGTH },
+  { "sessionId",            field::SESSION_ID },
+  { "simPin",               field::SIM_PIN },
+  { "useVlan",              field::USE_VLAN },
+  { "userName",             field::USER_NAME },
+  { "vlanId",               field::VLAN_ID },
+  { "vlanName",             field::VLAN_NAME },
+};
+
+
+template <typename E>
+struct enumerator
+{
+  std::string_view  name;
+  E                 value;
+};
+
+static constexpr enumerator<MBIM_COMPRESSION> COMPRESSIONS[] = {
+  { "MBIMCompressionNone",   MBIMCompressionNone },
+  { "MBIMCompressionEnable", MBIMCompressionEnable },
+};
+
+static constexpr enumerator<MBIM_AUTH_PROTOCOL> AUTH_PROTOCOLS[] = {
+  { "MBIMAuthProtocolNone",     MBIMAuthProtocolNone },
+  { "MBIMAuthProtocolPap",      MBIMAuthProtocolPap },
+  { "MBIMAuthProtocolChap",     MBIMAuthProtocolChap },
+  { "MBIMAuthProtocolMsChapV2", MBIMAuthProtocolMsChapV2 },
+};
+
+static constexpr enumerator<MBIM_CONTEXT_IP_TYPE> IP_TYPES[] = {
+  { "MBIMContextIPTypeDefault",     MBIMContextIPTypeDefault },
+  { "MBIMContextIPTypeIPv4",        MBIMContextIPTypeIPv4 },
+  { "MBIMContextIPTypeIPv6",        MBIMContextIPTypeIPv6 },
+  { "MBIMContextIPTypeIPv4v6",      MBIMContextIPTypeIPv4v6 },
+  { "MBIMContextIPTypeIPv4AndIPv6", MBIMContextIPTypeIPv4AndIPv6 },
+};
+
+static constexpr std::uint16_t MAX_VLAN_ID = 4094;
+static constexpr std::size_t MIN_PIN_LENGTH = 4;
+static constexpr std::size_t MAX_PIN_LENGTH = 8;
+
+
+std::string
+type_name(nlohmann::json const & value)
+{
+  return value.type_name();
+}
+
+
+std::string const &
+string_value(std::string const & path, nlohmann::json const & value,
+    std::size_t max_length)
+{
+  if (!value.is_string()) {
+    throw config_error{path, "expected a string, not " + type_name(value)};
+  }
+  auto const & str = value.get_ref<std::string const &>();
+  if (str.size() > max_length) {
+    throw config_error{path, "longer than " + std::to_string(max_length)
+      + " characters"};
+  }
+  return str;
+}
+
+
+std::uint64_t
+unsigned_value(std::string const & path, nlohmann::json const & value,
+    std::uint64_t max)
+{
+  // Parsed documents hold non-negative integers as unsigned, but built ones
+  // may not.
+  if (!value.is_number_integer() || value.get<std::int64_t>() < 0) {
+    throw config_error{path, "expected an unsigned integer, not "
+      + (value.is_number_integer() ? value.dump() : type_name(value))};
+  }
+  auto num = value.get<std::uint64_t>();
+  if (num > max) {
+    throw config_error{path, "larger than " + std::to_string(max)};
+  }
+  return num;
+}
+
+
+bool
+bool_value(std::string const & path, nlohmann::json const & value)
+{
+  if (!value.is_boolean()) {
+    throw config_error{path, "expected a boolean, not " + type_name(value)};
+  }
+  return value.get<bool>();
+}
+
+
+template <typename E, std::size_t N>
+E
+enum_value(std::string const & path, nlohmann::json const & value,
+    enumerator<E> const (& enumerators)[N])
+{
+  auto const & name = string_value(path, value,
+      std::numeric_limits<std::size_t>::max());
+  for (auto const & e : enumerators) {
+    if (e.name == name) {
+      return e.value;
+    }
+  }
+  std::string message = "unknown value \"" + name + "\"; expected one of";
+  for (auto const & e : enumerators) {
+    message += " ";
+    message += e.name;
+  }
+  throw config_error{path, message};
+}
+
+
+
+template <typename E, std::size_t N>
+std::string_view
+enum_name(E value, enumerator<E> const (& enumerators)[N])
+{
+  for (auto const & e : enumerators) {
+    if (e.value == value) {
+      return e.name;
+    }
+  }
+  return {};
+}
+
+} // anonymous namespace
+
+
+
+config_error::config_error(std::string const & path, std::string const & message)
+  : std::runtime_error{path.empty() ? message : path + ": " + message}
+  , m_path{path}
+{
+}
+
+
+
+/**
+ * Builds a table, session by session, and setting by setting.
+ */
+class session_table::compiler
+{
+public:
+  explicit compiler(session_table & table)
+    : m_table{table}
+  {
+  }
+
+  string_ref intern(std::string_view str)
+  {
+    if (str.empty()) {
+      return {};
+    }
+    auto [iter, inserted] = m_interned.try_emplace(std::string{str});
+    if (inserted) {
+      if (m_table.m_arena.size() + str.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw config_error{"session", "too many strings"};
+      }
+      iter->second.offset = static_cast<std::uint32_t>(m_table.m_arena.size());
+      iter->second.length = static_cast<std::uint32_t>(str.size());
+      m_table.m_arena.append(str);
+    }
+    return iter->second;
+  }
+
+  void set_module_path(nlohmann::json const & value);
+  void set_interface_name(nlohmann::json const & value);
+
+  void add_session(std::string const & name, nlohmann::json const & settings);
+
+  // The same, in parts.
+  void begin_session(std::string const & name);
+  void set(std::string const & key, nlohmann::json const & value);
+  void set_route(std::string const & key, nlohmann::json const & value);
+  void end_session();
+
+  void finish();
+
+private:
+  // The route may be given in parts, so it is checked once all are in.
+  struct route
+  {
+    std::optional<std::string>    dst;
+    std::optional<std::uint64_t>  prefix_length;
+  };
+
+  void add_route();
+  void sort_by_name();
+
+  session_table &                             m_table;
+  std::unordered_map<std::string, string_ref> m_interned;
+
+  // The session being compiled.
+  std::string                                 m_path;
+  std::size_t                                 m_row = 0;
+  bool                                        m_have_id = false;
+  route                                       m_route;
+};
+
+
+
+void
+session_table::compiler::set_module_path(nlohmann::json const & value)
+{
+  m_table.m_module_path = intern(string_value("modulePath", value,
+        std::numeric_limits<std::size_t>::max()));
+}
+
+
+
+void
+session_table::compiler::set_interface_name(nlohmann::json const & value)
+{
+  m_table.m_interface_name = intern(string_value("deviceInterfaceName", value,
+        IF_NAMESIZE - 1));
+}
+
+
+
+void
+session_table::compiler::add_session(std::string const & name,
+    nlohmann::json const & settings)
+{
+  if (!settings.is_object()) {
+    throw config_error{"session/" + name, "expected an object, not " + type_name(settings)};
+  }
+
+  begin_session(name);
+  for (auto const & [key, value] : settings.items()) {
+    set(key, value);
+  }
+  end_session();
+}
+
+
+
+void
+session_table::compiler::begin_session(std::string const & name)
+{
+  m_path = "session/" + name;
+  m_have_id = false;
+  m_route = {};
+
+  auto & t = m_table;
+  t.m_name.push_back(intern(name));
+  t.m_session_id.push_back(0);
+  t.m_user_name.emplace_back();
+  t.m_password.emplace_back();
+  t.m_access_string.emplace_back();
+  t.m_compression.push_back(MBIMCompressionNone);
+  t.m_auth_protocol.push_back(MBIMAuthProtocolNone);
+  t.m_ip_type.push_back(MBIMContextIPTypeDefault);
+  t.m_use_vlan.push_back(0);
+  t.m_vlan_name.emplace_back();
+  t.m_vlan_id.push_back(0);
+  t.m_sim_pin.emplace_back();
+  t.m_route_family.push_back(AF_UNSPEC);
+  t.m_route_dst.emplace_back();
+  t.m_route_prefix_length.push_back(0);
+  m_row = t.m_session_id.size() - 1;
+}
+
+
+
+void
+session_table::compiler::set(std::string const & key, nlohmann::json const & value)
+{
+  auto & t = m_table;
+  auto const row = m_row;
+  auto const key_path = m_path + "/" + key;
+  auto iter = std::lower_bound(std::begin(FIELDS), std::end(FIELDS), key,
+      [](auto const & entry, std::string const & k) { return entry.first < k; });
+  if (iter == std::end(FIELDS) || iter->first != key) {
+    throw config_error{key_path, "unknown setting"};
+  }
+
+  switch (iter->second) {
+    case field::SESSION_ID:
+      t.m_session_id[row] = static_cast<std::uint32_t>(unsigned_value(key_path, value,
+            std::numeric_limits<std::uint32_t>::max()));
+      m_have_id = true;
+      break;
+
+    case field::USER_NAME:
+      t.m_user_name[row] = intern(string_value(key_path, value, MBIM_USER_NAME_MAX_LEN));
+      break;
+
+    case field::PASSWORD:
+      t.m_password[row] = intern(string_value(key_path, value, MBIM_PASSWORD_MAX_LEN));
+      break;
+
+    case field::ACCESS_STRING:
+      t.m_access_string[row] = intern(string_value(key_path, value,
+            MBIM_ACCESS_STRING_MAX_LEN));
+      break;
+
+    case field::COMPRESSION:
+      t.m_compression[row] = enum_value(key_path, value, COMPRESSIONS);
+      break;
+
+    case field::AUTH_PROTOCOL:
+      t.m_auth_protocol[row] = enum_value(key_path, value, AUTH_PROTOCOLS);
+      break;
+
+    case field::IP_TYPE:
+      t.m_ip_type[row] = enum_value(key_path, value, IP_TYPES);
+      break;
+
+    case field::USE_VLAN:
+      t.m_use_vlan[row] = bool_value(key_path, value);
+      break;
+
+    case field::VLAN_NAME:
+      t.m_vlan_name[row] = intern(string_value(key_path, value, IF_NAMESIZE - 1));
+      break;
+
+    case field::VLAN_ID:
+      t.m_vlan_id[row] = static_cast<std::uint16_t>(unsigned_value(key_path, value,
+            MAX_VLAN_ID));
+      break;
+
+    case field::SIM_PIN:
+      {
+        // Accepted as a number, too, as that is what it looks like.
+        auto pin = value.is_number_integer()
+          ? std::to_string(unsigned_value(key_path, value,
+                std::numeric_limits<std::uint64_t>::max()))
+          : string_value(key_path, value, MAX_PIN_LENGTH);
+        if (pin.size() < MIN_PIN_LENGTH || pin.size() > MAX_PIN_LENGTH
+            || pin.find_first_not_of("0123456789") != std::string::npos) {
+          throw config_error{key_path, "expected " + std::to_string(MIN_PIN_LENGTH)
+            + " to " + std::to_string(MAX_PIN_LENGTH) + " digits"};
+        }
+        t.m_sim_pin[row] = intern(pin);
+      }
+      break;
+
+    case field::ROUTE:
+      if (!value.is_object()) {
+        throw config_error{key_path, "expected an object, not " + type_name(value)};
+      }
+      for (auto const & [route_key, route_value] : value.items()) {
+        set_route(route_key, route_value);
+      }
+      break;
+
+    case field::ROUTE_DST:
+      m_route.dst = string_value(key_path, value, INET6_ADDRSTRLEN - 1);
+      break;
+
+    case field::ROUTE_DST_PREFIX_LENGTH:
+      m_route.prefix_length = unsigned_value(key_path, value, 128);
+      break;
+  }
+}
+
+
+
+void
+session_table::compiler::set_route(std::string const & key, nlohmann::json const & value)
+{
+  auto const key_path = m_path + "/route/" + key;
+  if (key == "dst") {
+    m_route.dst = string_value(key_path, value, INET6_ADDRSTRLEN - 1);
+  }
+  else if (key == "dstPrefixLength") {
+    m_route.prefix_length = unsigned_value(key_path, value, 128);
+  }
+  else {
+    throw config_error{key_path, "unknown setting"};
+  }
+}
+
+
+
+void
+session_table::compiler::end_session()
+{
+  if (!m_have_id) {
+    throw config_error{m_path + "/sessionId", "missing"};
+  }
+  if (m_table.m_use_vlan[m_row] && !m_table.m_vlan_name[m_row].length) {
+    throw config_error{m_path + "/vlanName", "required with useVlan"};
+  }
+  add_route();
+}
+
+
+
+void
+session_table::compiler::add_route()
+{
+  auto const path = m_path + "/route";
+  auto const & r = m_route;
+  if (!r.dst) {
+    if (r.prefix_length) {
+      throw config_error{path, "prefix length without destination"};
+    }
+    return;
+  }
+
+  unsigned char addr[sizeof(struct in6_addr)];
+  std::uint8_t family = AF_INET;
+  std::uint64_t max_prefix = 32;
+  if (inet_pton(AF_INET, r.dst->c_str(), addr) != 1) {
+    if (inet_pton(AF_INET6, r.dst->c_str(), addr) != 1) {
+      throw config_error{path, "\"" + *r.dst + "\" is not an IPv4 or IPv6 address"};
+    }
+    family = AF_INET6;
+    max_prefix = 128;
+  }
+
+  auto prefix = r.prefix_length.value_or(max_prefix);
+  if (prefix > max_prefix) {
+    throw config_error{path, "prefix length " + std::to_string(prefix)
+      + " is longer than the address"};
+  }
+
+  m_table.m_route_family[m_row] = family;
+  m_table.m_route_dst[m_row] = intern(*r.dst);
+  m_table.m_route_prefix_length[m_row] = static_cast<std::uint8_t>(prefix);
+}
+
+
+
+void
+session_table::compiler::sort_by_name()
+{
+  auto & t = m_table;
+  auto by_name = [&t](std::uint32_t a, std::uint32_t b)
+  {
+    return t.name(a) < t.name(b);
+  };
+
+  std::vector<std::uint32_t> order(t.size());
+  for (std::uint32_t row = 0 ; row < order.size() ; ++row) {
+    order[row] = row;
+  }
+  bool const sorted = std::is_sorted(order.begin(), order.end(), by_name);
+  if (!sorted) {
+    std::sort(order.begin(), order.end(), by_name);
+  }
+
+  auto dup = std::adjacent_find(order.begin(), order.end(),
+      [&t](std::uint32_t a, std::uint32_t b) { return t.name(a) == t.name(b); });
+  if (dup != order.end()) {
+    throw config_error{"session/" + std::string{t.name(*dup)}, "duplicate session name"};
+  }
+  if (sorted) {
+    return;
+  }
+
+  for_each_column(t, [&order](auto & column)
+      {
+        std::remove_reference_t<decltype(column)> permuted;
+        permuted.reserve(column.size());
+        for (auto row : order) {
+          permuted.push_back(column[row]);
+        }
+        column.swap(permuted);
+      });
+}
+
+
+
+void
+session_table::compiler::finish()
+{
+  // Documents iterate sessions by name already, streams need not.
+  sort_by_name();
+  m_table.index();
+
+  auto const & by_id = m_table.m_by_id;
+  auto dup = std::adjacent_find(by_id.begin(), by_id.end(),
+      [](auto const & a, auto const & b) { return a.first == b.first; });
+  if (dup != by_id.end()) {
+    throw config_error{"session/" + std::string{m_table.name((dup + 1)->second)}
+      + "/sessionId", "duplicate session ID " + std::to_string(dup->first)
+      + ", also used by session " + std::string{m_table.name(dup->second)}};
+  }
+
+  m_table.m_arena.shrink_to_fit();
+}
+
+
+
+/**
+ * Streams a configuration into a compiler, with nlohmann::json's SAX
+ * interface. Session settings are handed over one by one; only the other
+ * top-level keys are built into a document.
+ */
+class session_table::reader
+{
+public:
+  reader(compiler & c, nlohmann::json & rest)
+    : m_compiler{c}
+    , m_rest{rest}
+  {
+  }
+
+  bool null()
+  {
+    return value(nullptr);
+  }
+
+  bool boolean(bool val)
+  {
+    return value(val);
+  }
+
+  bool number_integer(nlohmann::json::number_integer_t val)
+  {
+    return value(val);
+  }
+
+  bool number_unsigned(nlohmann::json::number_unsigned_t val)
+  {
+    return value(val);
+  }
+
+  bool number_float(nlohmann::json::number_float_t val, std::string const &)
+  {
+    return value(val);
+  }
+
+  bool string(std::string & val)
+  {
+    return value(std::move(val));
+  }
+
+  bool binary(nlohmann::json::binary_t & val)
+  {
+    return value(nlohmann::json::binary(std::move(val)));
+  }
+
+  bool start_object(std::size_t)
+  {
+    return start(nlohmann::json::value_t::object);
+  }
+
+  bool start_array(std::size_t)
+  {
+    return start(nlohmann::json::value_t::array);
+  }
+
+  bool end_object()
+  {
+    return end();
+  }
+
+  bool end_array()
+  {
+    return end();
+  }
+
+  bool key(std::string & val);
+
+  [[noreturn]] bool parse_error(std::size_t, std::string const &,
+      nlohmann::json::exception const & ex)
+  {
+    throw ex;
+  }
+
+private:
+  enum class state : std::uint8_t
+  {
+    START,    // Before the configuration object.
+    TOP,      // In the configuration object.
+    SESSIONS, // In the "session" object.
+    SESSION,  // In a session.
+    ROUTE,    // In a session's route.
+    REST,     // In any other top-level value.
+    DONE,     // After the configuration object.
+  };
+
+  bool value(nlohmann::json && val);
+  bool start(nlohmann::json::value_t type);
+  bool end();
+
+  void device_setting(nlohmann::json const & val);
+  nlohmann::json & add_rest(nlohmann::json && val);
+
+  compiler &                    m_compiler;
+  nlohmann::json &              m_rest;
+
+  state                         m_state = state::START;
+  bool                          m_have_sessions = false;
+  std::string                   m_top_key;
+  std::string                   m_name;
+  std::string                   m_key;
+
+  // Containers of other top-level values being built, innermost last.
+  std::vector<nlohmann::json *> m_stack;
+  std::string                   m_rest_key;
+};
+
+
+
+bool
+session_table::reader::key(std::string & val)
+{
+  switch (m_state) {
+    case state::TOP:
+      m_top_key = std::move(val);
+      break;
+
+    case state::SESSIONS:
+      m_name = std::move(val);
+      break;
+
+    case state::SESSION:
+    case state::ROUTE:
+      m_key = std::move(val);
+      break;
+
+    case state::REST:
+      m_rest_key = std::move(val);
+      break;
+
+    case state::START:
+    case state::DONE:
+      return false;
+  }
+  return true;
+}
+
+
+
+bool
+session_table::reader::value(nlohmann::json && val)
+{
+  switch (m_state) {
+    case state::START:
+      throw config_error{"", "expected an object, not " + type_name(val)};
+
+    case state::TOP:
+      if (m_top_key == "session") {
+        throw config_error{"session", "expected an object, not " + type_name(val)};
+      }
+      device_setting(val);
+      m_rest[m_top_key] = std::move(val);
+      break;
+
+    case state::SESSIONS:
+      // Not an object, so this raises the same error as for a document.
+      m_compiler.add_session(m_name, val);
+      break;
+
+    case state::SESSION:
+      m_compiler.set(m_key, val);
+      break;
+
+    case state::ROUTE:
+      m_compiler.set_route(m_key, val);
+      break;
+
+    case state::REST:
+      add_rest(std::move(val));
+      break;
+
+    case state::DONE:
+      return false;
+  }
+  return true;
+}
+
+
+
+bool
+session_table::reader::start(nlohmann::json::value_t type)
+{
+  // Where a container is not expected, the compiler is handed an empty one,
+  // so that it raises the error.
+  nlohmann::json empty(type);
+  switch (m_state) {
+    case state::START:
+      if (type != nlohmann::json::value_t::object) {
+        throw config_error{"", "expected an object, not " + type_name(empty)};
+      }
+      m_rest = nlohmann::json::object();
+      m_state = state::TOP;
+      break;
+
+    case state::TOP:
+      if (m_top_key == "session") {
+        if (type != nlohmann::json::value_t::object) {
+          throw config_error{"session", "expected an object, not " + type_name(empty)};
+        }
+        if (m_have_sessions) {
+          throw config_error{"session", "given more than once"};
+        }
+        m_have_sessions = true;
+        m_state = state::SESSIONS;
+        break;
+      }
+      device_setting(empty);
+      m_stack.push_back(&(m_rest[m_top_key] = std::move(empty)));
+      m_state = state::REST;
+      break;
+
+    case state::SESSIONS:
+      if (type != nlohmann::json::value_t::object) {
+        m_compiler.add_session(m_name, empty);
+      }
+      m_compiler.begin_session(m_name);
+      m_state = state::SESSION;
+      break;
+
+    case state::SESSION:
+      if (m_key != "route" || type != nlohmann::json::value_t::object) {
+        m_compiler.set(m_key, empty);
+      }
+      m_state = state::ROUTE;
+      break;
+
+    case state::ROUTE:
+      m_compiler.set_route(m_key, empty);
+      return false;
+
+    case state::REST:
+      m_stack.push_back(&add_rest(std::move(empty)));
+      break;
+
+    case state::DONE:
+      return false;
+  }
+  return true;
+}
+
+
+
+bool
+session_table::reader::end()
+{
+  switch (m_state) {
+    case state::TOP:
+      m_state = state::DONE;
+      break;
+
+    case state::SESSIONS:
+      m_state = state::TOP;
+      break;
+
+    case state::SESSION:
+      m_compiler.end_session();
+      m_state = state::SESSIONS;
+      break;
+
+    case state::ROUTE:
+      m_state = state::SESSION;
+      break;
+
+    case state::REST:
+      m_stack.pop_back();
+      if (m_stack.empty()) {
+        m_state = state::TOP;
+      }
+      break;
+
+    case state::START:
+    case state::DONE:
+      return false;
+  }
+  return true;
+}
+
+
+
+void
+session_table::reader::device_setting(nlohmann::json const & val)
+{
+  if (m_top_key == "modulePath") {
+    m_compiler.set_module_path(val);
+  }
+  else if (m_top_key == "deviceInterfaceName") {
+    m_compiler.set_interface_name(val);
+  }
+}
+
+
+
+nlohmann::json &
+session_table::reader::add_rest(nlohmann::json && val)
+{
+  auto & container = *m_stack.back();
+  if (container.is_array()) {
+    container.push_back(std::move(val));
+    return container.back();
+  }
+  return container[m_rest_key] = std::move(val);
+}
+
+
+
+session_table
+session_table::compile(nlohmann::json const & config)
+{
+  if (!config.is_object()) {
+    throw config_error{"", "expected an object, not " + type_name(config)};
+  }
+
+  session_table table;
+  compiler c{table};
+
+  if (config.contains("modulePath")) {
+    c.set_module_path(config["modulePath"]);
+  }
+  if (config.contains("deviceInterfaceName")) {
+    c.set_interface_name(config["deviceInterfaceName"]);
+  }
+
+  if (config.contains("session")) {
+    auto const & sessions = config["session"];
+    if (!sessions.is_object()) {
+      throw config_error{"session", "expected an object, not " + type_name(sessions)};
+    }
+    for (auto const & [name, settings] : sessions.items()) {
+      c.add_session(name, settings);
+    }
+  }
+
+  c.finish();
+  return table;
+}
+
+
+
+session_table
+session_table::compile(std::istream & in, nlohmann::json & rest)
+{
+  session_table table;
+  compiler c{table};
+  reader r{c, rest};
+  nlohmann::json::sax_parse(in, &r);
+  c.finish();
+  return table;
+}
+
+
+
+void
+session_table::index()
+{
+  m_by_id.clear();
+  m_by_id.reserve(size());
+  for (std::uint32_t row = 0 ; row < size() ; ++row) {
+    m_by_id.emplace_back(m_session_id[row], row);
+  }
+  std::sort(m_by_id.begin(), m_by_id.end());
+}
+
+
+
+std::optional<std::size_t>
+session_table::find(std::uint32_t session_id) const
+{
+  auto iter = std::lower_bound(m_by_id.begin(), m_by_id.end(),
+      std::make_pair(session_id, std::uint32_t{0}));
+  if (iter == m_by_id.end() || iter->first != session_id) {
+    return {};
+  }
+  return iter->second;
+}
+
+
+
+nlohmann::json
+session_table::settings(std::size_t row) const
+{
+  nlohmann::json ret = {
+    { "sessionId",    session_id(row) },
+    { "userName",     user_name(row) },
+    { "password",     password(row) },
+    { "accessString", access_string(row) },
+    { "compression",  enum_name(compression(row), COMPRESSIONS) },
+    { "authProtocol", enum_name(auth_protocol(row), AUTH_PROTOCOLS) },
+    { "ipType",       enum_name(ip_type(row), IP_TYPES) },
+    { "useVlan",      use_vlan(row) },
+    { "vlanName",     vlan_name(row) },
+    { "vlanId",       vlan_id(row) },
+  };
+  if (!sim_pin(row).empty()) {
+    ret["simPin"] = sim_pin(row);
+  }
+  if (route_family(row) != AF_UNSPEC) {
+    ret["route"] = {
+      { "dst",             route_dst(row) },
+      { "dstPrefixLength", route_prefix_length(row) },
+    };
+  }
+  return ret;
+}
+
+} // namespace linkmanager::config
@@ -0,0 +1,292 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_CONFIG_SESSION_TABLE_H
+#define LINKMANAGER_CONFIG_SESSION_TABLE_H
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "lite-mbim/BasicConnectDeviceService.h"
+
+namespace linkmanager::config {
+
+/**
+ * Invalid configuration. The path names the offending value, e.g.
+ * "session/0/ipType".
+ */
+class config_error : public std::runtime_error
+{
+public:
+  config_error(std::string const & path, std::string const & message);
+
+  inline std::string const & path() const noexcept
+  {
+    return m_path;
+  }
+
+private:
+  std::string m_path;
+};
+
+
+/**
+ * The sessions of a configuration, compiled once into a validated table.
+ *
+ * The "session" object of the configuration maps a name to each session's
+ * settings:
+ *
+ *   "session": {
+ *     "0": {
+ *       "sessionId": 0,
+ *       "userName": "...", "password": "...", "accessString": "...",
+ *       "compression": "MBIMCompressionNone",
+ *       "authProtocol": "MBIMAuthProtocolNone",
+ *       "ipType": "MBIMContextIPTypeIPv4",
+ *       "useVlan": false, "vlanName": "vlan.0", "vlanId": 4094,
+ *       "simPin": 1234,
+ *       "route": { "dst": "8.8.8.0", "dstPrefixLength": 24 }
+ *     }
+ *   }
+ *
+ * Only "sessionId" is required. The route may also be given as the flat
+ * "routeDst" and "routeDstPrefixLength" keys. Unknown keys, values of the
+ * wrong type or out of range, unknown enumerator names, strings longer than
+ * MBIM (or the kernel, for VLAN names) allows, and duplicate session IDs
+ * are all rejected with a config_error.
+ *
+ * Sessions are stored by column, one row per session in order of their
+ * names, so that scans over a single field touch only that field. Enum
+ * fields hold their MBIM values, and strings live in a single arena, with
+ * identical strings stored once. Nothing refers back to the JSON, and the
+ * table is immutable once compiled, so it may be read from any thread.
+ */
+class session_table
+{
+public:
+  /**
+   * Compile the sessions of a configuration; the "modulePath" and
+   * "deviceInterfaceName" keys are taken along, if present. Other top-level
+   * keys are left alone. Raises config_error.
+   */
+  static session_table compile(nlohmann::json const & config);
+
+  /**
+   * As above, but streaming the configuration from a JSON text: sessions are
+   * validated and compiled as they are read, without building a document of
+   * them. The other top-level keys are collected into rest, which is all
+   * that is kept of the document.
+   *
+   * Rows are in order of session names, as when compiling a document, and a
+   * session name may only appear once. Raises config_error for an invalid
+   * configuration, and nlohmann::json::exception if the text is not JSON.
+   */
+  static session_table compile(std::istream & in, nlohmann::json & rest);
+
+  inline std::size_t size() const noexcept
+  {
+    return m_session_id.size();
+  }
+
+  inline bool empty() const noexcept
+  {
+    return m_session_id.empty();
+  }
+
+  /**
+   * The row of a session ID, if configured.
+   */
+  std::optional<std::size_t> find(std::uint32_t session_id) const;
+
+  /**
+   * The settings of a row, as given in a configuration; compiling them
+   * yields the same row. For handing a session to its link.
+   */
+  nlohmann::json settings(std::size_t row) const;
+
+  /**
+   * (session ID, row) pairs, sorted by session ID.
+   */
+  using id_index = std::vector<std::pair<std::uint32_t, std::uint32_t>>;
+
+  inline id_index const & by_id() const noexcept
+  {
+    return m_by_id;
+  }
+
+  inline std::string_view module_path() const
+  {
+    return str(m_module_path);
+  }
+
+  inline std::string_view interface_name() const
+  {
+    return str(m_interface_name);
+  }
+
+  // Columns, by row.
+  inline std::string_view name(std::size_t row) const
+  {
+    return str(m_name[row]);
+  }
+
+  inline std::uint32_t session_id(std::size_t row) const
+  {
+    return m_session_id[row];
+  }
+
+  inline std::string_view user_name(std::size_t row) const
+  {
+    return str(m_user_name[row]);
+  }
+
+  inline std::string_view password(std::size_t row) const
+  {
+    return str(m_password[row]);
+  }
+
+  inline std::string_view access_string(std::size_t row) const
+  {
+    return str(m_access_string[row]);
+  }
+
+  inline MBIM_COMPRESSION compression(std::size_t row) const
+  {
+    return m_compression[row];
+  }
+
+  inline MBIM_AUTH_PROTOCOL auth_protocol(std::size_t row) const
+  {
+    return m_auth_protocol[row];
+  }
+
+  inline MBIM_CONTEXT_IP_TYPE ip_type(std::size_t row) const
+  {
+    return m_ip_type[row];
+  }
+
+  inline bool use_vlan(std::size_t row) const
+  {
+    return m_use_vlan[row] != 0;
+  }
+
+  inline std::string_view vlan_name(std::size_t row) const
+  {
+    return str(m_vlan_name[row]);
+  }
+
+  inline std::uint16_t vlan_id(std::size_t row) const
+  {
+    return m_vlan_id[row];
+  }
+
+  /** Empty if not configured. */
+  inline std::string_view sim_pin(std::size_t row) const
+  {
+    return str(m_sim_pin[row]);
+  }
+
+  /** AF_INET or AF_INET6, or AF_UNSPEC if the session has no route. */
+  inline std::uint8_t route_family(std::size_t row) const
+  {
+    return m_route_family[row];
+  }
+
+  inline std::string_view route_dst(std::size_t row) const
+  {
+    return str(m_route_dst[row]);
+  }
+
+  inline std::uint8_t route_prefix_length(std::size_t row) const
+  {
+    return m_route_prefix_length[row];
+  }
+
+  /**
+   * Bytes held by the string arena.
+   */
+  inline std::size_t arena_size() const noexcept
+  {
+    return m_arena.size();
+  }
+
+private:
+  /** A string in the arena. */
+  struct string_ref
+  {
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+  };
+
+  class compiler;
+  class reader;
+  friend class snapshot;
+
+  /**
+   * Build the session ID index from the session ID column.
+   */
+  void index();
+
+  /**
+   * Apply func to each of the table's columns, in the order of their
+   * declaration.
+   */
+  template <typename T, typename F>
+  static void for_each_column(T & table, F && func)
+  {
+    func(table.m_name);
+    func(table.m_session_id);
+    func(table.m_user_name);
+    func(table.m_password);
+    func(table.m_access_string);
+    func(table.m_compression);
+    func(table.m_auth_protocol);
+    func(table.m_ip_type);
+    func(table.m_use_vlan);
+    func(table.m_vlan_name);
+    func(table.m_vlan_id);
+    func(table.m_sim_pin);
+    func(table.m_route_family);
+    func(table.m_route_dst);
+    func(table.m_route_prefix_length);
+  }
+
+  inline std::string_view str(string_ref ref) const
+  {
+    return std::string_view{m_arena.data() + ref.offset, ref.length};
+  }
+
+  std::string                       m_arena;
+  string_ref                        m_module_path;
+  string_ref                        m_interface_name;
+
+  std::vector<string_ref>           m_name;
+  std::vector<std::uint32_t>        m_session_id;
+  std::vector<string_ref>           m_user_name;
+  std::vector<string_ref>           m_password;
+  std::vector<string_ref>           m_access_string;
+  std::vector<MBIM_COMPRESSION>     m_compression;
+  std::vector<MBIM_AUTH_PROTOCOL>   m_auth_protocol;
+  std::vector<MBIM_CONTEXT_IP_TYPE> m_ip_type;
+  std::vector<std::uint8_t>         m_use_vlan;
+  std::vector<string_ref>           m_vlan_name;
+  std::vector<std::uint16_t>        m_vlan_id;
+  std::vector<string_ref>           m_sim_pin;
+  std::vector<std::uint8_t>         m_route_family;
+  std::vector<string_ref>           m_route_dst;
+  std::vector<std::uint8_t>         m_route_prefix_length;
+
+  id_index                          m_by_id;
+};
+
+} // namespace linkmanager::config
+
+#endif // guard
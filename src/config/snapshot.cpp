@@ -0,0 +1,393 @@
+/*
+ *
+ */
+#include "snapshot.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <liberate/logging.h>
+
+namespace linkmanager::config {
+
+namespace {
+
+static constexpr char MAGIC[8] = { 'L', 'M', 'C', 'O', 'N', 'F', 'I', 'G' };
+static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+static constexpr std::size_t ALIGNMENT = 8;
+
+
+constexpr std::array<std::uint32_t, 256>
+crc32_table()
+{
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t i = 0 ; i < 256 ; ++i) {
+    std::uint32_t crc = i;
+    for (int bit = 0 ; bit < 8 ; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+static constexpr auto CRC32_TABLE = crc32_table();
+
+
+std::uint32_t
+crc32(std::uint8_t const * data, std::size_t size)
+{
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0 ; i < size ; ++i) {
+    crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+
+inline std::uint64_t
+mtime_ns(struct stat const & st)
+{
+  return static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1000000000ull
+    + static_cast<std::uint64_t>(st.st_mtim.tv_nsec);
+}
+
+
+inline std::size_t
+aligned(std::size_t size)
+{
+  return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+
+/**
+ * Appends the payload, section by section.
+ */
+struct image_writer
+{
+  std::string buf;
+
+  inline void bytes(void const * data, std::size_t size)
+  {
+    buf.append(static_cast<char const *>(data), size);
+    buf.resize(aligned(buf.size()), '\0');
+  }
+
+  template <typename T>
+  inline void operator()(std::vector<T> const & column)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    bytes(column.data(), column.size() * sizeof(T));
+  }
+};
+
+
+/**
+ * Reads the payload back, section by section, within its bounds.
+ */
+struct image_reader
+{
+  std::uint8_t const *  pos;
+  std::uint8_t const *  end;
+  std::size_t           rows;
+  bool                  ok = true;
+
+  inline std::uint8_t const * bytes(std::size_t size)
+  {
+    if (!ok || static_cast<std::size_t>(end - pos) < aligned(size)) {
+      ok = false;
+      return nullptr;
+    }
+    auto ret = pos;
+    pos += aligned(size);
+    return ret;
+  }
+
+  template <typename T>
+  inline void operator()(std::vector<T> & column)
+  {
+    auto data = bytes(rows * sizeof(T));
+    if (data) {
+      column.resize(rows);
+      std::memcpy(column.data(), data, rows * sizeof(T));
+    }
+  }
+};
+
+
+/**
+ * Write all of a buffer, retrying on short writes.
+ */
+bool
+write_all(int fd, std::string const & buf)
+{
+  std::size_t done = 0;
+  while (done < buf.size()) {
+    auto ret = ::write(fd, buf.data() + done, buf.size() - done);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    done += static_cast<std::size_t>(ret);
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+
+struct snapshot::header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t source_mtime;   // Nanoseconds since the epoch.
+  std::uint64_t source_size;
+  std::uint64_t payload_size;
+  std::uint32_t checksum;       // CRC-32 of the payload.
+  std::uint32_t rows;
+  std::uint32_t arena_size;
+  std::uint32_t document_size;
+};
+
+
+
+bool
+snapshot::write(std::string const & path, std::uint64_t source_mtime,
+    std::uint64_t source_size, compiled_config const & config)
+{
+  auto const & table = config.sessions;
+
+  image_writer payload;
+  payload.bytes(&table.m_module_path, sizeof(table.m_module_path));
+  payload.bytes(&table.m_interface_name, sizeof(table.m_interface_name));
+  session_table::for_each_column(table, payload);
+  payload.bytes(table.m_arena.data(), table.m_arena.size());
+  auto document = nlohmann::json::to_cbor(config.document);
+  payload.bytes(document.data(), document.size());
+
+  header hdr{};
+  std::memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+  hdr.version = VERSION;
+  hdr.byte_order = BYTE_ORDER_MARK;
+  hdr.source_mtime = source_mtime;
+  hdr.source_size = source_size;
+  hdr.payload_size = payload.buf.size();
+  hdr.checksum = crc32(reinterpret_cast<std::uint8_t const *>(payload.buf.data()),
+      payload.buf.size());
+  hdr.rows = static_cast<std::uint32_t>(table.size());
+  hdr.arena_size = static_cast<std::uint32_t>(table.m_arena.size());
+  hdr.document_size = static_cast<std::uint32_t>(document.size());
+
+  std::string image{reinterpret_cast<char const *>(&hdr), sizeof(hdr)};
+  image += payload.buf;
+
+  auto tmp = path + ".tmp." + std::to_string(::getpid());
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = write_all(fd, image) && ::fsync(fd) == 0;
+  int err = errno;
+  ::close(fd);
+  if (!ok || ::rename(tmp.c_str(), path.c_str()) < 0) {
+    err = ok ? errno : err;
+    ::unlink(tmp.c_str());
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+
+
+bool
+snapshot::save(std::string const & path, std::string const & source,
+    compiled_config const & config)
+{
+  struct stat st;
+  if (::stat(source.c_str(), &st) < 0) {
+    return false;
+  }
+  return write(path, mtime_ns(st), static_cast<std::uint64_t>(st.st_size), config);
+}
+
+
+
+std::optional<compiled_config>
+snapshot::parse(header const & hdr, std::uint8_t const * payload)
+{
+  compiled_config ret;
+  auto & table = ret.sessions;
+
+  image_reader reader{payload, payload + hdr.payload_size, hdr.rows};
+  auto module_path = reader.bytes(sizeof(table.m_module_path));
+  auto interface_name = reader.bytes(sizeof(table.m_interface_name));
+  session_table::for_each_column(table, reader);
+  auto arena = reader.bytes(hdr.arena_size);
+  auto document = reader.bytes(hdr.document_size);
+  if (!reader.ok) {
+    return {};
+  }
+
+  std::memcpy(&table.m_module_path, module_path, sizeof(table.m_module_path));
+  std::memcpy(&table.m_interface_name, interface_name, sizeof(table.m_interface_name));
+  table.m_arena.assign(reinterpret_cast<char const *>(arena), hdr.arena_size);
+
+  // The checksum guards against damage, but not against an image written
+  // by a broken writer; keep strings within the arena regardless.
+  auto in_arena = [&table](session_table::string_ref const & ref)
+  {
+    return std::uint64_t{ref.offset} + ref.length <= table.m_arena.size();
+  };
+  bool valid = in_arena(table.m_module_path) && in_arena(table.m_interface_name);
+  for (auto const * column : { &table.m_name, &table.m_user_name, &table.m_password,
+      &table.m_access_string, &table.m_vlan_name, &table.m_sim_pin, &table.m_route_dst })
+  {
+    for (auto const & ref : *column) {
+      valid = valid && in_arena(ref);
+    }
+  }
+  if (!valid) {
+    return {};
+  }
+
+  try {
+    ret.document = nlohmann::json::from_cbor(document, document + hdr.document_size);
+  } catch (nlohmann::json::exception const &) {
+    return {};
+  }
+
+  table.index();
+  return ret;
+}
+
+
+
+std::optional<compiled_config>
+snapshot::load(std::string const & path, std::string const & source)
+{
+  struct stat source_st;
+  if (::stat(source.c_str(), &source_st) < 0) {
+    return {};
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return {};
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+    ::close(fd);
+    return {};
+  }
+
+  auto size = static_cast<std::size_t>(st.st_size);
+  void * map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return {};
+  }
+
+  std::optional<compiled_config> ret;
+  header hdr;
+  std::memcpy(&hdr, map, sizeof(hdr));
+  auto payload = static_cast<std::uint8_t const *>(map) + sizeof(hdr);
+  if (!std::memcmp(hdr.magic, MAGIC, sizeof(MAGIC))
+      && hdr.version == VERSION
+      && hdr.byte_order == BYTE_ORDER_MARK
+      && hdr.source_mtime == mtime_ns(source_st)
+      && hdr.source_size == static_cast<std::uint64_t>(source_st.st_size)
+      && hdr.payload_size == size - sizeof(hdr)
+      && hdr.checksum == crc32(payload, hdr.payload_size))
+  {
+    ret = parse(hdr, payload);
+  }
+
+  ::munmap(map, size);
+  return ret;
+}
+
+
+
+compiled_config
+snapshot::load_or_compile(std::string const & source, std::string const & snapshot_path)
+{
+  if (!snapshot_path.empty()) {
+    auto loaded = load(snapshot_path, source);
+    if (loaded) {
+      return std::move(*loaded);
+    }
+    LIBLOG_DEBUG("No up-to-date configuration snapshot at " << snapshot_path
+        << "; parsing " << source << ".");
+  }
+
+  // Stat before reading, so that a change while reading makes the snapshot
+  // stale rather than wrong.
+  struct stat st;
+  if (::stat(source.c_str(), &st) < 0) {
+    throw std::runtime_error{"Cannot open " + source + ": " + ::strerror(errno)};
+  }
+
+  std::ifstream in{source};
+  if (!in) {
+    throw std::runtime_error{"Cannot open " + source};
+  }
+  compiled_config ret;
+  try {
+    ret.sessions = session_table::compile(in, ret.document);
+  } catch (nlohmann::json::exception const & err) {
+    throw std::runtime_error{"Cannot parse " + source + ": " + err.what()};
+  }
+
+  if (!snapshot_path.empty() && !write(snapshot_path, mtime_ns(st),
+        static_cast<std::uint64_t>(st.st_size), ret))
+  {
+    LIBLOG_WARN("Could not write configuration snapshot " << snapshot_path << ": "
+        << ::strerror(errno));
+  }
+  return ret;
+}
+
+
+
+nlohmann::json
+snapshot::load_document(std::string const & source)
+{
+  std::ifstream in{source};
+  if (!in) {
+    throw std::runtime_error{"Cannot open " + source};
+  }
+
+  // The sessions are skipped as they are parsed.
+  nlohmann::json ret;
+  try {
+    ret = nlohmann::json::parse(in,
+        [](int depth, nlohmann::json::parse_event_t event, nlohmann::json & parsed)
+        {
+          return !(depth == 1 && event == nlohmann::json::parse_event_t::key
+              && parsed == "session");
+        });
+  } catch (nlohmann::json::exception const & err) {
+    throw std::runtime_error{"Cannot parse " + source + ": " + err.what()};
+  }
+
+  if (!ret.is_object()) {
+    throw std::runtime_error{"Cannot use " + source + ": expected an object, not "
+      + std::string{ret.type_name()}};
+  }
+  return ret;
+}
+
+} // namespace linkmanager::config
@@ -0,0 +1,96 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_CONFIG_SNAPSHOT_H
+#define LINKMANAGER_CONFIG_SNAPSHOT_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "session_table.h"
+
+namespace linkmanager::config {
+
+/**
+ * A compiled configuration, as saved to and loaded from a snapshot.
+ */
+struct compiled_config
+{
+  /** The configuration without its "session" object. */
+  nlohmann::json  document;
+
+  session_table   sessions;
+};
+
+
+/**
+ * Binary snapshot of a compiled configuration, so that starting up does not
+ * need to parse and validate the JSON configuration file again.
+ *
+ * The image starts with a header carrying a magic number, the format
+ * version, a CRC-32 of the rest, and the modification time and size of the
+ * configuration file it was compiled from. Then follow the session table's
+ * columns and string arena as they are laid out in memory, each 8-byte
+ * aligned, and the rest of the configuration as CBOR.
+ *
+ * Images are specific to the host they were written on (byte order, enum
+ * sizes); a mismatching image is rejected by its header, as is one that is
+ * damaged or was compiled from another version of the configuration file.
+ */
+class snapshot
+{
+public:
+  static constexpr std::uint32_t VERSION = 1;
+
+  /**
+   * Write a snapshot of the configuration compiled from the given source
+   * file. The image is written to a temporary file first, and renamed into
+   * place, so a reader never sees a partial one. Returns false (with errno
+   * set) if it cannot be written.
+   */
+  static bool save(std::string const & path, std::string const & source,
+      compiled_config const & config);
+
+  /**
+   * Map a snapshot, and load it if it is valid and up to date with the
+   * source file. Returns nothing otherwise, in which case the source file
+   * has to be parsed.
+   */
+  static std::optional<compiled_config> load(std::string const & path,
+      std::string const & source);
+
+  /**
+   * Parse and compile a configuration file, using a snapshot if there is an
+   * up-to-date one at snapshot_path, and saving one there otherwise. Without
+   * a snapshot path, this just streams the file into a session table.
+   *
+   * Raises config_error for an invalid configuration, and std::runtime_error
+   * if the file cannot be read or parsed.
+   */
+  static compiled_config load_or_compile(std::string const & source,
+      std::string const & snapshot_path);
+
+  /**
+   * Parse a configuration file without its "session" object, e.g. to carry
+   * on without sessions once they turned out to be invalid. Raises
+   * std::runtime_error if the file cannot be read or parsed, or does not
+   * hold an object.
+   */
+  static nlohmann::json load_document(std::string const & source);
+
+private:
+  struct header;
+
+  static bool write(std::string const & path, std::uint64_t source_mtime,
+      std::uint64_t source_size, compiled_config const & config);
+
+  static std::optional<compiled_config> parse(header const & hdr,
+      std::uint8_t const * payload);
+};
+
+} // namespace linkmanager::config
+
+#endif // guard
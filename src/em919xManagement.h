@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "Em919xManagementClassHelper.h"
+#include "config/session_table.h"
 
 char s_DevicePath[256];
 char s_InterfaceName[256];
@@ -8,71 +9,42 @@ char s_SimPin[16];
 
 MbimTransport s_Transport;
 
-bool configure_link(nlohmann::json const & config)
+/**
+ * Sessions of the configuration, as set by configure_link().
+ */
+linkmanager::config::session_table s_Sessions;
+
+bool configure_link(linkmanager::config::session_table const & sessions)
 {
 	/**
 	 * pSession is actualy new link object
 	 */
 
-	if (config.contains("modulePath")) {
-		auto tmpStr= config.at("modulePath").dump();
-		std::copy(tmpStr.begin(), tmpStr.end(), s_DevicePath);
-		std::cout << "Device path: " << s_DevicePath << "\n";
-	} else {
+	s_Sessions = sessions;
+
+	auto modulePath = s_Sessions.module_path();
+	if (modulePath.empty()) {
 		std::cout << "ERROR: Missing device (module) path!" << "\n";
-		return 0;
+		return false;
 	}
+	if (modulePath.size() >= sizeof(s_DevicePath)) {
+		std::cout << "ERROR: Device (module) path is too long!" << "\n";
+		return false;
+	}
+	*std::copy(modulePath.begin(), modulePath.end(), s_DevicePath) = '\0';
+	std::cout << "Device path: " << s_DevicePath << "\n";
 
-	if (config.contains("session")) {
-		for (auto& [key_master, _] : config["session"].items()) {
-//			  std::cout << key_master << "\n";
-//			  std::cout << "\n";
-			// Session data
-			ConfigFileSettings tmpConfiguration;
-
-			for (auto [key, value] : config["session"][key_master].items()) {
+	auto interfaceName = s_Sessions.interface_name();
+	*std::copy(interfaceName.begin(), interfaceName.end(), s_InterfaceName) = '\0';
 
-				if (!key.compare("sessionId")) {
-					tmpConfiguration.sessionId = value;
-					std::cout << tmpConfiguration.sessionId << "\n";
-				} else if (!key.compare("userName")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szUserName);
-					std::cout << tmpConfiguration.szUserName << "\n";
-				} else if (!key.compare("password")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szPassword);
-					std::cout << tmpConfiguration.szPassword << "\n";
-				} else if (!key.compare("accessString")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szAccessString);
-					std::cout << tmpConfiguration.szAccessString << "\n";
-				} else if (!key.compare("compression")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szCompressionType);
-					std::cout << tmpConfiguration.szCompressionType << "\n";
-				} else if (!key.compare("authProtocol")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szAuthProtocolType);
-					std::cout << tmpConfiguration.szAuthProtocolType << "\n";
-				} else if (!key.compare("ipType")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szIpType);
-					std::cout << tmpConfiguration.szIpType << "\n";
-				} else if (!key.compare("useVlan")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szUseVlan);
-					std::cout << tmpConfiguration.szUseVlan << "\n";
-				} else if (!key.compare("vlanName")) {
-					auto tmpStr = value.dump();
-					std::copy(tmpStr.begin(), tmpStr.end(), tmpConfiguration.szVlanName);
-					std::cout << tmpConfiguration.szVlanName << "\n";
-				}
-			}
-		}
-	} else {
+	if (s_Sessions.empty()) {
 		std::cout << "ERROR: Session(s) missing!" << "\n";
-		return 0;
+		return false;
+	}
+	for (std::size_t row = 0 ; row < s_Sessions.size() ; ++row) {
+		std::cout << "Session " << s_Sessions.name(row) << ": ID "
+			<< s_Sessions.session_id(row) << ", APN " << s_Sessions.access_string(row)
+			<< ", " << MBIMContextIPTypeToString(s_Sessions.ip_type(row)) << "\n";
 	}
-	return 0;
-}
\ No newline at end of file
+	return true;
+}
@@ -0,0 +1,338 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimCapture.c
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "MbimCapture.h"
+#include "MbimLogging.h"
+
+#define PCAPNG_SECTION_HEADER_BLOCK     0x0A0D0D0A
+#define PCAPNG_INTERFACE_DESCRIPTION_BLOCK 1
+#define PCAPNG_ENHANCED_PACKET_BLOCK    6
+#define PCAPNG_BYTE_ORDER_MAGIC         0x1A2B3C4D
+#define PCAPNG_OPTION_IF_TSRESOL        9
+
+#define LINKTYPE_USB_LINUX_MMAPPED      220
+
+// USB CDC class requests carrying MBIM control messages.
+#define USB_CDC_SEND_ENCAPSULATED_COMMAND   0x00
+#define USB_CDC_GET_ENCAPSULATED_RESPONSE   0x01
+
+struct MbimCaptureSlot
+{
+    uint64_t sequence;          // 2 * sequence + 1 while being written, + 2 once written.
+    uint64_t timestamp;         // Nanoseconds since the epoch.
+    uint32_t length;            // Length of the fragment.
+    uint32_t captured;          // Bytes of it in data.
+    uint8_t device;
+    uint8_t direction;
+    uint8_t reserved[6];
+    uint8_t data[];
+};
+
+// The pseudo-header of LINKTYPE_USB_LINUX_MMAPPED, in host byte order.
+struct UsbmonPacket
+{
+    uint64_t id;
+    uint8_t type;               // 'S'ubmission or 'C'ompletion.
+    uint8_t xferType;
+    uint8_t epnum;
+    uint8_t devnum;
+    uint16_t busnum;
+    int8_t flagSetup;
+    int8_t flagData;
+    int64_t tsSec;
+    int32_t tsUsec;
+    int32_t status;
+    uint32_t length;
+    uint32_t lenCap;
+    uint8_t setup[8];
+    int32_t interval;
+    int32_t startFrame;
+    uint32_t xferFlags;
+    uint32_t ndesc;
+};
+
+_Static_assert(sizeof(struct UsbmonPacket) == 64, "usbmon header must be 64 bytes");
+
+static uint32_t RoundUp(uint32_t value, uint32_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static struct MbimCaptureSlot* SlotOf(MbimCapture* pThis, uint64_t sequence)
+{
+    return (struct MbimCaptureSlot*)(pThis->pRing +
+        (size_t)(sequence & (pThis->slotCount - 1)) * pThis->slotSize);
+}
+
+/*
+ * Copy a recorded fragment out of the ring. Fails if the slot does not
+ * hold the fragment, or it was overwritten while being copied.
+ */
+static bool ReadSlot(MbimCapture* pThis, uint64_t sequence, struct MbimCaptureSlot* pCopy)
+{
+    struct MbimCaptureSlot* pSlot = SlotOf(pThis, sequence);
+
+    if (__atomic_load_n(&pSlot->sequence, __ATOMIC_ACQUIRE) != 2 * sequence + 2)
+    {
+        return false;
+    }
+    memcpy(pCopy, pSlot, pThis->slotSize);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&pSlot->sequence, __ATOMIC_RELAXED) == 2 * sequence + 2 &&
+        pCopy->captured <= pThis->snapLength;
+}
+
+static bool WriteBlock(FILE* pFile, uint32_t type, const void* pBody, uint32_t bodyLength,
+    const uint8_t* pData, uint32_t dataLength)
+{
+    static const uint8_t padding[4];
+    uint32_t totalLength = 12 + bodyLength + RoundUp(dataLength, 4);
+
+    return fwrite(&type, sizeof(type), 1, pFile) == 1 &&
+        fwrite(&totalLength, sizeof(totalLength), 1, pFile) == 1 &&
+        fwrite(pBody, bodyLength, 1, pFile) == 1 &&
+        (dataLength == 0 || fwrite(pData, dataLength, 1, pFile) == 1) &&
+        (dataLength % 4 == 0 || fwrite(padding, 4 - dataLength % 4, 1, pFile) == 1) &&
+        fwrite(&totalLength, sizeof(totalLength), 1, pFile) == 1;
+}
+
+static bool WriteHeaders(MbimCapture* pThis, FILE* pFile)
+{
+    struct
+    {
+        uint32_t byteOrderMagic;
+        uint16_t majorVersion;
+        uint16_t minorVersion;
+        int64_t sectionLength;
+    } __attribute__((packed)) section = { PCAPNG_BYTE_ORDER_MAGIC, 1, 0, -1 };
+    struct
+    {
+        uint16_t linkType;
+        uint16_t reserved;
+        uint32_t snapLength;
+        uint16_t tsresolCode;
+        uint16_t tsresolLength;
+        uint8_t tsresol;        // Nanoseconds.
+        uint8_t tsresolPadding[3];
+        uint32_t endOfOptions;
+    } interface = {
+        LINKTYPE_USB_LINUX_MMAPPED, 0, sizeof(struct UsbmonPacket) + pThis->snapLength,
+        PCAPNG_OPTION_IF_TSRESOL, 1, 9, { 0 }, 0
+    };
+
+    return WriteBlock(pFile, PCAPNG_SECTION_HEADER_BLOCK, &section, sizeof(section), NULL, 0) &&
+        WriteBlock(pFile, PCAPNG_INTERFACE_DESCRIPTION_BLOCK, &interface, sizeof(interface), NULL, 0);
+}
+
+static bool WritePacket(FILE* pFile, uint64_t timestamp, const struct UsbmonPacket* pUsb,
+    const uint8_t* pData)
+{
+    struct
+    {
+        uint32_t interfaceId;
+        uint32_t timestampHigh;
+        uint32_t timestampLow;
+        uint32_t capturedLength;
+        uint32_t originalLength;
+        struct UsbmonPacket usb;
+    } __attribute__((packed)) packet;
+
+    packet.interfaceId = 0;
+    packet.timestampHigh = (uint32_t)(timestamp >> 32);
+    packet.timestampLow = (uint32_t)timestamp;
+    packet.capturedLength = sizeof(packet.usb) + pUsb->lenCap;
+    packet.originalLength = sizeof(packet.usb) + pUsb->length;
+    packet.usb = *pUsb;
+
+    return WriteBlock(pFile, PCAPNG_ENHANCED_PACKET_BLOCK, &packet, sizeof(packet),
+        pData, pUsb->lenCap);
+}
+
+/*
+ * Write a fragment as the control transfer carrying it: the submission of a
+ * SEND_ENCAPSULATED_COMMAND with the fragment as its data, or the
+ * submission of a GET_ENCAPSULATED_RESPONSE and its completion with the
+ * fragment.
+ */
+static bool WriteFragment(FILE* pFile, uint64_t sequence, const struct MbimCaptureSlot* pSlot)
+{
+    struct UsbmonPacket usb;
+    bool sent = pSlot->direction == MBIM_CAPTURE_SENT;
+
+    memset(&usb, 0, sizeof(usb));
+    usb.id = sequence;
+    usb.type = 'S';
+    usb.xferType = 2;   // Control.
+    usb.epnum = 0;
+    usb.devnum = pSlot->device;
+    usb.busnum = 1;
+    usb.flagSetup = 0;
+    usb.flagData = sent ? 0 : '<';
+    usb.tsSec = (int64_t)(pSlot->timestamp / 1000000000);
+    usb.tsUsec = (int32_t)(pSlot->timestamp % 1000000000 / 1000);
+    usb.status = -115;  // -EINPROGRESS, as for any submission.
+    usb.length = pSlot->length;
+    usb.lenCap = sent ? pSlot->captured : 0;
+    usb.setup[0] = sent ? 0x21 : 0xA1;  // Class request to the interface, out or in.
+    usb.setup[1] = sent ? USB_CDC_SEND_ENCAPSULATED_COMMAND : USB_CDC_GET_ENCAPSULATED_RESPONSE;
+    usb.setup[6] = (uint8_t)pSlot->length;
+    usb.setup[7] = (uint8_t)(pSlot->length >> 8);
+
+    if (!WritePacket(pFile, pSlot->timestamp, &usb, pSlot->data))
+    {
+        return false;
+    }
+    if (sent)
+    {
+        return true;
+    }
+
+    usb.type = 'C';
+    usb.epnum = 0x80;
+    usb.flagSetup = '-';
+    usb.flagData = 0;
+    usb.status = 0;
+    usb.lenCap = pSlot->captured;
+    memset(usb.setup, 0, sizeof(usb.setup));
+    return WritePacket(pFile, pSlot->timestamp, &usb, pSlot->data);
+}
+
+int MbimCapture_Initialize(MbimCapture* pThis, uint32_t slotCount, uint32_t snapLength,
+    const char* errorDumpPath)
+{
+    uint32_t count = 1;
+
+    if (slotCount == 0)
+    {
+        slotCount = MBIM_CAPTURE_DEFAULT_SLOTS;
+    }
+    if (snapLength == 0)
+    {
+        snapLength = MBIM_CAPTURE_DEFAULT_SNAPLEN;
+    }
+    if (slotCount > 0x80000000 || snapLength > 0x10000)
+    {
+        litembim_log(LOG_ERR, "%s: invalid capture size %u x %u", __FUNCTION__, slotCount, snapLength);
+        return -1;
+    }
+    while (count < slotCount)
+    {
+        count <<= 1;
+    }
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->slotCount = count;
+    pThis->snapLength = snapLength;
+    pThis->slotSize = sizeof(struct MbimCaptureSlot) + RoundUp(snapLength, 8);
+
+    // Zeroed slots hold no fragment, as no fragment has sequence -1.
+    pThis->pRing = calloc(pThis->slotCount, pThis->slotSize);
+    if (pThis->pRing == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: calloc(%u x %u) failed", __FUNCTION__, pThis->slotCount, pThis->slotSize);
+        return -1;
+    }
+
+    if (errorDumpPath != NULL)
+    {
+        pThis->pErrorDumpPath = strdup(errorDumpPath);
+        if (pThis->pErrorDumpPath == NULL)
+        {
+            litembim_log(LOG_ERR, "%s: strdup failed", __FUNCTION__);
+            MbimCapture_Destroy(pThis);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void MbimCapture_Destroy(MbimCapture* pThis)
+{
+    free(pThis->pRing);
+    pThis->pRing = NULL;
+    free(pThis->pErrorDumpPath);
+    pThis->pErrorDumpPath = NULL;
+}
+
+void MbimCapture_Record(MbimCapture* pThis, uint8_t device, MBIM_CAPTURE_DIRECTION direction,
+    const uint8_t* pFragment, uint32_t length)
+{
+    struct MbimCaptureSlot* pSlot;
+    struct timespec now;
+    uint64_t sequence;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    sequence = __atomic_fetch_add(&pThis->head, 1, __ATOMIC_RELAXED);
+    pSlot = SlotOf(pThis, sequence);
+
+    // Readers check the sequence before and after copying a slot, so they
+    // either see the whole fragment or skip it.
+    __atomic_store_n(&pSlot->sequence, 2 * sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    pSlot->timestamp = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+    pSlot->length = length;
+    pSlot->captured = length < pThis->snapLength ? length : pThis->snapLength;
+    pSlot->device = device;
+    pSlot->direction = (uint8_t)direction;
+    memcpy(pSlot->data, pFragment, pSlot->captured);
+
+    __atomic_store_n(&pSlot->sequence, 2 * sequence + 2, __ATOMIC_RELEASE);
+}
+
+int MbimCapture_Dump(MbimCapture* pThis, const char* path)
+{
+    struct MbimCaptureSlot* pCopy;
+    uint64_t head, sequence;
+    FILE* pFile;
+    int written = 0;
+    bool ok;
+
+    pCopy = malloc(pThis->slotSize);
+    if (pCopy == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: malloc(%u) failed", __FUNCTION__, pThis->slotSize);
+        return -1;
+    }
+
+    pFile = fopen(path, "wb");
+    if (pFile == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: cannot create %s", __FUNCTION__, path);
+        free(pCopy);
+        return -1;
+    }
+
+    head = __atomic_load_n(&pThis->head, __ATOMIC_ACQUIRE);
+    sequence = head > pThis->slotCount ? head - pThis->slotCount : 0;
+
+    ok = WriteHeaders(pThis, pFile);
+    for ( ; ok && sequence < head; ++sequence)
+    {
+        if (ReadSlot(pThis, sequence, pCopy))
+        {
+            ok = WriteFragment(pFile, sequence, pCopy);
+            ++written;
+        }
+    }
+
+    ok = fclose(pFile) == 0 && ok;
+    free(pCopy);
+    if (!ok)
+    {
+        litembim_log(LOG_ERR, "%s: cannot write %s", __FUNCTION__, path);
+        return -1;
+    }
+
+    return written;
+}
@@ -0,0 +1,84 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimSlabPool.c
+ */
+#include <stdlib.h>
+#include "MbimSlabPool.h"
+
+int MbimSlabPool_Initialize(MbimSlabPool* pThis, uint32_t bufferSize, uint32_t bufferCount)
+{
+    uint32_t i;
+
+    pThis->pSlab = NULL;
+    pThis->pFreeList = NULL;
+    pThis->bufferCount = 0;
+    pThis->freeCount = 0;
+
+    if (bufferSize == 0 || bufferCount == 0 ||
+        bufferSize > UINT32_MAX - MBIM_SLAB_POOL_ALIGNMENT)
+    {
+        return -1;
+    }
+    bufferSize = (bufferSize + MBIM_SLAB_POOL_ALIGNMENT - 1) & ~(uint32_t)(MBIM_SLAB_POOL_ALIGNMENT - 1);
+    if ((uint64_t)bufferSize * bufferCount > SIZE_MAX)
+    {
+        return -1;
+    }
+
+    if (posix_memalign((void**)&pThis->pSlab, MBIM_SLAB_POOL_ALIGNMENT, (size_t)bufferSize * bufferCount) != 0)
+    {
+        pThis->pSlab = NULL;
+        return -1;
+    }
+    pThis->pFreeList = malloc(bufferCount * sizeof(uint32_t));
+    if (pThis->pFreeList == NULL)
+    {
+        free(pThis->pSlab);
+        pThis->pSlab = NULL;
+        return -1;
+    }
+
+    // Hand out low indices first.
+    for (i = 0; i < bufferCount; i++)
+    {
+        pThis->pFreeList[i] = bufferCount - 1 - i;
+    }
+    pThis->bufferSize = bufferSize;
+    pThis->bufferCount = bufferCount;
+    pThis->freeCount = bufferCount;
+
+    return 0;
+}
+
+void MbimSlabPool_Destroy(MbimSlabPool* pThis)
+{
+    free(pThis->pSlab);
+    free(pThis->pFreeList);
+    pThis->pSlab = NULL;
+    pThis->pFreeList = NULL;
+    pThis->bufferCount = 0;
+    pThis->freeCount = 0;
+}
+
+uint8_t* MbimSlabPool_Alloc(MbimSlabPool* pThis)
+{
+    if (pThis->freeCount == 0)
+    {
+        return NULL;
+    }
+
+    pThis->freeCount--;
+    return pThis->pSlab + (size_t)pThis->pFreeList[pThis->freeCount] * pThis->bufferSize;
+}
+
+void MbimSlabPool_Free(MbimSlabPool* pThis, uint8_t* pBuffer)
+{
+    if (pBuffer == NULL)
+    {
+        return;
+    }
+
+    pThis->pFreeList[pThis->freeCount] = (uint32_t)((size_t)(pBuffer - pThis->pSlab) / pThis->bufferSize);
+    pThis->freeCount++;
+}
@@ -0,0 +1,99 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimSlabPool.h
+ */
+#ifndef __MBIM_SLAB_POOL_H__
+#define __MBIM_SLAB_POOL_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBIM_SLAB_POOL_ALIGNMENT 64  /**< Buffers start on cache line boundaries. */
+
+/**
+ * \ingroup litembim
+ *
+ *  A fixed number of equally sized buffers, carved out of a single
+ *  allocation made up front. Allocating and freeing a buffer takes constant
+ *  time and never calls into the heap.
+ *
+ *  The pool does no locking of its own.
+ *
+ *  \param  pSlab
+ *          - The allocation all buffers are carved from.
+ *
+ *  \param  bufferSize
+ *          - Size of each buffer in bytes, rounded up to
+ *            MBIM_SLAB_POOL_ALIGNMENT.
+ *
+ *  \param  bufferCount
+ *          - Number of buffers in the pool.
+ *
+ *  \param  pFreeList
+ *          - Stack of indices of free buffers.
+ *
+ *  \param  freeCount
+ *          - Number of free buffers.
+ */
+typedef struct MbimSlabPool
+{
+    uint8_t* pSlab;
+    uint32_t bufferSize;
+    uint32_t bufferCount;
+    uint32_t* pFreeList;
+    uint32_t freeCount;
+} MbimSlabPool;
+
+/**
+ * \ingroup litembim
+ *
+ * Allocate the pool.
+ *
+ * @param[in] pThis        The primary object of this call.
+ * @param[in] bufferSize   Minimum size of each buffer in bytes.
+ * @param[in] bufferCount  Number of buffers.
+ *
+ * @return 0 on success, < 0 on failure.
+ */
+int MbimSlabPool_Initialize(MbimSlabPool* pThis, uint32_t bufferSize, uint32_t bufferCount);
+
+/**
+ * \ingroup litembim
+ *
+ * Free the pool, including buffers still allocated from it.
+ *
+ * @param[in] pThis      The primary object of this call.
+ */
+void MbimSlabPool_Destroy(MbimSlabPool* pThis);
+
+/**
+ * \ingroup litembim
+ *
+ * Take a buffer from the pool.
+ *
+ * @param[in] pThis      The primary object of this call.
+ *
+ * @return A buffer of at least the configured size, or NULL if all buffers
+ *         are in use.
+ */
+uint8_t* MbimSlabPool_Alloc(MbimSlabPool* pThis);
+
+/**
+ * \ingroup litembim
+ *
+ * Return a buffer to the pool.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] pBuffer    Buffer obtained from MbimSlabPool_Alloc.
+ */
+void MbimSlabPool_Free(MbimSlabPool* pThis, uint8_t* pBuffer);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_SLAB_POOL_H__
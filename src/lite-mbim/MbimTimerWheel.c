@@ -0,0 +1,202 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimTimerWheel.c
+ */
+#include <string.h>
+#include "MbimTimerWheel.h"
+
+#define MBIM_TIMER_WHEEL_SLOTS  (1u << MBIM_TIMER_WHEEL_BITS)
+#define MBIM_TIMER_WHEEL_MASK   (MBIM_TIMER_WHEEL_SLOTS - 1)
+#define MBIM_TIMER_WHEEL_RANGE  ((uint64_t)1 << (MBIM_TIMER_WHEEL_BITS * MBIM_TIMER_WHEEL_LEVELS))
+
+static inline uint32_t Shift(uint32_t level)
+{
+    return level * MBIM_TIMER_WHEEL_BITS;
+}
+
+static void Link(MbimTimerWheel* pThis, MbimTransaction* pTransaction, uint32_t bucket)
+{
+    pTransaction->timerBucket = bucket;
+    pTransaction->pPrev = NULL;
+    pTransaction->pNext = pThis->pBuckets[bucket];
+    if (pTransaction->pNext != NULL)
+    {
+        pTransaction->pNext->pPrev = pTransaction;
+    }
+    pThis->pBuckets[bucket] = pTransaction;
+    pThis->occupied[bucket >> MBIM_TIMER_WHEEL_BITS] |= (uint64_t)1 << (bucket & MBIM_TIMER_WHEEL_MASK);
+}
+
+/*
+ * Put a transaction in the bucket for its deadline, but no earlier than
+ * `earliest`, which must not be before the wheel's time.
+ */
+static void Place(MbimTimerWheel* pThis, MbimTransaction* pTransaction, uint64_t earliest)
+{
+    uint64_t deadline = pTransaction->deadline > earliest ? pTransaction->deadline : earliest;
+    uint64_t delta;
+    uint32_t level = 0;
+
+    if (deadline - pThis->now >= MBIM_TIMER_WHEEL_RANGE)
+    {
+        deadline = pThis->now + MBIM_TIMER_WHEEL_RANGE - 1;
+    }
+    delta = deadline - pThis->now;
+    while (level < MBIM_TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << Shift(level + 1)))
+    {
+        level++;
+    }
+
+    Link(pThis, pTransaction,
+        (level << MBIM_TIMER_WHEEL_BITS) | ((uint32_t)(deadline >> Shift(level)) & MBIM_TIMER_WHEEL_MASK));
+}
+
+/*
+ * Empty a bucket, returning its list.
+ */
+static MbimTransaction* Take(MbimTimerWheel* pThis, uint32_t level, uint32_t slot)
+{
+    uint32_t bucket = (level << MBIM_TIMER_WHEEL_BITS) | slot;
+    MbimTransaction* pList = pThis->pBuckets[bucket];
+
+    pThis->pBuckets[bucket] = NULL;
+    pThis->occupied[level] &= ~((uint64_t)1 << slot);
+    return pList;
+}
+
+/*
+ * Move the transactions of a bucket down to the levels below, now that the
+ * wheel has reached its span.
+ */
+static void Cascade(MbimTimerWheel* pThis, uint32_t level)
+{
+    MbimTransaction* pTransaction;
+    MbimTransaction* pNext;
+
+    pTransaction = Take(pThis, level, (uint32_t)(pThis->now >> Shift(level)) & MBIM_TIMER_WHEEL_MASK);
+    for ( ; pTransaction != NULL; pTransaction = pNext)
+    {
+        pNext = pTransaction->pNext;
+        Place(pThis, pTransaction, pThis->now);
+    }
+}
+
+void MbimTimerWheel_Initialize(MbimTimerWheel* pThis, uint64_t now)
+{
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->now = now;
+}
+
+void MbimTimerWheel_Add(MbimTimerWheel* pThis, MbimTransaction* pTransaction)
+{
+    // The bucket for the wheel's current time has already been expired.
+    Place(pThis, pTransaction, pThis->now + 1);
+    pThis->count++;
+}
+
+void MbimTimerWheel_Remove(MbimTimerWheel* pThis, MbimTransaction* pTransaction)
+{
+    uint32_t bucket = pTransaction->timerBucket;
+
+    if (pTransaction->pPrev != NULL)
+    {
+        pTransaction->pPrev->pNext = pTransaction->pNext;
+    }
+    else
+    {
+        pThis->pBuckets[bucket] = pTransaction->pNext;
+    }
+    if (pTransaction->pNext != NULL)
+    {
+        pTransaction->pNext->pPrev = pTransaction->pPrev;
+    }
+    if (pThis->pBuckets[bucket] == NULL)
+    {
+        pThis->occupied[bucket >> MBIM_TIMER_WHEEL_BITS] &= ~((uint64_t)1 << (bucket & MBIM_TIMER_WHEEL_MASK));
+    }
+    pTransaction->pPrev = NULL;
+    pTransaction->pNext = NULL;
+    pThis->count--;
+}
+
+MbimTransaction* MbimTimerWheel_Advance(MbimTimerWheel* pThis, uint64_t now)
+{
+    MbimTransaction* pExpired = NULL;
+    MbimTransaction* pTransaction;
+    MbimTransaction* pNext;
+    uint64_t next;
+    uint32_t level;
+
+    while (pThis->now < now)
+    {
+        if (pThis->count == 0)
+        {
+            pThis->now = now;
+            break;
+        }
+
+        // Skip to the next time a bucket is due: while the lower levels are
+        // empty, only the start of a bucket of the lowest occupied level is.
+        for (level = 0; level < MBIM_TIMER_WHEEL_LEVELS - 1 && pThis->occupied[level] == 0; level++)
+        {
+        }
+        next = (pThis->now | (((uint64_t)1 << Shift(level)) - 1)) + 1;
+        if (next > now)
+        {
+            pThis->now = now;
+            break;
+        }
+        pThis->now = next;
+
+        for (level = 1; level < MBIM_TIMER_WHEEL_LEVELS &&
+            (next & (((uint64_t)1 << Shift(level)) - 1)) == 0; level++)
+        {
+            Cascade(pThis, level);
+        }
+
+        pTransaction = Take(pThis, 0, (uint32_t)next & MBIM_TIMER_WHEEL_MASK);
+        for ( ; pTransaction != NULL; pTransaction = pNext)
+        {
+            pNext = pTransaction->pNext;
+            pTransaction->pPrev = NULL;
+            pTransaction->pNext = pExpired;
+            pExpired = pTransaction;
+            pThis->count--;
+        }
+    }
+
+    return pExpired;
+}
+
+uint64_t MbimTimerWheel_NextExpiry(const MbimTimerWheel* pThis)
+{
+    uint64_t earliest = UINT64_MAX;
+    uint64_t occupied, rotated, due;
+    uint32_t level, start;
+
+    if (pThis->count == 0)
+    {
+        return UINT64_MAX;
+    }
+
+    for (level = 0; level < MBIM_TIMER_WHEEL_LEVELS; level++)
+    {
+        occupied = pThis->occupied[level];
+        if (occupied == 0)
+        {
+            continue;
+        }
+
+        // Buckets after the current one come first, the current one last.
+        start = ((uint32_t)(pThis->now >> Shift(level)) + 1) & MBIM_TIMER_WHEEL_MASK;
+        rotated = start == 0 ? occupied : (occupied >> start) | (occupied << (MBIM_TIMER_WHEEL_SLOTS - start));
+        due = ((pThis->now >> Shift(level)) + 1 + (uint64_t)__builtin_ctzll(rotated)) << Shift(level);
+        if (due < earliest)
+        {
+            earliest = due;
+        }
+    }
+
+    return earliest;
+}
@@ -0,0 +1,119 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimTimerWheel.h
+ */
+#ifndef __MBIM_TIMER_WHEEL_H__
+#define __MBIM_TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include "MbimTransaction.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBIM_TIMER_WHEEL_BITS   6   /**< log2 of the buckets per level. */
+#define MBIM_TIMER_WHEEL_LEVELS 4   /**< Levels; deadlines up to 2^24 ms (4.6 hours) ahead are exact. */
+#define MBIM_TIMER_WHEEL_BUCKETS (MBIM_TIMER_WHEEL_LEVELS << MBIM_TIMER_WHEEL_BITS)
+
+/**
+ * \ingroup litembim
+ *
+ *  Deadlines of outstanding transactions, with a resolution of one
+ *  millisecond.
+ *
+ *  This is a hierarchical timing wheel. Level 0 has a bucket for each of
+ *  the next 64 milliseconds; each further level has 64 buckets, each
+ *  spanning all of the level below. A transaction is put in the bucket of
+ *  the lowest level its deadline fits in, and moves down a level each time
+ *  the wheel reaches the start of its bucket, so adding and removing a
+ *  transaction take constant time, as does expiring one. Deadlines further
+ *  ahead than the top level reaches are parked in its last bucket, and
+ *  placed again when it is reached.
+ *
+ *  Transactions are linked into their bucket through pPrev and pNext, so
+ *  they must not be in any other list meanwhile. The wheel does no locking
+ *  of its own.
+ *
+ *  \param  pBuckets
+ *          - Head of each bucket's list, MBIM_TIMER_WHEEL_BUCKETS entries,
+ *            level by level.
+ *
+ *  \param  occupied
+ *          - For each level, a bit per non-empty bucket.
+ *
+ *  \param  now
+ *          - Time the wheel has been advanced to, in milliseconds.
+ *
+ *  \param  count
+ *          - Number of transactions in the wheel.
+ */
+typedef struct MbimTimerWheel
+{
+    MbimTransaction* pBuckets[MBIM_TIMER_WHEEL_BUCKETS];
+    uint64_t occupied[MBIM_TIMER_WHEEL_LEVELS];
+    uint64_t now;
+    uint32_t count;
+} MbimTimerWheel;
+
+/**
+ * \ingroup litembim
+ *
+ * Initialize an empty wheel.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] now        Current time, in milliseconds.
+ */
+void MbimTimerWheel_Initialize(MbimTimerWheel* pThis, uint64_t now);
+
+/**
+ * \ingroup litembim
+ *
+ * Add a transaction, to expire at its deadline. A deadline already past
+ * expires on the next advance.
+ *
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] pTransaction  Transaction with a non-zero deadline.
+ */
+void MbimTimerWheel_Add(MbimTimerWheel* pThis, MbimTransaction* pTransaction);
+
+/**
+ * \ingroup litembim
+ *
+ * Remove a transaction before it expires.
+ *
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] pTransaction  Transaction in the wheel.
+ */
+void MbimTimerWheel_Remove(MbimTimerWheel* pThis, MbimTransaction* pTransaction);
+
+/**
+ * \ingroup litembim
+ *
+ * Advance the wheel, removing the transactions whose deadline has passed.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] now        Current time, in milliseconds.
+ *
+ * @return The expired transactions, linked through pNext, or NULL.
+ */
+MbimTransaction* MbimTimerWheel_Advance(MbimTimerWheel* pThis, uint64_t now);
+
+/**
+ * \ingroup litembim
+ *
+ * Time by which the wheel must next be advanced. This is the earliest
+ * deadline, or earlier, when transactions are due to move down a level.
+ *
+ * @param[in] pThis      The primary object of this call.
+ *
+ * @return A time in milliseconds, or UINT64_MAX if the wheel is empty.
+ */
+uint64_t MbimTimerWheel_NextExpiry(const MbimTimerWheel* pThis);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_TIMER_WHEEL_H__
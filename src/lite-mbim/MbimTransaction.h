@@ -24,7 +24,8 @@ extern "C" {
  * 
  * @param[in] transactionId Transaction ID of associated MBIM transaction.
  * 
- * @param[in] informationBuffer Transaction response's informationBuffer.
+ * @param[in] informationBuffer Transaction response's informationBuffer. This points into the
+ *                              transport's receive buffers, and is only valid during the callback.
  *
  * @param[in] informationBufferLength Number of bytes in transaction response's informationBuffer.
  *
@@ -68,6 +69,15 @@ typedef void (*MBIM_DONE_CALLBACK)(
  *  \param  status
  *          - MBIM status of response, typically contained in 
  *            first response fragment.
+ *
+ *  \param  deadline
+ *          - Time by which the transaction expires, in milliseconds of
+ *            CLOCK_MONOTONIC, or 0 if it never does. Set by the transport.
+ *
+ *  \param  timerBucket
+ *          - Bucket of the transport's timer wheel the transaction is in,
+ *            while it has a deadline. The transaction is linked into the
+ *            bucket through pPrev and pNext.
  */
 typedef struct MbimTransaction  
 {
@@ -80,6 +90,8 @@ typedef struct MbimTransaction
 
     uint32_t status; 
 
+    uint64_t deadline;
+    uint32_t timerBucket;
 } MbimTransaction;
 
 
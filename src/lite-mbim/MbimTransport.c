@@ -0,0 +1,1577 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimTransport.c
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#ifndef EVENT_FD_UNSUPPORTED
+#include <sys/eventfd.h>
+#endif
+
+#include "MbimTransport.h"
+#include "MbimSyncObject.h"
+#include "MbimLogging.h"
+#include "MbimInternal.h"
+
+#define MBIM_DEFAULT_TIMEOUT 5  /**< Seconds to wait for MBIM_OPEN_DONE and MBIM_CLOSE_DONE. */
+
+// The transport whose dispatchLock the calling thread holds while running
+// done callbacks and indicators, if any.
+static __thread MbimTransport* tDispatching;
+
+// From linux/usb/cdc-wdm.h: the device's wMaxControlMessage.
+#ifndef IOCTL_WDM_MAX_COMMAND
+#define IOCTL_WDM_MAX_COMMAND _IOR('H', 0xA0, uint16_t)
+#endif
+
+/**
+ * State of a multi-fragment command response or indication being assembled.
+ * The information buffer comes from the transport's reassembly pool, and is
+ * handed to the done callback or indicators in place once complete.
+ *
+ * Devices may interleave fragments of different messages (typically an
+ * indication arriving while a response is being sent), so several messages
+ * can be assembled at once; they are told apart by message type and
+ * transaction ID.
+ */
+struct MultiFragmentMessage
+{
+    uint32_t messageType;       // MBIM_COMMAND_DONE_MSG_TYPE or MBIM_INDICATE_STATUS_MSG_TYPE; 0 if idle.
+    uint32_t transactionId;
+    uint8_t deviceServiceId[MBIM_UUID_SIZE];
+    uint32_t cid;
+    uint32_t status;
+    uint32_t expectedTotalFragments;
+    uint32_t expectedInformationBufferLength;
+    uint32_t expectedFragment;
+    uint32_t received;          // Information bytes received so far.
+    uint32_t sequence;          // Age, for choosing a message to abandon.
+    uint8_t* informationBuffer; // From the reassembly pool.
+};
+
+static int AllocateBuffers(MbimTransport* pThis, uint32_t maxIncomingInformationLength)
+{
+    pThis->pIncomingMessages = calloc(MBIM_REASSEMBLY_BUFFERS, sizeof(struct MultiFragmentMessage));
+    if (pThis->pIncomingMessages == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: calloc(MultiFragmentMessage) failed", __FUNCTION__);
+        return -1;
+    }
+
+    if (MbimSlabPool_Initialize(&pThis->reassemblyPool, maxIncomingInformationLength,
+            MBIM_REASSEMBLY_BUFFERS) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot allocate %d reassembly buffers of %u bytes", __FUNCTION__,
+            MBIM_REASSEMBLY_BUFFERS, maxIncomingInformationLength);
+        free(pThis->pIncomingMessages);
+        pThis->pIncomingMessages = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void FreeBuffers(MbimTransport* pThis)
+{
+    if (pThis->pIncomingMessages != NULL)
+    {
+        MbimSlabPool_Destroy(&pThis->reassemblyPool);
+        free(pThis->pIncomingMessages);
+        pThis->pIncomingMessages = NULL;
+    }
+    free(pThis->pFrame);
+    free(pThis->pReadBuffer);
+    pThis->pFrame = NULL;
+    pThis->pReadBuffer = NULL;
+}
+
+static void ResetIncomingMessage(MbimTransport* pThis, struct MultiFragmentMessage* pMessage)
+{
+    MbimSlabPool_Free(&pThis->reassemblyPool, pMessage->informationBuffer);
+    pMessage->informationBuffer = NULL;
+    pMessage->messageType = 0;
+    pMessage->transactionId = 0;
+}
+
+static struct MultiFragmentMessage* FindIncomingMessage(MbimTransport* pThis, uint32_t messageType,
+    uint32_t transactionId)
+{
+    uint32_t i;
+
+    for (i = 0; i < MBIM_REASSEMBLY_BUFFERS; i++)
+    {
+        struct MultiFragmentMessage* pMessage = &pThis->pIncomingMessages[i];
+        if (pMessage->messageType == messageType && pMessage->transactionId == transactionId)
+        {
+            return pMessage;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Ask the cdc-wdm driver for the largest control message the device
+ * supports. Other devices (e.g. a pty) get the default.
+ */
+static uint32_t QueryMaxControlTransfer(int fd)
+{
+    uint16_t maxCommand = 0;
+
+    if (ioctl(fd, IOCTL_WDM_MAX_COMMAND, &maxCommand) < 0)
+    {
+        litembim_log(LOG_DEBUG, "%s: not a cdc-wdm device, using %d bytes", __FUNCTION__,
+            MBIM_MAX_CTRL_TRANSFER);
+        return MBIM_MAX_CTRL_TRANSFER;
+    }
+    if (maxCommand < MBIM_MIN_CTRL_TRANSFER)
+    {
+        litembim_log(LOG_ERR, "%s: driver reports %u bytes, using %d bytes", __FUNCTION__,
+            maxCommand, MBIM_MAX_CTRL_TRANSFER);
+        return MBIM_MAX_CTRL_TRANSFER;
+    }
+
+    return maxCommand;
+}
+
+static const char* MessageTypeToString(uint32_t type)
+{
+    switch (type)
+    {
+        case MBIM_OPEN_MSG_TYPE:            return "MBIM_OPEN";
+        case MBIM_CLOSE_MSG_TYPE:           return "MBIM_CLOSE";
+        case MBIM_COMMAND_MSG_TYPE:         return "MBIM_COMMAND";
+        case MBIM_HOST_ERROR_MSG_TYPE:      return "MBIM_HOST_ERROR";
+        case MBIM_OPEN_DONE_MSG_TYPE:       return "MBIM_OPEN_DONE";
+        case MBIM_CLOSE_DONE_MSG_TYPE:      return "MBIM_CLOSE_DONE";
+        case MBIM_COMMAND_DONE_MSG_TYPE:    return "MBIM_COMMAND_DONE";
+        case MBIM_FUNCTION_ERROR_MSG_TYPE:  return "MBIM_FUNCTION_ERROR";
+        case MBIM_INDICATE_STATUS_MSG_TYPE: return "MBIM_INDICATE_STATUS";
+        default:                            return "Unknown";
+    }
+}
+
+static void LogMessageHeader(const MBIM_MESSAGE_HEADER* pHeader, bool sending)
+{
+    litembim_log(LOG_DEBUG, "%s MessageType=%s MessageLength=%d TransactionId=%d",
+        sending ? "-> MBIM" : "<- MBIM",
+        MessageTypeToString(pHeader->MessageType),
+        pHeader->MessageLength,
+        pHeader->TransactionId);
+}
+
+static void NotifyError(MbimTransport* pThis, MBIM_TRANSPORT_ERR_TYPE errType, int errnoVal)
+{
+    MBIM_TRANSPORT_ERR_INFO err_info;
+    MbimCapture* pCapture = __atomic_load_n(&pThis->pCapture, __ATOMIC_ACQUIRE);
+
+    if (pCapture != NULL && pCapture->pErrorDumpPath != NULL)
+    {
+        MbimCapture_Dump(pCapture, pCapture->pErrorDumpPath);
+    }
+
+    if (pThis->pErrCallback == NULL)
+    {
+        return;
+    }
+
+    err_info.err_type = errType;
+    err_info.errno_val = errnoVal;
+    pThis->pErrCallback(pThis->pErrCallbackContext, err_info);
+}
+
+/*
+ * Write one MBIM message, which must fit in a single control transfer.
+ * Must be called with writeLock held.
+ */
+static int WriteMessage(MbimTransport* pThis, const uint8_t* pMessage, size_t messageLength)
+{
+    MbimCapture* pCapture = __atomic_load_n(&pThis->pCapture, __ATOMIC_ACQUIRE);
+    ssize_t ret;
+
+    if (pCapture != NULL)
+    {
+        MbimCapture_Record(pCapture, pThis->captureDevice, MBIM_CAPTURE_SENT,
+            pMessage, (uint32_t)messageLength);
+    }
+
+    do
+    {
+        ret = write(pThis->deviceFd, pMessage, messageLength);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret != (ssize_t)messageLength)
+    {
+        litembim_log(LOG_ERR, "%s: write failed, ret: %d, errno: %d", __FUNCTION__, (int)ret, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint64_t NowMs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/*
+ * Arm the timer to go off at a time in milliseconds, or disarm it for
+ * UINT64_MAX. Must be called with transactionTableLock held.
+ */
+static void SetTimer(MbimTransport* pThis, uint64_t when)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    if (when != UINT64_MAX)
+    {
+        spec.it_value.tv_sec = (time_t)(when / 1000);
+        spec.it_value.tv_nsec = (long)(when % 1000) * 1000000;
+    }
+    if (timerfd_settime(pThis->timerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: timerfd_settime failed, errno: %d", __FUNCTION__, errno);
+    }
+    pThis->timerArmed = when;
+}
+
+static int AddTransaction(MbimTransport* pThis, MbimTransaction* pTransaction)
+{
+    int ret;
+
+    pthread_mutex_lock(&pThis->transactionTableLock);
+    ret = MbimTransactionTable_Insert(&pThis->transactionTable, pTransaction);
+    if (ret == 0 && pTransaction->deadline != 0)
+    {
+        MbimTimerWheel_Add(&pThis->timerWheel, pTransaction);
+        // Deadlines mostly come in order, so the timer rarely needs to be
+        // brought forward.
+        if (pTransaction->deadline < pThis->timerArmed)
+        {
+            SetTimer(pThis, pTransaction->deadline);
+        }
+    }
+    pthread_mutex_unlock(&pThis->transactionTableLock);
+
+    if (ret < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot track transaction %u, %u outstanding",
+            __FUNCTION__, pTransaction->transactionId, pThis->transactionTable.count);
+    }
+
+    return ret;
+}
+
+static MbimTransaction* RemoveTransaction(MbimTransport* pThis, uint32_t transactionId)
+{
+    MbimTransaction* pTransaction;
+
+    pthread_mutex_lock(&pThis->transactionTableLock);
+    pTransaction = MbimTransactionTable_Remove(&pThis->transactionTable, transactionId);
+    if (pTransaction != NULL && pTransaction->deadline != 0)
+    {
+        MbimTimerWheel_Remove(&pThis->timerWheel, pTransaction);
+    }
+    pthread_mutex_unlock(&pThis->transactionTableLock);
+
+    return pTransaction;
+}
+
+static MbimTransaction* FindTransaction(MbimTransport* pThis, uint32_t transactionId)
+{
+    MbimTransaction* pTransaction;
+
+    pthread_mutex_lock(&pThis->transactionTableLock);
+    pTransaction = MbimTransactionTable_Find(&pThis->transactionTable, transactionId);
+    pthread_mutex_unlock(&pThis->transactionTableLock);
+
+    return pTransaction;
+}
+
+/*
+ * Remove a transaction and invoke its done callback. Called on the read
+ * thread with dispatchLock held. Returns false if the transaction is no
+ * longer outstanding.
+ */
+static bool CompleteTransaction(
+    MbimTransport* pThis,
+    uint32_t transactionId,
+    uint32_t status,
+    uint8_t* informationBuffer,
+    uint32_t informationBufferLength)
+{
+    MbimTransaction* pTransaction = RemoveTransaction(pThis, transactionId);
+    if (pTransaction == NULL)
+    {
+        return false;
+    }
+
+    pTransaction->status = status;
+    if (pTransaction->pDoneCallback != NULL)
+    {
+        pTransaction->pDoneCallback(status, transactionId, informationBuffer, informationBufferLength,
+            pTransaction->pDoneCallbackContext);
+    }
+
+    return true;
+}
+
+/*
+ * Complete the transactions whose deadline has passed with
+ * MBIM_STATUS_CUSTOM_TIMEOUT, and arm the timer for the next.
+ */
+static void ExpireTransactions(MbimTransport* pThis)
+{
+    MbimTransaction* pTransaction;
+    MbimTransaction* pNext;
+    MbimTransaction* pExpired;
+    uint64_t expirations;
+
+    if (read(pThis->timerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+    {
+        litembim_log(LOG_ERR, "%s: cannot read timer, errno: %d", __FUNCTION__, errno);
+    }
+
+    pthread_mutex_lock(&pThis->dispatchLock);
+    tDispatching = pThis;
+
+    pthread_mutex_lock(&pThis->transactionTableLock);
+    pExpired = MbimTimerWheel_Advance(&pThis->timerWheel, NowMs());
+    for (pTransaction = pExpired; pTransaction != NULL; pTransaction = pTransaction->pNext)
+    {
+        MbimTransactionTable_Remove(&pThis->transactionTable, pTransaction->transactionId);
+        pTransaction->deadline = 0;
+    }
+    SetTimer(pThis, MbimTimerWheel_NextExpiry(&pThis->timerWheel));
+    pthread_mutex_unlock(&pThis->transactionTableLock);
+
+    // The callbacks may free the transactions.
+    for (pTransaction = pExpired; pTransaction != NULL; pTransaction = pNext)
+    {
+        pNext = pTransaction->pNext;
+        litembim_log(LOG_ERR, "%s: transaction %u timed out", __FUNCTION__, pTransaction->transactionId);
+        pTransaction->status = MBIM_STATUS_CUSTOM_TIMEOUT;
+        if (pTransaction->pDoneCallback != NULL)
+        {
+            pTransaction->pDoneCallback(MBIM_STATUS_CUSTOM_TIMEOUT, pTransaction->transactionId,
+                NULL, 0, pTransaction->pDoneCallbackContext);
+        }
+    }
+
+    tDispatching = NULL;
+    pthread_mutex_unlock(&pThis->dispatchLock);
+}
+
+static void DispatchIndication(
+    MbimTransport* pThis,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint8_t* informationBuffer,
+    uint32_t informationBufferLength)
+{
+    MbimIndicator* pIndicator;
+
+    pthread_mutex_lock(&pThis->indicatorListLock);
+    for (pIndicator = pThis->indicatorList; pIndicator != NULL; pIndicator = pIndicator->pNext)
+    {
+        if (pIndicator->pIndicationCallback != NULL)
+        {
+            pIndicator->pIndicationCallback((uint8_t*)deviceServiceId, cid,
+                informationBuffer, informationBufferLength,
+                pIndicator->pIndicationCallbackContext);
+        }
+    }
+    pthread_mutex_unlock(&pThis->indicatorListLock);
+}
+
+/*
+ * Give up on a message being assembled, failing its transaction.
+ */
+static void AbortIncomingMessage(MbimTransport* pThis, struct MultiFragmentMessage* pMessage)
+{
+    if (pMessage->messageType == MBIM_COMMAND_DONE_MSG_TYPE)
+    {
+        CompleteTransaction(pThis, pMessage->transactionId, MBIM_STATUS_READ_FAILURE, NULL, 0);
+    }
+    ResetIncomingMessage(pThis, pMessage);
+}
+
+/*
+ * Append a fragment's information to a message being assembled, and deliver
+ * it once complete.
+ */
+static void AddFragment(
+    MbimTransport* pThis,
+    struct MultiFragmentMessage* pMessage,
+    const uint8_t* pInformation,
+    uint32_t infoBytesThisFragment)
+{
+    if (infoBytesThisFragment > pMessage->expectedInformationBufferLength - pMessage->received)
+    {
+        litembim_log(LOG_ERR, "%s: failed. Mismatch in informationBufferLength", __FUNCTION__);
+        AbortIncomingMessage(pThis, pMessage);
+        return;
+    }
+
+    memcpy(pMessage->informationBuffer + pMessage->received, pInformation, infoBytesThisFragment);
+    pMessage->received += infoBytesThisFragment;
+    pMessage->expectedFragment++;
+
+    if (pMessage->expectedFragment < pMessage->expectedTotalFragments)
+    {
+        return;
+    }
+
+    if (pMessage->received != pMessage->expectedInformationBufferLength)
+    {
+        litembim_log(LOG_ERR, "%s: failed. Mismatch in informationBufferLength", __FUNCTION__);
+        AbortIncomingMessage(pThis, pMessage);
+        return;
+    }
+
+    if (pMessage->messageType == MBIM_COMMAND_DONE_MSG_TYPE)
+    {
+        CompleteTransaction(pThis, pMessage->transactionId, pMessage->status,
+            pMessage->informationBuffer, pMessage->received);
+    }
+    else
+    {
+        DispatchIndication(pThis, pMessage->deviceServiceId, pMessage->cid,
+            pMessage->informationBuffer, pMessage->received);
+    }
+    ResetIncomingMessage(pThis, pMessage);
+}
+
+/*
+ * Start assembling a multi-fragment command response or indication from its
+ * first fragment. Returns NULL if it cannot be assembled.
+ */
+static struct MultiFragmentMessage* StartMessage(
+    MbimTransport* pThis,
+    uint32_t messageType,
+    uint32_t transactionId,
+    const MBIM_FRAGMENT_HEADER* pFragmentHeader,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint32_t status,
+    uint32_t informationBufferLength)
+{
+    struct MultiFragmentMessage* pMessage = NULL;
+    uint32_t sequence = 0;
+    uint32_t i;
+
+    if (informationBufferLength > pThis->reassemblyPool.bufferSize)
+    {
+        litembim_log(LOG_ERR, "%s: failed. Not enough storage for %u bytes", __FUNCTION__,
+            informationBufferLength);
+        return NULL;
+    }
+
+    pMessage = FindIncomingMessage(pThis, messageType, transactionId);
+    if (pMessage != NULL)
+    {
+        litembim_log(LOG_ERR, "%s: failed. Previous message incomplete", __FUNCTION__);
+        AbortIncomingMessage(pThis, pMessage);
+    }
+
+    // Take an idle slot, or else abandon the oldest message.
+    pMessage = NULL;
+    for (i = 0; i < MBIM_REASSEMBLY_BUFFERS; i++)
+    {
+        struct MultiFragmentMessage* pCandidate = &pThis->pIncomingMessages[i];
+        if (pCandidate->messageType == 0)
+        {
+            pMessage = pCandidate;
+        }
+        else if (pCandidate->sequence >= sequence)
+        {
+            sequence = pCandidate->sequence + 1;
+        }
+    }
+    if (pMessage == NULL)
+    {
+        pMessage = &pThis->pIncomingMessages[0];
+        for (i = 1; i < MBIM_REASSEMBLY_BUFFERS; i++)
+        {
+            if (pThis->pIncomingMessages[i].sequence < pMessage->sequence)
+            {
+                pMessage = &pThis->pIncomingMessages[i];
+            }
+        }
+        litembim_log(LOG_ERR, "%s: too many incomplete messages, dropping transaction %u",
+            __FUNCTION__, pMessage->transactionId);
+        AbortIncomingMessage(pThis, pMessage);
+    }
+
+    pMessage->informationBuffer = MbimSlabPool_Alloc(&pThis->reassemblyPool);
+    pMessage->messageType = messageType;
+    pMessage->transactionId = transactionId;
+    memcpy(pMessage->deviceServiceId, deviceServiceId, MBIM_UUID_SIZE);
+    pMessage->cid = cid;
+    pMessage->status = status;
+    pMessage->expectedTotalFragments = pFragmentHeader->TotalFragments;
+    pMessage->expectedInformationBufferLength = informationBufferLength;
+    pMessage->expectedFragment = 0;
+    pMessage->received = 0;
+    pMessage->sequence = sequence;
+
+    return pMessage;
+}
+
+/*
+ * Deliver the first fragment of a command response or indication. A message
+ * which fits in one fragment is delivered in place from the receive buffer;
+ * longer ones are assembled in a reassembly buffer.
+ */
+static void HandleFirstFragment(
+    MbimTransport* pThis,
+    uint32_t messageType,
+    uint32_t transactionId,
+    const MBIM_FRAGMENT_HEADER* pFragmentHeader,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint32_t status,
+    uint32_t informationBufferLength,
+    uint8_t* pInformation,
+    uint32_t infoBytesThisFragment)
+{
+    struct MultiFragmentMessage* pMessage;
+
+    if (pFragmentHeader->TotalFragments <= 1)
+    {
+        if (infoBytesThisFragment != informationBufferLength)
+        {
+            litembim_log(LOG_ERR, "%s: failed. Mismatch in informationBufferLength", __FUNCTION__);
+            if (messageType == MBIM_COMMAND_DONE_MSG_TYPE)
+            {
+                CompleteTransaction(pThis, transactionId, MBIM_STATUS_READ_FAILURE, NULL, 0);
+            }
+        }
+        else if (messageType == MBIM_COMMAND_DONE_MSG_TYPE)
+        {
+            CompleteTransaction(pThis, transactionId, status, pInformation, informationBufferLength);
+        }
+        else
+        {
+            DispatchIndication(pThis, deviceServiceId, cid, pInformation, informationBufferLength);
+        }
+        return;
+    }
+
+    pMessage = StartMessage(pThis, messageType, transactionId, pFragmentHeader, deviceServiceId, cid,
+        status, informationBufferLength);
+    if (pMessage == NULL)
+    {
+        if (messageType == MBIM_COMMAND_DONE_MSG_TYPE)
+        {
+            CompleteTransaction(pThis, transactionId, MBIM_STATUS_READ_FAILURE, NULL, 0);
+        }
+        return;
+    }
+    AddFragment(pThis, pMessage, pInformation, infoBytesThisFragment);
+}
+
+/*
+ * Process one complete MBIM message received from the device. Called on the
+ * read thread with dispatchLock held.
+ */
+static void HandleMbimPacket(MbimTransport* pThis, uint8_t* mbimPacket, uint32_t mbimPacketSize)
+{
+    MBIM_MESSAGE_HEADER messageHeader;
+
+    if (mbimPacketSize < sizeof(MBIM_MESSAGE_HEADER))
+    {
+        litembim_log(LOG_ERR, "%s: failed. Insufficient header bytes", __FUNCTION__);
+        return;
+    }
+    memcpy(&messageHeader, mbimPacket, sizeof(messageHeader));
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&messageHeader);
+    LogMessageHeader(&messageHeader, false);
+
+    switch (messageHeader.MessageType)
+    {
+        case MBIM_OPEN_DONE_MSG_TYPE:
+        {
+            MBIM_OPEN_DONE_MSG msg;
+            if (mbimPacketSize < sizeof(msg))
+            {
+                litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_OPEN_DONE_MSG header", __FUNCTION__);
+                return;
+            }
+            memcpy(&msg, mbimPacket, sizeof(msg));
+            MBIM_OPEN_DONE_MSG_SWAP_BYTES(&msg);
+            if (!CompleteTransaction(pThis, msg.MessageHeader.TransactionId, msg.Status, NULL, 0))
+            {
+                litembim_log(LOG_DEBUG, "%s: stale transaction", __FUNCTION__);
+            }
+            break;
+        }
+
+        case MBIM_CLOSE_DONE_MSG_TYPE:
+        {
+            MBIM_CLOSE_DONE_MSG msg;
+            if (mbimPacketSize < sizeof(msg))
+            {
+                litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_CLOSE_DONE_MSG header", __FUNCTION__);
+                return;
+            }
+            memcpy(&msg, mbimPacket, sizeof(msg));
+            MBIM_CLOSE_DONE_MSG_SWAP_BYTES(&msg);
+            if (!CompleteTransaction(pThis, msg.MessageHeader.TransactionId, msg.Status, NULL, 0))
+            {
+                litembim_log(LOG_DEBUG, "%s: stale transaction", __FUNCTION__);
+            }
+            break;
+        }
+
+        case MBIM_FUNCTION_ERROR_MSG_TYPE:
+        {
+            MBIM_FUNCTION_ERROR_MSG msg;
+            struct MultiFragmentMessage* pMessage;
+            if (mbimPacketSize < sizeof(msg))
+            {
+                litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_FUNCTION_ERROR_MSG header", __FUNCTION__);
+                return;
+            }
+            memcpy(&msg, mbimPacket, sizeof(msg));
+            MBIM_FUNCTION_ERROR_MSG_SWAP_BYTES(&msg);
+            litembim_log(LOG_ERR, "%s: function error %u for transaction %u", __FUNCTION__,
+                msg.ErrorStatusCode, msg.MessageHeader.TransactionId);
+            pMessage = FindIncomingMessage(pThis, MBIM_COMMAND_DONE_MSG_TYPE, msg.MessageHeader.TransactionId);
+            if (pMessage != NULL)
+            {
+                ResetIncomingMessage(pThis, pMessage);
+            }
+            CompleteTransaction(pThis, msg.MessageHeader.TransactionId, MBIM_STATUS_FAILURE, NULL, 0);
+            break;
+        }
+
+        case MBIM_COMMAND_DONE_MSG_TYPE:
+        case MBIM_INDICATE_STATUS_MSG_TYPE:
+        {
+            MBIM_FRAGMENT_MSG fragmentMsg;
+
+            if (mbimPacketSize < sizeof(fragmentMsg))
+            {
+                litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_FRAGMENT_MSG header", __FUNCTION__);
+                return;
+            }
+            memcpy(&fragmentMsg, mbimPacket, sizeof(fragmentMsg));
+            MBIM_FRAGMENT_MSG_SWAP_BYTES(&fragmentMsg);
+
+            if (fragmentMsg.FragmentHeader.CurrentFragment != 0)
+            {
+                // Continuation of a message being assembled.
+                struct MultiFragmentMessage* pMessage = FindIncomingMessage(pThis,
+                    messageHeader.MessageType, messageHeader.TransactionId);
+                if (pMessage == NULL)
+                {
+                    litembim_log(LOG_DEBUG, "%s: stale response", __FUNCTION__);
+                    return;
+                }
+                if (fragmentMsg.FragmentHeader.CurrentFragment != pMessage->expectedFragment)
+                {
+                    litembim_log(LOG_ERR, "%s: failed. Fragment not the expected fragment. Aborting", __FUNCTION__);
+                    AbortIncomingMessage(pThis, pMessage);
+                    return;
+                }
+                AddFragment(pThis, pMessage, mbimPacket + sizeof(fragmentMsg),
+                    mbimPacketSize - (uint32_t)sizeof(fragmentMsg));
+            }
+            else if (messageHeader.MessageType == MBIM_COMMAND_DONE_MSG_TYPE)
+            {
+                MBIM_COMMAND_DONE_MSG msg;
+                if (mbimPacketSize < sizeof(msg))
+                {
+                    litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_COMMAND_DONE_MSG header", __FUNCTION__);
+                    CompleteTransaction(pThis, messageHeader.TransactionId, MBIM_STATUS_READ_FAILURE, NULL, 0);
+                    return;
+                }
+                memcpy(&msg, mbimPacket, sizeof(msg));
+                MBIM_COMMAND_DONE_MSG_SWAP_BYTES(&msg);
+
+                if (FindTransaction(pThis, messageHeader.TransactionId) == NULL)
+                {
+                    litembim_log(LOG_DEBUG, "%s: stale response", __FUNCTION__);
+                    return;
+                }
+                if (msg.Status != MBIM_STATUS_SUCCESS)
+                {
+                    litembim_log(LOG_ERR, "%s: failed. Command failed with status %d", __FUNCTION__, msg.Status);
+                }
+                HandleFirstFragment(pThis, MBIM_COMMAND_DONE_MSG_TYPE, messageHeader.TransactionId,
+                    &msg.FragmentHeader, msg.DeviceServiceId, msg.CID, msg.Status, msg.InformationBufferLength,
+                    mbimPacket + sizeof(msg), mbimPacketSize - (uint32_t)sizeof(msg));
+            }
+            else
+            {
+                MBIM_INDICATE_STATUS_MSG msg;
+                if (mbimPacketSize < sizeof(msg))
+                {
+                    litembim_log(LOG_ERR, "%s: failed. Incomplete MBIM_INDICATE_STATUS_MSG header", __FUNCTION__);
+                    return;
+                }
+                memcpy(&msg, mbimPacket, sizeof(msg));
+                MBIM_INDICATE_STATUS_MSG_SWAP_BYTES(&msg);
+
+                HandleFirstFragment(pThis, MBIM_INDICATE_STATUS_MSG_TYPE, messageHeader.TransactionId,
+                    &msg.FragmentHeader, msg.DeviceServiceId, msg.CID, MBIM_STATUS_SUCCESS,
+                    msg.InformationBufferLength, mbimPacket + sizeof(msg), mbimPacketSize - (uint32_t)sizeof(msg));
+            }
+            break;
+        }
+
+        default:
+            litembim_log(LOG_DEBUG, "%s: ignoring %s", __FUNCTION__, MessageTypeToString(messageHeader.MessageType));
+            break;
+    }
+}
+
+/*
+ * Read what the device has to offer, and handle the complete messages in
+ * it. Returns < 0 once the device cannot be read any longer.
+ */
+static int ReadDevice(MbimTransport* pThis)
+{
+    MbimCapture* pCapture = __atomic_load_n(&pThis->pCapture, __ATOMIC_ACQUIRE);
+    uint8_t* mbimPacket = pThis->pReadBuffer;
+    uint32_t mbimPacketSize = pThis->readBufferUsed;
+    uint32_t offset = 0;
+    ssize_t bytesRead;
+
+    bytesRead = read(pThis->deviceFd, mbimPacket + mbimPacketSize,
+        pThis->maxControlTransfer - mbimPacketSize);
+    if (bytesRead <= 0)
+    {
+        if (bytesRead < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            return 0;
+        }
+        if (bytesRead == 0 || errno == ENODEV)
+        {
+            litembim_log(LOG_ERR, "%s: MBIM: Device has been removed. Set device removal flag to prevent future requests.", __FUNCTION__);
+            pThis->devRemoved = true;
+        }
+        else
+        {
+            litembim_log(LOG_ERR, "%s: read failed. ret = %ld. errno = %d", __FUNCTION__, (long)bytesRead, errno);
+        }
+        NotifyError(pThis, MBIM_TRANSPORT_ERR_READ, bytesRead == 0 ? ENODEV : errno);
+        return -1;
+    }
+    mbimPacketSize += (uint32_t)bytesRead;
+
+    // A character device delivers one message per read, but a stream
+    // (e.g. a pty) may deliver partial or several messages at a time.
+    while (mbimPacketSize - offset >= sizeof(MBIM_MESSAGE_HEADER))
+    {
+        MBIM_MESSAGE_HEADER messageHeader;
+        memcpy(&messageHeader, mbimPacket + offset, sizeof(messageHeader));
+        MBIM_MESSAGE_HEADER_SWAP_BYTES(&messageHeader);
+
+        if (messageHeader.MessageLength < sizeof(MBIM_MESSAGE_HEADER) ||
+            messageHeader.MessageLength > pThis->maxControlTransfer)
+        {
+            litembim_log(LOG_ERR, "%s: invalid MessageLength %u, discarding %u bytes",
+                __FUNCTION__, messageHeader.MessageLength, mbimPacketSize - offset);
+            offset = mbimPacketSize;
+            break;
+        }
+        if (messageHeader.MessageLength > mbimPacketSize - offset)
+        {
+            break;
+        }
+
+        if (pCapture != NULL)
+        {
+            MbimCapture_Record(pCapture, pThis->captureDevice, MBIM_CAPTURE_RECEIVED,
+                mbimPacket + offset, messageHeader.MessageLength);
+        }
+
+        pthread_mutex_lock(&pThis->dispatchLock);
+        tDispatching = pThis;
+        HandleMbimPacket(pThis, mbimPacket + offset, messageHeader.MessageLength);
+        tDispatching = NULL;
+        pthread_mutex_unlock(&pThis->dispatchLock);
+
+        offset += messageHeader.MessageLength;
+    }
+
+    // Keep the start of an incomplete message.
+    mbimPacketSize -= offset;
+    if (mbimPacketSize > 0 && offset > 0)
+    {
+        memmove(mbimPacket, mbimPacket + offset, mbimPacketSize);
+    }
+    pThis->readBufferUsed = mbimPacketSize;
+
+    return 0;
+}
+
+static int ReactorReadCallback(void* pContext)
+{
+    return ReadDevice((MbimTransport*)pContext);
+}
+
+static int ReactorTimerCallback(void* pContext)
+{
+    ExpireTransactions((MbimTransport*)pContext);
+    return 0;
+}
+
+static void* ReadThreadFunc(void* arg)
+{
+    MbimTransport* pThis = (MbimTransport*)arg;
+    fd_set readSet;
+    int ret;
+#ifndef EVENT_FD_UNSUPPORTED
+    int shutdownFd = pThis->shutdownFd;
+#else
+    int shutdownFd = pThis->shutdownFd[0];
+#endif
+    int maxFd = (pThis->deviceFd > shutdownFd) ? pThis->deviceFd : shutdownFd;
+    bool deviceFailed = false;
+
+    if (pThis->timerFd > maxFd)
+    {
+        maxFd = pThis->timerFd;
+    }
+
+    while (true)
+    {
+        FD_ZERO(&readSet);
+        if (!deviceFailed)
+        {
+            FD_SET(pThis->deviceFd, &readSet);
+        }
+        FD_SET(shutdownFd, &readSet);
+        FD_SET(pThis->timerFd, &readSet);
+
+        ret = select(maxFd + 1, &readSet, NULL, NULL, NULL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            litembim_log(LOG_ERR, "%s: select failed. ret = %d. erron = %d", __FUNCTION__, ret, errno);
+            NotifyError(pThis, MBIM_TRANSPORT_ERR_READ, errno);
+            break;
+        }
+
+        if (FD_ISSET(shutdownFd, &readSet))
+        {
+            break;
+        }
+
+        if (FD_ISSET(pThis->timerFd, &readSet))
+        {
+            ExpireTransactions(pThis);
+        }
+
+        // Once the device fails, outstanding transactions still time out.
+        if (FD_ISSET(pThis->deviceFd, &readSet) && ReadDevice(pThis) < 0)
+        {
+            deviceFailed = true;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Send a message which has no information buffer, and wait for the device
+ * to acknowledge it. Returns the MBIM status of the response.
+ */
+static uint32_t ExecuteControlRequest(MbimTransport* pThis, uint8_t* pMsg, size_t msgLength, uint32_t transactionId)
+{
+    MbimSyncObject syncObject;
+    MbimTransaction transaction;
+    uint32_t status;
+    int ret;
+
+    MbimSyncObject_Initialize(&syncObject, NULL, 0);
+    MbimTransaction_Initialize(&transaction, transactionId, MbimSyncObject_DoneCallback, &syncObject);
+    transaction.deadline = 0;
+    if (AddTransaction(pThis, &transaction) < 0)
+    {
+        MbimSyncObject_Destroy(&syncObject);
+        return MBIM_STATUS_WRITE_FAILURE;
+    }
+
+    MbimSyncObject_Lock(&syncObject);
+
+    pthread_mutex_lock(&pThis->writeLock);
+    ret = WriteMessage(pThis, pMsg, msgLength);
+    pthread_mutex_unlock(&pThis->writeLock);
+
+    if (ret < 0)
+    {
+        status = MBIM_STATUS_WRITE_FAILURE;
+    }
+    else
+    {
+        ret = MbimSyncObject_TimedWait(&syncObject, pThis->timeOut);
+        status = (ret == 0) ? syncObject.status : MBIM_STATUS_READ_FAILURE;
+        if (ret != 0)
+        {
+            litembim_log(LOG_ERR, "%s: MbimSyncObject_TimedWait failed. ret = %d", __FUNCTION__, ret);
+        }
+    }
+
+    MbimSyncObject_Unlock(&syncObject);
+    MbimTransport_CancelTransaction(pThis, transactionId);
+    MbimSyncObject_Destroy(&syncObject);
+
+    return status;
+}
+
+static int OpenRequest(MbimTransport* pThis)
+{
+    MBIM_OPEN_MSG msg;
+    uint32_t transactionId = MbimTransport_GetNextTransactionId(pThis);
+
+    msg.MessageHeader.MessageType = MBIM_OPEN_MSG_TYPE;
+    msg.MessageHeader.MessageLength = sizeof(msg);
+    msg.MessageHeader.TransactionId = transactionId;
+    msg.MaxControlTransfer = pThis->maxControlTransfer;
+    LogMessageHeader(&msg.MessageHeader, true);
+    MBIM_OPEN_MSG_SWAP_BYTES(&msg);
+
+    return ExecuteControlRequest(pThis, (uint8_t*)&msg, sizeof(msg), transactionId) == MBIM_STATUS_SUCCESS ? 0 : -1;
+}
+
+static int CloseRequest(MbimTransport* pThis)
+{
+    MBIM_CLOSE_MSG msg;
+    uint32_t transactionId = MbimTransport_GetNextTransactionId(pThis);
+
+    msg.MessageHeader.MessageType = MBIM_CLOSE_MSG_TYPE;
+    msg.MessageHeader.MessageLength = sizeof(msg);
+    msg.MessageHeader.TransactionId = transactionId;
+    LogMessageHeader(&msg.MessageHeader, true);
+    MBIM_CLOSE_MSG_SWAP_BYTES(&msg);
+
+    return ExecuteControlRequest(pThis, (uint8_t*)&msg, sizeof(msg), transactionId) == MBIM_STATUS_SUCCESS ? 0 : -1;
+}
+
+static void CloseFds(MbimTransport* pThis)
+{
+    if (pThis->deviceFd >= 0)
+    {
+        close(pThis->deviceFd);
+        pThis->deviceFd = -1;
+    }
+#ifndef EVENT_FD_UNSUPPORTED
+    if (pThis->shutdownFd >= 0)
+    {
+        close(pThis->shutdownFd);
+        pThis->shutdownFd = -1;
+    }
+#else
+    if (pThis->shutdownFd[0] >= 0)
+    {
+        close(pThis->shutdownFd[0]);
+        close(pThis->shutdownFd[1]);
+        pThis->shutdownFd[0] = pThis->shutdownFd[1] = -1;
+    }
+#endif
+    if (pThis->timerFd >= 0)
+    {
+        close(pThis->timerFd);
+        pThis->timerFd = -1;
+    }
+}
+
+static void StopReadThread(MbimTransport* pThis)
+{
+#ifndef EVENT_FD_UNSUPPORTED
+    uint64_t shutdown = 1;
+    int fd = pThis->shutdownFd;
+#else
+    uint8_t shutdown = 1;
+    int fd = pThis->shutdownFd[1];
+#endif
+
+    if (pThis->pReactor != NULL)
+    {
+        MbimReactor_Detach(pThis->pReactor, pThis->reactorSlot);
+        MbimReactor_Detach(pThis->pReactor, pThis->timerSlot);
+        return;
+    }
+
+    if (write(fd, &shutdown, sizeof(shutdown)) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot signal read thread, errno: %d", __FUNCTION__, errno);
+    }
+    pthread_join(pThis->readThread, NULL);
+}
+
+static void ClearMutexes(MbimTransport* pThis)
+{
+    pthread_mutex_destroy(&pThis->writeLock);
+    pthread_mutex_destroy(&pThis->transactionTableLock);
+    pthread_mutex_destroy(&pThis->dispatchLock);
+    pthread_mutex_destroy(&pThis->indicatorListLock);
+}
+
+static void CleanUp(MbimTransport* pThis)
+{
+    CloseFds(pThis);
+    ClearMutexes(pThis);
+    MbimTransactionTable_Destroy(&pThis->transactionTable);
+    FreeBuffers(pThis);
+}
+
+/*
+ * Have the device read, either by the reactor or by a read thread of its own.
+ */
+static int StartReading(MbimTransport* pThis)
+{
+    pThis->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (pThis->timerFd < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot create timer, errno: %d", __FUNCTION__, errno);
+        return -1;
+    }
+
+    if (pThis->pReactor != NULL)
+    {
+        if (MbimReactor_Attach(pThis->pReactor, pThis->timerFd, ReactorTimerCallback, pThis,
+                &pThis->timerSlot) < 0)
+        {
+            return -1;
+        }
+        if (MbimReactor_Attach(pThis->pReactor, pThis->deviceFd, ReactorReadCallback, pThis,
+                &pThis->reactorSlot) < 0)
+        {
+            MbimReactor_Detach(pThis->pReactor, pThis->timerSlot);
+            return -1;
+        }
+        return 0;
+    }
+
+#ifndef EVENT_FD_UNSUPPORTED
+    pThis->shutdownFd = eventfd(0, EFD_CLOEXEC);
+    if (pThis->shutdownFd < 0)
+#else
+    if (pipe(pThis->shutdownFd) < 0)
+#endif
+    {
+        litembim_log(LOG_ERR, "%s: cannot create shutdown event, errno: %d", __FUNCTION__, errno);
+        return -1;
+    }
+
+    if (pthread_create(&pThis->readThread, NULL, ReadThreadFunc, pThis) != 0)
+    {
+        litembim_log(LOG_ERR, "%s: pthread_create failed", __FUNCTION__);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int Initialize(MbimTransport* pThis, char *devicePath, uint32_t maxExpectedInformationLength,
+    uint32_t maxTransactions, MbimReactor* pReactor)
+{
+    int n;
+
+    pThis->deviceFd = -1;
+#ifndef EVENT_FD_UNSUPPORTED
+    pThis->shutdownFd = -1;
+#else
+    pThis->shutdownFd[0] = pThis->shutdownFd[1] = -1;
+#endif
+    pThis->timerFd = -1;
+    pThis->timerArmed = UINT64_MAX;
+    pThis->devRemoved = false;
+    pThis->transactionId = 0;
+    pThis->maxControlTransfer = MBIM_MAX_CTRL_TRANSFER;
+    pThis->pReactor = pReactor;
+    pThis->pFrame = NULL;
+    pThis->pReadBuffer = NULL;
+    pThis->readBufferUsed = 0;
+    pThis->pIncomingMessages = NULL;
+    pThis->indicatorList = NULL;
+    pThis->pErrCallback = NULL;
+    pThis->pErrCallbackContext = NULL;
+    pThis->pCapture = NULL;
+
+    if (pThis->initRetry <= 0)
+    {
+        pThis->initRetry = 1;
+    }
+    if (pThis->timeOut <= 0)
+    {
+        pThis->timeOut = MBIM_DEFAULT_TIMEOUT;
+    }
+
+    if (AllocateBuffers(pThis, maxExpectedInformationLength) < 0)
+    {
+        return -1;
+    }
+
+    if (MbimTransactionTable_Initialize(&pThis->transactionTable, maxTransactions) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot allocate table for %u transactions", __FUNCTION__, maxTransactions);
+        FreeBuffers(pThis);
+        return -1;
+    }
+    MbimTimerWheel_Initialize(&pThis->timerWheel, NowMs());
+
+    pthread_mutex_init(&pThis->writeLock, NULL);
+    pthread_mutex_init(&pThis->transactionTableLock, NULL);
+    pthread_mutex_init(&pThis->dispatchLock, NULL);
+    pthread_mutex_init(&pThis->indicatorListLock, NULL);
+
+    for (n = 1; n <= pThis->initRetry; n++)
+    {
+        pThis->deviceFd = open(devicePath, O_RDWR | O_CLOEXEC);
+        if (pThis->deviceFd >= 0)
+        {
+            break;
+        }
+        litembim_log(LOG_ERR, "%s: Cannot open '%s' on %d tries. Error: %d, %s",
+            __FUNCTION__, devicePath, n, errno, strerror(errno));
+        if (n < pThis->initRetry)
+        {
+            sleep(1);
+        }
+    }
+    if (pThis->deviceFd < 0)
+    {
+        CleanUp(pThis);
+        return -1;
+    }
+
+    pThis->maxControlTransfer = QueryMaxControlTransfer(pThis->deviceFd);
+    pThis->pFrame = malloc(pThis->maxControlTransfer);
+    pThis->pReadBuffer = malloc(pThis->maxControlTransfer);
+    if (pThis->pFrame == NULL || pThis->pReadBuffer == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: cannot allocate %u byte frame buffers", __FUNCTION__,
+            pThis->maxControlTransfer);
+        CleanUp(pThis);
+        return -1;
+    }
+
+    if (StartReading(pThis) < 0)
+    {
+        CleanUp(pThis);
+        return -1;
+    }
+
+    for (n = 1; n <= pThis->initRetry; n++)
+    {
+        if (OpenRequest(pThis) == 0)
+        {
+            return 0;
+        }
+        litembim_log(LOG_ERR, "%s: OpenRequest failed on %d tries", __FUNCTION__, n);
+    }
+
+    StopReadThread(pThis);
+    CleanUp(pThis);
+    return -1;
+}
+
+int MbimTransport_Initialize(MbimTransport* pThis, char *devicePath, uint32_t maxExpectedInformationLength)
+{
+    return MbimTransport_InitializeEx(pThis, devicePath, maxExpectedInformationLength, MBIM_DEFAULT_MAX_TRANSACTIONS);
+}
+
+int MbimTransport_InitializeEx(MbimTransport* pThis, char *devicePath, uint32_t maxExpectedInformationLength,
+    uint32_t maxTransactions)
+{
+    return Initialize(pThis, devicePath, maxExpectedInformationLength, maxTransactions, NULL);
+}
+
+int MbimTransport_InitializeShared(MbimTransport* pThis, char *devicePath,
+    uint32_t maxExpectedInformationLength, uint32_t maxTransactions, MbimReactor* pReactor)
+{
+    return Initialize(pThis, devicePath, maxExpectedInformationLength, maxTransactions, pReactor);
+}
+
+void MbimTransport_ShutDown(MbimTransport* pThis)
+{
+    if (!pThis->devRemoved)
+    {
+        CloseRequest(pThis);
+    }
+
+    StopReadThread(pThis);
+
+    if (pThis->transactionTable.count != 0)
+    {
+        litembim_log(LOG_WARNING, "%s: %u transactions still outstanding", __FUNCTION__,
+            pThis->transactionTable.count);
+    }
+    CleanUp(pThis);
+}
+
+uint32_t MbimTransport_GetNextTransactionId(MbimTransport* pThis)
+{
+    uint32_t newTransactionId;
+
+    // Never hand out 0, which MBIM reserves for indications.
+    do
+    {
+        newTransactionId = __atomic_add_fetch(&pThis->transactionId, 1, __ATOMIC_RELAXED);
+    } while (newTransactionId == 0);
+
+    return newTransactionId;
+}
+
+int MbimTransport_SendCommand(
+    MbimTransport* pThis,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MbimTransaction* pTransaction
+)
+{
+    return MbimTransport_SendCommandWithTimeout(pThis, deviceServiceId, cid, commandType,
+        informationBuffer, informationBufferLength, pTransaction, 0);
+}
+
+int MbimTransport_SendCommandWithTimeout(
+    MbimTransport* pThis,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MbimTransaction* pTransaction,
+    uint32_t timeoutMs
+)
+{
+    uint32_t firstCapacity;
+    uint32_t nextCapacity;
+    uint32_t totalFragments = 1;
+    uint32_t informationLeft = informationBufferLength;
+    uint32_t fragment;
+    int ret = 0;
+
+    if (pThis == NULL || pTransaction == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: Invalid pThis pointer. Error out.", __FUNCTION__);
+        return -1;
+    }
+    if (pThis->devRemoved)
+    {
+        litembim_log(LOG_ERR, "%s: Trying to send MBIM packets when device is removed. Error out.", __FUNCTION__);
+        return -1;
+    }
+
+    firstCapacity = pThis->maxControlTransfer - (uint32_t)sizeof(MBIM_COMMAND_MSG);
+    nextCapacity = pThis->maxControlTransfer - (uint32_t)sizeof(MBIM_FRAGMENT_MSG);
+    if (informationLeft > firstCapacity)
+    {
+        totalFragments += (informationLeft - firstCapacity + nextCapacity - 1) / nextCapacity;
+    }
+
+    // Track the transaction before sending, so that the response cannot
+    // overtake it. NowMs() rounds down, so round the deadline up, so as not
+    // to expire a transaction before its full timeout.
+    pTransaction->deadline = (timeoutMs != 0) ? NowMs() + timeoutMs + 1 : 0;
+    if (AddTransaction(pThis, pTransaction) < 0)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pThis->writeLock);
+    for (fragment = 0; fragment < totalFragments && ret == 0; fragment++)
+    {
+        uint32_t headerLength;
+        uint32_t informationTransferThisTime;
+
+        if (fragment == 0)
+        {
+            MBIM_COMMAND_MSG command;
+
+            informationTransferThisTime = (informationLeft < firstCapacity) ? informationLeft : firstCapacity;
+            headerLength = sizeof(command);
+
+            command.MessageHeader.MessageType = MBIM_COMMAND_MSG_TYPE;
+            command.MessageHeader.MessageLength = headerLength + informationTransferThisTime;
+            command.MessageHeader.TransactionId = pTransaction->transactionId;
+            command.FragmentHeader.TotalFragments = totalFragments;
+            command.FragmentHeader.CurrentFragment = 0;
+            memcpy(command.DeviceServiceId, deviceServiceId, MBIM_UUID_SIZE);
+            command.CID = cid;
+            command.CommandType = commandType;
+            command.InformationBufferLength = informationBufferLength;
+            LogMessageHeader(&command.MessageHeader, true);
+            MBIM_COMMAND_MSG_SWAP_BYTES(&command);
+            memcpy(pThis->pFrame, &command, headerLength);
+        }
+        else
+        {
+            MBIM_FRAGMENT_MSG fragmentMsg;
+
+            informationTransferThisTime = (informationLeft < nextCapacity) ? informationLeft : nextCapacity;
+            headerLength = sizeof(fragmentMsg);
+
+            fragmentMsg.MessageHeader.MessageType = MBIM_COMMAND_MSG_TYPE;
+            fragmentMsg.MessageHeader.MessageLength = headerLength + informationTransferThisTime;
+            fragmentMsg.MessageHeader.TransactionId = pTransaction->transactionId;
+            fragmentMsg.FragmentHeader.TotalFragments = totalFragments;
+            fragmentMsg.FragmentHeader.CurrentFragment = fragment;
+            MBIM_FRAGMENT_MSG_SWAP_BYTES(&fragmentMsg);
+            memcpy(pThis->pFrame, &fragmentMsg, headerLength);
+        }
+
+        if (informationTransferThisTime > 0)
+        {
+            memcpy(pThis->pFrame + headerLength, informationBuffer, informationTransferThisTime);
+            informationBuffer += informationTransferThisTime;
+            informationLeft -= informationTransferThisTime;
+        }
+        ret = WriteMessage(pThis, pThis->pFrame, headerLength + informationTransferThisTime);
+    }
+    pthread_mutex_unlock(&pThis->writeLock);
+
+    if (ret < 0)
+    {
+        RemoveTransaction(pThis, pTransaction->transactionId);
+        litembim_log(LOG_ERR, "%s: MBIM transport write error notified to upper layer application.", __FUNCTION__);
+        NotifyError(pThis, MBIM_TRANSPORT_ERR_WRITE, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+void MbimTransport_CancelTransaction(MbimTransport* pThis, uint32_t transactionId)
+{
+    // Wait for a completion in progress, unless called from a done callback
+    // or indicator of this transport, which holds the lock already.
+    bool inCallback = tDispatching == pThis;
+
+    if (!inCallback)
+    {
+        pthread_mutex_lock(&pThis->dispatchLock);
+    }
+    RemoveTransaction(pThis, transactionId);
+    if (!inCallback)
+    {
+        pthread_mutex_unlock(&pThis->dispatchLock);
+    }
+}
+
+void MbimTransport_AttachIndicator(MbimTransport* pThis, MbimIndicator* pIndicator)
+{
+    MbimIndicator* pLast;
+
+    pthread_mutex_lock(&pThis->indicatorListLock);
+    pIndicator->pNext = NULL;
+    if (pThis->indicatorList == NULL)
+    {
+        pIndicator->pPrev = NULL;
+        pThis->indicatorList = pIndicator;
+    }
+    else
+    {
+        for (pLast = pThis->indicatorList; pLast->pNext != NULL; pLast = pLast->pNext)
+        {
+        }
+        pLast->pNext = pIndicator;
+        pIndicator->pPrev = pLast;
+    }
+    pthread_mutex_unlock(&pThis->indicatorListLock);
+}
+
+void MbimTransport_DetachIndicator(MbimTransport* pThis, MbimIndicator* pIndicator)
+{
+    pthread_mutex_lock(&pThis->indicatorListLock);
+    if (pIndicator->pPrev != NULL)
+    {
+        pIndicator->pPrev->pNext = pIndicator->pNext;
+    }
+    else if (pThis->indicatorList == pIndicator)
+    {
+        pThis->indicatorList = pIndicator->pNext;
+    }
+    if (pIndicator->pNext != NULL)
+    {
+        pIndicator->pNext->pPrev = pIndicator->pPrev;
+    }
+    pIndicator->pPrev = NULL;
+    pIndicator->pNext = NULL;
+    pthread_mutex_unlock(&pThis->indicatorListLock);
+}
+
+/*
+ * State of a command executed by MbimTransport_ExecuteCommandSynchronously.
+ * The response is parsed on the read thread, straight from the transport's
+ * receive buffers, so nothing needs to be copied for the waiting caller.
+ */
+struct SyncCommand
+{
+    MbimSyncObject syncObject;
+    bool done;
+    MBIM_PARSE_CALLBACK pParseCallback;
+    void* pParseCallbackContext;
+};
+
+static void SyncCommandDoneCallback(
+    uint32_t status,
+    uint32_t transactionId,
+    uint8_t* informationBuffer,
+    uint32_t informationBufferLength,
+    void* pDoneCallbackContext)
+{
+    struct SyncCommand* pCommand = (struct SyncCommand*)pDoneCallbackContext;
+
+    (void)transactionId;
+    if (status == MBIM_STATUS_SUCCESS && pCommand->pParseCallback != NULL)
+    {
+        status = pCommand->pParseCallback(informationBuffer, informationBufferLength,
+            pCommand->pParseCallbackContext);
+    }
+
+    MbimSyncObject_Lock(&pCommand->syncObject);
+    pCommand->syncObject.status = status;
+    pCommand->done = true;
+    MbimSyncObject_Signal(&pCommand->syncObject);
+    MbimSyncObject_Unlock(&pCommand->syncObject);
+}
+
+uint32_t MbimTransport_ExecuteCommandSynchronously(
+    MbimTransport* pTransport,
+    const uint8_t* deviceService,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MBIM_PARSE_CALLBACK pParseCallback,
+    void* pParseCallbackContext,
+    time_t timeout
+)
+{
+    uint32_t timeoutMs;
+    uint32_t mbimStatus;
+
+    if (timeout <= 0)
+    {
+        timeoutMs = 1;
+    }
+    else if (timeout >= (time_t)(UINT32_MAX / 1000))
+    {
+        timeoutMs = UINT32_MAX;
+    }
+    else
+    {
+        timeoutMs = (uint32_t)timeout * 1000;
+    }
+
+    mbimStatus = MbimTransport_ExecuteCommandWithTimeout(pTransport, deviceService, cid, commandType,
+        informationBuffer, informationBufferLength, pParseCallback, pParseCallbackContext, timeoutMs);
+
+    // Timeouts have always been reported as read failures here.
+    return (mbimStatus == MBIM_STATUS_CUSTOM_TIMEOUT) ? MBIM_STATUS_READ_FAILURE : mbimStatus;
+}
+
+uint32_t MbimTransport_ExecuteCommandWithTimeout(
+    MbimTransport* pTransport,
+    const uint8_t* deviceService,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MBIM_PARSE_CALLBACK pParseCallback,
+    void* pParseCallbackContext,
+    uint32_t timeoutMs
+)
+{
+    struct SyncCommand command;
+    MbimTransaction transaction;
+    uint32_t transactionId;
+    uint32_t mbimStatus;
+    int ret = 0;
+
+    MbimSyncObject_Initialize(&command.syncObject, NULL, 0);
+    command.done = false;
+    command.pParseCallback = pParseCallback;
+    command.pParseCallbackContext = pParseCallbackContext;
+    transactionId = MbimTransport_GetNextTransactionId(pTransport);
+    MbimTransaction_Initialize(&transaction, transactionId, SyncCommandDoneCallback, &command);
+
+    MbimSyncObject_Lock(&command.syncObject);
+    if (MbimTransport_SendCommandWithTimeout(pTransport, deviceService, cid, commandType,
+            informationBuffer, informationBufferLength, &transaction, timeoutMs) < 0)
+    {
+        MbimSyncObject_Unlock(&command.syncObject);
+        MbimSyncObject_Destroy(&command.syncObject);
+        return MBIM_STATUS_WRITE_FAILURE;
+    }
+
+    // The transaction completes one way or the other by its deadline.
+    while (!command.done && ret == 0)
+    {
+        ret = MbimSyncObject_Wait(&command.syncObject);
+    }
+    MbimSyncObject_Unlock(&command.syncObject);
+
+    if (!command.done)
+    {
+        // The response may still arrive, until the transaction is cancelled.
+        MbimTransport_CancelTransaction(pTransport, transactionId);
+    }
+
+    MbimSyncObject_Lock(&command.syncObject);
+    if (command.done)
+    {
+        mbimStatus = command.syncObject.status;
+    }
+    else
+    {
+        litembim_log(LOG_ERR, "%s: MbimSyncObject_Wait failed. ret = %d", __FUNCTION__, ret);
+        mbimStatus = MBIM_STATUS_READ_FAILURE;
+    }
+    MbimSyncObject_Unlock(&command.syncObject);
+
+    MbimSyncObject_Destroy(&command.syncObject);
+
+    return mbimStatus;
+}
+
+void MbimTransport_RegisterErrCallback(
+    MbimTransport * pThis,
+    MBIM_TRANSPORT_ERR_CALLBACK pErrCallback,
+    void * pErrCallbackContext
+)
+{
+    if (pThis == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: Invalid MbimTransport pointer, no callback registered.", __FUNCTION__);
+        return;
+    }
+
+    pThis->pErrCallback = pErrCallback;
+    pThis->pErrCallbackContext = pErrCallbackContext;
+    litembim_log(LOG_INFO, "MBIM transport error callback is %s", pErrCallback ? "enabled" : "disabled");
+}
+
+void MbimTransport_AttachCapture(MbimTransport* pThis, MbimCapture* pCapture)
+{
+    if (pCapture != NULL)
+    {
+        pThis->captureDevice = (uint8_t)__atomic_add_fetch(&pCapture->devices, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&pThis->pCapture, pCapture, __ATOMIC_RELEASE);
+}
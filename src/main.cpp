@@ -15,6 +15,7 @@
 #include "options.h"
 #include "commands.h"
 #include "em919xManagement.h"
+#include "config/snapshot.h"
 
 namespace linkmanager {
 
@@ -53,6 +54,11 @@ parse_cli(options & opts, int argc, char **argv)
       (option("--config", "-c") & value("FILENAME", config))
         .doc("Path of a configuration file."),
 
+      (option("--snapshot") & value("FILENAME", opts.snapshot_file))
+        .doc("Path of a compiled snapshot of the configuration file. It is "
+             "used instead of the configuration file while it is up to date, "
+             "and written otherwise."),
+
 
       repeatable(option("--plugins", "-p") & values("PATH", opts.plugin_path))
         .doc("Path for loading link module plugins."),
@@ -136,11 +142,37 @@ void
 parse_config(std::string const & filename, options & opts)
 {
   if (filename.empty()) {
+    opts.sessions = std::make_shared<config::session_table const>();
     return;
   }
 
-  std::ifstream i(filename);
-  i >> opts.config;
+  config::compiled_config compiled;
+  bool without_sessions = false;
+  try {
+    compiled = config::snapshot::load_or_compile(filename, opts.snapshot_file);
+  } catch (config::config_error const & err) {
+    std::cerr << "Invalid session configuration: " << err.what() << std::endl;
+    without_sessions = true;
+  } catch (std::runtime_error const & err) {
+    std::cerr << err.what() << std::endl;
+    exit(2);
+  }
+
+  // Without sessions, but still with the rest of the configuration, if that
+  // can be had.
+  if (without_sessions) {
+    try {
+      compiled.document = config::snapshot::load_document(filename);
+    } catch (std::runtime_error const & err) {
+      std::cerr << err.what() << std::endl;
+      exit(2);
+    }
+  }
+
+  opts.config = std::move(compiled.document);
+  opts.config_file = filename;
+  opts.sessions = std::make_shared<config::session_table const>(
+      std::move(compiled.sessions));
 }
 
 } // anonymous namespace
@@ -166,6 +198,9 @@ int main(int argc, char **argv)
   // Initialise plugin registry. We can treat plugin paths given on the command
   // line as *additional* to those given in a config file, if any.
   linkmanager::module_registry registry;
+  if (opts.config.contains("plugin_index")) {
+    registry.set_plugin_index(opts.config["plugin_index"].get<std::string>());
+  }
   if (opts.config.contains("plugin_path")) {
     auto pp = opts.config["plugin_path"];
     if (pp.is_string()) {
@@ -189,17 +224,17 @@ int main(int argc, char **argv)
     // std::cout << mod->is_powered_on() << "\n";
     // std::cout << mod->name() << "\n";
     // std::cout << mod->links().size() << "\n";
-    std::cout << configure_link(opts.config) << "\n";
+    std::cout << configure_link(*opts.sessions) << "\n";
     // mod->configure_link(opts.config);
     // std::cout << mod->links().size() << "\n";
 
   }
 
-  // // Run the specified command.
-  // auto cmd = get_command(opts.cmd);
-  // if (!cmd) {
-  //   std::cerr << "Internal error: command not implemented." << std::endl;
-  //   exit(-1);
-  // }
-  // return cmd->run(opts, registry);
+  // Run the specified command.
+  auto cmd = get_command(opts.cmd);
+  if (!cmd) {
+    std::cerr << "Internal error: command not implemented." << std::endl;
+    exit(-1);
+  }
+  return cmd->run(opts, registry);
 }
@@ -0,0 +1,183 @@
+/*
+ *
+ */
+#include "async.h"
+
+#include <limits>
+
+namespace linkmanager::mbim {
+
+struct async_transport::pending
+{
+  MbimTransaction   transaction;
+  async_transport * owner;
+  completion        done;
+};
+
+
+
+async_transport::async_transport(MbimTransport & transport)
+  : m_transport{transport}
+{
+}
+
+
+
+async_transport::~async_transport()
+{
+  std::vector<std::uint32_t> ids;
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (auto const & [id, _] : m_pending) {
+      ids.push_back(id);
+    }
+  }
+  for (auto id : ids) {
+    cancel(id);
+  }
+}
+
+
+
+std::uint32_t
+async_transport::submit_raw(command const & cmd, completion && done,
+    std::chrono::milliseconds timeout)
+{
+  if (cmd.payload.size() > std::numeric_limits<std::uint16_t>::max()
+      || timeout.count() < 0 || timeout.count() > std::numeric_limits<std::uint32_t>::max()) {
+    throw mbim_error{MBIM_STATUS_INVALID_PARAMETERS};
+  }
+
+  auto p = std::make_unique<pending>();
+  p->owner = this;
+  p->done = std::move(done);
+
+  auto id = MbimTransport_GetNextTransactionId(&m_transport);
+  MbimTransaction_Initialize(&p->transaction, id, &async_transport::done_callback, p.get());
+
+  // Register before sending; the response may arrive before
+  // MbimTransport_SendCommand returns.
+  auto raw = p.get();
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_pending[id] = std::move(p);
+  }
+
+  auto ret = MbimTransport_SendCommandWithTimeout(&m_transport, cmd.service, cmd.cid, cmd.type,
+      const_cast<std::uint8_t *>(cmd.payload.data()),
+      static_cast<std::uint16_t>(cmd.payload.size()),
+      &raw->transaction, static_cast<std::uint32_t>(timeout.count()));
+  if (ret < 0) {
+    // Hand the completion back; the caller may still want to invoke it.
+    auto failed = take(id);
+    if (failed) {
+      done = std::move(failed->done);
+    }
+    throw mbim_error{MBIM_STATUS_WRITE_FAILURE};
+  }
+
+  return id;
+}
+
+
+
+bool
+async_transport::cancel(std::uint32_t transaction_id)
+{
+  // Once this returns, the transport will not invoke done_callback for the
+  // transaction any longer, so whoever takes the pending entry completes it.
+  MbimTransport_CancelTransaction(&m_transport, transaction_id);
+
+  auto p = take(transaction_id);
+  if (!p) {
+    return false;
+  }
+  p->done(MBIM_STATUS_CUSTOM_CANCELLED, nullptr, 0);
+  return true;
+}
+
+
+
+std::size_t
+async_transport::outstanding() const
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_pending.size();
+}
+
+
+
+std::unique_ptr<async_transport::pending>
+async_transport::take(std::uint32_t transaction_id)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto iter = m_pending.find(transaction_id);
+  if (iter == m_pending.end()) {
+    return {};
+  }
+  auto p = std::move(iter->second);
+  m_pending.erase(iter);
+  return p;
+}
+
+
+
+void
+async_transport::done_callback(std::uint32_t status, std::uint32_t transaction_id,
+    std::uint8_t * info, std::uint32_t length, void * context)
+{
+  auto owner = static_cast<pending *>(context)->owner;
+  auto p = owner->take(transaction_id);
+  if (p) {
+    p->done(status, info, length);
+  }
+}
+
+
+
+command_batch::command_batch(async_transport & transport)
+  : m_transport{transport}
+{
+}
+
+
+
+std::vector<std::uint32_t>
+command_batch::submit()
+{
+  std::vector<std::uint32_t> ids;
+  ids.reserve(m_entries.size());
+
+  for (auto & e : m_entries) {
+    try {
+      ids.push_back(m_transport.submit_raw(e.cmd, std::move(e.done)));
+    } catch (mbim_error const & err) {
+      ids.push_back(0);
+      e.done(err.status(), nullptr, 0);
+    }
+  }
+
+  m_entries.clear();
+  return ids;
+}
+
+
+
+status_poll
+poll_status(async_transport & transport, std::uint32_t session_id)
+{
+  command_batch batch{transport};
+  status_poll poll;
+
+  poll.radio = batch.add(radio_state_query());
+  poll.subscriber = batch.add(subscriber_ready_query());
+  poll.registration = batch.add(register_state_query());
+  poll.packet = batch.add(packet_service_query());
+  poll.connection = batch.add(connect_query(session_id));
+  poll.ip = batch.add(ip_configuration_query(session_id));
+
+  batch.submit();
+  return poll;
+}
+
+} // namespace linkmanager::mbim
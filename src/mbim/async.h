@@ -0,0 +1,229 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_ASYNC_H
+#define LINKMANAGER_MBIM_ASYNC_H
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "commands.h"
+
+namespace linkmanager::mbim {
+
+/**
+ * Asynchronous command interface over an MbimTransport.
+ *
+ * Commands are sent without waiting for earlier responses, so that several
+ * commands are in flight at once; N queries then take about one round trip
+ * to the modem rather than N. Results are delivered to a completion
+ * callback, or through a future.
+ *
+ * Completion callbacks run on the transport's read thread. They must not
+ * block, but may submit or cancel commands. Futures are completed from the
+ * same thread; waiting on them from within a completion callback deadlocks.
+ *
+ * Destroying the async_transport cancels all commands still outstanding.
+ */
+class async_transport
+{
+public:
+  /**
+   * Raw completion; the information buffer is only valid for the duration
+   * of the call.
+   */
+  using completion = std::function<void (std::uint32_t status,
+      std::uint8_t * info, std::uint32_t length)>;
+
+  explicit async_transport(MbimTransport & transport);
+  ~async_transport();
+
+  async_transport(async_transport const &) = delete;
+  async_transport & operator=(async_transport const &) = delete;
+
+  /**
+   * Send a command. Returns the transaction ID, which may be used to cancel
+   * the command. Throws mbim_error if the command could not be sent, in
+   * which case the completion is not invoked, and is left in done.
+   *
+   * If a timeout is given and no response arrives in time, the completion
+   * is invoked with MBIM_STATUS_CUSTOM_TIMEOUT (see
+   * MbimTransport_SendCommandWithTimeout).
+   */
+  std::uint32_t submit_raw(command const & cmd, completion && done,
+      std::chrono::milliseconds timeout = {});
+
+  /**
+   * Send a command, and parse its response before invoking the callback.
+   */
+  template <typename T>
+  inline std::uint32_t submit(typed_command<T> const & cmd,
+      typename typed_command<T>::callback done, std::chrono::milliseconds timeout = {})
+  {
+    auto parse = cmd.parse;
+    return submit_raw(cmd,
+        [parse, done = std::move(done)](std::uint32_t status, std::uint8_t * info,
+            std::uint32_t length)
+        {
+          T result{};
+          if (status == MBIM_STATUS_SUCCESS && parse) {
+            status = parse(info, length, result);
+          }
+          done(status, result);
+        }, timeout);
+  }
+
+  /**
+   * Send a command; the future yields the parsed response, or throws
+   * mbim_error.
+   */
+  template <typename T>
+  inline std::future<T> submit(typed_command<T> const & cmd,
+      std::chrono::milliseconds timeout = {})
+  {
+    auto promise = std::make_shared<std::promise<T>>();
+    auto future = promise->get_future();
+    submit(cmd, typename typed_command<T>::callback{
+        [promise](std::uint32_t status, T const & result)
+        {
+          complete(*promise, status, result);
+        }}, timeout);
+    return future;
+  }
+
+  /**
+   * Cancel an outstanding command. Its completion is invoked with
+   * MBIM_STATUS_CUSTOM_CANCELLED before this returns, unless the command
+   * has already completed, in which case false is returned.
+   */
+  bool cancel(std::uint32_t transaction_id);
+
+  /**
+   * Number of commands awaiting a response.
+   */
+  std::size_t outstanding() const;
+
+  inline MbimTransport & transport()
+  {
+    return m_transport;
+  }
+
+  template <typename T>
+  static inline void complete(std::promise<T> & promise, std::uint32_t status,
+      T const & result)
+  {
+    if (status == MBIM_STATUS_SUCCESS) {
+      promise.set_value(result);
+    }
+    else {
+      promise.set_exception(std::make_exception_ptr(mbim_error{status}));
+    }
+  }
+
+private:
+  struct pending;
+
+  static void done_callback(std::uint32_t status, std::uint32_t transaction_id,
+      std::uint8_t * info, std::uint32_t length, void * context);
+
+  std::unique_ptr<pending> take(std::uint32_t transaction_id);
+
+  MbimTransport &     m_transport;
+  mutable std::mutex  m_mutex;
+  std::unordered_map<std::uint32_t, std::unique_ptr<pending>> m_pending;
+};
+
+
+
+/**
+ * Collects commands, then sends them back to back.
+ *
+ * All commands are built before anything is sent, so that a build failure
+ * does not leave half a batch in flight. If sending a command fails, its
+ * completion receives MBIM_STATUS_WRITE_FAILURE and the remaining commands
+ * are still sent.
+ */
+class command_batch
+{
+public:
+  explicit command_batch(async_transport & transport);
+
+  template <typename T>
+  inline void add(typed_command<T> cmd, typename typed_command<T>::callback done)
+  {
+    auto parse = cmd.parse;
+    m_entries.push_back(entry{std::move(cmd),
+        [parse, done = std::move(done)](std::uint32_t status, std::uint8_t * info,
+            std::uint32_t length)
+        {
+          T result{};
+          if (status == MBIM_STATUS_SUCCESS && parse) {
+            status = parse(info, length, result);
+          }
+          done(status, result);
+        }});
+  }
+
+  template <typename T>
+  inline std::future<T> add(typed_command<T> cmd)
+  {
+    auto promise = std::make_shared<std::promise<T>>();
+    auto future = promise->get_future();
+    add(std::move(cmd), typename typed_command<T>::callback{
+        [promise](std::uint32_t status, T const & result)
+        {
+          async_transport::complete(*promise, status, result);
+        }});
+    return future;
+  }
+
+  /**
+   * Send all commands added so far. Returns the transaction IDs, in the
+   * order the commands were added; 0 marks a command that failed to send.
+   */
+  std::vector<std::uint32_t> submit();
+
+  inline std::size_t size() const
+  {
+    return m_entries.size();
+  }
+
+private:
+  struct entry
+  {
+    command                     cmd;
+    async_transport::completion done;
+  };
+
+  async_transport &   m_transport;
+  std::vector<entry>  m_entries;
+};
+
+
+
+/**
+ * Modem status, as polled by poll_status().
+ */
+struct status_poll
+{
+  std::future<radio_state>      radio;
+  std::future<subscriber_ready> subscriber;
+  std::future<register_state>   registration;
+  std::future<packet_service>   packet;
+  std::future<connect_state>    connection;
+  std::future<ip_configuration> ip;
+};
+
+/**
+ * Query radio, subscriber, registration, packet service, connection and IP
+ * configuration state of a session as one pipelined batch.
+ */
+status_poll poll_status(async_transport & transport, std::uint32_t session_id);
+
+} // namespace linkmanager::mbim
+
+#endif // guard
@@ -0,0 +1,81 @@
+/*
+ *
+ */
+#include "bring_up.h"
+
+#include <algorithm>
+
+namespace linkmanager::mbim {
+
+namespace {
+
+inline bool
+registered(register_state const & state)
+{
+  return state.state == MBIMRegisterStateHome
+    || state.state == MBIMRegisterStateRoaming
+    || state.state == MBIMRegisterStatePartner;
+}
+
+} // anonymous namespace
+
+
+
+task<bring_up_result>
+bring_up(coroutine_context & ctx, bring_up_parameters params)
+{
+  auto const timeout = params.command_timeout;
+  bring_up_result result;
+
+  // All Basic Connect indications; a CID count of zero selects all.
+  std::vector<MbimEventEntry> entries(1);
+  auto uuid = BasicConnectDeviceService_Uuid();
+  std::copy(uuid, uuid + MBIM_UUID_SIZE, entries[0].DeviceServiceId);
+  co_await ctx.execute(device_service_subscribe(entries), timeout);
+
+  auto radio = co_await ctx.execute(radio_state_query(), timeout);
+  if (radio.sw != MBIMRadioOn) {
+    radio = co_await ctx.execute(radio_state_set(MBIMRadioOn), timeout);
+  }
+  if (radio.hw != MBIMRadioOn || radio.sw != MBIMRadioOn) {
+    throw std::runtime_error{"Radio is switched off."};
+  }
+
+  auto pin = co_await ctx.execute(pin_query(), timeout);
+  if (pin.state == MBIMPinStateLocked) {
+    if (params.pin.empty()) {
+      throw std::runtime_error{"SIM is locked, but no PIN is configured."};
+    }
+    pin = co_await ctx.execute(pin_set(pin.type, MBIMPinOperationEnter, params.pin), timeout);
+    if (pin.state == MBIMPinStateLocked) {
+      throw std::runtime_error{"SIM could not be unlocked."};
+    }
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + params.register_timeout;
+  for (;;) {
+    result.registration = co_await ctx.execute(register_state_query(), timeout);
+    if (registered(result.registration)) {
+      break;
+    }
+    if (std::chrono::steady_clock::now() + params.register_poll_interval > deadline) {
+      throw std::runtime_error{"Timed out waiting for network registration."};
+    }
+    co_await ctx.sleep(params.register_poll_interval);
+  }
+
+  result.packet = co_await ctx.execute(packet_service_set(MBIMPacketServiceActionAttach),
+      timeout);
+
+  result.connection = co_await ctx.execute(connect_set(params.session_id, params.connect),
+      timeout);
+  if (result.connection.activation_state != MBIMActivationStateActivated) {
+    throw std::runtime_error{"Session activation was rejected."};
+  }
+
+  result.ip = co_await ctx.execute(ip_configuration_query(params.session_id), timeout);
+
+  co_return result;
+}
+
+} // namespace linkmanager::mbim
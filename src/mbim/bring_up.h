@@ -0,0 +1,51 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_BRING_UP_H
+#define LINKMANAGER_MBIM_BRING_UP_H
+
+#include "coroutine.h"
+
+namespace linkmanager::mbim {
+
+struct bring_up_parameters
+{
+  std::uint32_t             session_id = 0;
+
+  /** Entered if the SIM is PIN locked; an empty PIN fails bring-up instead. */
+  std::wstring              pin;
+
+  connect_parameters        connect;
+
+  /** Timeout for each command. */
+  std::chrono::milliseconds command_timeout = coroutine_context::DEFAULT_TIMEOUT;
+
+  /** How long to wait for network registration, and how often to poll it. */
+  std::chrono::milliseconds register_timeout{60000};
+  std::chrono::milliseconds register_poll_interval{1000};
+};
+
+
+struct bring_up_result
+{
+  register_state            registration;
+  packet_service            packet;
+  connect_state             connection;
+  ip_configuration          ip;
+};
+
+
+/**
+ * Bring a modem's data session up: subscribe to Basic Connect indications,
+ * switch the radio on, unlock the SIM if necessary, wait for network
+ * registration, attach packet service, connect the session and query its IP
+ * configuration.
+ *
+ * MBIM failures surface as mbim_error; a SIM that cannot be unlocked, a
+ * registration timeout or a rejected activation as std::runtime_error.
+ */
+task<bring_up_result> bring_up(coroutine_context & ctx, bring_up_parameters params);
+
+} // namespace linkmanager::mbim
+
+#endif // guard
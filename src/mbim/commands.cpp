@@ -0,0 +1,410 @@
+/*
+ *
+ */
+#include "commands.h"
+
+#include <sstream>
+
+namespace linkmanager::mbim {
+
+namespace {
+
+// Room for the largest payload we build: a connect request with maximum
+// length strings.
+static constexpr std::uint32_t MAX_PAYLOAD = 4096;
+
+// Capacity for strings in responses; generous compared to what the
+// specification allows for provider IDs, names and roaming texts.
+static constexpr std::uint32_t MAX_STRING = 256;
+
+
+inline std::string
+status_message(std::uint32_t status)
+{
+  std::ostringstream os;
+  os << "MBIM command failed with status " << status;
+  switch (status) {
+    case MBIM_STATUS_READ_FAILURE:
+      os << " (read failure or timeout)";
+      break;
+    case MBIM_STATUS_WRITE_FAILURE:
+      os << " (write failure)";
+      break;
+    case MBIM_STATUS_CUSTOM_BUILD_FAILURE:
+      os << " (build failure)";
+      break;
+    case MBIM_STATUS_CUSTOM_PARSE_FAILURE:
+      os << " (parse failure)";
+      break;
+    case MBIM_STATUS_CUSTOM_CANCELLED:
+      os << " (cancelled)";
+      break;
+    case MBIM_STATUS_CUSTOM_TIMEOUT:
+      os << " (timeout)";
+      break;
+  }
+  return os.str();
+}
+
+
+/**
+ * Run a query Build function, which takes no payload.
+ */
+template <typename T, typename B>
+inline typed_command<T>
+build_query(B && build)
+{
+  typed_command<T> cmd;
+  auto ret = build(&cmd.service, &cmd.cid, &cmd.type);
+  if (ret != MBIM_STATUS_SUCCESS) {
+    throw mbim_error{MBIM_STATUS_CUSTOM_BUILD_FAILURE};
+  }
+  return cmd;
+}
+
+
+/**
+ * Run a Build function with a payload; the remaining arguments are passed
+ * on after the payload buffer and length.
+ */
+template <typename T, typename B, typename... Args>
+inline typed_command<T>
+build_payload(B && build, Args &&... args)
+{
+  typed_command<T> cmd;
+  cmd.payload.resize(MAX_PAYLOAD);
+  std::uint32_t length = MAX_PAYLOAD;
+  auto ret = build(&cmd.service, &cmd.cid, &cmd.type, cmd.payload.data(), &length,
+      std::forward<Args>(args)...);
+  if (ret != MBIM_STATUS_SUCCESS) {
+    throw mbim_error{MBIM_STATUS_CUSTOM_BUILD_FAILURE};
+  }
+  cmd.payload.resize(length);
+  return cmd;
+}
+
+
+/**
+ * Build functions take non-const strings; hand them a copy. Empty strings
+ * are passed as such rather than as NULL, which some Build functions reject
+ * despite documenting otherwise.
+ */
+inline wchar_t *
+writable(std::wstring & copy, std::wstring const & value)
+{
+  copy = value;
+  return copy.data();
+}
+
+} // anonymous namespace
+
+
+std::uint32_t
+parse_subscribe_list(std::uint8_t * info, std::uint32_t length, subscribe_list & result)
+{
+  std::uint32_t count = 0;
+  auto ret = BasicConnectDeviceService_DeviceServiceSubscribeParse(info, length, &count, nullptr);
+  if (ret != MBIM_STATUS_SUCCESS || count == 0) {
+    return ret;
+  }
+
+  result.entries.resize(count);
+  ret = BasicConnectDeviceService_DeviceServiceSubscribeParse(info, length, &count,
+      result.entries.data());
+  result.entries.resize(count);
+  return ret;
+}
+
+
+
+std::uint32_t
+parse_radio_state(std::uint8_t * info, std::uint32_t length, radio_state & result)
+{
+  return BasicConnectDeviceService_RadioStateParse(info, length, &result.hw, &result.sw);
+}
+
+
+
+std::uint32_t
+parse_pin(std::uint8_t * info, std::uint32_t length, pin_state & result)
+{
+  return BasicConnectDeviceService_PinParse(info, length, &result.type, &result.state,
+      &result.remaining_attempts);
+}
+
+
+
+std::uint32_t
+parse_subscriber_ready(std::uint8_t * info, std::uint32_t length, subscriber_ready & result)
+{
+  wchar_t subscriber_id[MAX_STRING + 1] = {};
+  wchar_t sim_iccid[MAX_STRING + 1] = {};
+  std::uint32_t subscriber_id_len = MAX_STRING;
+  std::uint32_t sim_iccid_len = MAX_STRING;
+
+  // First pass for the number of telephone numbers only.
+  std::uint32_t count = 0;
+  auto ret = BasicConnectDeviceService_SubscriberReadyStatusParse(info, length,
+      &result.state, &subscriber_id_len, subscriber_id, &sim_iccid_len, sim_iccid,
+      &result.ready_info, nullptr, &count);
+  if (ret != MBIM_STATUS_SUCCESS || count == 0) {
+    result.subscriber_id.assign(subscriber_id, subscriber_id_len);
+    result.sim_iccid.assign(sim_iccid, sim_iccid_len);
+    return ret;
+  }
+
+  std::vector<MbimTelephoneNumber> numbers(count);
+  subscriber_id_len = MAX_STRING;
+  sim_iccid_len = MAX_STRING;
+  ret = BasicConnectDeviceService_SubscriberReadyStatusParse(info, length,
+      &result.state, &subscriber_id_len, subscriber_id, &sim_iccid_len, sim_iccid,
+      &result.ready_info, numbers.data(), &count);
+  if (ret != MBIM_STATUS_SUCCESS) {
+    return ret;
+  }
+
+  result.subscriber_id.assign(subscriber_id, subscriber_id_len);
+  result.sim_iccid.assign(sim_iccid, sim_iccid_len);
+  for (std::uint32_t i = 0 ; i < count ; ++i) {
+    result.telephone_numbers.emplace_back(numbers[i].value);
+  }
+  return ret;
+}
+
+
+
+std::uint32_t
+parse_register_state(std::uint8_t * info, std::uint32_t length, register_state & result)
+{
+  wchar_t provider_id[MAX_STRING + 1] = {};
+  wchar_t provider_name[MAX_STRING + 1] = {};
+  wchar_t roaming_text[MAX_STRING + 1] = {};
+  std::uint32_t provider_id_len = MAX_STRING;
+  std::uint32_t provider_name_len = MAX_STRING;
+  std::uint32_t roaming_text_len = MAX_STRING;
+
+  auto ret = BasicConnectDeviceService_RegisterStateParse(info, length,
+      &result.nw_error, &result.state, &result.mode,
+      &result.available_data_classes, &result.current_cellular_class,
+      &provider_id_len, provider_id,
+      &provider_name_len, provider_name,
+      &roaming_text_len, roaming_text,
+      &result.registration_flag);
+  if (ret == MBIM_STATUS_SUCCESS) {
+    result.provider_id.assign(provider_id, provider_id_len);
+    result.provider_name.assign(provider_name, provider_name_len);
+    result.roaming_text.assign(roaming_text, roaming_text_len);
+  }
+  return ret;
+}
+
+
+
+std::uint32_t
+parse_packet_service(std::uint8_t * info, std::uint32_t length, packet_service & result)
+{
+  return BasicConnectDeviceService_PacketServiceParse(info, length,
+      &result.nw_error, &result.state, &result.highest_available_data_class,
+      &result.uplink_speed, &result.downlink_speed);
+}
+
+
+
+std::uint32_t
+parse_connect(std::uint8_t * info, std::uint32_t length, connect_state & result)
+{
+  return BasicConnectDeviceService_ConnectParse(info, length,
+      &result.session_id, &result.activation_state, &result.voice_call_state,
+      &result.ip_type, result.context_type.data(), &result.nw_error);
+}
+
+
+
+std::uint32_t
+parse_ip_configuration(std::uint8_t * info, std::uint32_t length, ip_configuration & result)
+{
+  // First pass for the element counts, second pass for the elements.
+  std::uint32_t ipv4_count = 0;
+  std::uint32_t ipv6_count = 0;
+  std::uint32_t ipv4_dns_count = 0;
+  std::uint32_t ipv6_dns_count = 0;
+
+  auto ret = BasicConnectDeviceService_IpConfigurationParse(info, length,
+      &result.session_id, &result.ipv4_available, &result.ipv6_available,
+      &ipv4_count, nullptr, &ipv6_count, nullptr,
+      &result.ipv4_gateway, &result.ipv6_gateway,
+      &ipv4_dns_count, nullptr, &ipv6_dns_count, nullptr,
+      &result.ipv4_mtu, &result.ipv6_mtu);
+  if (ret != MBIM_STATUS_SUCCESS
+      || (!ipv4_count && !ipv6_count && !ipv4_dns_count && !ipv6_dns_count))
+  {
+    return ret;
+  }
+
+  result.ipv4_addresses.resize(ipv4_count);
+  result.ipv6_addresses.resize(ipv6_count);
+  result.ipv4_dns_servers.resize(ipv4_dns_count);
+  result.ipv6_dns_servers.resize(ipv6_dns_count);
+
+  ret = BasicConnectDeviceService_IpConfigurationParse(info, length,
+      &result.session_id, &result.ipv4_available, &result.ipv6_available,
+      &ipv4_count, result.ipv4_addresses.data(),
+      &ipv6_count, result.ipv6_addresses.data(),
+      &result.ipv4_gateway, &result.ipv6_gateway,
+      &ipv4_dns_count, result.ipv4_dns_servers.data(),
+      &ipv6_dns_count, result.ipv6_dns_servers.data(),
+      &result.ipv4_mtu, &result.ipv6_mtu);
+
+  result.ipv4_addresses.resize(ipv4_count);
+  result.ipv6_addresses.resize(ipv6_count);
+  result.ipv4_dns_servers.resize(ipv4_dns_count);
+  result.ipv6_dns_servers.resize(ipv6_dns_count);
+  return ret;
+}
+
+
+
+mbim_error::mbim_error(std::uint32_t status)
+  : std::runtime_error{status_message(status)}
+  , m_status{status}
+{
+}
+
+
+
+typed_command<subscribe_list>
+device_service_subscribe(std::vector<MbimEventEntry> const & entries)
+{
+  auto copy = entries;
+  auto cmd = build_payload<subscribe_list>(BasicConnectDeviceService_DeviceServiceSubscribeSetBuild,
+      static_cast<std::uint32_t>(copy.size()), copy.data());
+  cmd.parse = parse_subscribe_list;
+  return cmd;
+}
+
+
+
+typed_command<radio_state>
+radio_state_query()
+{
+  auto cmd = build_query<radio_state>(BasicConnectDeviceService_RadioStateQueryBuild);
+  cmd.parse = parse_radio_state;
+  return cmd;
+}
+
+
+
+typed_command<radio_state>
+radio_state_set(MBIM_RADIO_SWITCH_STATE state)
+{
+  auto cmd = build_payload<radio_state>(BasicConnectDeviceService_RadioStateSetBuild, state);
+  cmd.parse = parse_radio_state;
+  return cmd;
+}
+
+
+
+typed_command<pin_state>
+pin_query()
+{
+  auto cmd = build_query<pin_state>(BasicConnectDeviceService_PinQueryBuild);
+  cmd.parse = parse_pin;
+  return cmd;
+}
+
+
+
+typed_command<pin_state>
+pin_set(MBIM_PIN_TYPE type, MBIM_PIN_OPERATION operation,
+    std::wstring const & pin, std::wstring const & new_pin)
+{
+  std::wstring pin_copy;
+  std::wstring new_pin_copy;
+  auto cmd = build_payload<pin_state>(BasicConnectDeviceService_PinSetBuild,
+      type, operation, writable(pin_copy, pin), writable(new_pin_copy, new_pin));
+  cmd.parse = parse_pin;
+  return cmd;
+}
+
+
+
+typed_command<subscriber_ready>
+subscriber_ready_query()
+{
+  auto cmd = build_query<subscriber_ready>(BasicConnectDeviceService_SubscriberReadyStatusQueryBuild);
+  cmd.parse = parse_subscriber_ready;
+  return cmd;
+}
+
+
+
+typed_command<register_state>
+register_state_query()
+{
+  auto cmd = build_query<register_state>(BasicConnectDeviceService_RegisterStateQueryBuild);
+  cmd.parse = parse_register_state;
+  return cmd;
+}
+
+
+
+typed_command<packet_service>
+packet_service_query()
+{
+  auto cmd = build_query<packet_service>(BasicConnectDeviceService_PacketServiceQueryBuild);
+  cmd.parse = parse_packet_service;
+  return cmd;
+}
+
+
+
+typed_command<packet_service>
+packet_service_set(MBIM_PACKET_SERVICE_ACTION action)
+{
+  auto cmd = build_payload<packet_service>(BasicConnect_DeviceService_PacketServiceSetBuild, action);
+  cmd.parse = parse_packet_service;
+  return cmd;
+}
+
+
+
+typed_command<connect_state>
+connect_query(std::uint32_t session_id)
+{
+  auto cmd = build_payload<connect_state>(BasicConnectDeviceService_ConnectQueryBuild, session_id);
+  cmd.parse = parse_connect;
+  return cmd;
+}
+
+
+
+typed_command<connect_state>
+connect_set(std::uint32_t session_id, connect_parameters const & params)
+{
+  std::wstring access_string;
+  std::wstring user_name;
+  std::wstring password;
+  auto context_type = params.context_type;
+
+  auto cmd = build_payload<connect_state>(BasicConnectDeviceService_ConnectSetBuild,
+      session_id, params.command,
+      writable(access_string, params.access_string),
+      writable(user_name, params.user_name),
+      writable(password, params.password),
+      params.compression, params.auth_protocol, params.ip_type, context_type.data());
+  cmd.parse = parse_connect;
+  return cmd;
+}
+
+
+
+typed_command<ip_configuration>
+ip_configuration_query(std::uint32_t session_id)
+{
+  auto cmd = build_payload<ip_configuration>(BasicConnectDeviceService_IpConfigurationQueryBuild,
+      session_id);
+  cmd.parse = parse_ip_configuration;
+  return cmd;
+}
+
+} // namespace linkmanager::mbim
@@ -0,0 +1,218 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_COMMANDS_H
+#define LINKMANAGER_MBIM_COMMANDS_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lite-mbim/BasicConnectDeviceService.h"
+
+namespace linkmanager::mbim {
+
+/**
+ * Failure of an MBIM command, carrying the MBIM status (or one of the
+ * MBIM_STATUS_CUSTOM_* values).
+ */
+class mbim_error : public std::runtime_error
+{
+public:
+  explicit mbim_error(std::uint32_t status);
+
+  inline std::uint32_t status() const noexcept
+  {
+    return m_status;
+  }
+
+private:
+  std::uint32_t m_status;
+};
+
+
+/**
+ * A command ready to be sent: the output of one of the Build functions in
+ * BasicConnectDeviceService.h.
+ */
+struct command
+{
+  std::uint8_t const *      service = nullptr;
+  std::uint32_t             cid = 0;
+  std::uint32_t             type = MBIM_COMMAND_TYPE_QUERY;
+  std::vector<std::uint8_t> payload;
+};
+
+
+/**
+ * A command together with the Parse function for its response.
+ *
+ * Completion callbacks receive the MBIM status, and the parsed result if the
+ * status is MBIM_STATUS_SUCCESS; the status is MBIM_STATUS_CUSTOM_PARSE_FAILURE
+ * if the response could not be parsed.
+ */
+template <typename T>
+struct typed_command : public command
+{
+  using result_type = T;
+  using callback = std::function<void (std::uint32_t status, T const & result)>;
+
+  std::uint32_t (*parse)(std::uint8_t * info, std::uint32_t length, T & result) = nullptr;
+};
+
+
+/**
+ * Parsed responses.
+ */
+struct subscribe_list
+{
+  std::vector<MbimEventEntry> entries;
+};
+
+
+struct radio_state
+{
+  MBIM_RADIO_SWITCH_STATE   hw = MBIMRadioOff;
+  MBIM_RADIO_SWITCH_STATE   sw = MBIMRadioOff;
+};
+
+
+struct pin_state
+{
+  MBIM_PIN_TYPE             type = MBIMPinTypeNone;
+  MBIM_PIN_STATE            state = MBIMPinStateUnlocked;
+  std::uint32_t             remaining_attempts = 0;
+};
+
+
+struct subscriber_ready
+{
+  MBIM_SUBSCRIBER_READY_STATE state = MBIMSubscriberReadyStateNotInitialized;
+  std::wstring              subscriber_id;
+  std::wstring              sim_iccid;
+  MBIM_UNIQUE_ID_FLAGS      ready_info = MBIMReadyInfoFlagsNone;
+  std::vector<std::wstring> telephone_numbers;
+};
+
+
+struct register_state
+{
+  std::uint32_t             nw_error = 0;
+  MBIM_REGISTER_STATE       state = MBIMRegisterStateUnknown;
+  MBIM_REGISTER_MODE        mode = MBIMRegisterModeUnknown;
+  std::uint32_t             available_data_classes = 0;
+  std::uint32_t             current_cellular_class = 0;
+  std::wstring              provider_id;
+  std::wstring              provider_name;
+  std::wstring              roaming_text;
+  std::uint32_t             registration_flag = 0;
+};
+
+
+struct packet_service
+{
+  std::uint32_t             nw_error = 0;
+  MBIM_PACKET_SERVICE_STATE state = MBIMPacketServiceStateUnknown;
+  std::uint32_t             highest_available_data_class = 0;
+  std::uint64_t             uplink_speed = 0;
+  std::uint64_t             downlink_speed = 0;
+};
+
+
+struct connect_state
+{
+  std::uint32_t             session_id = 0;
+  MBIM_ACTIVATION_STATE     activation_state = MBIMActivationStateUnknown;
+  MBIM_VOICE_CALL_STATE     voice_call_state = MBIMVoiceCallStateNone;
+  MBIM_CONTEXT_IP_TYPE      ip_type = MBIMContextIPTypeDefault;
+  std::array<std::uint8_t, MBIM_UUID_SIZE> context_type = {};
+  std::uint32_t             nw_error = 0;
+};
+
+
+struct ip_configuration
+{
+  std::uint32_t                   session_id = 0;
+  std::uint32_t                   ipv4_available = 0;
+  std::uint32_t                   ipv6_available = 0;
+  std::vector<MBIM_IPV4_ELEMENT>  ipv4_addresses;
+  std::vector<MBIM_IPV6_ELEMENT>  ipv6_addresses;
+  MBIM_IPV4_ADDRESS               ipv4_gateway = {};
+  MBIM_IPV6_ADDRESS               ipv6_gateway = {};
+  std::vector<MBIM_IPV4_ADDRESS>  ipv4_dns_servers;
+  std::vector<MBIM_IPV6_ADDRESS>  ipv6_dns_servers;
+  std::uint32_t                   ipv4_mtu = 0;
+  std::uint32_t                   ipv6_mtu = 0;
+};
+
+
+/**
+ * Parameters of a connect (activation) request.
+ */
+struct connect_parameters
+{
+  MBIM_ACTIVATION_COMMAND   command = MBIMActivationCommandActivate;
+  std::wstring              access_string;
+  std::wstring              user_name;
+  std::wstring              password;
+  MBIM_COMPRESSION          compression = MBIMCompressionNone;
+  MBIM_AUTH_PROTOCOL        auth_protocol = MBIMAuthProtocolNone;
+  MBIM_CONTEXT_IP_TYPE      ip_type = MBIMContextIPTypeDefault;
+  std::array<std::uint8_t, MBIM_UUID_SIZE> context_type = MBIMContextTypeInternet;
+};
+
+
+/**
+ * Command builders. These throw mbim_error with
+ * MBIM_STATUS_CUSTOM_BUILD_FAILURE if the Build function fails.
+ */
+typed_command<subscribe_list> device_service_subscribe(
+    std::vector<MbimEventEntry> const & entries);
+
+typed_command<radio_state> radio_state_query();
+typed_command<radio_state> radio_state_set(MBIM_RADIO_SWITCH_STATE state);
+
+typed_command<pin_state> pin_query();
+typed_command<pin_state> pin_set(MBIM_PIN_TYPE type, MBIM_PIN_OPERATION operation,
+    std::wstring const & pin, std::wstring const & new_pin = {});
+
+typed_command<subscriber_ready> subscriber_ready_query();
+
+typed_command<register_state> register_state_query();
+
+typed_command<packet_service> packet_service_query();
+typed_command<packet_service> packet_service_set(MBIM_PACKET_SERVICE_ACTION action);
+
+typed_command<connect_state> connect_query(std::uint32_t session_id);
+typed_command<connect_state> connect_set(std::uint32_t session_id,
+    connect_parameters const & params);
+
+typed_command<ip_configuration> ip_configuration_query(std::uint32_t session_id);
+
+
+/**
+ * Parse functions, as used for command responses. Indications of the same
+ * CIDs carry the same payload, so these parse them as well.
+ */
+std::uint32_t parse_subscribe_list(std::uint8_t * info, std::uint32_t length,
+    subscribe_list & result);
+std::uint32_t parse_radio_state(std::uint8_t * info, std::uint32_t length,
+    radio_state & result);
+std::uint32_t parse_pin(std::uint8_t * info, std::uint32_t length, pin_state & result);
+std::uint32_t parse_subscriber_ready(std::uint8_t * info, std::uint32_t length,
+    subscriber_ready & result);
+std::uint32_t parse_register_state(std::uint8_t * info, std::uint32_t length,
+    register_state & result);
+std::uint32_t parse_packet_service(std::uint8_t * info, std::uint32_t length,
+    packet_service & result);
+std::uint32_t parse_connect(std::uint8_t * info, std::uint32_t length,
+    connect_state & result);
+std::uint32_t parse_ip_configuration(std::uint8_t * info, std::uint32_t length,
+    ip_configuration & result);
+
+} // namespace linkmanager::mbim
+
+#endif // guard
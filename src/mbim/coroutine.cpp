@@ -0,0 +1,150 @@
+/*
+ *
+ */
+#include "coroutine.h"
+
+namespace linkmanager::mbim {
+
+coroutine_context::coroutine_context(async_transport & transport, api::event_loop & loop)
+  : m_transport{transport}
+  , m_loop{loop}
+{
+}
+
+
+
+coroutine_context::~coroutine_context()
+{
+  // Nothing should be outstanding any longer; if something is, make sure no
+  // timer refers to this context.
+  for (auto const & op : m_operations) {
+    if (op->timer != api::event_loop::INVALID_HANDLE) {
+      m_loop.remove(op->timer);
+    }
+  }
+}
+
+
+
+coroutine_context::sleep_awaiter
+coroutine_context::sleep(std::chrono::milliseconds duration)
+{
+  return sleep_awaiter{*this, duration};
+}
+
+
+
+void
+coroutine_context::cancel()
+{
+  m_cancelled = true;
+
+  // Cancelling commands completes them synchronously, which posts their
+  // resumption; sleeps are resumed the same way.
+  auto ops = m_operations;
+  for (auto const & op : ops) {
+    if (op->transaction_id) {
+      m_transport.cancel(op->transaction_id);
+    }
+    else if (op->timer != api::event_loop::INVALID_HANDLE) {
+      m_loop.remove(op->timer);
+      op->timer = api::event_loop::INVALID_HANDLE;
+      op->status = MBIM_STATUS_CUSTOM_CANCELLED;
+      m_loop.post([op]() { op->context->finish(op); });
+    }
+  }
+}
+
+
+
+void
+coroutine_context::start_timer(operation_ptr const & op, std::chrono::milliseconds timeout)
+{
+  m_operations.insert(op);
+  op->timer = m_loop.add_timer(timeout, {}, [op]()
+      {
+        op->timer = api::event_loop::INVALID_HANDLE;
+        op->context->timed_out(op);
+      });
+}
+
+
+
+void
+coroutine_context::timed_out(operation_ptr const & op)
+{
+  if (!op->transaction_id) {
+    // A sleep
+    finish(op);
+    return;
+  }
+
+  // If the response is already on its way, cancel() does nothing, and the
+  // operation completes normally.
+  op->timed_out = true;
+  m_transport.cancel(op->transaction_id);
+}
+
+
+
+void
+coroutine_context::finish(operation_ptr const & op)
+{
+  if (op->timer != api::event_loop::INVALID_HANDLE) {
+    m_loop.remove(op->timer);
+    op->timer = api::event_loop::INVALID_HANDLE;
+  }
+  if (!m_operations.erase(op)) {
+    // Already resumed.
+    return;
+  }
+
+  if (op->timed_out && op->status == MBIM_STATUS_CUSTOM_CANCELLED) {
+    op->status = MBIM_STATUS_READ_FAILURE;
+  }
+  op->handle.resume();
+}
+
+
+
+coroutine_context::sleep_awaiter::sleep_awaiter(coroutine_context & context,
+    std::chrono::milliseconds duration)
+  : m_duration{duration}
+  , m_op{std::make_shared<operation>()}
+{
+  m_op->context = &context;
+}
+
+
+
+bool
+coroutine_context::sleep_awaiter::await_ready() const noexcept
+{
+  if (m_op->context->cancelled()) {
+    m_op->status = MBIM_STATUS_CUSTOM_CANCELLED;
+    return true;
+  }
+  return false;
+}
+
+
+
+bool
+coroutine_context::sleep_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+  m_op->handle = h;
+  m_op->context->start_timer(m_op, m_duration);
+  return true;
+}
+
+
+
+void
+coroutine_context::sleep_awaiter::await_resume()
+{
+  if (m_op->status != MBIM_STATUS_SUCCESS) {
+    throw mbim_error{m_op->status};
+  }
+}
+
+} // namespace linkmanager::mbim
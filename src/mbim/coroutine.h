@@ -0,0 +1,464 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_COROUTINE_H
+#define LINKMANAGER_MBIM_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "linkmanager::mbim coroutines require C++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+#include <linkmanager/api/event_loop.h>
+
+#include "async.h"
+
+namespace linkmanager::mbim {
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct promise_base
+{
+  std::coroutine_handle<> continuation;
+  std::exception_ptr      error;
+
+  struct final_awaiter
+  {
+    inline bool await_ready() noexcept
+    {
+      return false;
+    }
+
+    template <typename P>
+    inline std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+    {
+      auto cont = h.promise().continuation;
+      return cont ? cont : std::noop_coroutine();
+    }
+
+    inline void await_resume() noexcept
+    {
+    }
+  };
+
+  inline std::suspend_always initial_suspend() noexcept
+  {
+    return {};
+  }
+
+  inline final_awaiter final_suspend() noexcept
+  {
+    return {};
+  }
+
+  inline void unhandled_exception()
+  {
+    error = std::current_exception();
+  }
+};
+
+
+template <typename T>
+struct promise : public promise_base
+{
+  std::optional<T> value;
+
+  inline task<T> get_return_object();
+
+  inline void return_value(T v)
+  {
+    value = std::move(v);
+  }
+
+  inline T result()
+  {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return std::move(*value);
+  }
+};
+
+
+template <>
+struct promise<void> : public promise_base
+{
+  inline task<void> get_return_object();
+
+  inline void return_void()
+  {
+  }
+
+  inline void result()
+  {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+} // namespace detail
+
+
+/**
+ * A lazily started coroutine producing a T. Awaiting the task starts it, and
+ * resumes the awaiting coroutine when it finishes; exceptions propagate to
+ * the awaiting coroutine. Use spawn() to start a task from plain code.
+ */
+template <typename T>
+class task
+{
+public:
+  using promise_type = detail::promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  inline explicit task(handle_type h)
+    : m_handle{h}
+  {
+  }
+
+  inline task(task && other) noexcept
+    : m_handle{std::exchange(other.m_handle, {})}
+  {
+  }
+
+  inline task & operator=(task && other) noexcept
+  {
+    if (this != &other) {
+      if (m_handle) {
+        m_handle.destroy();
+      }
+      m_handle = std::exchange(other.m_handle, {});
+    }
+    return *this;
+  }
+
+  task(task const &) = delete;
+  task & operator=(task const &) = delete;
+
+  inline ~task()
+  {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  inline bool await_ready() const noexcept
+  {
+    return !m_handle || m_handle.done();
+  }
+
+  inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+  {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+  }
+
+  inline T await_resume()
+  {
+    return m_handle.promise().result();
+  }
+
+private:
+  handle_type m_handle;
+};
+
+
+namespace detail {
+
+template <typename T>
+inline task<T>
+promise<T>::get_return_object()
+{
+  return task<T>{std::coroutine_handle<promise<T>>::from_promise(*this)};
+}
+
+
+inline task<void>
+promise<void>::get_return_object()
+{
+  return task<void>{std::coroutine_handle<promise<void>>::from_promise(*this)};
+}
+
+
+/**
+ * Eagerly started, self-destroying coroutine used by spawn().
+ */
+struct detached
+{
+  struct promise_type
+  {
+    inline detached get_return_object() noexcept
+    {
+      return {};
+    }
+
+    inline std::suspend_never initial_suspend() noexcept
+    {
+      return {};
+    }
+
+    inline std::suspend_never final_suspend() noexcept
+    {
+      return {};
+    }
+
+    inline void return_void() noexcept
+    {
+    }
+
+    inline void unhandled_exception() noexcept
+    {
+      std::terminate();
+    }
+  };
+};
+
+
+inline detached
+run_detached(task<void> t, std::function<void (std::exception_ptr)> done)
+{
+  std::exception_ptr error;
+  try {
+    co_await t;
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (done) {
+    done(error);
+  }
+}
+
+
+template <typename T>
+inline detached
+run_detached(task<T> t, std::function<void (std::exception_ptr, T)> done)
+{
+  std::exception_ptr error;
+  T result{};
+  try {
+    result = co_await t;
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (done) {
+    done(error, std::move(result));
+  }
+}
+
+} // namespace detail
+
+
+/**
+ * Start a task on the loop thread. The completion is invoked on the loop
+ * thread with the exception the task exited with, if any; for tasks producing
+ * a value, the value is passed as well, or a default constructed value if
+ * the task failed.
+ */
+inline void
+spawn(api::event_loop & loop, task<void> t,
+    std::function<void (std::exception_ptr)> done = {})
+{
+  auto holder = std::make_shared<task<void>>(std::move(t));
+  loop.post([holder, done = std::move(done)]() mutable
+      {
+        detail::run_detached(std::move(*holder), std::move(done));
+      });
+}
+
+
+template <typename T>
+inline void
+spawn(api::event_loop & loop, task<T> t,
+    std::function<void (std::exception_ptr, T)> done)
+{
+  auto holder = std::make_shared<task<T>>(std::move(t));
+  loop.post([holder, done = std::move(done)]() mutable
+      {
+        detail::run_detached(std::move(*holder), std::move(done));
+      });
+}
+
+
+
+/**
+ * Binds an async_transport to an event loop, so that coroutines running on
+ * the loop can await MBIM commands. Any number of contexts (one per modem)
+ * may share a loop, and so a single thread.
+ *
+ * Coroutines are always resumed on the loop thread, never on the transport's
+ * read thread. A command that does not complete within its timeout is
+ * cancelled with MbimTransport_CancelTransaction(), and the awaiting
+ * coroutine receives an mbim_error with MBIM_STATUS_READ_FAILURE, as
+ * MbimTransport_ExecuteCommandSynchronously() would report. cancel() cancels
+ * all outstanding commands and sleeps with MBIM_STATUS_CUSTOM_CANCELLED.
+ *
+ * All functions must be called on the loop thread. The context must outlive
+ * all coroutines awaiting through it.
+ */
+class coroutine_context
+{
+public:
+  static constexpr std::chrono::milliseconds DEFAULT_TIMEOUT{10000};
+
+  coroutine_context(async_transport & transport, api::event_loop & loop);
+  ~coroutine_context();
+
+  coroutine_context(coroutine_context const &) = delete;
+  coroutine_context & operator=(coroutine_context const &) = delete;
+
+  /**
+   * State shared between an awaiter, the command completion and the timer.
+   */
+  struct operation
+  {
+    coroutine_context *       context = nullptr;
+    std::coroutine_handle<>   handle;
+    std::uint32_t             status = MBIM_STATUS_SUCCESS;
+    std::uint32_t             transaction_id = 0;
+    api::event_loop::handle   timer = api::event_loop::INVALID_HANDLE;
+    bool                      timed_out = false;
+  };
+
+  template <typename T>
+  class command_awaiter
+  {
+  public:
+    inline command_awaiter(coroutine_context & context, typed_command<T> cmd,
+        std::chrono::milliseconds timeout)
+      : m_cmd{std::move(cmd)}
+      , m_timeout{timeout}
+      , m_op{std::make_shared<typed_operation>()}
+    {
+      m_op->context = &context;
+    }
+
+    inline bool await_ready() const noexcept
+    {
+      if (m_op->context->cancelled()) {
+        m_op->status = MBIM_STATUS_CUSTOM_CANCELLED;
+        return true;
+      }
+      return false;
+    }
+
+    inline bool await_suspend(std::coroutine_handle<> h)
+    {
+      m_op->handle = h;
+      auto op = m_op;
+      auto & ctx = *op->context;
+      try {
+        op->transaction_id = ctx.m_transport.submit(m_cmd,
+            typename typed_command<T>::callback{
+              [op](std::uint32_t status, T const & result)
+              {
+                op->status = status;
+                op->result = result;
+                op->context->m_loop.post([op]() { op->context->finish(op); });
+              }});
+      } catch (mbim_error const & err) {
+        op->status = err.status();
+        return false;
+      }
+      ctx.start_timer(op, m_timeout);
+      return true;
+    }
+
+    inline T await_resume()
+    {
+      if (m_op->status != MBIM_STATUS_SUCCESS) {
+        throw mbim_error{m_op->status};
+      }
+      return std::move(m_op->result);
+    }
+
+  private:
+    struct typed_operation : public operation
+    {
+      T result{};
+    };
+
+    typed_command<T>                  m_cmd;
+    std::chrono::milliseconds         m_timeout;
+    std::shared_ptr<typed_operation>  m_op;
+  };
+
+  class sleep_awaiter
+  {
+  public:
+    sleep_awaiter(coroutine_context & context, std::chrono::milliseconds duration);
+
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h);
+    void await_resume();
+
+  private:
+    std::chrono::milliseconds   m_duration;
+    std::shared_ptr<operation>  m_op;
+  };
+
+  /**
+   * Send a command; awaiting the result yields the parsed response, or
+   * throws mbim_error.
+   */
+  template <typename T>
+  inline command_awaiter<T> execute(typed_command<T> cmd,
+      std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+  {
+    return command_awaiter<T>{*this, std::move(cmd), timeout};
+  }
+
+  /**
+   * Suspend the awaiting coroutine for the given duration.
+   */
+  sleep_awaiter sleep(std::chrono::milliseconds duration);
+
+  /**
+   * Cancel everything outstanding; subsequent commands and sleeps fail
+   * immediately.
+   */
+  void cancel();
+
+  inline bool cancelled() const
+  {
+    return m_cancelled;
+  }
+
+  /**
+   * Number of commands and sleeps awaited.
+   */
+  inline std::size_t outstanding() const
+  {
+    return m_operations.size();
+  }
+
+  inline api::event_loop & loop()
+  {
+    return m_loop;
+  }
+
+private:
+  using operation_ptr = std::shared_ptr<operation>;
+
+  void start_timer(operation_ptr const & op, std::chrono::milliseconds timeout);
+  void timed_out(operation_ptr const & op);
+  void finish(operation_ptr const & op);
+
+  async_transport &                   m_transport;
+  api::event_loop &                   m_loop;
+  bool                                m_cancelled = false;
+  std::unordered_set<operation_ptr>   m_operations;
+};
+
+} // namespace linkmanager::mbim
+
+#endif // guard
@@ -0,0 +1,227 @@
+/*
+ *
+ */
+#include "indications.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace linkmanager::mbim {
+
+struct indication_dispatcher::subscriber
+{
+  key                       k;
+  api::event_loop &         loop;
+  callback                  cb;
+  spsc_queue<indication>    queue;
+  std::atomic<bool>         scheduled = false;
+  std::atomic<bool>         active = true;
+
+  inline subscriber(key const & _k, api::event_loop & _loop, callback _cb,
+      std::size_t queue_size)
+    : k{_k}
+    , loop{_loop}
+    , cb{std::move(_cb)}
+    , queue{queue_size}
+  {
+  }
+
+  /**
+   * Post a drain unless one is pending. Producer side.
+   */
+  static inline void schedule(std::shared_ptr<subscriber> const & self)
+  {
+    if (!self->scheduled.exchange(true, std::memory_order_acq_rel)) {
+      self->loop.post([self]() { drain(self); });
+    }
+  }
+
+  /**
+   * Deliver queued indications. Consumer side, on the loop thread. At most
+   * a queue's worth is delivered at a time, so that a busy subscriber does
+   * not starve the rest of the loop.
+   */
+  static inline void drain(std::shared_ptr<subscriber> const & self)
+  {
+    // Clearing the flag with an exchange makes everything pushed before the
+    // producer last found the flag set visible below.
+    self->scheduled.exchange(false, std::memory_order_acq_rel);
+
+    indication ind;
+    for (std::size_t n = self->queue.capacity() ; n > 0 && self->queue.pop(ind) ; --n) {
+      if (!self->active.load(std::memory_order_acquire)) {
+        return;
+      }
+      self->cb(ind);
+    }
+
+    if (self->queue.size() > 0) {
+      schedule(self);
+    }
+  }
+};
+
+
+
+std::size_t
+indication_dispatcher::key_hash::operator()(key const & k) const noexcept
+{
+  std::uint64_t lo, hi;
+  std::memcpy(&lo, k.service.data(), sizeof(lo));
+  std::memcpy(&hi, k.service.data() + sizeof(lo), sizeof(hi));
+
+  std::uint64_t h = lo ^ (hi * 0x9e3779b97f4a7c15ULL) ^ (std::uint64_t{k.cid} << 32);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return static_cast<std::size_t>(h);
+}
+
+
+
+indication_dispatcher::indication_dispatcher()
+  : m_table{std::make_unique<table>()}
+{
+  MbimIndicator_Initialize(&m_indicator, &indication_dispatcher::indication_callback, this);
+}
+
+
+
+indication_dispatcher::indication_dispatcher(MbimTransport & transport)
+  : indication_dispatcher{}
+{
+  m_transport = &transport;
+  MbimTransport_AttachIndicator(m_transport, &m_indicator);
+}
+
+
+
+indication_dispatcher::~indication_dispatcher()
+{
+  // Detaching waits for an indication being dispatched.
+  if (m_transport) {
+    MbimTransport_DetachIndicator(m_transport, &m_indicator);
+  }
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  for (auto const & [_, sub] : m_subscribers) {
+    sub->active = false;
+  }
+}
+
+
+
+indication_dispatcher::subscription_id
+indication_dispatcher::subscribe(std::uint8_t const * service, std::uint32_t cid,
+    api::event_loop & loop, callback cb, std::size_t queue_size)
+{
+  auto k = make_key(service, cid);
+  auto sub = std::make_shared<subscriber>(k, loop, std::move(cb), queue_size);
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto next = std::make_unique<table>(*m_table.read());
+  (*next)[k].push_back(sub);
+  m_table.publish(std::move(next));
+
+  auto id = m_next_id++;
+  m_subscribers[id] = sub;
+  return id;
+}
+
+
+
+bool
+indication_dispatcher::unsubscribe(subscription_id id)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto iter = m_subscribers.find(id);
+  if (iter == m_subscribers.end()) {
+    return false;
+  }
+  auto sub = iter->second;
+  m_subscribers.erase(iter);
+
+  auto next = std::make_unique<table>(*m_table.read());
+  auto & subs = (*next)[sub->k];
+  subs.erase(std::remove(subs.begin(), subs.end(), sub), subs.end());
+  if (subs.empty()) {
+    next->erase(sub->k);
+  }
+
+  // Once published, the read thread no longer queues to the subscriber;
+  // drains already posted find it inactive.
+  m_table.publish(std::move(next));
+  sub->active = false;
+  return true;
+}
+
+
+
+void
+indication_dispatcher::dispatch(std::uint8_t const * service, std::uint32_t cid,
+    std::uint8_t const * info, std::uint32_t length)
+{
+  auto guard = m_table.read();
+  if (guard->empty()) {
+    return;
+  }
+
+  auto k = make_key(service, cid);
+  auto exact = guard->find(k);
+  k.cid = ANY_CID;
+  auto any = (cid == ANY_CID) ? guard->end() : guard->find(k);
+  if (exact == guard->end() && any == guard->end()) {
+    return;
+  }
+
+  // One copy of the payload, shared by all subscribers.
+  indication ind;
+  std::copy(service, service + MBIM_UUID_SIZE, ind.service.begin());
+  ind.cid = cid;
+  ind.payload = std::make_shared<std::vector<std::uint8_t> const>(info, info + length);
+
+  for (auto iter : {exact, any}) {
+    if (iter == guard->end()) {
+      continue;
+    }
+    for (auto const & sub : iter->second) {
+      auto copy = ind;
+      if (sub->queue.push(std::move(copy))) {
+        subscriber::schedule(sub);
+      }
+      else {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+
+
+std::uint64_t
+indication_dispatcher::dropped() const
+{
+  return m_dropped.load(std::memory_order_relaxed);
+}
+
+
+
+void
+indication_dispatcher::indication_callback(std::uint8_t * service, std::uint32_t cid,
+    std::uint8_t * info, std::uint32_t length, void * context)
+{
+  static_cast<indication_dispatcher *>(context)->dispatch(service, cid, info, length);
+}
+
+
+
+indication_dispatcher::key
+indication_dispatcher::make_key(std::uint8_t const * service, std::uint32_t cid)
+{
+  key k;
+  std::copy(service, service + MBIM_UUID_SIZE, k.service.begin());
+  k.cid = cid;
+  return k;
+}
+
+} // namespace linkmanager::mbim
@@ -0,0 +1,139 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_INDICATIONS_H
+#define LINKMANAGER_MBIM_INDICATIONS_H
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <linkmanager/api/event_loop.h>
+#include <linkmanager/rcu.h>
+#include <linkmanager/spsc_queue.h>
+
+#include "lite-mbim/MbimTransport.h"
+
+namespace linkmanager::mbim {
+
+/**
+ * An indication as delivered to subscribers. The payload is shared between
+ * all subscribers of the indication.
+ */
+struct indication
+{
+  std::array<std::uint8_t, MBIM_UUID_SIZE>          service = {};
+  std::uint32_t                                     cid = 0;
+  std::shared_ptr<std::vector<std::uint8_t> const>  payload;
+};
+
+
+/**
+ * Delivers a transport's indications to subscribers on their own event
+ * loops.
+ *
+ * Subscriptions are kept in a hash table keyed by device service and CID,
+ * which the transport's read thread looks up without taking locks (see
+ * rcu_cell). Each subscriber has a bounded lock-free queue; the read thread
+ * copies an indication once, pushes it to the queues of all matching
+ * subscribers, and posts a drain to a subscriber's loop if none is pending.
+ * The read thread therefore never runs subscriber code, and never waits for
+ * it: if a subscriber's queue is full, the indication is dropped for that
+ * subscriber and counted.
+ *
+ * Subscribing and unsubscribing may be done from any thread, but the
+ * callback is only guaranteed not to run after unsubscribe() returns if it
+ * is called on the subscriber's loop thread. Subscribers' loops must outlive
+ * their subscriptions.
+ */
+class indication_dispatcher
+{
+public:
+  using callback = std::function<void (indication const &)>;
+  using subscription_id = std::uint64_t;
+
+  static constexpr std::uint32_t ANY_CID = 0;
+  static constexpr std::size_t DEFAULT_QUEUE_SIZE = 256;
+
+  /**
+   * A dispatcher fed through dispatch() only.
+   */
+  indication_dispatcher();
+
+  /**
+   * A dispatcher fed by the transport's indications.
+   */
+  explicit indication_dispatcher(MbimTransport & transport);
+  ~indication_dispatcher();
+
+  indication_dispatcher(indication_dispatcher const &) = delete;
+  indication_dispatcher & operator=(indication_dispatcher const &) = delete;
+
+  /**
+   * Subscribe to indications of a device service's CID, or of all its CIDs
+   * with ANY_CID. The callback runs on the given loop.
+   */
+  subscription_id subscribe(std::uint8_t const * service, std::uint32_t cid,
+      api::event_loop & loop, callback cb,
+      std::size_t queue_size = DEFAULT_QUEUE_SIZE);
+
+  /**
+   * Returns false if there is no such subscription.
+   */
+  bool unsubscribe(subscription_id id);
+
+  /**
+   * Hand an indication to its subscribers. Called on the transport's read
+   * thread; only one thread may call this at a time.
+   */
+  void dispatch(std::uint8_t const * service, std::uint32_t cid,
+      std::uint8_t const * info, std::uint32_t length);
+
+  /**
+   * Indications dropped because a subscriber's queue was full.
+   */
+  std::uint64_t dropped() const;
+
+private:
+  struct subscriber;
+
+  struct key
+  {
+    std::array<std::uint8_t, MBIM_UUID_SIZE>  service;
+    std::uint32_t                             cid;
+
+    inline bool operator==(key const & other) const
+    {
+      return cid == other.cid && service == other.service;
+    }
+  };
+
+  struct key_hash
+  {
+    std::size_t operator()(key const & k) const noexcept;
+  };
+
+  using table = std::unordered_map<key, std::vector<std::shared_ptr<subscriber>>, key_hash>;
+
+  static void indication_callback(std::uint8_t * service, std::uint32_t cid,
+      std::uint8_t * info, std::uint32_t length, void * context);
+
+  static key make_key(std::uint8_t const * service, std::uint32_t cid);
+
+  MbimTransport *         m_transport = nullptr;
+  MbimIndicator           m_indicator;
+
+  rcu_cell<table>         m_table;
+  std::mutex              m_mutex;      // Serializes table updates.
+  subscription_id         m_next_id = 1;
+  std::unordered_map<subscription_id, std::shared_ptr<subscriber>> m_subscribers;
+  std::atomic<std::uint64_t>  m_dropped = 0;
+};
+
+} // namespace linkmanager::mbim
+
+#endif // guard
@@ -0,0 +1,289 @@
+/*
+ *
+ */
+#include "session_store.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace linkmanager::mbim {
+
+template <typename T>
+void
+session_store::assign(arena<T> & a, extent session_lists::* member, std::size_t index,
+    T const * data, std::size_t count)
+{
+  auto & e = m_lists[index].*member;
+  if (count > e.capacity) {
+    // Outgrown; the old space stays unused until the arena is compacted.
+    if (a.items.size() + count > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error{"Session list arena is full."};
+    }
+    a.unused += e.capacity;
+    e.offset = static_cast<std::uint32_t>(a.items.size());
+    e.capacity = static_cast<std::uint32_t>(count);
+    a.items.resize(a.items.size() + count);
+    if (a.unused > a.items.size() / 2) {
+      compact(a, member);
+    }
+  }
+
+  std::copy(data, data + count, a.items.begin() + e.offset);
+  e.size = static_cast<std::uint32_t>(count);
+}
+
+
+
+template <typename T>
+void
+session_store::compact(arena<T> & a, extent session_lists::* member)
+{
+  std::vector<T> items;
+  items.reserve(a.items.size() - a.unused);
+  for (auto & lists : m_lists) {
+    auto & e = lists.*member;
+    auto first = a.items.begin() + e.offset;
+    e.offset = static_cast<std::uint32_t>(items.size());
+    items.insert(items.end(), first, first + e.capacity);
+  }
+  a.items.swap(items);
+  a.unused = 0;
+}
+
+
+
+template <typename T>
+list_view<T>
+session_store::view(arena<T> const & a, extent session_lists::* member,
+    std::size_t index) const
+{
+  auto const & e = m_lists[index].*member;
+  return {a.items.data() + e.offset, e.size};
+}
+
+
+
+std::size_t
+session_store::add(std::uint32_t session_id)
+{
+  auto existing = find(session_id);
+  if (existing) {
+    return *existing;
+  }
+
+  m_state.emplace_back();
+  m_state.back().session_id = session_id;
+  m_lists.emplace_back();
+  return m_state.size() - 1;
+}
+
+
+
+std::optional<std::size_t>
+session_store::find(std::uint32_t session_id) const
+{
+  auto iter = std::find_if(m_state.begin(), m_state.end(),
+      [session_id](session_state const & s) { return s.session_id == session_id; });
+  if (iter == m_state.end()) {
+    return {};
+  }
+  return iter - m_state.begin();
+}
+
+
+
+void
+session_store::reset()
+{
+  m_state.clear();
+  m_lists.clear();
+
+  auto clear = [](auto & a)
+  {
+    a.items.clear();
+    a.unused = 0;
+  };
+  clear(m_ipv4_addresses);
+  clear(m_ipv6_addresses);
+  clear(m_ipv4_dns_servers);
+  clear(m_ipv6_dns_servers);
+  clear(m_routes);
+  clear(m_probes);
+}
+
+
+
+void
+session_store::set_connect_state(std::size_t index, connect_state const & state)
+{
+  auto & s = m_state[index];
+  s.activation_state = static_cast<std::uint8_t>(state.activation_state);
+  s.ip_type = static_cast<std::uint8_t>(state.ip_type);
+  if (state.activation_state == MBIMActivationStateDeactivated) {
+    clear_ip_configuration(index);
+  }
+}
+
+
+
+void
+session_store::set_ip_configuration(std::size_t index, ip_configuration const & config)
+{
+  auto & lists = m_lists[index];
+  lists.ipv4_available = config.ipv4_available;
+  lists.ipv6_available = config.ipv6_available;
+  lists.ipv4_gateway = config.ipv4_gateway;
+  lists.ipv6_gateway = config.ipv6_gateway;
+
+  assign(m_ipv4_addresses, &session_lists::ipv4_addresses, index,
+      config.ipv4_addresses.data(), config.ipv4_addresses.size());
+  assign(m_ipv6_addresses, &session_lists::ipv6_addresses, index,
+      config.ipv6_addresses.data(), config.ipv6_addresses.size());
+  assign(m_ipv4_dns_servers, &session_lists::ipv4_dns_servers, index,
+      config.ipv4_dns_servers.data(), config.ipv4_dns_servers.size());
+  assign(m_ipv6_dns_servers, &session_lists::ipv6_dns_servers, index,
+      config.ipv6_dns_servers.data(), config.ipv6_dns_servers.size());
+
+  std::uint32_t mtu = 0;
+  if (config.ipv4_available & MBIM_IPV4_CONFIGURATION_AVAILABLE_MTU) {
+    mtu = config.ipv4_mtu;
+  }
+  else if (config.ipv6_available & MBIM_IPV6_CONFIGURATION_AVAILABLE_MTU) {
+    mtu = config.ipv6_mtu;
+  }
+  m_state[index].mtu = static_cast<std::uint16_t>(
+      std::min<std::uint32_t>(mtu, std::numeric_limits<std::uint16_t>::max()));
+}
+
+
+
+void
+session_store::clear_ip_configuration(std::size_t index)
+{
+  auto & lists = m_lists[index];
+  lists.ipv4_available = 0;
+  lists.ipv6_available = 0;
+  lists.ipv4_gateway = {};
+  lists.ipv6_gateway = {};
+  lists.ipv4_addresses.size = 0;
+  lists.ipv6_addresses.size = 0;
+  lists.ipv4_dns_servers.size = 0;
+  lists.ipv6_dns_servers.size = 0;
+  m_state[index].mtu = 0;
+}
+
+
+
+void
+session_store::set_routes(std::size_t index, session_route const * routes,
+    std::size_t count)
+{
+  assign(m_routes, &session_lists::routes, index, routes, count);
+}
+
+
+
+void
+session_store::set_probes(std::size_t index, ip_prefix const * probes,
+    std::size_t count)
+{
+  assign(m_probes, &session_lists::probes, index, probes, count);
+}
+
+
+
+std::uint32_t
+session_store::ipv4_available(std::size_t index) const
+{
+  return m_lists[index].ipv4_available;
+}
+
+
+
+std::uint32_t
+session_store::ipv6_available(std::size_t index) const
+{
+  return m_lists[index].ipv6_available;
+}
+
+
+
+MBIM_IPV4_ADDRESS const &
+session_store::ipv4_gateway(std::size_t index) const
+{
+  return m_lists[index].ipv4_gateway;
+}
+
+
+
+MBIM_IPV6_ADDRESS const &
+session_store::ipv6_gateway(std::size_t index) const
+{
+  return m_lists[index].ipv6_gateway;
+}
+
+
+
+list_view<MBIM_IPV4_ELEMENT>
+session_store::ipv4_addresses(std::size_t index) const
+{
+  return view(m_ipv4_addresses, &session_lists::ipv4_addresses, index);
+}
+
+
+
+list_view<MBIM_IPV6_ELEMENT>
+session_store::ipv6_addresses(std::size_t index) const
+{
+  return view(m_ipv6_addresses, &session_lists::ipv6_addresses, index);
+}
+
+
+
+list_view<MBIM_IPV4_ADDRESS>
+session_store::ipv4_dns_servers(std::size_t index) const
+{
+  return view(m_ipv4_dns_servers, &session_lists::ipv4_dns_servers, index);
+}
+
+
+
+list_view<MBIM_IPV6_ADDRESS>
+session_store::ipv6_dns_servers(std::size_t index) const
+{
+  return view(m_ipv6_dns_servers, &session_lists::ipv6_dns_servers, index);
+}
+
+
+
+list_view<session_route>
+session_store::routes(std::size_t index) const
+{
+  return view(m_routes, &session_lists::routes, index);
+}
+
+
+
+list_view<ip_prefix>
+session_store::probes(std::size_t index) const
+{
+  return view(m_probes, &session_lists::probes, index);
+}
+
+
+
+std::size_t
+session_store::memory_size() const noexcept
+{
+  auto bytes = [](auto const & vec)
+  {
+    return vec.capacity() * sizeof(vec[0]);
+  };
+  return bytes(m_state) + bytes(m_lists)
+    + bytes(m_ipv4_addresses.items) + bytes(m_ipv6_addresses.items)
+    + bytes(m_ipv4_dns_servers.items) + bytes(m_ipv6_dns_servers.items)
+    + bytes(m_routes.items) + bytes(m_probes.items);
+}
+
+} // namespace linkmanager::mbim
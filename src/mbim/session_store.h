@@ -0,0 +1,233 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_SESSION_STORE_H
+#define LINKMANAGER_MBIM_SESSION_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "commands.h"
+
+namespace linkmanager::mbim {
+
+/**
+ * An IPv4 or IPv6 address with a prefix length; family is AF_UNSPEC if
+ * there is none.
+ */
+struct ip_prefix
+{
+  std::uint8_t                  family = 0;
+  std::uint8_t                  length = 0;
+  std::array<std::uint8_t, 16>  bytes = {};
+};
+
+
+/**
+ * A route of a session; a gateway of family AF_UNSPEC means the route is
+ * on-link.
+ */
+struct session_route
+{
+  ip_prefix dst;
+  ip_prefix gateway;
+};
+
+
+/**
+ * What is read of a session on every state change and scheduling decision,
+ * packed so that four sessions share a cache line.
+ */
+struct session_state
+{
+  enum flags : std::uint8_t
+  {
+    USE_VLAN  = 1,
+  };
+
+  std::uint32_t session_id = 0;
+  std::uint32_t ifindex = 0;
+  std::uint16_t mtu = 0;
+  std::uint16_t vlan_id = 0;
+  std::uint8_t  activation_state = MBIMActivationStateUnknown;
+  std::uint8_t  ip_type = MBIMContextIPTypeDefault;
+  std::uint8_t  flags = 0;
+};
+
+static_assert(sizeof(session_state) == 16);
+
+
+/**
+ * A read-only view of one of a session's lists.
+ */
+template <typename T>
+class list_view
+{
+public:
+  inline list_view(T const * data, std::size_t size)
+    : m_data{data}
+    , m_size{size}
+  {
+  }
+
+  inline T const * begin() const noexcept { return m_data; }
+  inline T const * end() const noexcept { return m_data + m_size; }
+  inline std::size_t size() const noexcept { return m_size; }
+  inline bool empty() const noexcept { return !m_size; }
+  inline T const & operator[](std::size_t i) const { return m_data[i]; }
+
+private:
+  T const *   m_data;
+  std::size_t m_size;
+};
+
+
+/**
+ * The sessions of one link, with their connection state, IP configuration,
+ * routes and probe destinations.
+ *
+ * The state fields read most often live in a dense array of session_state.
+ * The variable-length lists of all sessions are kept in one arena per kind
+ * of list, and each session refers to its part of them. There is no limit
+ * to the length of any list. A session keeps its space in the arenas when
+ * it disconnects, so that reconnecting with lists no longer than before
+ * allocates nothing; a session that outgrows its space gets new space at
+ * the end, and the arena is compacted once more than half of it is unused.
+ *
+ * Sessions are referred to by their index, which stays valid until reset().
+ * The store is not thread-safe; it belongs to the link's loop.
+ */
+class session_store
+{
+public:
+  /**
+   * Add a session; returns its index. If the session ID is stored already,
+   * this is the index of that session.
+   */
+  std::size_t add(std::uint32_t session_id);
+
+  /**
+   * The index of a session ID, if stored.
+   */
+  std::optional<std::size_t> find(std::uint32_t session_id) const;
+
+  /**
+   * Drop all sessions and their lists, but keep the memory.
+   */
+  void reset();
+
+  inline std::size_t size() const noexcept
+  {
+    return m_state.size();
+  }
+
+  inline session_state & state(std::size_t index)
+  {
+    return m_state[index];
+  }
+
+  inline session_state const & state(std::size_t index) const
+  {
+    return m_state[index];
+  }
+
+  /**
+   * Update a session from a connect response or indication. Deactivating a
+   * session clears its IP configuration.
+   */
+  void set_connect_state(std::size_t index, connect_state const & state);
+
+  /**
+   * Replace a session's IP configuration. The MTU of the session state is
+   * taken from it, preferring the IPv4 one.
+   */
+  void set_ip_configuration(std::size_t index, ip_configuration const & config);
+
+  /**
+   * Clear a session's IP configuration, keeping its routes and probes.
+   */
+  void clear_ip_configuration(std::size_t index);
+
+  /**
+   * Replace a session's routes or probe destinations. The data must not
+   * point into the store.
+   */
+  void set_routes(std::size_t index, session_route const * routes, std::size_t count);
+  void set_probes(std::size_t index, ip_prefix const * probes, std::size_t count);
+
+  // IP configuration, as last set.
+  std::uint32_t ipv4_available(std::size_t index) const;
+  std::uint32_t ipv6_available(std::size_t index) const;
+  MBIM_IPV4_ADDRESS const & ipv4_gateway(std::size_t index) const;
+  MBIM_IPV6_ADDRESS const & ipv6_gateway(std::size_t index) const;
+  list_view<MBIM_IPV4_ELEMENT> ipv4_addresses(std::size_t index) const;
+  list_view<MBIM_IPV6_ELEMENT> ipv6_addresses(std::size_t index) const;
+  list_view<MBIM_IPV4_ADDRESS> ipv4_dns_servers(std::size_t index) const;
+  list_view<MBIM_IPV6_ADDRESS> ipv6_dns_servers(std::size_t index) const;
+
+  list_view<session_route> routes(std::size_t index) const;
+  list_view<ip_prefix> probes(std::size_t index) const;
+
+  /**
+   * Bytes held for sessions and their lists, including unused capacity.
+   */
+  std::size_t memory_size() const noexcept;
+
+private:
+  /** A session's part of an arena. */
+  struct extent
+  {
+    std::uint32_t offset = 0;
+    std::uint32_t size = 0;
+    std::uint32_t capacity = 0;
+  };
+
+  template <typename T>
+  struct arena
+  {
+    std::vector<T>  items;
+    std::size_t     unused = 0;
+  };
+
+  /** What is read of a session only when its configuration changes. */
+  struct session_lists
+  {
+    std::uint32_t     ipv4_available = 0;
+    std::uint32_t     ipv6_available = 0;
+    MBIM_IPV4_ADDRESS ipv4_gateway = {};
+    MBIM_IPV6_ADDRESS ipv6_gateway = {};
+    extent            ipv4_addresses;
+    extent            ipv6_addresses;
+    extent            ipv4_dns_servers;
+    extent            ipv6_dns_servers;
+    extent            routes;
+    extent            probes;
+  };
+
+  template <typename T>
+  void assign(arena<T> & a, extent session_lists::* member, std::size_t index,
+      T const * data, std::size_t count);
+
+  template <typename T>
+  void compact(arena<T> & a, extent session_lists::* member);
+
+  template <typename T>
+  list_view<T> view(arena<T> const & a, extent session_lists::* member,
+      std::size_t index) const;
+
+  std::vector<session_state>      m_state;
+  std::vector<session_lists>      m_lists;
+
+  arena<MBIM_IPV4_ELEMENT>        m_ipv4_addresses;
+  arena<MBIM_IPV6_ELEMENT>        m_ipv6_addresses;
+  arena<MBIM_IPV4_ADDRESS>        m_ipv4_dns_servers;
+  arena<MBIM_IPV6_ADDRESS>        m_ipv6_dns_servers;
+  arena<session_route>            m_routes;
+  arena<ip_prefix>                m_probes;
+};
+
+} // namespace linkmanager::mbim
+
+#endif // guard
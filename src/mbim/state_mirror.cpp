@@ -0,0 +1,177 @@
+/*
+ *
+ */
+#include "state_mirror.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace linkmanager::mbim {
+
+state_mirror::state_mirror(async_transport & transport, indication_dispatcher & dispatcher,
+    api::event_loop & loop)
+  : m_transport{transport}
+  , m_dispatcher{dispatcher}
+  , m_loop{loop}
+  , m_cids{
+      radio_state_query().cid,
+      register_state_query().cid,
+      packet_service_query().cid,
+      connect_query(0).cid,
+      ip_configuration_query(0).cid,
+    }
+  , m_published{std::make_unique<modem_state const>()}
+  , m_self{std::make_shared<state_mirror *>(this)}
+{
+}
+
+
+
+state_mirror::~state_mirror()
+{
+  for (auto id : m_subscriptions) {
+    m_dispatcher.unsubscribe(id);
+  }
+}
+
+
+
+void
+state_mirror::start(std::vector<std::uint32_t> const & sessions)
+{
+  auto service = BasicConnectDeviceService_Uuid();
+  std::uint32_t const cids[] = {
+    m_cids.radio, m_cids.registration, m_cids.packet, m_cids.connect, m_cids.ip,
+  };
+
+  // Subscribe before anything can change, so that no indication is missed.
+  for (auto cid : cids) {
+    m_subscriptions.push_back(m_dispatcher.subscribe(service, cid, m_loop,
+        [this](indication const & ind)
+        {
+          // The Parse functions take a non-const buffer, and the payload is
+          // shared with other subscribers.
+          auto payload = *ind.payload;
+          update(ind.cid, payload.data(), static_cast<std::uint32_t>(payload.size()), true, 0);
+        }));
+  }
+
+  std::vector<MbimEventEntry> entries(1);
+  std::copy(service, service + MBIM_UUID_SIZE, entries[0].DeviceServiceId);
+  entries[0].CidCount = std::size(cids);
+  std::copy(std::begin(cids), std::end(cids), entries[0].Cids);
+  m_transport.submit_raw(device_service_subscribe(entries),
+      [](std::uint32_t, std::uint8_t *, std::uint32_t) {});
+
+  refresh(sessions);
+}
+
+
+
+void
+state_mirror::refresh(std::vector<std::uint32_t> const & sessions)
+{
+  prime(radio_state_query());
+  prime(register_state_query());
+  prime(packet_service_query());
+  for (auto session_id : sessions) {
+    prime(connect_query(session_id));
+    prime(ip_configuration_query(session_id));
+  }
+}
+
+
+
+void
+state_mirror::prime(command const & cmd)
+{
+  std::weak_ptr<state_mirror *> self = m_self;
+  auto & loop = m_loop;
+  auto cid = cmd.cid;
+  auto sent = m_indications.load();
+  m_transport.submit_raw(cmd,
+      [self, &loop, cid, sent](std::uint32_t status, std::uint8_t * info, std::uint32_t length)
+      {
+        if (status != MBIM_STATUS_SUCCESS) {
+          return;
+        }
+        auto payload = std::make_shared<std::vector<std::uint8_t>>(info, info + length);
+        loop.post([self, cid, sent, payload]()
+            {
+              if (auto mirror = self.lock()) {
+                (*mirror)->update(cid, payload->data(),
+                    static_cast<std::uint32_t>(payload->size()), false, sent);
+              }
+            });
+      });
+}
+
+
+
+void
+state_mirror::update(std::uint32_t cid, std::uint8_t * info, std::uint32_t length,
+    bool indicated, std::uint64_t sent)
+{
+  // Indicated state wins over the response to a query sent before the
+  // indication, which may have been generated before it.
+  auto seen = [this, cid, indicated, sent](std::uint32_t session_id)
+  {
+    auto key = std::make_pair(cid, session_id);
+    if (indicated) {
+      m_indicated[key] = ++m_indications;
+      return false;
+    }
+    auto iter = m_indicated.find(key);
+    return iter != m_indicated.end() && iter->second > sent;
+  };
+
+  if (cid == m_cids.radio) {
+    radio_state radio;
+    if (parse_radio_state(info, length, radio) != MBIM_STATUS_SUCCESS || seen(0)) {
+      return;
+    }
+    m_state.radio = radio;
+  }
+  else if (cid == m_cids.registration) {
+    register_state registration;
+    if (parse_register_state(info, length, registration) != MBIM_STATUS_SUCCESS || seen(0)) {
+      return;
+    }
+    m_state.registration = std::move(registration);
+  }
+  else if (cid == m_cids.packet) {
+    packet_service packet;
+    if (parse_packet_service(info, length, packet) != MBIM_STATUS_SUCCESS || seen(0)) {
+      return;
+    }
+    m_state.packet = packet;
+  }
+  else if (cid == m_cids.connect) {
+    connect_state conn;
+    if (parse_connect(info, length, conn) != MBIM_STATUS_SUCCESS || seen(conn.session_id)) {
+      return;
+    }
+    if (conn.activation_state == MBIMActivationStateDeactivated) {
+      m_state.sessions.erase(conn.session_id);
+      m_state.ip.erase(conn.session_id);
+    }
+    else {
+      m_state.sessions[conn.session_id] = conn;
+    }
+  }
+  else if (cid == m_cids.ip) {
+    ip_configuration ip;
+    if (parse_ip_configuration(info, length, ip) != MBIM_STATUS_SUCCESS || seen(ip.session_id)) {
+      return;
+    }
+    m_state.ip[ip.session_id] = std::move(ip);
+  }
+  else {
+    return;
+  }
+
+  ++m_state.version;
+  m_published.publish(std::make_unique<modem_state const>(m_state));
+}
+
+} // namespace linkmanager::mbim
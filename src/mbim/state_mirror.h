@@ -0,0 +1,151 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_MBIM_STATE_MIRROR_H
+#define LINKMANAGER_MBIM_STATE_MIRROR_H
+
+#include <atomic>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <linkmanager/rcu.h>
+
+#include "async.h"
+#include "indications.h"
+
+namespace linkmanager::mbim {
+
+/**
+ * What is known about a modem's state.
+ */
+struct modem_state
+{
+  radio_state               radio;
+  register_state            registration;
+  packet_service            packet;
+
+  /** By session ID; deactivated sessions are removed. */
+  std::map<std::uint32_t, connect_state>    sessions;
+  std::map<std::uint32_t, ip_configuration> ip;
+
+  /** Incremented with every published change. */
+  std::uint64_t             version = 0;
+
+  inline bool powered_on() const
+  {
+    return radio.hw == MBIMRadioOn && radio.sw == MBIMRadioOn;
+  }
+
+  inline bool registered() const
+  {
+    return registration.state == MBIMRegisterStateHome
+      || registration.state == MBIMRegisterStateRoaming
+      || registration.state == MBIMRegisterStatePartner;
+  }
+
+  inline bool attached() const
+  {
+    return packet.state == MBIMPacketServiceStateAttached;
+  }
+
+  inline bool is_active(std::uint32_t session_id) const
+  {
+    auto iter = sessions.find(session_id);
+    return iter != sessions.end()
+      && iter->second.activation_state == MBIMActivationStateActivated;
+  }
+};
+
+
+/**
+ * Mirrors a modem's radio, registration, packet service, connection and IP
+ * configuration state from its indications, so that status reads never
+ * send commands to the modem.
+ *
+ * start() sets the modem's subscribe list to these indications, and queries
+ * the current state once; refresh() queries it again. From then on,
+ * indications are parsed on the given loop, and each change is published as
+ * a new modem_state snapshot. A query response is ignored if the field was
+ * indicated after the query was sent, as it may be older. Reads
+ * are lock-free and may be done from any thread (see rcu_cell); read guards
+ * should not be held for long, as publishing waits for them.
+ *
+ * Note that the subscribe list replaces any previous one for the function.
+ * The mirror must be destroyed on the loop's thread.
+ */
+class state_mirror
+{
+public:
+  state_mirror(async_transport & transport, indication_dispatcher & dispatcher,
+      api::event_loop & loop);
+  ~state_mirror();
+
+  state_mirror(state_mirror const &) = delete;
+  state_mirror & operator=(state_mirror const &) = delete;
+
+  /**
+   * Subscribe to indications and query the current state, including that of
+   * the given sessions. Throws mbim_error if a command cannot be sent.
+   */
+  void start(std::vector<std::uint32_t> const & sessions = {});
+
+  /**
+   * Query the current state again, e.g. when indications may have been
+   * lost. Throws mbim_error if a command cannot be sent.
+   */
+  void refresh(std::vector<std::uint32_t> const & sessions = {});
+
+  inline rcu_cell<modem_state>::read_guard read() const
+  {
+    return m_published.read();
+  }
+
+  inline bool is_powered_on() const
+  {
+    return read()->powered_on();
+  }
+
+  inline bool is_active(std::uint32_t session_id) const
+  {
+    return read()->is_active(session_id);
+  }
+
+private:
+  struct mirrored_cids
+  {
+    std::uint32_t radio;
+    std::uint32_t registration;
+    std::uint32_t packet;
+    std::uint32_t connect;
+    std::uint32_t ip;
+  };
+
+  void prime(command const & cmd);
+  void update(std::uint32_t cid, std::uint8_t * info, std::uint32_t length,
+      bool indicated, std::uint64_t sent);
+
+  async_transport &           m_transport;
+  indication_dispatcher &     m_dispatcher;
+  api::event_loop &           m_loop;
+  mirrored_cids               m_cids;
+  std::vector<indication_dispatcher::subscription_id> m_subscriptions;
+
+  // Loop thread only
+  modem_state                 m_state;
+  // By CID, and session ID for per-session CIDs: the number of the last
+  // indication, from m_indications.
+  std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint64_t> m_indicated;
+
+  // Indications applied so far; queries note it when they are sent.
+  std::atomic<std::uint64_t>  m_indications{0};
+
+  rcu_cell<modem_state>       m_published;
+
+  // Keeps query completions from touching a destroyed mirror.
+  std::shared_ptr<state_mirror *> m_self;
+};
+
+} // namespace linkmanager::mbim
+
+#endif // guard
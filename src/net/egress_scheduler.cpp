@@ -0,0 +1,415 @@
+/*
+ *
+ */
+#include "egress_scheduler.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include <linkmanager/api/modules.h>
+
+#include "../common/netlink_util.h"
+
+#include <liberate/logging.h>
+
+namespace linkmanager::net {
+namespace {
+
+static constexpr double MAX_WEIGHT = NL_NEXTHOP_MAX_WEIGHT;
+
+/**
+ * The gateway of the interface's default route of the given family, or none
+ * if the interface has no such route, or it is on-link.
+ */
+address
+default_gateway(interface const & iface, int family)
+{
+  route const * best = nullptr;
+  for (auto const & rt : iface.routes) {
+    if (rt.dst.family != family || rt.dst.prefix_length != 0
+        || rt.gateway.family != family)
+    {
+      continue;
+    }
+    if (!best || rt.priority < best->priority) {
+      best = &rt;
+    }
+  }
+  return best ? best->gateway : address{};
+}
+
+
+
+std::string
+address_only(address const & addr)
+{
+  char buf[INET6_ADDRSTRLEN] = { 0 };
+  ::inet_ntop(addr.family, addr.bytes.data(), buf, sizeof(buf));
+  return buf;
+}
+
+} // anonymous namespace
+
+
+
+bool
+netlink_nexthop_table::set_nexthop(std::uint32_t id, int family, std::string const & device,
+    address const & gateway)
+{
+  if (gateway.family == family) {
+    return NlSetNexthop(id, family, device.c_str(), address_only(gateway).c_str()) == 0;
+  }
+  return NlSetNexthop(id, family, device.c_str(), nullptr) == 0;
+}
+
+
+
+bool
+netlink_nexthop_table::set_group(std::uint32_t id, std::vector<weighted_nexthop> const & members)
+{
+  std::vector<nlnhmember> group(members.size());
+  for (std::size_t i = 0 ; i < members.size() ; ++i) {
+    group[i].nId = members[i].id;
+    group[i].nWeight = members[i].weight;
+  }
+  return NlSetNexthopGroup(id, group.data(), group.size()) == 0;
+}
+
+
+
+bool
+netlink_nexthop_table::set_default_route(int family, std::uint32_t table,
+    std::uint32_t metric, std::uint32_t nexthop_id)
+{
+  return NlSetDefaultRouteNexthop(family, table, metric, nexthop_id) == 0;
+}
+
+
+
+bool
+netlink_nexthop_table::remove(std::uint32_t id)
+{
+  return NlDeleteNexthop(id) == 0;
+}
+
+
+
+struct egress_scheduler::candidate
+{
+  std::string                           device;
+  api::modules::device::metrics         metrics;
+  address                               gateway;
+  double                                score = 0;
+  std::uint16_t                         weight = 0;
+};
+
+
+
+egress_scheduler::egress_scheduler(api::event_loop & loop, module_registry const & registry,
+    link_monitor & links, nexthop_table & nexthops, options const & opts)
+  : m_loop{loop}
+  , m_registry{registry}
+  , m_links{links}
+  , m_nexthops{nexthops}
+  , m_opts{opts}
+  , m_next_id{opts.group_id + 1}
+{
+  if (opts.family != AF_INET && opts.family != AF_INET6) {
+    throw std::invalid_argument("Multipath family must be AF_INET or AF_INET6.");
+  }
+  if (!opts.group_id) {
+    throw std::invalid_argument("Nexthop group ID must not be zero.");
+  }
+  if (!opts.table) {
+    throw std::invalid_argument("Multipath routing table must not be zero.");
+  }
+  if (opts.interval.count() <= 0 || opts.settle.count() <= 0) {
+    throw std::invalid_argument("Multipath intervals must be positive.");
+  }
+  if (opts.min_weight_change < 0) {
+    throw std::invalid_argument("Minimum weight change must not be negative.");
+  }
+}
+
+
+
+egress_scheduler::~egress_scheduler()
+{
+  if (m_subscription) {
+    m_links.unsubscribe(m_subscription);
+  }
+  if (m_timer != api::event_loop::INVALID_HANDLE) {
+    m_loop.remove(m_timer);
+  }
+  if (m_settle_timer != api::event_loop::INVALID_HANDLE) {
+    m_loop.remove(m_settle_timer);
+  }
+  withdraw();
+}
+
+
+
+void
+egress_scheduler::start()
+{
+  m_subscription = m_links.subscribe({}, [this](link_event const & ev)
+      {
+        // The kernel flushes the nexthops of a device that goes down, and
+        // with them the group if it was the last; what was programmed
+        // cannot be relied on any longer.
+        if (ev.type == link_event::LINK_DOWN || ev.type == link_event::LINK_REMOVED) {
+          for (auto const & m : m_members) {
+            if (m.device == ev.name) {
+              m_stale = true;
+            }
+          }
+        }
+
+        if (m_settle_timer == api::event_loop::INVALID_HANDLE) {
+          m_settle_timer = m_loop.add_timer(m_opts.settle, std::chrono::nanoseconds{0},
+              [this]()
+              {
+                m_settle_timer = api::event_loop::INVALID_HANDLE;
+                update();
+              });
+        }
+      });
+
+  m_timer = m_loop.add_timer(m_opts.interval, m_opts.interval, [this]() { update(); });
+  if (m_timer == api::event_loop::INVALID_HANDLE) {
+    LIBLOG_ERROR("Could not add multipath timer; weights follow link changes only.");
+  }
+
+  update();
+}
+
+
+
+void
+egress_scheduler::update()
+{
+  auto cands = candidates();
+  assign_weights(cands);
+
+  bool stale = m_stale;
+  m_stale = false;
+  bool changed = stale;
+
+  // The kernel may have removed the group, and the route with it; adding
+  // the route again replaces it if not.
+  if (stale) {
+    m_route_installed = false;
+  }
+
+  std::vector<member> next;
+  next.reserve(cands.size());
+  for (auto const & c : cands) {
+    auto iter = std::lower_bound(m_members.begin(), m_members.end(), c.device,
+        [](member const & m, std::string const & name) { return m.device < name; });
+    bool known = iter != m_members.end() && iter->device == c.device;
+
+    member m;
+    if (known) {
+      m = *iter;
+    }
+    else {
+      m.device = c.device;
+      m.id = m_next_id++;
+    }
+
+    // Replacing a nexthop keeps it in the group.
+    if (!known || stale || m.gateway != c.gateway) {
+      m.gateway = c.gateway;
+      if (!m_nexthops.set_nexthop(m.id, m_opts.family, m.device, m.gateway)) {
+        LIBLOG_ERROR("Could not add nexthop " << m.id << " through " << m.device
+            << "; leaving it out.");
+        continue;
+      }
+    }
+
+    auto moved = std::abs(int{c.weight} - int{m.weight});
+    if (!known || stale || moved > m_opts.min_weight_change * m.weight) {
+      changed = changed || !known || m.weight != c.weight;
+      m.weight = c.weight;
+    }
+
+    next.push_back(std::move(m));
+  }
+
+  // Devices that are gone leave the group before their nexthops are
+  // removed.
+  std::vector<std::uint32_t> removed;
+  for (auto const & m : m_members) {
+    auto iter = std::find_if(next.begin(), next.end(),
+        [&m](member const & n) { return n.id == m.id; });
+    if (iter == next.end()) {
+      removed.push_back(m.id);
+      changed = true;
+    }
+  }
+
+  m_members = std::move(next);
+  if (changed) {
+    program_group();
+  }
+
+  // Their device may be gone, and the nexthop with it.
+  for (auto id : removed) {
+    m_nexthops.remove(id);
+  }
+}
+
+
+
+std::vector<egress_scheduler::candidate>
+egress_scheduler::candidates() const
+{
+  // Copy the modules out, so as not to hold up registration while querying
+  // links.
+  std::vector<module_registry::module_snapshot::entry> modules;
+  {
+    auto snap = m_registry.snapshot();
+    modules = snap->entries;
+  }
+
+  std::vector<candidate> ret;
+  for (auto const & [name, mod] : modules) {
+    for (auto const & link : mod->links()) {
+      if (!link || !link->is_active()) {
+        continue;
+      }
+      for (auto const & dev : link->devices()) {
+        if (dev && dev->is_up()) {
+          candidate c;
+          c.device = dev->name();
+          c.metrics = dev->get_metrics();
+          ret.push_back(std::move(c));
+        }
+      }
+    }
+  }
+
+  // Only devices whose interface is up carry traffic.
+  {
+    auto table = m_links.read();
+    ret.erase(std::remove_if(ret.begin(), ret.end(), [&](candidate & c)
+          {
+            auto iface = table->find(c.device);
+            if (!iface || !iface->is_up()) {
+              return true;
+            }
+            c.gateway = default_gateway(*iface, m_opts.family);
+            return false;
+          }),
+        ret.end());
+  }
+
+  std::sort(ret.begin(), ret.end(),
+      [](candidate const & a, candidate const & b) { return a.device < b.device; });
+  ret.erase(std::unique(ret.begin(), ret.end(),
+        [](candidate const & a, candidate const & b) { return a.device == b.device; }),
+      ret.end());
+  return ret;
+}
+
+
+
+void
+egress_scheduler::assign_weights(std::vector<candidate> & cands) const
+{
+  double known = 0;
+  std::size_t known_count = 0;
+  for (auto const & c : cands) {
+    if (c.metrics.capacity_bps) {
+      known += static_cast<double>(c.metrics.capacity_bps);
+      ++known_count;
+    }
+  }
+  auto mean = known_count ? known / known_count : 1.0;
+
+  double max = 0;
+  auto reference = static_cast<double>(m_opts.reference_rtt.count());
+  for (auto & c : cands) {
+    c.score = c.metrics.capacity_bps ? static_cast<double>(c.metrics.capacity_bps) : mean;
+    auto rtt = static_cast<double>(c.metrics.rtt.count());
+    if (rtt > reference && reference > 0) {
+      c.score *= reference / rtt;
+    }
+    max = std::max(max, c.score);
+  }
+
+  for (auto & c : cands) {
+    auto weight = std::lround(MAX_WEIGHT * c.score / max);
+    c.weight = static_cast<std::uint16_t>(std::clamp(weight, 1L,
+          static_cast<long>(MAX_WEIGHT)));
+  }
+}
+
+
+
+bool
+egress_scheduler::program_group()
+{
+  if (m_members.empty()) {
+    if (m_group_installed) {
+      LIBLOG_INFO("No devices for egress; removing the multipath route.");
+      m_nexthops.remove(m_opts.group_id);
+    }
+    m_group_installed = false;
+    m_route_installed = false;
+    return true;
+  }
+
+  std::vector<weighted_nexthop> group;
+  std::ostringstream desc;
+  for (auto const & m : m_members) {
+    group.push_back({m.id, m.weight});
+    desc << " " << m.device << "x" << m.weight;
+  }
+
+  if (!m_nexthops.set_group(m_opts.group_id, group)) {
+    LIBLOG_ERROR("Could not program nexthop group " << m_opts.group_id << "; retrying.");
+    m_group_installed = false;
+    m_route_installed = false;
+    m_stale = true;
+    return false;
+  }
+  m_group_installed = true;
+
+  // The route follows the group, whatever becomes of its members.
+  if (!m_route_installed) {
+    m_route_installed = m_nexthops.set_default_route(m_opts.family, m_opts.table,
+        m_opts.metric, m_opts.group_id);
+    if (!m_route_installed) {
+      LIBLOG_ERROR("Could not add the multipath route to table " << m_opts.table
+          << "; retrying.");
+      m_stale = true;
+      return false;
+    }
+  }
+
+  LIBLOG_INFO("Egress across " << m_members.size() << " device(s):" << desc.str());
+  return true;
+}
+
+
+
+void
+egress_scheduler::withdraw()
+{
+  if (m_group_installed) {
+    m_nexthops.remove(m_opts.group_id);
+  }
+  for (auto const & m : m_members) {
+    m_nexthops.remove(m.id);
+  }
+  m_members.clear();
+  m_group_installed = false;
+  m_route_installed = false;
+}
+
+} // namespace linkmanager::net
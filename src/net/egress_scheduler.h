@@ -0,0 +1,200 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_NET_EGRESS_SCHEDULER_H
+#define LINKMANAGER_NET_EGRESS_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <linkmanager/api/event_loop.h>
+#include <linkmanager/module_registry.h>
+
+#include "link_monitor.h"
+
+namespace linkmanager::net {
+
+/**
+ * A nexthop of a group, with its weight, 1 to 256.
+ */
+struct weighted_nexthop
+{
+  std::uint32_t id = 0;
+  std::uint16_t weight = 1;
+};
+
+
+/**
+ * Where the scheduler programs its nexthops: the kernel's nexthop objects,
+ * or a stand-in for testing. All functions return false on failure.
+ */
+class nexthop_table
+{
+public:
+  virtual ~nexthop_table() = default;
+
+  /**
+   * Add or replace a nexthop through the device, via the gateway if it has
+   * one, or on-link otherwise.
+   */
+  virtual bool set_nexthop(std::uint32_t id, int family, std::string const & device,
+      address const & gateway) = 0;
+
+  /**
+   * Add or replace a weighted group of nexthops. Routes through the group
+   * follow the new weights without being touched.
+   */
+  virtual bool set_group(std::uint32_t id, std::vector<weighted_nexthop> const & members) = 0;
+
+  /**
+   * Add or replace the default route of the table, through a nexthop or
+   * group.
+   */
+  virtual bool set_default_route(int family, std::uint32_t table, std::uint32_t metric,
+      std::uint32_t nexthop_id) = 0;
+
+  /**
+   * Remove a nexthop or group; the kernel removes routes through it, too.
+   */
+  virtual bool remove(std::uint32_t id) = 0;
+};
+
+
+/**
+ * The kernel's nexthop objects (RTM_NEWNEXTHOP), through the netlink helpers.
+ */
+class netlink_nexthop_table : public nexthop_table
+{
+public:
+  bool set_nexthop(std::uint32_t id, int family, std::string const & device,
+      address const & gateway) override;
+  bool set_group(std::uint32_t id, std::vector<weighted_nexthop> const & members) override;
+  bool set_default_route(int family, std::uint32_t table, std::uint32_t metric,
+      std::uint32_t nexthop_id) override;
+  bool remove(std::uint32_t id) override;
+};
+
+
+/**
+ * Spreads egress traffic across the devices of all active links.
+ *
+ * Every device that is up, of an active link, and whose interface the link
+ * monitor knows to be up, becomes a nexthop, via the gateway of its
+ * interface's default route, if any. The nexthops form one weighted group,
+ * and a default route through the group is added to the configured table.
+ * The kernel then balances flows across the devices by weight, as it does
+ * for any multipath route; nothing is done per packet here.
+ *
+ * Weights follow the devices' metrics: capacity, discounted by round trip
+ * times beyond the reference. Devices that report no capacity get the mean
+ * of the others. Devices are re-weighed periodically, and membership is
+ * reconsidered on link changes; a change of weights replaces the group only,
+ * and weights that moved less than the configured fraction are left alone,
+ * so that the kernel is not reprogrammed for noise.
+ *
+ * All work is done on the loop thread; the scheduler must be created and
+ * destroyed there, and the link monitor must outlive it.
+ */
+class egress_scheduler
+{
+public:
+  struct options
+  {
+    // AF_INET or AF_INET6
+    int                       family = AF_INET;
+
+    // Routing table and metric of the default route; by default, the main
+    // table, preferred over the devices' own default routes.
+    std::uint32_t             table = 254;
+    std::uint32_t             metric = 10;
+
+    // The group's nexthop ID; devices' nexthops are numbered after it.
+    std::uint32_t             group_id = 0x4c4d0000;
+
+    // How often metrics are polled.
+    std::chrono::milliseconds interval = std::chrono::seconds{1};
+
+    // Link changes are applied after this delay, so that a burst of them
+    // reprograms the kernel once.
+    std::chrono::milliseconds settle = std::chrono::milliseconds{20};
+
+    // Weights change only if they move by more than this fraction.
+    double                    min_weight_change = 0.1;
+
+    // Round trip times up to this do not lower a device's weight.
+    std::chrono::microseconds reference_rtt = std::chrono::milliseconds{50};
+  };
+
+  /**
+   * A programmed nexthop.
+   */
+  struct member
+  {
+    std::string   device;
+    std::uint32_t id = 0;
+    std::uint16_t weight = 0;
+    address       gateway;
+  };
+
+  /**
+   * Construction may raise std::invalid_argument for nonsensical options.
+   */
+  egress_scheduler(api::event_loop & loop, module_registry const & registry,
+      link_monitor & links, nexthop_table & nexthops, options const & opts);
+  ~egress_scheduler();
+
+  egress_scheduler(egress_scheduler const &) = delete;
+  egress_scheduler & operator=(egress_scheduler const &) = delete;
+
+  /**
+   * Program the current devices, and follow link changes and metrics from
+   * now on.
+   */
+  void start();
+
+  /**
+   * Reconsider devices and their weights now, and program what changed.
+   */
+  void update();
+
+  /**
+   * The programmed nexthops, sorted by device name.
+   */
+  inline std::vector<member> const & members() const
+  {
+    return m_members;
+  }
+
+private:
+  struct candidate;
+
+  std::vector<candidate> candidates() const;
+  void assign_weights(std::vector<candidate> & cands) const;
+  bool program_group();
+  void withdraw();
+
+  api::event_loop &             m_loop;
+  module_registry const &       m_registry;
+  link_monitor &                m_links;
+  nexthop_table &               m_nexthops;
+  options                       m_opts;
+
+  link_monitor::subscription_id m_subscription = 0;
+  api::event_loop::handle       m_timer = api::event_loop::INVALID_HANDLE;
+  api::event_loop::handle       m_settle_timer = api::event_loop::INVALID_HANDLE;
+
+  std::vector<member>           m_members;
+  std::uint32_t                 m_next_id;
+  bool                          m_group_installed = false;
+  bool                          m_route_installed = false;
+  // Set when programming failed; everything is programmed anew next time.
+  bool                          m_stale = false;
+};
+
+} // namespace linkmanager::net
+
+#endif // guard
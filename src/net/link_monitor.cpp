@@ -0,0 +1,811 @@
+/*
+ *
+ */
+#include "link_monitor.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "../common/netlink_util.h"
+#include "../common/netlink_ifcache.h"
+
+#include <liberate/logging.h>
+
+namespace linkmanager::net {
+namespace {
+
+static constexpr std::size_t RECV_BUF_SIZE = 32768;
+static constexpr int DUMP_TIMEOUT_MS = 1000;
+static constexpr unsigned UP_FLAGS = IFF_UP | IFF_RUNNING;
+
+// The monitor answering IsAdaptorUp(), if any.
+std::atomic<link_monitor const *> adaptor_state_provider{nullptr};
+
+extern "C" int
+provided_adaptor_state(char const * name)
+{
+  auto monitor = adaptor_state_provider.load(std::memory_order_acquire);
+  if (!monitor || !name) {
+    return -1;
+  }
+  return monitor->adaptor_state(name);
+}
+
+
+
+/**
+ * Parse rtnetlink attributes into a table indexed by type.
+ */
+template <std::size_t N>
+void
+parse_attributes(rtattr const * (& attrs)[N], rtattr const * rta, int len)
+{
+  std::fill(std::begin(attrs), std::end(attrs), nullptr);
+  for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len)) {
+    if (rta->rta_type < N) {
+      attrs[rta->rta_type] = rta;
+    }
+  }
+}
+
+
+
+template <typename T>
+T const *
+message_data(nlmsghdr const * nh)
+{
+  if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(T))) {
+    return nullptr;
+  }
+  return reinterpret_cast<T const *>(reinterpret_cast<char const *>(nh) + NLMSG_HDRLEN);
+}
+
+
+
+template <typename T>
+rtattr const *
+first_attribute(T const * msg)
+{
+  return reinterpret_cast<rtattr const *>(
+      reinterpret_cast<char const *>(msg) + NLMSG_ALIGN(sizeof(T)));
+}
+
+
+
+template <typename T>
+int
+attributes_length(nlmsghdr const * nh)
+{
+  return static_cast<int>(nh->nlmsg_len) - static_cast<int>(NLMSG_LENGTH(sizeof(T)));
+}
+
+
+
+std::uint32_t
+u32_attribute(rtattr const * rta, std::uint32_t fallback)
+{
+  if (!rta || RTA_PAYLOAD(rta) < sizeof(std::uint32_t)) {
+    return fallback;
+  }
+  std::uint32_t ret;
+  ::memcpy(&ret, RTA_DATA(rta), sizeof(ret));
+  return ret;
+}
+
+
+
+address
+address_attribute(rtattr const * rta, std::uint8_t family, std::uint8_t prefix_length)
+{
+  address ret;
+  std::size_t size = (family == AF_INET) ? 4 : 16;
+  if (!rta || RTA_PAYLOAD(rta) < size) {
+    return ret;
+  }
+  ret.family = family;
+  ret.prefix_length = prefix_length;
+  ::memcpy(ret.bytes.data(), RTA_DATA(rta), size);
+  return ret;
+}
+
+
+
+std::vector<interface>::iterator
+lower_bound(std::vector<interface> & interfaces, int index)
+{
+  return std::lower_bound(interfaces.begin(), interfaces.end(), index,
+      [](interface const & iface, int i) { return iface.index < i; });
+}
+
+
+
+interface *
+find_interface(link_table & table, int index)
+{
+  auto iter = lower_bound(table.interfaces, index);
+  if (iter == table.interfaces.end() || iter->index != index) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+
+
+link_event
+make_event(link_event::kind type, interface const & iface)
+{
+  link_event ev;
+  ev.type = type;
+  ev.index = iface.index;
+  ev.name = iface.name;
+  ev.flags = iface.flags;
+  return ev;
+}
+
+
+
+/**
+ * Forget the IPv4 routes of the interface; the kernel flushes them without
+ * notification.
+ */
+void
+drop_ipv4_routes(interface & iface)
+{
+  iface.routes.erase(std::remove_if(iface.routes.begin(), iface.routes.end(),
+        [](route const & rt) { return rt.dst.family == AF_INET; }),
+      iface.routes.end());
+}
+
+
+
+/**
+ * The events that turn one state of an interface into the next; either may
+ * be missing.
+ */
+void
+diff(interface const * prev, interface const * next, std::vector<link_event> & events)
+{
+  static interface const none;
+
+  if (prev && !next) {
+    events.push_back(make_event(link_event::LINK_REMOVED, *prev));
+    return;
+  }
+  if (!prev) {
+    events.push_back(make_event(link_event::LINK_ADDED, *next));
+    prev = &none;
+  }
+
+  if (prev->is_up() != next->is_up()) {
+    events.push_back(make_event(next->is_up() ? link_event::LINK_UP : link_event::LINK_DOWN,
+          *next));
+  }
+
+  for (auto const & addr : prev->addresses) {
+    if (std::find(next->addresses.begin(), next->addresses.end(), addr) == next->addresses.end()) {
+      events.push_back(make_event(link_event::ADDRESS_REMOVED, *next));
+      events.back().addr = addr;
+    }
+  }
+  for (auto const & addr : next->addresses) {
+    if (std::find(prev->addresses.begin(), prev->addresses.end(), addr) == prev->addresses.end()) {
+      events.push_back(make_event(link_event::ADDRESS_ADDED, *next));
+      events.back().addr = addr;
+    }
+  }
+
+  for (auto const & rt : prev->routes) {
+    if (std::find(next->routes.begin(), next->routes.end(), rt) == next->routes.end()) {
+      events.push_back(make_event(link_event::ROUTE_REMOVED, *next));
+      events.back().rt = rt;
+    }
+  }
+  for (auto const & rt : next->routes) {
+    if (std::find(prev->routes.begin(), prev->routes.end(), rt) == prev->routes.end()) {
+      events.push_back(make_event(link_event::ROUTE_ADDED, *next));
+      events.back().rt = rt;
+    }
+  }
+}
+
+} // anonymous namespace
+
+
+
+std::string
+address::to_string() const
+{
+  if (family != AF_INET && family != AF_INET6) {
+    return "none";
+  }
+  char buf[INET6_ADDRSTRLEN] = { 0 };
+  ::inet_ntop(family, bytes.data(), buf, sizeof(buf));
+  return std::string{buf} + "/" + std::to_string(prefix_length);
+}
+
+
+
+bool
+interface::is_up() const
+{
+  return (flags & UP_FLAGS) == UP_FLAGS;
+}
+
+
+
+interface const *
+link_table::find(int index) const
+{
+  auto iter = std::lower_bound(interfaces.begin(), interfaces.end(), index,
+      [](interface const & iface, int i) { return iface.index < i; });
+  if (iter == interfaces.end() || iter->index != index) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+
+
+interface const *
+link_table::find(std::string_view name) const
+{
+  auto iter = std::find_if(interfaces.begin(), interfaces.end(),
+      [name](interface const & iface) { return iface.name == name; });
+  if (iter == interfaces.end()) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+
+
+char const *
+to_string(link_event::kind type)
+{
+  switch (type) {
+    case link_event::LINK_ADDED: return "link added";
+    case link_event::LINK_UP: return "link up";
+    case link_event::LINK_DOWN: return "link down";
+    case link_event::LINK_REMOVED: return "link removed";
+    case link_event::ADDRESS_ADDED: return "address added";
+    case link_event::ADDRESS_REMOVED: return "address removed";
+    case link_event::ROUTE_ADDED: return "route added";
+    case link_event::ROUTE_REMOVED: return "route removed";
+  }
+  return "unknown";
+}
+
+
+
+link_monitor::link_monitor(api::event_loop & loop)
+  : m_loop{loop}
+  , m_published{std::make_unique<link_table const>()}
+{
+}
+
+
+
+link_monitor::~link_monitor()
+{
+  link_monitor const * self = this;
+  if (adaptor_state_provider.compare_exchange_strong(self, nullptr)) {
+    NlSetAdaptorStateProvider(nullptr);
+    NlIfCacheClear();
+  }
+
+  if (m_handle != api::event_loop::INVALID_HANDLE) {
+    m_loop.remove(m_handle);
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+
+
+bool
+link_monitor::start()
+{
+  m_fd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (m_fd < 0) {
+    LIBLOG_ERROR("Could not create rtnetlink socket: " << ::strerror(errno));
+    return false;
+  }
+
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR
+    | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+  socklen_t addr_len = sizeof(addr);
+  if (::bind(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+      || ::getsockname(m_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) < 0)
+  {
+    LIBLOG_ERROR("Could not bind rtnetlink socket: " << ::strerror(errno));
+    ::close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  m_port_id = addr.nl_pid;
+
+  // Dump before watching the socket, so that the table is complete before
+  // anyone reads it.
+  resync();
+  pollfd pfd{m_fd, POLLIN, 0};
+  while (m_rebuild) {
+    int ret = ::poll(&pfd, 1, DUMP_TIMEOUT_MS);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      LIBLOG_ERROR("Timed out dumping interfaces; continuing in the background.");
+      break;
+    }
+    on_readable();
+  }
+
+  m_handle = m_loop.add_fd(m_fd, api::event_loop::IO_READ, [this](int, std::uint32_t)
+      {
+        on_readable();
+      });
+  if (m_handle == api::event_loop::INVALID_HANDLE) {
+    LIBLOG_ERROR("Could not watch rtnetlink socket.");
+    ::close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+
+
+int
+link_monitor::adaptor_state(std::string_view name) const
+{
+  auto table = read();
+  auto iface = table->find(name);
+  if (!iface) {
+    return -1;
+  }
+  return static_cast<int>(iface->flags & UP_FLAGS);
+}
+
+
+
+void
+link_monitor::provide_interface_state()
+{
+  m_providing = true;
+  load_interface_cache();
+  adaptor_state_provider.store(this, std::memory_order_release);
+  NlSetAdaptorStateProvider(provided_adaptor_state);
+}
+
+
+
+void
+link_monitor::load_interface_cache() const
+{
+  std::vector<nlifentry> entries(m_table.interfaces.size());
+  for (std::size_t i = 0 ; i < entries.size() ; ++i) {
+    auto const & iface = m_table.interfaces[i];
+    entries[i].nIndex = iface.index;
+    iface.name.copy(entries[i].szName, sizeof(entries[i].szName) - 1);
+  }
+  NlIfCacheLoad(entries.data(), entries.size());
+}
+
+
+
+void
+link_monitor::update_interface_cache(std::vector<int> const & indices) const
+{
+  for (auto index : indices) {
+    auto iface = m_table.find(index);
+    if (iface) {
+      NlIfCacheSet(index, iface->name.c_str());
+    }
+    else {
+      NlIfCacheRemove(index);
+    }
+  }
+}
+
+
+
+link_monitor::subscription_id
+link_monitor::subscribe(std::string name, event_callback callback)
+{
+  auto id = m_next_id++;
+  m_subscriptions.push_back({id, std::move(name), std::move(callback)});
+  return id;
+}
+
+
+
+void
+link_monitor::unsubscribe(subscription_id id)
+{
+  m_subscriptions.erase(std::remove_if(m_subscriptions.begin(), m_subscriptions.end(),
+        [id](subscription const & sub) { return sub.id == id; }),
+      m_subscriptions.end());
+}
+
+
+
+void
+link_monitor::process(char const * buf, std::size_t len)
+{
+  receive(buf, len);
+  publish();
+}
+
+
+
+void
+link_monitor::on_readable()
+{
+  char buf[RECV_BUF_SIZE];
+  for (;;) {
+    auto len = ::recv(m_fd, buf, sizeof(buf), 0);
+    if (len > 0) {
+      receive(buf, static_cast<std::size_t>(len));
+      continue;
+    }
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len < 0 && errno == ENOBUFS) {
+      LIBLOG_WARN("rtnetlink socket overrun; dumping interfaces anew.");
+      resync();
+      continue;
+    }
+    if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      LIBLOG_ERROR("Could not read rtnetlink socket: " << ::strerror(errno));
+    }
+    break;
+  }
+
+  // Everything read so far is published in one go.
+  publish();
+}
+
+
+
+void
+link_monitor::resync()
+{
+  m_rebuild = std::make_unique<link_table>();
+  m_dumps = { RTM_GETROUTE, RTM_GETADDR, RTM_GETLINK };
+  if (!request_dump()) {
+    m_rebuild.reset();
+  }
+}
+
+
+
+bool
+link_monitor::request_dump()
+{
+  struct
+  {
+    nlmsghdr nh;
+    union
+    {
+      ifinfomsg ifi;
+      ifaddrmsg ifa;
+      rtmsg     rtm;
+    };
+  } req;
+  ::memset(&req, 0, sizeof(req));
+
+  auto type = m_dumps.back();
+  switch (type) {
+    case RTM_GETLINK:
+      req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg));
+      break;
+    case RTM_GETADDR:
+      req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(ifaddrmsg));
+      break;
+    default:
+      req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+      break;
+  }
+  req.nh.nlmsg_type = type;
+  req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req.nh.nlmsg_seq = m_dump_seq = ++m_seq;
+
+  sockaddr_nl kernel{};
+  kernel.nl_family = AF_NETLINK;
+  if (::sendto(m_fd, &req, req.nh.nlmsg_len, 0, reinterpret_cast<sockaddr *>(&kernel),
+        sizeof(kernel)) < 0)
+  {
+    LIBLOG_ERROR("Could not request interface dump: " << ::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+
+
+void
+link_monitor::receive(char const * buf, std::size_t len)
+{
+  auto nh = reinterpret_cast<nlmsghdr const *>(buf);
+  for ( ; NLMSG_OK(nh, len) ; nh = NLMSG_NEXT(nh, len)) {
+    // Replies to us are parts of a dump; those of an abandoned dump are
+    // ignored. Everything else is a notification.
+    bool reply = m_port_id && nh->nlmsg_pid == m_port_id;
+    if (reply && (!m_rebuild || nh->nlmsg_seq != m_dump_seq)) {
+      continue;
+    }
+
+    if (reply && (nh->nlmsg_flags & NLM_F_DUMP_INTR)) {
+      // The dump is inconsistent; it has to be done again.
+      resync();
+      continue;
+    }
+
+    if (nh->nlmsg_type == NLMSG_ERROR) {
+      if (reply) {
+        LIBLOG_ERROR("Interface dump failed; the table may be out of date.");
+        m_rebuild.reset();
+      }
+      continue;
+    }
+
+    if (nh->nlmsg_type == NLMSG_DONE) {
+      if (!reply) {
+        continue;
+      }
+      m_dumps.pop_back();
+      if (!m_dumps.empty()) {
+        request_dump();
+        continue;
+      }
+
+      // The new table replaces the old; subscribers learn of the
+      // differences.
+      m_table.interfaces = std::move(m_rebuild->interfaces);
+      m_rebuild.reset();
+      m_touched_all = true;
+      continue;
+    }
+
+    // Notifications go to the table being rebuilt as well, so that changes
+    // after its part of the dump are not lost.
+    if (m_rebuild) {
+      apply(*m_rebuild, nh);
+    }
+    if (!reply) {
+      apply(m_table, nh);
+    }
+  }
+
+  // A dump in progress may or may not have seen the flush; another follows
+  // it.
+  if (m_resync_routes && !m_rebuild && m_fd >= 0) {
+    m_resync_routes = false;
+    resync();
+  }
+}
+
+
+
+void
+link_monitor::apply(link_table & table, nlmsghdr const * nh)
+{
+  bool live = &table == &m_table;
+  rtattr const * attrs[std::max({RTA_MAX, IFLA_MAX, IFA_MAX}) + 1];
+
+  switch (nh->nlmsg_type) {
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+      {
+        auto ifi = message_data<ifinfomsg>(nh);
+        if (!ifi || ifi->ifi_family == AF_BRIDGE) {
+          return;
+        }
+        if (live) {
+          m_touched.push_back(ifi->ifi_index);
+        }
+
+        auto iter = lower_bound(table.interfaces, ifi->ifi_index);
+        bool found = iter != table.interfaces.end() && iter->index == ifi->ifi_index;
+        if (nh->nlmsg_type == RTM_DELLINK) {
+          if (found) {
+            table.interfaces.erase(iter);
+          }
+          return;
+        }
+
+        if (!found) {
+          iter = table.interfaces.emplace(iter);
+          iter->index = ifi->ifi_index;
+        }
+        // Taking the interface down flushes its IPv4 routes; IPv6 routes are
+        // reported as they go. Losing the carrier only marks them.
+        if ((iter->flags & IFF_UP) && !(ifi->ifi_flags & IFF_UP)) {
+          drop_ipv4_routes(*iter);
+        }
+        iter->flags = ifi->ifi_flags;
+        parse_attributes(attrs, first_attribute(ifi), attributes_length<ifinfomsg>(nh));
+        if (attrs[IFLA_IFNAME]) {
+          auto name = static_cast<char const *>(RTA_DATA(attrs[IFLA_IFNAME]));
+          iter->name.assign(name, ::strnlen(name, RTA_PAYLOAD(attrs[IFLA_IFNAME])));
+        }
+        iter->mtu = u32_attribute(attrs[IFLA_MTU], iter->mtu);
+      }
+      return;
+
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+      {
+        auto ifa = message_data<ifaddrmsg>(nh);
+        if (!ifa || (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)) {
+          return;
+        }
+        auto iface = find_interface(table, static_cast<int>(ifa->ifa_index));
+        if (!iface) {
+          return;
+        }
+        if (live) {
+          m_touched.push_back(iface->index);
+        }
+
+        parse_attributes(attrs, first_attribute(ifa), attributes_length<ifaddrmsg>(nh));
+        auto addr = address_attribute(attrs[IFA_LOCAL] ? attrs[IFA_LOCAL] : attrs[IFA_ADDRESS],
+            ifa->ifa_family, ifa->ifa_prefixlen);
+        if (addr.family == AF_UNSPEC) {
+          return;
+        }
+
+        auto & list = iface->addresses;
+        auto iter = std::find(list.begin(), list.end(), addr);
+        if (nh->nlmsg_type == RTM_DELADDR) {
+          if (iter != list.end()) {
+            list.erase(iter);
+          }
+        }
+        else if (iter == list.end()) {
+          list.push_back(addr);
+        }
+
+        // Removing the last IPv4 address flushes the interface's IPv4 routes;
+        // removing another flushes those with it as their source, which are
+        // not told apart here, so routes are dumped anew.
+        if (nh->nlmsg_type == RTM_DELADDR && addr.family == AF_INET) {
+          if (std::none_of(list.begin(), list.end(),
+                [](address const & a) { return a.family == AF_INET; }))
+          {
+            drop_ipv4_routes(*iface);
+          }
+          else if (live) {
+            m_resync_routes = true;
+          }
+        }
+      }
+      return;
+
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      {
+        auto rtm = message_data<rtmsg>(nh);
+        if (!rtm || (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6)
+            || rtm->rtm_type != RTN_UNICAST || (rtm->rtm_flags & RTM_F_CLONED))
+        {
+          return;
+        }
+
+        parse_attributes(attrs, first_attribute(rtm), attributes_length<rtmsg>(nh));
+        // Multipath routes have no single interface; they are not tracked.
+        auto iface = find_interface(table, static_cast<int>(u32_attribute(attrs[RTA_OIF], 0)));
+        if (!iface) {
+          return;
+        }
+        if (live) {
+          m_touched.push_back(iface->index);
+        }
+
+        route rt;
+        rt.dst = address_attribute(attrs[RTA_DST], rtm->rtm_family, rtm->rtm_dst_len);
+        if (!attrs[RTA_DST]) {
+          // The default route
+          rt.dst.family = rtm->rtm_family;
+        }
+        rt.gateway = address_attribute(attrs[RTA_GATEWAY], rtm->rtm_family,
+            rtm->rtm_family == AF_INET ? 32 : 128);
+        rt.table = u32_attribute(attrs[RTA_TABLE], rtm->rtm_table);
+        rt.priority = u32_attribute(attrs[RTA_PRIORITY], 0);
+
+        auto & list = iface->routes;
+        auto iter = std::find_if(list.begin(), list.end(),
+            [&rt](route const & other) { return other.same_route(rt); });
+        if (nh->nlmsg_type == RTM_DELROUTE) {
+          if (iter != list.end()) {
+            list.erase(iter);
+          }
+        }
+        else if (iter != list.end()) {
+          *iter = rt;
+        }
+        else {
+          list.push_back(rt);
+        }
+      }
+      return;
+
+    default:
+      return;
+  }
+}
+
+
+
+void
+link_monitor::publish()
+{
+  if (m_touched.empty() && !m_touched_all) {
+    return;
+  }
+
+  std::vector<link_event> events;
+  {
+    auto prev = read();
+    std::vector<int> indices;
+    if (m_touched_all) {
+      for (auto const & iface : prev->interfaces) {
+        indices.push_back(iface.index);
+      }
+      for (auto const & iface : m_table.interfaces) {
+        indices.push_back(iface.index);
+      }
+    }
+    else {
+      indices.swap(m_touched);
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    for (auto index : indices) {
+      diff(prev->find(index), m_table.find(index), events);
+    }
+    m_table.version = prev->version + 1;
+
+    if (m_providing && m_touched_all) {
+      // After a new dump, the cache is loaded anew as well.
+      load_interface_cache();
+    }
+    else if (m_providing) {
+      update_interface_cache(indices);
+    }
+  }
+  m_touched.clear();
+  m_touched_all = false;
+
+  // The guard is released; publishing waits for readers.
+  m_published.publish(std::make_unique<link_table const>(m_table));
+
+  if (events.empty() || m_subscriptions.empty()) {
+    return;
+  }
+  // Callbacks may subscribe or unsubscribe.
+  auto subscriptions = m_subscriptions;
+  for (auto const & ev : events) {
+    for (auto const & sub : subscriptions) {
+      if (sub.name.empty() || sub.name == ev.name) {
+        sub.callback(ev);
+      }
+    }
+  }
+}
+
+} // namespace linkmanager::net
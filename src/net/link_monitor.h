@@ -0,0 +1,246 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_NET_LINK_MONITOR_H
+#define LINKMANAGER_NET_LINK_MONITOR_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <linkmanager/api/event_loop.h>
+#include <linkmanager/rcu.h>
+
+struct nlmsghdr;
+
+namespace linkmanager::net {
+
+/**
+ * An IPv4 or IPv6 address with its prefix length; family is AF_UNSPEC for
+ * none.
+ */
+struct address
+{
+  std::uint8_t                  family = 0;
+  std::uint8_t                  prefix_length = 0;
+  std::array<std::uint8_t, 16>  bytes = {};
+
+  std::string to_string() const;
+
+  inline bool operator==(address const & other) const
+  {
+    return family == other.family && prefix_length == other.prefix_length
+      && bytes == other.bytes;
+  }
+
+  inline bool operator!=(address const & other) const
+  {
+    return !(*this == other);
+  }
+};
+
+
+/**
+ * A unicast route through an interface.
+ */
+struct route
+{
+  address       dst;
+  address       gateway;  // AF_UNSPEC if on-link
+  std::uint32_t table = 0;
+  std::uint32_t priority = 0;
+
+  /** Routes are the same if they differ in the gateway only. */
+  inline bool same_route(route const & other) const
+  {
+    return dst == other.dst && table == other.table && priority == other.priority;
+  }
+
+  inline bool operator==(route const & other) const
+  {
+    return same_route(other) && gateway == other.gateway;
+  }
+};
+
+
+/**
+ * What is known of an interface.
+ */
+struct interface
+{
+  int                   index = 0;
+  std::string           name;
+  unsigned              flags = 0;  // IFF_*
+  std::uint32_t         mtu = 0;
+  std::vector<address>  addresses;
+  std::vector<route>    routes;
+
+  /** Administratively up, and with carrier. */
+  bool is_up() const;
+};
+
+
+/**
+ * The interfaces of the network namespace, by index.
+ */
+struct link_table
+{
+  std::vector<interface>  interfaces;
+
+  /** Incremented with every published change. */
+  std::uint64_t           version = 0;
+
+  interface const * find(int index) const;
+  interface const * find(std::string_view name) const;
+};
+
+
+/**
+ * A change to an interface.
+ */
+struct link_event
+{
+  enum kind : std::uint8_t
+  {
+    LINK_ADDED,
+    LINK_UP,
+    LINK_DOWN,
+    LINK_REMOVED,
+    ADDRESS_ADDED,
+    ADDRESS_REMOVED,
+    ROUTE_ADDED,
+    ROUTE_REMOVED,
+  };
+
+  kind          type;
+  int           index = 0;
+  std::string   name;
+  unsigned      flags = 0;
+  address       addr;   // For address events
+  route         rt;     // For route events
+};
+
+char const * to_string(link_event::kind type);
+
+
+/**
+ * Monitors interfaces, their addresses and their routes through a single
+ * rtnetlink socket subscribed to the link, address and route groups, and
+ * mirrors them into a link_table.
+ *
+ * start() dumps the current state, one kind at a time, and from then on
+ * notifications are applied as the socket becomes readable on the given
+ * loop. All messages of one read are applied before the table is published,
+ * and subscribers are called after that, on the loop thread. If the socket
+ * overruns, and notifications are lost, the state is dumped anew and
+ * compared against the table, so subscribers see the changes they missed.
+ * IPv4 routes the kernel flushes without notification, as when an interface
+ * is taken down or loses an address, are removed from the table as well.
+ *
+ * Reads are lock-free and may be done from any thread (see rcu_cell), so
+ * asking whether an interface is up is a memory read rather than a
+ * request. The monitor must be destroyed on the loop's thread.
+ */
+class link_monitor
+{
+public:
+  using event_callback = std::function<void (link_event const &)>;
+  using subscription_id = std::uint64_t;
+
+  explicit link_monitor(api::event_loop & loop);
+  ~link_monitor();
+
+  link_monitor(link_monitor const &) = delete;
+  link_monitor & operator=(link_monitor const &) = delete;
+
+  /**
+   * Open the socket, and dump the current state; the table is complete when
+   * this returns. Returns false if the socket cannot be opened.
+   */
+  bool start();
+
+  inline rcu_cell<link_table>::read_guard read() const
+  {
+    return m_published.read();
+  }
+
+  /**
+   * As IsAdaptorUp(): IFF_UP | IFF_RUNNING, as far as set, or -1 if there
+   * is no such interface.
+   */
+  int adaptor_state(std::string_view name) const;
+
+  /**
+   * Answer IsAdaptorUp() from this monitor, instead of with a request, and
+   * keep the netlink helpers' interface cache loaded from the table, until
+   * the monitor is destroyed. Only one monitor can do so at a time, and
+   * threads calling IsAdaptorUp() must be done before it is destroyed.
+   */
+  void provide_interface_state();
+
+  /**
+   * Be called for changes to the named interface, or all interfaces if the
+   * name is empty. Changes to the table made before the call are not
+   * reported.
+   */
+  subscription_id subscribe(std::string name, event_callback callback);
+  void unsubscribe(subscription_id id);
+
+  /**
+   * Apply rtnetlink messages, as read from the socket. This is what the
+   * socket's handler does; it is exposed for testing.
+   */
+  void process(char const * buf, std::size_t len);
+
+private:
+  struct subscription
+  {
+    subscription_id id;
+    std::string     name;
+    event_callback  callback;
+  };
+
+  void on_readable();
+  void resync();
+  bool request_dump();
+
+  void receive(char const * buf, std::size_t len);
+  void apply(link_table & table, ::nlmsghdr const * nh);
+  void publish();
+  void load_interface_cache() const;
+  void update_interface_cache(std::vector<int> const & indices) const;
+
+  api::event_loop &             m_loop;
+  int                           m_fd = -1;
+  api::event_loop::handle       m_handle = api::event_loop::INVALID_HANDLE;
+  std::uint32_t                 m_port_id = 0;
+  std::uint32_t                 m_seq = 0;
+
+  // Loop thread only
+  link_table                    m_table;
+  // While the state is dumped anew, the dump builds a table of its own,
+  // which live notifications go to as well.
+  std::unique_ptr<link_table>   m_rebuild;
+  std::vector<std::uint16_t>    m_dumps;
+  std::uint32_t                 m_dump_seq = 0;
+  // Interfaces changed since the table was last published.
+  std::vector<int>              m_touched;
+  bool                          m_touched_all = false;
+  // The kernel may have flushed routes without telling.
+  bool                          m_resync_routes = false;
+
+  bool                          m_providing = false;
+
+  std::vector<subscription>     m_subscriptions;
+  subscription_id               m_next_id = 1;
+
+  rcu_cell<link_table>          m_published;
+};
+
+} // namespace linkmanager::net
+
+#endif // guard
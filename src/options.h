@@ -4,6 +4,7 @@
 #ifndef LINKMANAGER_OPTIONS_H
 #define LINKMANAGER_OPTIONS_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,10 @@
 
 namespace linkmanager {
 
+namespace config {
+class session_table;
+} // namespace config
+
 /**
  * Commands implemented in the CLI
  */
@@ -32,8 +37,15 @@ struct options
   commands                  cmd;
   spdlog::level::level_enum log_level = spdlog::level::info;
 
-  // Configuration as loaded from a file.
+  // Configuration as loaded from a file, and that file, if any. The sessions
+  // are compiled from the file's "session" object, which is not kept in the
+  // configuration itself.
   nlohmann::json            config = "{}"_json;
+  std::string               config_file;
+  std::shared_ptr<config::session_table const> sessions;
+
+  // Where to keep a compiled snapshot of the configuration file, if at all.
+  std::string               snapshot_file;
 
   // Command line options.
   std::vector<std::string>  plugin_path;
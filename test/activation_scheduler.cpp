@@ -0,0 +1,345 @@
+/*
+ *
+ */
+
+#include <linkmanager/activation_scheduler.h>
+#include <linkmanager/reactor.h>
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<int> in_flight = 0;
+std::atomic<int> max_in_flight = 0;
+
+/**
+ * Blocks in set_active() for the given delay, and fails the first
+ * fail_count attempts. A link that never answers never calls back.
+ */
+class test_link : public linkmanager::api::modules::link
+{
+public:
+  inline test_link(std::string name, std::chrono::milliseconds delay,
+      int fail_count = 0, bool never_answers = false)
+    : m_name{name}
+    , m_delay{delay}
+    , m_fail_count{fail_count}
+    , m_never_answers{never_answers}
+  {
+  }
+
+  virtual std::string name() const final
+  {
+    return m_name;
+  }
+
+  virtual bool configure(nlohmann::json const &) final
+  {
+    return true;
+  }
+
+  virtual bool is_active() const final
+  {
+    return m_active;
+  }
+
+  virtual void set_active(bool new_status, activation_callback cb) final
+  {
+    auto now = ++in_flight;
+    auto prev = max_in_flight.load();
+    while (now > prev && !max_in_flight.compare_exchange_weak(prev, now)) {}
+
+    std::this_thread::sleep_for(m_delay);
+    --in_flight;
+
+    if (m_never_answers) {
+      return;
+    }
+
+    if (m_fail_count > 0) {
+      --m_fail_count;
+      cb(*this, false);
+      return;
+    }
+
+    m_active = new_status;
+    cb(*this, m_active);
+  }
+
+  virtual device_list devices() const final
+  {
+    return {};
+  }
+
+  std::string               m_name;
+  std::chrono::milliseconds m_delay;
+  std::atomic<int>          m_fail_count;
+  bool                      m_never_answers;
+  std::atomic<bool>         m_active = false;
+};
+
+
+class test_module : public linkmanager::api::modules::link_module
+{
+public:
+  virtual std::string name() const final
+  {
+    return "scheduler_test_module";
+  }
+
+  virtual bool is_powered_on() const final
+  {
+    return true;
+  }
+
+  virtual bool set_powered_on(bool) final
+  {
+    return true;
+  }
+
+  virtual link_list links() const final
+  {
+    return m_links;
+  }
+
+  link_list m_links;
+};
+
+
+activation_scheduler::report
+run_to_completion(reactor & loop, activation_scheduler & sched,
+    activation_scheduler::link_list links)
+{
+  activation_scheduler::report result;
+  sched.activate(std::move(links), [&](activation_scheduler::report const & r)
+      {
+        result = r;
+        loop.stop();
+      });
+  loop.run();
+  return result;
+}
+
+} // anonymous namespace
+
+
+TEST(ActivationScheduler, bad_options)
+{
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_concurrent = 0;
+  ASSERT_THROW(activation_scheduler(loop, opts), std::invalid_argument);
+
+  opts = {};
+  opts.max_attempts = 0;
+  ASSERT_THROW(activation_scheduler(loop, opts), std::invalid_argument);
+}
+
+
+
+TEST(ActivationScheduler, empty_run)
+{
+  reactor loop;
+  activation_scheduler sched{loop};
+
+  auto r = run_to_completion(loop, sched, {});
+  ASSERT_TRUE(r.links.empty());
+  ASSERT_FALSE(sched.busy());
+}
+
+
+
+TEST(ActivationScheduler, parallel_activation)
+{
+  in_flight = 0;
+  max_in_flight = 0;
+
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_concurrent = 4;
+  activation_scheduler sched{loop, opts};
+
+  activation_scheduler::link_list links;
+  for (int i = 0 ; i < 4 ; ++i) {
+    links.emplace_back("mod", std::make_shared<test_link>(
+          "link" + std::to_string(i), 100ms));
+  }
+
+  auto r = run_to_completion(loop, sched, links);
+  ASSERT_EQ(4, r.links.size());
+  ASSERT_EQ(4, r.succeeded());
+  ASSERT_EQ(4, max_in_flight);
+
+  // Roughly the slowest link, not the sum of all of them.
+  ASSERT_LT(r.elapsed, 300ms);
+  for (auto & l : r.links) {
+    ASSERT_EQ(1, l.attempts);
+    ASSERT_GE(l.activating, 100ms);
+  }
+}
+
+
+
+TEST(ActivationScheduler, concurrency_limit)
+{
+  in_flight = 0;
+  max_in_flight = 0;
+
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_concurrent = 1;
+  activation_scheduler sched{loop, opts};
+
+  activation_scheduler::link_list links;
+  for (int i = 0 ; i < 3 ; ++i) {
+    links.emplace_back("mod", std::make_shared<test_link>(
+          "link" + std::to_string(i), 20ms));
+  }
+
+  auto r = run_to_completion(loop, sched, links);
+  ASSERT_EQ(3, r.succeeded());
+  ASSERT_EQ(1, max_in_flight);
+  ASSERT_GE(r.elapsed, 60ms);
+
+  // Later links had to wait for a slot.
+  ASSERT_GE(r.links[2].queued, 40ms);
+}
+
+
+
+TEST(ActivationScheduler, retry_with_backoff)
+{
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_attempts = 3;
+  opts.initial_backoff = 10ms;
+  activation_scheduler sched{loop, opts};
+
+  auto r = run_to_completion(loop, sched, {
+      { "mod", std::make_shared<test_link>("flaky", 1ms, 2) },
+  });
+  ASSERT_EQ(1, r.links.size());
+  ASSERT_TRUE(r.links[0].active);
+  ASSERT_EQ(3, r.links[0].attempts);
+  ASSERT_EQ(0, r.links[0].timeouts);
+
+  // 10ms, then 20ms backoff
+  ASSERT_GE(r.links[0].backoff, 30ms);
+}
+
+
+
+TEST(ActivationScheduler, deadline_exhausts_attempts)
+{
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_attempts = 2;
+  opts.deadline = 20ms;
+  opts.initial_backoff = 1ms;
+  activation_scheduler sched{loop, opts};
+
+  auto r = run_to_completion(loop, sched, {
+      { "mod", std::make_shared<test_link>("silent", 1ms, 0, true) },
+      { "mod", std::make_shared<test_link>("good", 1ms) },
+  });
+  ASSERT_EQ(2, r.links.size());
+  ASSERT_EQ(1, r.succeeded());
+
+  ASSERT_FALSE(r.links[0].active);
+  ASSERT_EQ(2, r.links[0].attempts);
+  ASSERT_EQ(2, r.links[0].timeouts);
+  ASSERT_TRUE(r.links[1].active);
+}
+
+
+
+TEST(ActivationScheduler, activate_all_from_registry)
+{
+  auto mod = std::make_shared<test_module>();
+  mod->m_links.push_back(std::make_shared<test_link>("a", 1ms));
+  mod->m_links.push_back(std::make_shared<test_link>("b", 1ms));
+
+  module_registry registry;
+  registry.register_module(mod);
+
+  reactor loop;
+  activation_scheduler sched{loop};
+
+  activation_scheduler::report result;
+  sched.activate_all(registry, [&](activation_scheduler::report const & r)
+      {
+        result = r;
+        loop.stop();
+      });
+  ASSERT_TRUE(sched.busy());
+  ASSERT_THROW(sched.activate({}, {}), std::logic_error);
+
+  loop.run();
+  ASSERT_FALSE(sched.busy());
+  ASSERT_EQ(2, result.succeeded());
+  ASSERT_EQ("scheduler_test_module", result.links[0].module);
+  ASSERT_EQ("a", result.links[0].link);
+}
+
+
+
+TEST(ActivationScheduler, timed_out_attempt_holds_slot)
+{
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_concurrent = 1;
+  opts.max_attempts = 1;
+  opts.deadline = 50ms;
+  activation_scheduler sched{loop, opts};
+
+  // The second link gets its slot only once the first returns, and is not
+  // timed out while waiting for a worker.
+  auto r = run_to_completion(loop, sched, {
+      { "mod", std::make_shared<test_link>("stuck", 150ms) },
+      { "mod", std::make_shared<test_link>("next", 1ms) },
+  });
+  ASSERT_EQ(2, r.links.size());
+  ASSERT_EQ(1, r.links[0].timeouts);
+  ASSERT_FALSE(r.links[0].active);
+
+  ASSERT_TRUE(r.links[1].active);
+  ASSERT_EQ(0, r.links[1].timeouts);
+  ASSERT_GE(r.links[1].queued, 140ms);
+}
+
+
+
+TEST(ActivationScheduler, late_completion_of_earlier_run)
+{
+  reactor loop;
+  activation_scheduler::options opts;
+  opts.max_concurrent = 2;
+  opts.max_attempts = 1;
+  opts.deadline = 40ms;
+  activation_scheduler sched{loop, opts};
+
+  // The first run times out before the link answers; the answer arrives
+  // during the second run, and must not complete its silent link.
+  activation_scheduler::report second;
+  sched.activate({ { "mod", std::make_shared<test_link>("late", 60ms) } },
+      [&](activation_scheduler::report const &)
+      {
+        sched.activate({ { "mod", std::make_shared<test_link>("silent", 1ms, 0, true) } },
+            [&](activation_scheduler::report const & r)
+            {
+              second = r;
+              loop.stop();
+            });
+      });
+  loop.run();
+
+  ASSERT_EQ(1, second.links.size());
+  ASSERT_FALSE(second.links[0].active);
+  ASSERT_EQ(1, second.links[0].timeouts);
+}
@@ -0,0 +1,207 @@
+/*
+ *
+ */
+
+/**
+ * Benchmark for the ways of starting up from a configuration file.
+ *
+ * A fleet configuration is written to a temporary file, and each path is
+ * run in a fresh child process, so that the time and the peak resident set
+ * size measured are those of a daemon starting up: the baseline parses the
+ * file into a document and compiles the session table from that, the
+ * streaming path compiles the table while parsing, and the snapshot path
+ * maps and loads the compiled image. The peak RSS of a child that does
+ * none of these is reported for reference.
+ *
+ * Usage: bench_config_startup [sessions] [rounds]
+ */
+
+#include "config/snapshot.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace linkmanager::config;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+static char const * const IP_TYPES[] = {
+  "MBIMContextIPTypeIPv4",
+  "MBIMContextIPTypeIPv6",
+  "MBIMContextIPTypeIPv4v6",
+};
+
+
+nlohmann::json
+fleet_config(std::size_t sessions)
+{
+  nlohmann::json config;
+  config["modulePath"] = "/dev/cdc-wdm0";
+  config["deviceInterfaceName"] = "wwan0";
+  config["controlSocket"] = "/run/linkmanager.sock";
+  auto & section = config["session"];
+  for (std::size_t i = 0 ; i < sessions ; ++i) {
+    section["s" + std::to_string(i)] = {
+      { "sessionId", i },
+      { "userName", "fleet" + std::to_string(i % 8) },
+      { "password", "secret" },
+      { "accessString", "apn" + std::to_string(i % 4) + ".example" },
+      { "compression", "MBIMCompressionNone" },
+      { "authProtocol", "MBIMAuthProtocolChap" },
+      { "ipType", IP_TYPES[i % 3] },
+      { "useVlan", i % 2 == 0 },
+      { "vlanName", "vlan." + std::to_string(i % 4094) },
+      { "vlanId", 1 + i % 4094 },
+      { "route", {
+        { "dst", "10." + std::to_string(i / 256 % 256) + "." + std::to_string(i % 256) + ".0" },
+        { "dstPrefixLength", 24 },
+      } },
+    };
+  }
+  return config;
+}
+
+
+struct startup
+{
+  double  ms = 0;
+  long    max_rss_kb = 0;
+};
+
+
+/**
+ * Run func in a child process; it reports its elapsed time through a pipe,
+ * and its peak RSS comes from its resource usage.
+ */
+template <typename F>
+startup
+in_child(F && func)
+{
+  int fds[2];
+  if (pipe(fds) < 0) {
+    std::perror("pipe");
+    std::exit(1);
+  }
+
+  auto pid = fork();
+  if (pid < 0) {
+    std::perror("fork");
+    std::exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    auto start = clock_type::now();
+    func();
+    double ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    auto ret = write(fds[1], &ms, sizeof(ms));
+    _exit(ret == sizeof(ms) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  startup result;
+  if (read(fds[0], &result.ms, sizeof(result.ms)) != sizeof(result.ms)) {
+    std::cerr << "Child did not report." << std::endl;
+    std::exit(1);
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+    std::cerr << "Child failed." << std::endl;
+    std::exit(1);
+  }
+  result.max_rss_kb = usage.ru_maxrss;
+  return result;
+}
+
+
+/**
+ * The best time, and the largest RSS, of several rounds.
+ */
+template <typename F>
+startup
+measure(std::size_t rounds, F && func)
+{
+  startup best{1e12, 0};
+  for (std::size_t r = 0 ; r < rounds ; ++r) {
+    auto result = in_child(func);
+    best.ms = std::min(best.ms, result.ms);
+    best.max_rss_kb = std::max(best.max_rss_kb, result.max_rss_kb);
+  }
+  return best;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  std::size_t sessions = (argc > 1) ? std::atoi(argv[1]) : 10000;
+  std::size_t rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+  auto base = "/tmp/bench_config_startup." + std::to_string(getpid());
+  auto source = base + ".json";
+  auto image = base + ".snapshot";
+  // Set up in a child as well, so the others start out small.
+  in_child([&]()
+      {
+        {
+          std::ofstream out{source};
+          out << fleet_config(sessions).dump(2);
+        }
+        snapshot::load_or_compile(source, image);
+      });
+  if (!snapshot::load(image, source)) {
+    std::cerr << "Could not write a snapshot." << std::endl;
+    return 1;
+  }
+
+  std::size_t sink = 0;
+  auto idle = measure(rounds, []() {});
+  auto dom = measure(rounds, [&]()
+      {
+        std::ifstream in{source};
+        nlohmann::json document;
+        in >> document;
+        sink += session_table::compile(document).size();
+      });
+  auto stream = measure(rounds, [&]()
+      {
+        sink += snapshot::load_or_compile(source, "").sessions.size();
+      });
+  auto snap = measure(rounds, [&]()
+      {
+        sink += snapshot::load(image, source)->sessions.size();
+      });
+
+  std::ifstream source_in{source, std::ios::ate};
+  std::ifstream image_in{image, std::ios::ate};
+  std::cout << std::fixed << std::setprecision(2)
+    << "sessions: " << sessions << "\n"
+    << "source: " << source_in.tellg() << " bytes, snapshot: "
+    << image_in.tellg() << " bytes\n"
+    << std::setw(10) << "path" << std::setw(12) << "ms"
+    << std::setw(16) << "peak RSS kB" << std::setw(16) << "over idle kB" << "\n"
+    << std::setw(10) << "document" << std::setw(12) << dom.ms
+    << std::setw(16) << dom.max_rss_kb << std::setw(16) << dom.max_rss_kb - idle.max_rss_kb << "\n"
+    << std::setw(10) << "stream" << std::setw(12) << stream.ms
+    << std::setw(16) << stream.max_rss_kb << std::setw(16) << stream.max_rss_kb - idle.max_rss_kb << "\n"
+    << std::setw(10) << "snapshot" << std::setw(12) << snap.ms
+    << std::setw(16) << snap.max_rss_kb << std::setw(16) << snap.max_rss_kb - idle.max_rss_kb << "\n";
+
+  std::remove(source.c_str());
+  std::remove(image.c_str());
+
+  // The children did the work; the sink only keeps it from being elided.
+  return sink == 42 ? 1 : 0;
+}
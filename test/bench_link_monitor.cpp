@@ -0,0 +1,140 @@
+/*
+ *
+ */
+
+/**
+ * Benchmark for link status checks.
+ *
+ * Compares asking the kernel whether an interface is up, with an RTM_GETLINK
+ * request per check, against reading the link monitor's table; and the same
+ * for resolving interface names, indices and device paths, with system calls
+ * or from the interface cache the monitor keeps loaded. If an
+ * interface is given that may be taken down and up again, the time from
+ * taking it down until subscribers learn of it is measured as well; this
+ * needs CAP_NET_ADMIN.
+ *
+ * Usage: bench_link_monitor [interface to check] [interface to toggle] [rounds]
+ */
+
+#include "net/link_monitor.h"
+#include "common/netlink_util.h"
+#include "common/netlink_ifcache.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <linkmanager/reactor.h>
+
+using namespace linkmanager;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename F>
+double
+ns_per_call(std::size_t calls, F && func)
+{
+  auto start = clock_type::now();
+  for (std::size_t i = 0 ; i < calls ; ++i) {
+    func();
+  }
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / calls;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  std::string check = (argc > 1) ? argv[1] : "lo";
+  std::string toggle = (argc > 2) ? argv[2] : "";
+  std::size_t rounds = (argc > 3) ? std::atoi(argv[3]) : 20;
+
+  reactor loop;
+  net::link_monitor monitor{loop};
+  if (!monitor.start()) {
+    std::cerr << "Could not start the link monitor." << std::endl;
+    return 1;
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  clock_type::time_point down_at;
+  bool down = false;
+  if (!toggle.empty()) {
+    monitor.subscribe(toggle, [&](net::link_event const & ev)
+        {
+          if (ev.type == net::link_event::LINK_DOWN) {
+            std::lock_guard<std::mutex> lock{mutex};
+            down_at = clock_type::now();
+            down = true;
+            cond.notify_one();
+          }
+        });
+  }
+
+  // Status checks and interface resolution, with system calls
+  int sink = 0;
+  auto index = NlIfNameToIndex(check.c_str());
+  char name[NL_IFNAMSIZ];
+  auto resolve = [&]()
+  {
+    sink += NlIfNameToIndex(check.c_str());
+    sink += NlIfIndexToName(index, name) ? 1 : 0;
+    sink += GetNetInterfaceName("/dev/cdc-wdm0", name, sizeof(name)) ? 1 : 0;
+  };
+  auto request = ns_per_call(1000, [&]() { sink += IsAdaptorUp(check.c_str()); });
+  auto system = ns_per_call(10000, resolve);
+
+  // ... and from memory. The monitor belongs to the loop's thread from here.
+  monitor.provide_interface_state();
+  std::thread thread{[&loop]() { loop.run(); }};
+  auto read = ns_per_call(1000000, [&]() { sink += IsAdaptorUp(check.c_str()); });
+  auto cached = ns_per_call(1000000, resolve);
+
+  std::cout << std::fixed << std::setprecision(1)
+    << "status of " << check << ":\n"
+    << "  request: " << std::setw(12) << request << " ns/check\n"
+    << "  monitor: " << std::setw(12) << read << " ns/check\n"
+    << "name, index and device path of " << check << ":\n"
+    << "  system:  " << std::setw(12) << system << " ns/lookup\n"
+    << "  cache:   " << std::setw(12) << cached << " ns/lookup\n";
+
+  // Down detection
+  if (!toggle.empty()) {
+    double total = 0;
+    double worst = 0;
+    std::size_t detected = 0;
+    for (std::size_t r = 0 ; r < rounds ; ++r) {
+      UpAdaptorInterface(toggle.c_str());
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+
+      std::unique_lock<std::mutex> lock{mutex};
+      down = false;
+      lock.unlock();
+      auto start = clock_type::now();
+      DownAdaptorInterface(toggle.c_str());
+      lock.lock();
+      if (!cond.wait_for(lock, std::chrono::seconds{1}, [&down]() { return down; })) {
+        continue;
+      }
+      auto us = std::chrono::duration<double, std::micro>(down_at - start).count();
+      total += us;
+      worst = std::max(worst, us);
+      ++detected;
+    }
+    std::cout << "down detection on " << toggle << ": " << detected << "/" << rounds
+      << " detected, mean " << (detected ? total / detected : 0) << " us, max "
+      << worst << " us\n";
+  }
+
+  loop.stop();
+  thread.join();
+
+  return sink == 42 ? 1 : 0;
+}
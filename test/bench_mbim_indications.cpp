@@ -0,0 +1,129 @@
+/*
+ *
+ */
+
+/**
+ * Benchmark for MBIM indication dispatch.
+ *
+ * The calling thread plays the transport's read thread, and dispatches
+ * indications as fast as it can to 1 to 32 subscribers, all subscribed to
+ * the same CID. Subscribers are spread over up to four event loops, each on
+ * its own thread.
+ *
+ * Reported are the time the read thread spends per indication, the rate at
+ * which subscribers receive indications in total, and the fraction dropped
+ * because a subscriber fell behind.
+ *
+ * Usage: bench_mbim_indications [indications per run]
+ */
+
+#include "mbim/indications.h"
+
+#include <linkmanager/reactor.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace linkmanager;
+using namespace linkmanager::mbim;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::size_t MAX_LOOPS = 4;
+static constexpr std::uint32_t CID = 11;
+static constexpr std::size_t PAYLOAD = 64;
+
+std::uint8_t const SERVICE[MBIM_UUID_SIZE] = {
+  0xa2, 0x89, 0xcc, 0x33, 0xbc, 0xbb, 0x8b, 0x4f,
+  0xb6, 0xb0, 0x13, 0x3e, 0xc2, 0xaa, 0xe6, 0xdf,
+};
+
+
+struct result
+{
+  double dispatch_ns = 0;
+  double delivered_per_s = 0;
+  double dropped_pct = 0;
+};
+
+
+result
+run(std::size_t subscribers, std::size_t indications)
+{
+  std::size_t const num_loops = std::min(subscribers, MAX_LOOPS);
+  std::vector<std::unique_ptr<reactor>> loops;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0 ; i < num_loops ; ++i) {
+    loops.push_back(std::make_unique<reactor>());
+  }
+  for (auto & loop : loops) {
+    threads.emplace_back([&loop]() { loop->run(); });
+  }
+
+  indication_dispatcher dispatcher;
+  std::atomic<std::uint64_t> delivered = 0;
+  for (std::size_t i = 0 ; i < subscribers ; ++i) {
+    dispatcher.subscribe(SERVICE, CID, *loops[i % num_loops],
+        [&delivered](indication const &)
+        {
+          delivered.fetch_add(1, std::memory_order_relaxed);
+        }, 1024);
+  }
+
+  std::vector<std::uint8_t> payload(PAYLOAD, 0x5a);
+  auto start = clock_type::now();
+  for (std::size_t i = 0 ; i < indications ; ++i) {
+    dispatcher.dispatch(SERVICE, CID, payload.data(), static_cast<std::uint32_t>(payload.size()));
+  }
+  auto dispatched = clock_type::now();
+
+  std::uint64_t const expected = subscribers * indications;
+  while (delivered.load(std::memory_order_relaxed) + dispatcher.dropped() < expected) {
+    std::this_thread::yield();
+  }
+  auto end = clock_type::now();
+
+  for (auto & loop : loops) {
+    loop->stop();
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  result res;
+  res.dispatch_ns = std::chrono::duration<double, std::nano>(dispatched - start).count()
+    / indications;
+  res.delivered_per_s = delivered / std::chrono::duration<double>(end - start).count();
+  res.dropped_pct = 100.0 * dispatcher.dropped() / expected;
+  return res;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  std::size_t indications = (argc > 1) ? std::atoi(argv[1]) : 200000;
+
+  std::cout << std::setw(12) << "subscribers"
+    << std::setw(16) << "dispatch ns"
+    << std::setw(16) << "delivered/s"
+    << std::setw(12) << "dropped %" << std::endl;
+
+  for (std::size_t subscribers : {1, 2, 4, 8, 16, 32}) {
+    auto res = run(subscribers, indications);
+    std::cout << std::fixed << std::setprecision(1)
+      << std::setw(12) << subscribers
+      << std::setw(16) << res.dispatch_ns
+      << std::setw(16) << res.delivered_per_s
+      << std::setw(12) << res.dropped_pct << std::endl;
+  }
+
+  return 0;
+}
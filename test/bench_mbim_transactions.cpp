@@ -0,0 +1,191 @@
+/*
+ *
+ */
+
+/**
+ * Microbenchmark for MBIM transaction tracking.
+ *
+ * Measures lookups (as done for every response fragment), and insert/remove
+ * pairs (as done for every command) with a given number of transactions
+ * outstanding. The transaction table is compared against the doubly linked
+ * list the transport used to keep.
+ *
+ * Usage: bench_mbim_transactions [iterations per run]
+ */
+
+#include "lite-mbim/MbimTransactionTable.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+
+/**
+ * The previous transaction list, for comparison; transactions are appended
+ * at the tail and searched from the head.
+ */
+struct transaction_list
+{
+  MbimTransaction * head = nullptr;
+  MbimTransaction * tail = nullptr;
+
+  inline void insert(MbimTransaction * trans)
+  {
+    trans->pPrev = tail;
+    trans->pNext = nullptr;
+    if (tail) {
+      tail->pNext = trans;
+    }
+    else {
+      head = trans;
+    }
+    tail = trans;
+  }
+
+  inline MbimTransaction * find(std::uint32_t id)
+  {
+    for (auto cur = head ; cur ; cur = cur->pNext) {
+      if (cur->transactionId == id) {
+        return cur;
+      }
+    }
+    return nullptr;
+  }
+
+  inline MbimTransaction * remove(std::uint32_t id)
+  {
+    auto trans = find(id);
+    if (!trans) {
+      return nullptr;
+    }
+    (trans->pPrev ? trans->pPrev->pNext : head) = trans->pNext;
+    (trans->pNext ? trans->pNext->pPrev : tail) = trans->pPrev;
+    return trans;
+  }
+};
+
+
+struct table_adapter
+{
+  MbimTransactionTable table;
+
+  inline explicit table_adapter(std::uint32_t max)
+  {
+    MbimTransactionTable_Initialize(&table, max);
+  }
+
+  inline ~table_adapter()
+  {
+    MbimTransactionTable_Destroy(&table);
+  }
+
+  inline void insert(MbimTransaction * trans)
+  {
+    MbimTransactionTable_Insert(&table, trans);
+  }
+
+  inline MbimTransaction * find(std::uint32_t id)
+  {
+    return MbimTransactionTable_Find(&table, id);
+  }
+
+  inline MbimTransaction * remove(std::uint32_t id)
+  {
+    return MbimTransactionTable_Remove(&table, id);
+  }
+};
+
+
+struct result
+{
+  double lookup_ns = 0;
+  double insert_remove_ns = 0;
+};
+
+
+/**
+ * With `outstanding` transactions in the container, time lookups of random
+ * outstanding IDs, then time retiring the oldest transaction and adding a
+ * new one, as a steady stream of commands would.
+ */
+template <typename C>
+result
+run(C & container, std::size_t outstanding, std::size_t iterations)
+{
+  std::vector<MbimTransaction> storage(outstanding + 1);
+  std::uint32_t next_id = 1;
+  for (std::size_t i = 0 ; i < outstanding ; ++i) {
+    storage[i].transactionId = next_id++;
+    container.insert(&storage[i]);
+  }
+
+  result res;
+  std::uintptr_t sink = 0;
+
+  // Lookups; a cheap LCG picks IDs in no particular order.
+  std::uint32_t x = 12345;
+  auto start = clock_type::now();
+  for (std::size_t i = 0 ; i < iterations ; ++i) {
+    x = x * 1664525u + 1013904223u;
+    sink += reinterpret_cast<std::uintptr_t>(container.find(1 + (x >> 8) % outstanding));
+  }
+  res.lookup_ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count()
+    / iterations;
+
+  // Insert/remove pairs; oldest transaction out, new transaction in.
+  std::uint32_t oldest = 1;
+  std::size_t spare = outstanding;
+  start = clock_type::now();
+  for (std::size_t i = 0 ; i < iterations ; ++i) {
+    auto done = container.remove(oldest++);
+    sink += reinterpret_cast<std::uintptr_t>(done);
+    storage[spare].transactionId = next_id++;
+    container.insert(&storage[spare]);
+    spare = done - storage.data();
+  }
+  res.insert_remove_ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count()
+    / iterations;
+
+  if (sink == 42) {
+    std::cout << "";
+  }
+  return res;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  std::size_t iterations = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+
+  std::cout << std::setw(12) << "outstanding"
+    << std::setw(16) << "table find ns"
+    << std::setw(16) << "table ins/rm ns"
+    << std::setw(16) << "list find ns"
+    << std::setw(16) << "list ins/rm ns" << std::endl;
+
+  for (std::size_t outstanding : {1, 64, 1024}) {
+    table_adapter table{static_cast<std::uint32_t>(outstanding)};
+    auto tab = run(table, outstanding, iterations);
+
+    // The list is linear in the number of outstanding transactions; fewer
+    // iterations keep the run time bearable.
+    transaction_list list;
+    auto lst = run(list, outstanding, std::max<std::size_t>(iterations / outstanding, 1000));
+
+    std::cout << std::fixed << std::setprecision(1)
+      << std::setw(12) << outstanding
+      << std::setw(16) << tab.lookup_ns
+      << std::setw(16) << tab.insert_remove_ns
+      << std::setw(16) << lst.lookup_ns
+      << std::setw(16) << lst.insert_remove_ns << std::endl;
+  }
+
+  return 0;
+}
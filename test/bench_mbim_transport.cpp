@@ -0,0 +1,479 @@
+/*
+ *
+ */
+
+/**
+ * Benchmark for the MBIM transport, run against the modem simulator.
+ *
+ * Scenarios:
+ * - single: one command in flight at a time.
+ * - pipelined: --depth commands kept in flight on one transport.
+ * - multi_modem: --modems simulators, each with its own transport, with
+ *   --depth commands in flight on each.
+ * - multi_modem_shared: as multi_modem, but with all transports serviced by
+ *   a single shared reader thread (see MbimReactor).
+ * - pipelined_captured: as pipelined, with every fragment recorded in an
+ *   MbimCapture, for the cost of always-on capture.
+ *
+ * For each scenario, commands per second and p50/p99/p999 command latency
+ * are reported. Additionally reported are:
+ * - The rate at which indications from an indication storm arrive at an
+ *   attached indicator.
+ * - The cost of fragment reassembly, as the difference in time per command
+ *   between a response that fits a single control transfer and the same
+ *   response split into 64 byte fragments, divided by the number of extra
+ *   fragments. This is end to end, so includes writing and reading the
+ *   additional fragments.
+ * - Heap memory per outstanding transaction, measured against a simulator
+ *   that never answers.
+ *
+ * With --json, the results are also written to a file in machine-readable
+ * form, for tracking across releases.
+ */
+
+#include "mbim/async.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <clipp.h>
+#include <nlohmann/json.hpp>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager::mbim;
+using namespace std::chrono_literals;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::uint32_t MAX_TRANSACTIONS = 1024;
+static constexpr std::size_t FRAGMENT_SIZE = 64;
+
+
+struct bench_transport
+{
+  MbimTransport t;
+
+  inline explicit bench_transport(test::mbim_simulator & sim, MbimReactor * reactor = nullptr)
+  {
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_InitializeShared(&t, sim.path(), 4096, MAX_TRANSACTIONS, reactor) < 0) {
+      throw std::runtime_error{"MbimTransport_InitializeShared failed"};
+    }
+  }
+
+  inline ~bench_transport()
+  {
+    MbimTransport_ShutDown(&t);
+  }
+};
+
+
+/**
+ * Keeps `depth` commands in flight until `count` have completed; each
+ * completion submits the next command from the transport's read thread.
+ */
+class driver
+{
+public:
+  inline driver(async_transport & transport, command const & cmd, std::size_t count,
+      std::size_t depth)
+    : m_transport{transport}
+    , m_cmd{cmd}
+    , m_count{count}
+    , m_depth{depth}
+    , m_latencies(count)
+  {
+  }
+
+  inline void start()
+  {
+    m_start = clock_type::now();
+    for (std::size_t i = 0 ; i < std::min(m_depth, m_count) ; ++i) {
+      launch();
+    }
+  }
+
+  inline void wait()
+  {
+    m_done.get_future().wait();
+  }
+
+  inline std::vector<double> const & latencies() const
+  {
+    return m_latencies;
+  }
+
+  inline std::size_t errors() const
+  {
+    return m_errors;
+  }
+
+  inline clock_type::duration elapsed() const
+  {
+    return m_end - m_start;
+  }
+
+private:
+  inline void launch()
+  {
+    auto index = m_next.fetch_add(1);
+    if (index >= m_count) {
+      return;
+    }
+    auto sent = clock_type::now();
+    m_transport.submit_raw(m_cmd,
+        [this, index, sent](std::uint32_t status, std::uint8_t *, std::uint32_t)
+        {
+          auto now = clock_type::now();
+          m_latencies[index] = std::chrono::duration<double, std::micro>(now - sent).count();
+          if (status != MBIM_STATUS_SUCCESS) {
+            ++m_errors;
+          }
+          if (++m_completed == m_count) {
+            m_end = now;
+            m_done.set_value();
+            return;
+          }
+          launch();
+        });
+  }
+
+  async_transport &         m_transport;
+  command const &           m_cmd;
+  std::size_t               m_count;
+  std::size_t               m_depth;
+
+  std::atomic<std::size_t>  m_next{0};
+  std::atomic<std::size_t>  m_completed{0};
+  std::atomic<std::size_t>  m_errors{0};
+  std::vector<double>       m_latencies;  // Microseconds
+  clock_type::time_point    m_start;
+  clock_type::time_point    m_end;
+  std::promise<void>        m_done;
+};
+
+
+double
+percentile(std::vector<double> const & sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+
+/**
+ * Run `count` commands on each of `modems` simulators, optionally with
+ * their transports serviced by a shared reactor, and recording to a
+ * capture.
+ */
+nlohmann::json
+run_commands(char const * name, test::simulator_config const & config,
+    std::size_t modems, std::size_t count, std::size_t depth, MbimReactor * reactor = nullptr,
+    MbimCapture * capture = nullptr)
+{
+  std::vector<std::unique_ptr<test::mbim_simulator>> sims;
+  std::vector<std::unique_ptr<bench_transport>> transports;
+  std::vector<std::unique_ptr<async_transport>> asyncs;
+  std::vector<std::unique_ptr<driver>> drivers;
+
+  auto cmd = radio_state_query();
+  for (std::size_t i = 0 ; i < modems ; ++i) {
+    sims.push_back(std::make_unique<test::mbim_simulator>(config));
+    sims.back()->start();
+    transports.push_back(std::make_unique<bench_transport>(*sims.back(), reactor));
+    if (capture) {
+      MbimTransport_AttachCapture(&transports.back()->t, capture);
+    }
+    asyncs.push_back(std::make_unique<async_transport>(transports.back()->t));
+    drivers.push_back(std::make_unique<driver>(*asyncs.back(), cmd, count, depth));
+  }
+
+  auto start = clock_type::now();
+  for (auto & d : drivers) {
+    d->start();
+  }
+  std::vector<double> latencies;
+  std::size_t errors = 0;
+  for (auto & d : drivers) {
+    d->wait();
+    latencies.insert(latencies.end(), d->latencies().begin(), d->latencies().end());
+    errors += d->errors();
+  }
+  auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  std::sort(latencies.begin(), latencies.end());
+
+  return {
+    {"name", name},
+    {"modems", modems},
+    {"depth", depth},
+    {"commands", latencies.size()},
+    {"errors", errors},
+    {"commands_per_s", latencies.size() / seconds},
+    {"latency_us", {
+      {"p50", percentile(latencies, 0.5)},
+      {"p99", percentile(latencies, 0.99)},
+      {"p999", percentile(latencies, 0.999)},
+      {"max", latencies.empty() ? 0 : latencies.back()},
+    }},
+  };
+}
+
+
+nlohmann::json
+run_indications(std::chrono::milliseconds duration)
+{
+  test::simulator_config config;
+  config.storm_interval = 100us;
+  config.storm_burst = 100;
+  test::mbim_simulator sim{config};
+  sim.start();
+  bench_transport tr{sim};
+
+  std::atomic<std::uint64_t> received{0};
+  MbimIndicator indicator;
+  MbimIndicator_Initialize(&indicator,
+      [](std::uint8_t *, std::uint32_t, std::uint8_t *, std::uint32_t, void * context)
+      {
+        static_cast<std::atomic<std::uint64_t> *>(context)->fetch_add(1,
+            std::memory_order_relaxed);
+      }, &received);
+  MbimTransport_AttachIndicator(&tr.t, &indicator);
+
+  auto start = clock_type::now();
+  auto sent_before = sim.stats().indications.load();
+  auto received_before = received.load();
+  std::this_thread::sleep_for(duration);
+  auto sent = sim.stats().indications - sent_before;
+  auto count = received - received_before;
+  auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  MbimTransport_DetachIndicator(&tr.t, &indicator);
+  sim.stop();
+
+  return {
+    {"sent", sent},
+    {"received", count},
+    {"received_per_s", count / seconds},
+  };
+}
+
+
+/**
+ * Time per command for subscriber ready status queries, whose responses
+ * are large enough to be fragmented at FRAGMENT_SIZE.
+ */
+double
+time_per_command(std::size_t max_transfer, std::size_t count, std::uint32_t & response_length)
+{
+  test::simulator_config config;
+  config.max_transfer = max_transfer;
+  test::mbim_simulator sim{config};
+  sim.start();
+  bench_transport tr{sim};
+  async_transport async{tr.t};
+
+  std::promise<std::uint32_t> length;
+  async.submit_raw(subscriber_ready_query(),
+      [&length](std::uint32_t, std::uint8_t *, std::uint32_t len)
+      {
+        length.set_value(len);
+      });
+  response_length = length.get_future().get();
+
+  auto cmd = subscriber_ready_query();
+  driver d{async, cmd, count, 1};
+  d.start();
+  d.wait();
+  return std::chrono::duration<double, std::micro>(d.elapsed()).count() / count;
+}
+
+
+nlohmann::json
+run_reassembly(std::size_t count)
+{
+  std::uint32_t length = 0;
+  auto whole = time_per_command(4096, count, length);
+  auto fragmented = time_per_command(FRAGMENT_SIZE, count, length);
+
+  // Every fragment carries a 20 byte message and fragment header; the
+  // first one another 28 bytes of command done header.
+  std::size_t const payload = FRAGMENT_SIZE - 20;
+  std::size_t const fragments = (length + 28 + payload - 1) / payload;
+
+  return {
+    {"response_bytes", length},
+    {"fragment_bytes", FRAGMENT_SIZE},
+    {"fragments", fragments},
+    {"whole_us_per_command", whole},
+    {"fragmented_us_per_command", fragmented},
+    {"us_per_extra_fragment", fragments > 1 ? (fragmented - whole) / (fragments - 1) : 0},
+  };
+}
+
+
+nlohmann::json
+run_memory(std::size_t outstanding)
+{
+  test::simulator_config config;
+  config.drop_rate = 1;
+  test::mbim_simulator sim{config};
+  sim.start();
+  bench_transport tr{sim};
+  async_transport async{tr.t};
+
+  auto cmd = radio_state_query();
+  auto before = mallinfo2().uordblks;
+  for (std::size_t i = 0 ; i < outstanding ; ++i) {
+    async.submit_raw(cmd, [](std::uint32_t, std::uint8_t *, std::uint32_t) {});
+  }
+  auto after = mallinfo2().uordblks;
+
+  return {
+    {"outstanding", outstanding},
+    {"heap_bytes_per_transaction",
+      static_cast<double>(after - before) / outstanding},
+    // Preallocated when the transport is initialized.
+    {"table_bytes_per_transaction",
+      static_cast<double>(tr.t.transactionTable.capacity * sizeof(MbimTransactionSlot))
+        / tr.t.transactionTable.maxCount},
+  };
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  using namespace clipp;
+
+  std::size_t commands = 20000;
+  std::size_t depth = 32;
+  std::size_t modems = 4;
+  long duration = 1000;
+  long latency = 0;
+  std::string json_file;
+  bool help = false;
+
+  auto cli = (
+      (option("--commands") & value("COUNT", commands))
+        .doc("Commands per scenario and modem (default: 20000)."),
+      (option("--depth") & value("COUNT", depth))
+        .doc("Commands in flight when pipelining (default: 32)."),
+      (option("--modems") & value("COUNT", modems))
+        .doc("Simulated modems in the multi-modem scenario (default: 4)."),
+      (option("--latency") & value("USEC", latency))
+        .doc("Simulated response latency in microseconds (default: 0)."),
+      (option("--duration") & value("MSEC", duration))
+        .doc("Duration of the indication storm (default: 1000)."),
+      (option("--json") & value("FILE", json_file))
+        .doc("Also write the results as JSON to FILE."),
+      option("--help", "-?")
+        .set(help)
+        .doc("Display this help.")
+  );
+
+  if (!parse(argc, argv, cli) || help || depth == 0 || depth > MAX_TRANSACTIONS) {
+    std::cerr << make_man_page(cli, argv[0]);
+    return 1;
+  }
+
+  test::simulator_config config;
+  config.latency = std::chrono::microseconds{latency};
+
+  nlohmann::json results;
+  results["config"] = {
+    {"commands", commands},
+    {"depth", depth},
+    {"modems", modems},
+    {"latency_us", latency},
+  };
+
+  auto & scenarios = results["scenarios"] = nlohmann::json::array();
+  scenarios.push_back(run_commands("single", config, 1, commands, 1));
+  scenarios.push_back(run_commands("pipelined", config, 1, commands, depth));
+  {
+    MbimCapture capture;
+    if (MbimCapture_Initialize(&capture, 0, 0, nullptr) < 0) {
+      std::cerr << "Cannot initialize capture" << std::endl;
+      return 1;
+    }
+    scenarios.push_back(run_commands("pipelined_captured", config, 1, commands, depth,
+          nullptr, &capture));
+    MbimCapture_Destroy(&capture);
+  }
+  scenarios.push_back(run_commands("multi_modem", config, modems, commands, depth));
+  {
+    MbimReactor reactor;
+    if (MbimReactor_Initialize(&reactor, 1, static_cast<std::uint32_t>(2 * modems)) < 0) {
+      std::cerr << "Cannot initialize reactor" << std::endl;
+      return 1;
+    }
+    scenarios.push_back(run_commands("multi_modem_shared", config, modems, commands, depth,
+          &reactor));
+    MbimReactor_ShutDown(&reactor);
+  }
+
+  std::cout << std::setw(20) << "scenario"
+    << std::setw(8) << "modems"
+    << std::setw(8) << "depth"
+    << std::setw(14) << "commands/s"
+    << std::setw(12) << "p50 us"
+    << std::setw(12) << "p99 us"
+    << std::setw(12) << "p999 us"
+    << std::setw(8) << "errors" << std::endl;
+  for (auto const & s : scenarios) {
+    std::cout << std::fixed << std::setprecision(1)
+      << std::setw(20) << s["name"].get<std::string>()
+      << std::setw(8) << s["modems"].get<std::size_t>()
+      << std::setw(8) << s["depth"].get<std::size_t>()
+      << std::setw(14) << s["commands_per_s"].get<double>()
+      << std::setw(12) << s["latency_us"]["p50"].get<double>()
+      << std::setw(12) << s["latency_us"]["p99"].get<double>()
+      << std::setw(12) << s["latency_us"]["p999"].get<double>()
+      << std::setw(8) << s["errors"].get<std::size_t>() << std::endl;
+  }
+
+  auto & ind = results["indications"] = run_indications(std::chrono::milliseconds{duration});
+  std::cout << std::endl << "indications: " << ind["received_per_s"].get<double>()
+    << "/s (" << ind["received"].get<std::uint64_t>() << " of "
+    << ind["sent"].get<std::uint64_t>() << " received)" << std::endl;
+
+  auto & reasm = results["reassembly"] = run_reassembly(std::max<std::size_t>(commands / 10, 1));
+  std::cout << "reassembly: " << reasm["us_per_extra_fragment"].get<double>()
+    << " us per extra fragment ("
+    << reasm["response_bytes"].get<std::uint32_t>() << " byte response in "
+    << reasm["fragments"].get<std::size_t>() << " fragments: "
+    << reasm["fragmented_us_per_command"].get<double>() << " us, unfragmented: "
+    << reasm["whole_us_per_command"].get<double>() << " us)" << std::endl;
+
+  auto & mem = results["memory"] = run_memory(std::min<std::size_t>(MAX_TRANSACTIONS, 512));
+  std::cout << "memory: " << mem["heap_bytes_per_transaction"].get<double>()
+    << " heap bytes per outstanding transaction, plus "
+    << mem["table_bytes_per_transaction"].get<double>() << " preallocated" << std::endl;
+
+  if (!json_file.empty()) {
+    std::ofstream out{json_file};
+    out << std::setw(2) << results << std::endl;
+    if (!out) {
+      std::cerr << "Cannot write " << json_file << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ *
+ */
+
+/**
+ * Contention benchmark for module registry reads.
+ *
+ * Many reader threads look up modules while a single writer keeps
+ * registering new ones. Lock-free snapshot reads are compared against a
+ * map guarded by a reader/writer lock, which is what the registry would
+ * otherwise need.
+ *
+ * Usage: bench_module_registry [milliseconds per run]
+ */
+
+#include <linkmanager/module_registry.h>
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <shared_mutex>
+#include <thread>
+
+using namespace linkmanager;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::size_t INITIAL_MODULES = 16;
+static constexpr auto WRITE_INTERVAL = std::chrono::milliseconds{1};
+
+
+class bench_module : public api::modules::link_module
+{
+public:
+  virtual std::string name() const final
+  {
+    return "bench";
+  }
+
+  virtual bool is_powered_on() const final
+  {
+    return true;
+  }
+
+  virtual bool set_powered_on(bool) final
+  {
+    return true;
+  }
+
+  virtual link_list links() const final
+  {
+    return {};
+  }
+};
+
+
+inline std::string
+module_name(std::size_t i)
+{
+  return "module" + std::to_string(i);
+}
+
+
+struct result
+{
+  double reads_per_sec = 0;
+  double writes = 0;
+  double max_write_us = 0;
+};
+
+
+/**
+ * Run readers and a writer for the given duration. The read function must
+ * return a value derived from the data it read, so the work is not optimized
+ * away.
+ */
+template <typename R, typename W>
+result
+run(std::size_t readers, std::chrono::milliseconds duration, R && read, W && write)
+{
+  std::atomic<bool> done = false;
+  std::atomic<std::uint64_t> total_reads = 0;
+  std::atomic<std::uint64_t> sink = 0;
+
+  auto start = clock_type::now();
+  auto end = start + duration;
+
+  // Readers also watch the clock; a writer starved by a reader preferring
+  // lock might otherwise never get to tell them to stop.
+  std::vector<std::thread> threads;
+  for (std::size_t r = 0 ; r < readers ; ++r) {
+    threads.emplace_back([&, r]()
+        {
+          std::uint64_t reads = 0;
+          std::uint64_t acc = 0;
+          std::size_t i = r;
+          while (!done.load(std::memory_order_relaxed)) {
+            acc += read(i++);
+            ++reads;
+            if (!(reads % 1024) && clock_type::now() >= end) {
+              break;
+            }
+          }
+          total_reads += reads;
+          sink += acc;
+        });
+  }
+
+  result res;
+  std::size_t next = INITIAL_MODULES;
+  while (clock_type::now() < end) {
+    auto wstart = clock_type::now();
+    write(next++);
+    auto us = std::chrono::duration<double, std::micro>(clock_type::now() - wstart).count();
+    res.max_write_us = std::max(res.max_write_us, us);
+    res.writes += 1;
+    std::this_thread::sleep_for(WRITE_INTERVAL);
+  }
+  done = true;
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  auto secs = std::chrono::duration<double>(clock_type::now() - start).count();
+  res.reads_per_sec = total_reads / secs;
+  return res;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  auto duration = std::chrono::milliseconds{(argc > 1) ? std::atoi(argv[1]) : 500};
+  auto mod = std::make_shared<bench_module>();
+
+  std::cout << std::setw(8) << "readers"
+    << std::setw(16) << "rcu reads/s"
+    << std::setw(14) << "rcu max w us"
+    << std::setw(16) << "rwlock reads/s"
+    << std::setw(14) << "rwl max w us" << std::endl;
+
+  for (std::size_t readers : {1, 2, 4, 8, 16}) {
+    // Snapshot reads
+    module_registry registry;
+    for (std::size_t i = 0 ; i < INITIAL_MODULES ; ++i) {
+      registry.register_module(mod, module_name(i));
+    }
+    auto lookup = module_name(INITIAL_MODULES / 2);
+
+    auto rcu = run(readers, duration,
+        [&](std::size_t i) -> std::uint64_t
+        {
+          auto snap = registry.snapshot();
+          auto const & e = snap->entries[i % snap->size()];
+          return snap->version + e.name.size() + (snap->find(lookup) ? 1 : 0);
+        },
+        [&](std::size_t i)
+        {
+          registry.register_module(mod, module_name(i));
+        });
+
+    // Reader/writer lock baseline
+    std::shared_mutex mutex;
+    module_registry::module_map map;
+    std::uint64_t version = 0;
+    for (std::size_t i = 0 ; i < INITIAL_MODULES ; ++i) {
+      map[module_name(i)] = mod;
+    }
+
+    auto rwlock = run(readers, duration,
+        [&](std::size_t i) -> std::uint64_t
+        {
+          std::shared_lock<std::shared_mutex> lock{mutex};
+          auto iter = map.begin();
+          std::advance(iter, i % INITIAL_MODULES);
+          return version + iter->first.size() + (map.count(lookup) ? 1 : 0);
+        },
+        [&](std::size_t i)
+        {
+          std::unique_lock<std::shared_mutex> lock{mutex};
+          map[module_name(i)] = mod;
+          ++version;
+        });
+
+    std::cout << std::fixed << std::setprecision(0)
+      << std::setw(8) << readers
+      << std::setw(16) << rcu.reads_per_sec
+      << std::setw(14) << rcu.max_write_us
+      << std::setw(16) << rwlock.reads_per_sec
+      << std::setw(14) << rwlock.max_write_us << std::endl;
+  }
+
+  return 0;
+}
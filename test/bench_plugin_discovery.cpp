@@ -0,0 +1,160 @@
+/*
+ *
+ */
+
+/**
+ * Startup benchmark for plugin discovery.
+ *
+ * Populates scratch directories with 1, 10 and 100 copies of the test plugin
+ * (and as many non-plugin files), and compares:
+ *
+ * - serial: the previous approach of dlopen()ing every file in turn,
+ * - cold: ELF inspection and parallel loading with an empty index,
+ * - warm: as cold, but with an up-to-date index.
+ *
+ * Usage: bench_plugin_discovery <path to libtest_plugin.so> [rounds]
+ */
+
+#include <linkmanager/plugin_discovery.h>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace fs = std::filesystem;
+using namespace linkmanager;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+void
+close_all(std::vector<void *> const & handles)
+{
+  for (auto h : handles) {
+    if (h) {
+      ::dlclose(h);
+    }
+  }
+}
+
+
+std::size_t
+run_serial(fs::path const & dir)
+{
+  std::vector<void *> handles;
+  std::vector<fs::path> files;
+  for (auto const & entry : fs::directory_iterator{dir}) {
+    files.push_back(entry.path());
+  }
+
+  std::size_t found = 0;
+  for (auto const & f : files) {
+    auto handle = ::dlopen(f.c_str(), RTLD_LAZY);
+    if (!handle) {
+      continue;
+    }
+    if (::dlsym(handle, PLUGIN_INIT_SYMBOL)) {
+      ++found;
+    }
+    handles.push_back(handle);
+  }
+  close_all(handles);
+  return found;
+}
+
+
+std::size_t
+run_discovery(fs::path const & dir, plugin_index * index)
+{
+  auto candidates = discover_plugins(dir, index);
+  auto handles = open_plugins(candidates);
+
+  std::size_t found = 0;
+  for (auto h : handles) {
+    if (h && ::dlsym(h, PLUGIN_INIT_SYMBOL)) {
+      ++found;
+    }
+  }
+  close_all(handles);
+  return found;
+}
+
+
+template <typename F>
+double
+measure(int rounds, F && func)
+{
+  std::chrono::nanoseconds total{};
+  for (int i = 0 ; i < rounds ; ++i) {
+    auto start = clock_type::now();
+    func();
+    total += clock_type::now() - start;
+  }
+  return std::chrono::duration<double, std::milli>(total).count() / rounds;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <test plugin> [rounds]" << std::endl;
+    return 1;
+  }
+  fs::path plugin = fs::absolute(argv[1]);
+  int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+  if (rounds < 1) {
+    rounds = 1;
+  }
+
+  auto base = fs::temp_directory_path()
+    / ("linkmanager-bench-" + std::to_string(::getpid()));
+
+  std::cout << std::setw(8) << "plugins"
+    << std::setw(14) << "serial ms"
+    << std::setw(14) << "cold ms"
+    << std::setw(14) << "warm ms" << std::endl;
+
+  for (std::size_t count : {1, 10, 100}) {
+    auto dir = base / std::to_string(count);
+    fs::create_directories(dir);
+    for (std::size_t i = 0 ; i < count ; ++i) {
+      fs::copy_file(plugin, dir / ("bench" + std::to_string(i) + "_plugin.so"));
+      std::ofstream{dir / ("notes" + std::to_string(i) + ".txt")} << "not a plugin\n";
+    }
+
+    std::size_t found_serial = 0, found_cold = 0, found_warm = 0;
+    auto serial = measure(rounds, [&]() { found_serial = run_serial(dir); });
+    auto cold = measure(rounds, [&]()
+        {
+          plugin_index index;
+          found_cold = run_discovery(dir, &index);
+        });
+
+    plugin_index warm_index;
+    discover_plugins(dir, &warm_index);
+    auto warm = measure(rounds, [&]() { found_warm = run_discovery(dir, &warm_index); });
+
+    if (found_serial != count || found_cold != count || found_warm != count) {
+      std::cerr << "Plugin count mismatch: expected " << count << ", got "
+        << found_serial << "/" << found_cold << "/" << found_warm << std::endl;
+      fs::remove_all(base);
+      return 2;
+    }
+
+    std::cout << std::fixed << std::setprecision(3)
+      << std::setw(8) << count
+      << std::setw(14) << serial
+      << std::setw(14) << cold
+      << std::setw(14) << warm << std::endl;
+  }
+
+  fs::remove_all(base);
+  return 0;
+}
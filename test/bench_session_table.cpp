@@ -0,0 +1,179 @@
+/*
+ *
+ */
+
+/**
+ * Benchmark for the compiled session table, with fleets of many sessions.
+ *
+ * A fleet configuration is compiled once, and then the kind of reads links
+ * and the scheduler do are run against the table: scanning every session
+ * for a few fields, and looking sessions up by ID. The same reads against
+ * the JSON document, by key, are the baseline. Reloading, i.e. compiling a
+ * changed configuration and diffing it against the running one, is timed
+ * as well.
+ *
+ * Usage: bench_session_table [sessions] [rounds]
+ */
+
+#include "config/session_diff.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace linkmanager::config;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+static char const * const IP_TYPES[] = {
+  "MBIMContextIPTypeIPv4",
+  "MBIMContextIPTypeIPv6",
+  "MBIMContextIPTypeIPv4v6",
+};
+
+static char const * const AUTH_PROTOCOLS[] = {
+  "MBIMAuthProtocolNone",
+  "MBIMAuthProtocolPap",
+  "MBIMAuthProtocolChap",
+};
+
+
+/**
+ * A fleet of sessions spread over a handful of APNs, as is typical.
+ */
+nlohmann::json
+fleet_config(std::size_t sessions)
+{
+  nlohmann::json config;
+  config["modulePath"] = "/dev/cdc-wdm0";
+  config["deviceInterfaceName"] = "wwan0";
+  auto & section = config["session"];
+  for (std::size_t i = 0 ; i < sessions ; ++i) {
+    section["s" + std::to_string(i)] = {
+      { "sessionId", i },
+      { "userName", "fleet" + std::to_string(i % 8) },
+      { "password", "secret" },
+      { "accessString", "apn" + std::to_string(i % 4) + ".example" },
+      { "compression", "MBIMCompressionNone" },
+      { "authProtocol", AUTH_PROTOCOLS[i % 3] },
+      { "ipType", IP_TYPES[i % 3] },
+      { "useVlan", i % 2 == 0 },
+      { "vlanName", "vlan." + std::to_string(i % 4094) },
+      { "vlanId", 1 + i % 4094 },
+      { "route", {
+        { "dst", "10." + std::to_string(i / 256 % 256) + "." + std::to_string(i % 256) + ".0" },
+        { "dstPrefixLength", 24 },
+      } },
+    };
+  }
+  return config;
+}
+
+
+template <typename F>
+double
+ns_per_op(std::size_t ops, F && func)
+{
+  auto start = clock_type::now();
+  func();
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / ops;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv)
+{
+  std::size_t sessions = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  std::size_t rounds = (argc > 2) ? std::atoi(argv[2]) : 200;
+
+  auto config = fleet_config(sessions);
+  std::uint64_t sink = 0;
+
+  auto compile_ns = ns_per_op(1, [&]()
+      {
+        auto table = session_table::compile(config);
+        sink += table.size();
+      });
+  auto table = session_table::compile(config);
+
+  // Reload with one session changed.
+  auto changed = config;
+  changed["session"]["s0"]["accessString"] = "changed.example";
+  auto reload_ns = ns_per_op(1, [&]()
+      {
+        auto next = session_table::compile(changed);
+        sink += diff(table, next).changed.size();
+      });
+
+  // Scan: how many sessions want an IPv4 VLAN, and how long their APNs are.
+  auto table_scan = ns_per_op(rounds * sessions, [&]()
+      {
+        for (std::size_t r = 0 ; r < rounds ; ++r) {
+          for (std::size_t row = 0 ; row < table.size() ; ++row) {
+            if (table.use_vlan(row) && table.ip_type(row) == MBIMContextIPTypeIPv4) {
+              sink += table.access_string(row).size();
+            }
+          }
+        }
+      });
+
+  auto json_scan = ns_per_op(rounds * sessions, [&]()
+      {
+        for (std::size_t r = 0 ; r < rounds ; ++r) {
+          for (auto const & [name, session] : config["session"].items()) {
+            if (session["useVlan"].get<bool>()
+                && session["ipType"].get_ref<std::string const &>() == "MBIMContextIPTypeIPv4") {
+              sink += session["accessString"].get_ref<std::string const &>().size();
+            }
+          }
+        }
+      });
+
+  // Lookup by session ID, as indications name sessions by ID.
+  auto table_find = ns_per_op(rounds * sessions, [&]()
+      {
+        for (std::size_t r = 0 ; r < rounds ; ++r) {
+          for (std::uint32_t id = 0 ; id < sessions ; ++id) {
+            sink += table.vlan_id(*table.find((id * 7919) % sessions));
+          }
+        }
+      });
+
+  // The JSON has to be searched; keep the baseline's rounds down.
+  std::size_t json_rounds = std::max<std::size_t>(1, rounds / 100);
+  auto json_find = ns_per_op(json_rounds * sessions, [&]()
+      {
+        auto const & section = config["session"];
+        for (std::size_t r = 0 ; r < json_rounds ; ++r) {
+          for (std::uint32_t id = 0 ; id < sessions ; ++id) {
+            auto wanted = (id * 7919) % sessions;
+            for (auto const & session : section) {
+              if (session["sessionId"].get<std::uint32_t>() == wanted) {
+                sink += session["vlanId"].get<std::uint16_t>();
+                break;
+              }
+            }
+          }
+        }
+      });
+
+  std::cout << std::fixed << std::setprecision(1)
+    << "sessions: " << sessions << "\n"
+    << "compile: " << compile_ns / 1e6 << " ms ("
+    << compile_ns / sessions << " ns per session)\n"
+    << "reload: " << reload_ns / 1e6 << " ms\n"
+    << "arena: " << table.arena_size() << " bytes ("
+    << static_cast<double>(table.arena_size()) / sessions << " per session)\n"
+    << std::setw(10) << "read" << std::setw(16) << "table ns/op"
+    << std::setw(16) << "json ns/op" << std::setw(10) << "speedup" << "\n"
+    << std::setw(10) << "scan" << std::setw(16) << table_scan
+    << std::setw(16) << json_scan << std::setw(10) << json_scan / table_scan << "\n"
+    << std::setw(10) << "find" << std::setw(16) << table_find
+    << std::setw(16) << json_find << std::setw(10) << json_find / table_find << "\n";
+
+  // Keep the reads from being optimized away.
+  return sink == 42 ? 1 : 0;
+}
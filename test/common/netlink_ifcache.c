@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+
+#include "netlink_ifcache.h"
+
+#define NL_IFCACHE_MAX_DEVICES	8
+#define NL_IFCACHE_DEVPATH_SIZE	64
+
+// Interface found for a device path
+struct nlifdevice
+{
+	char szPath[NL_IFCACHE_DEVPATH_SIZE];
+	int nIndex;
+};
+
+static pthread_rwlock_t s_lock = PTHREAD_RWLOCK_INITIALIZER;
+static bool s_bLoaded = false;
+
+// Interfaces, sorted by index
+static struct nlifentry* s_pEntries = NULL;
+static size_t s_nEntries = 0;
+static size_t s_nCapacity = 0;
+
+static struct nlifdevice s_devices[NL_IFCACHE_MAX_DEVICES];
+static size_t s_nDevices = 0;
+
+// Position of the index, or of where it would be inserted
+static size_t FindIndex(int nIndex)
+{
+	size_t lo = 0;
+	size_t hi = s_nEntries;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (s_pEntries[mid].nIndex < nIndex)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static bool HasIndex(int nIndex, size_t* pPos)
+{
+	size_t pos = FindIndex(nIndex);
+	if (pPos)
+		*pPos = pos;
+	return pos < s_nEntries && s_pEntries[pos].nIndex == nIndex;
+}
+
+static const struct nlifentry* FindName(const char* szName)
+{
+	for (size_t i = 0; i < s_nEntries; ++i)
+	{
+		if (strncmp(s_pEntries[i].szName, szName, NL_IFNAMSIZ) == 0)
+			return &s_pEntries[i];
+	}
+	return NULL;
+}
+
+static bool Reserve(size_t nCount)
+{
+	if (nCount <= s_nCapacity)
+		return true;
+
+	size_t nCapacity = s_nCapacity ? s_nCapacity * 2 : 16;
+	while (nCapacity < nCount)
+		nCapacity *= 2;
+
+	struct nlifentry* pEntries = realloc(s_pEntries, nCapacity * sizeof(struct nlifentry));
+	if (pEntries == NULL)
+		return false;
+
+	s_pEntries = pEntries;
+	s_nCapacity = nCapacity;
+	return true;
+}
+
+static void CopyName(char* pDst, const char* szSrc)
+{
+	strncpy(pDst, szSrc, NL_IFNAMSIZ - 1);
+	pDst[NL_IFNAMSIZ - 1] = 0;
+}
+
+static int CompareIndex(const void* a, const void* b)
+{
+	int x = ((const struct nlifentry*)a)->nIndex;
+	int y = ((const struct nlifentry*)b)->nIndex;
+	return (x > y) - (x < y);
+}
+
+// Forget the devices whose interface is gone.
+static void PruneDevices(void)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < s_nDevices; ++i)
+	{
+		if (HasIndex(s_devices[i].nIndex, NULL))
+			s_devices[n++] = s_devices[i];
+	}
+	s_nDevices = n;
+}
+
+void NlIfCacheLoad(const struct nlifentry* pEntries, size_t nCount)
+{
+	pthread_rwlock_wrlock(&s_lock);
+
+	if (Reserve(nCount))
+	{
+		memcpy(s_pEntries, pEntries, nCount * sizeof(struct nlifentry));
+		s_nEntries = nCount;
+		for (size_t i = 0; i < nCount; ++i)
+			s_pEntries[i].szName[NL_IFNAMSIZ - 1] = 0;
+		qsort(s_pEntries, s_nEntries, sizeof(struct nlifentry), CompareIndex);
+		PruneDevices();
+		s_bLoaded = true;
+	}
+	else
+	{
+		// Without memory for the interfaces, ask the system.
+		s_nEntries = 0;
+		s_nDevices = 0;
+		s_bLoaded = false;
+	}
+
+	pthread_rwlock_unlock(&s_lock);
+}
+
+void NlIfCacheSet(int nIndex, const char* szName)
+{
+	if (szName == NULL)
+		return;
+
+	pthread_rwlock_wrlock(&s_lock);
+
+	size_t pos;
+	if (!s_bLoaded)
+	{
+		// Nothing to keep up to date
+	}
+	else if (HasIndex(nIndex, &pos))
+	{
+		CopyName(s_pEntries[pos].szName, szName);
+	}
+	else if (Reserve(s_nEntries + 1))
+	{
+		memmove(&s_pEntries[pos + 1], &s_pEntries[pos], (s_nEntries - pos) * sizeof(struct nlifentry));
+		s_pEntries[pos].nIndex = nIndex;
+		CopyName(s_pEntries[pos].szName, szName);
+		++s_nEntries;
+	}
+	else
+	{
+		s_nEntries = 0;
+		s_nDevices = 0;
+		s_bLoaded = false;
+	}
+
+	pthread_rwlock_unlock(&s_lock);
+}
+
+void NlIfCacheRemove(int nIndex)
+{
+	pthread_rwlock_wrlock(&s_lock);
+
+	size_t pos;
+	if (s_bLoaded && HasIndex(nIndex, &pos))
+	{
+		memmove(&s_pEntries[pos], &s_pEntries[pos + 1], (s_nEntries - pos - 1) * sizeof(struct nlifentry));
+		--s_nEntries;
+		PruneDevices();
+	}
+
+	pthread_rwlock_unlock(&s_lock);
+}
+
+void NlIfCacheClear(void)
+{
+	pthread_rwlock_wrlock(&s_lock);
+	s_nEntries = 0;
+	s_nDevices = 0;
+	s_bLoaded = false;
+	pthread_rwlock_unlock(&s_lock);
+}
+
+bool NlIfCacheLoaded(void)
+{
+	pthread_rwlock_rdlock(&s_lock);
+	bool bLoaded = s_bLoaded;
+	pthread_rwlock_unlock(&s_lock);
+	return bLoaded;
+}
+
+unsigned int NlIfNameToIndex(const char* szName)
+{
+	if (szName == NULL)
+		return 0;
+
+	pthread_rwlock_rdlock(&s_lock);
+	const struct nlifentry* pEntry = s_bLoaded ? FindName(szName) : NULL;
+	int nIndex = pEntry ? pEntry->nIndex : 0;
+	pthread_rwlock_unlock(&s_lock);
+
+	if (nIndex > 0)
+		return (unsigned int)nIndex;
+
+	return if_nametoindex(szName);
+}
+
+char* NlIfIndexToName(unsigned int nIndex, char* pName)
+{
+	pthread_rwlock_rdlock(&s_lock);
+	size_t pos;
+	bool bFound = s_bLoaded && HasIndex((int)nIndex, &pos);
+	if (bFound)
+		memcpy(pName, s_pEntries[pos].szName, NL_IFNAMSIZ);
+	pthread_rwlock_unlock(&s_lock);
+
+	if (bFound)
+		return pName;
+
+	return if_indextoname(nIndex, pName);
+}
+
+// Whether the interface is of the kind a device of this kind has
+static bool IsDeviceInterface(const char* szName, bool bPCIe)
+{
+	if (bPCIe)
+		return strncmp(szName, "mhi_netdev", 10) == 0;
+
+	return strncmp(szName, "wwan", 4) == 0 ||
+		strncmp(szName, "wwp", 3) == 0 ||
+		strncmp(szName, "wws", 3) == 0;
+}
+
+// Look the interface up in the system, as there is no cache.
+static bool SystemDeviceToName(bool bPCIe, char* pIfName, size_t size)
+{
+	struct ifaddrs* ifaddr = NULL;
+	if (getifaddrs(&ifaddr) == -1)
+		return false;
+
+	struct ifaddrs* ifa = ifaddr;
+	while (ifa != NULL && !IsDeviceInterface(ifa->ifa_name, bPCIe))
+		ifa = ifa->ifa_next;
+
+	if (ifa != NULL && strlen(ifa->ifa_name) < size)
+		strcpy(pIfName, ifa->ifa_name);
+
+	freeifaddrs(ifaddr);
+
+	return strlen(pIfName) > 0;
+}
+
+bool NlIfDeviceToName(const char* pDevPath, char* pIfName, size_t size)
+{
+	if (pDevPath == NULL || size == 0)
+		return false;
+
+	bool bPCIe = strncmp(pDevPath, "/dev/mhi_", 9) == 0;
+
+	memset(pIfName, 0, size);
+
+	pthread_rwlock_wrlock(&s_lock);
+	if (!s_bLoaded)
+	{
+		pthread_rwlock_unlock(&s_lock);
+		return SystemDeviceToName(bPCIe, pIfName, size);
+	}
+
+	const struct nlifentry* pEntry = NULL;
+	for (size_t i = 0; i < s_nDevices && pEntry == NULL; ++i)
+	{
+		size_t pos;
+		if (strncmp(s_devices[i].szPath, pDevPath, NL_IFCACHE_DEVPATH_SIZE) == 0 &&
+			HasIndex(s_devices[i].nIndex, &pos))
+			pEntry = &s_pEntries[pos];
+	}
+
+	if (pEntry == NULL)
+	{
+		for (size_t i = 0; i < s_nEntries && pEntry == NULL; ++i)
+		{
+			if (IsDeviceInterface(s_pEntries[i].szName, bPCIe))
+				pEntry = &s_pEntries[i];
+		}
+
+		// Remember the interface, if the path fits.
+		if (pEntry != NULL && s_nDevices < NL_IFCACHE_MAX_DEVICES &&
+			strlen(pDevPath) < NL_IFCACHE_DEVPATH_SIZE)
+		{
+			strcpy(s_devices[s_nDevices].szPath, pDevPath);
+			s_devices[s_nDevices].nIndex = pEntry->nIndex;
+			++s_nDevices;
+		}
+	}
+
+	if (pEntry != NULL && strlen(pEntry->szName) < size)
+		strcpy(pIfName, pEntry->szName);
+
+	pthread_rwlock_unlock(&s_lock);
+
+	return strlen(pIfName) > 0;
+}
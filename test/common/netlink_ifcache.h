@@ -0,0 +1,63 @@
+#ifndef __NETLINK_IFCACHE_H__
+#define __NETLINK_IFCACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// As IFNAMSIZ; net/if.h and linux/if.h do not mix on all toolchains.
+#define NL_IFNAMSIZ	16
+
+// Interface name and index cache.
+//
+// Until the cache is loaded, lookups ask the system, with if_nametoindex(),
+// if_indextoname() and getifaddrs(). Once loaded, lookups are answered from
+// memory, and whoever loaded the cache must keep it up to date from
+// RTM_NEWLINK and RTM_DELLINK notifications. A name that is not cached is
+// still looked up in the system, so that interfaces created a moment ago
+// resolve before their notification is processed.
+//
+// All functions are thread-safe.
+
+struct nlifentry
+{
+	int nIndex;
+	char szName[NL_IFNAMSIZ];
+};
+
+// Replace the cache contents with the given interfaces, and answer lookups
+// from it from now on.
+void NlIfCacheLoad(const struct nlifentry* pEntries, size_t nCount);
+
+// Add or rename an interface, or remove it. These do nothing unless the
+// cache is loaded.
+void NlIfCacheSet(int nIndex, const char* szName);
+void NlIfCacheRemove(int nIndex);
+
+// Empty the cache, and ask the system again.
+void NlIfCacheClear(void);
+
+// Whether lookups are answered from the cache.
+bool NlIfCacheLoaded(void);
+
+// Index of the named interface, or 0; szName may be NULL.
+unsigned int NlIfNameToIndex(const char* szName);
+
+// Name of the interface, or NULL if there is no such interface. pName must
+// hold NL_IFNAMSIZ characters.
+char* NlIfIndexToName(unsigned int nIndex, char* pName);
+
+// Name of the network interface of a modem's control device, e.g. wwan0 for
+// /dev/cdc-wdm0, or mhi_netdev0 for /dev/mhi_MBIM. The first interface of
+// the matching kind is taken; once found for a device, the interface is kept
+// for it, across renames, until it is removed.
+bool NlIfDeviceToName(const char* pDevPath, char* pIfName, size_t size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif // __NETLINK_IFCACHE_H__
@@ -0,0 +1,81 @@
+#ifndef __NETLINK_SESSION_H__
+#define __NETLINK_SESSION_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/netlink.h>
+
+// Timeout for synchronous requests, in milliseconds
+#define NL_SESSION_TIMEOUT_MS	5000
+
+// Completion for an asynchronous request. nError is 0 on success, or a
+// negative errno value as reported by the kernel (-ECANCELED when the
+// session is destroyed, -ETIMEDOUT for synchronous requests that time out,
+// -EMSGSIZE when the reply did not fit in the receive buffer).
+// pData holds the concatenated reply messages, if any, excluding the final
+// ACK or NLMSG_DONE; it is only valid for the duration of the call.
+//
+// Completions run on the session's receive thread; they must not block, and
+// must not call NlSessionTransact() on the same session.
+typedef void (*FNNLCOMPLETION)(int nError, const char* pData, size_t nLen, void* pContext);
+
+struct nlsession;
+
+// Create a session: one NETLINK_ROUTE socket, with a port ID assigned by the
+// kernel so that several sessions (or processes) never collide, and a thread
+// receiving replies. nGroups may subscribe to multicast groups; notifications
+// are passed to pfnNotify, if given.
+struct nlsession* NlSessionCreate(uint32_t nGroups, FNNLCOMPLETION pfnNotify, void* pNotifyContext);
+
+// Destroy a session. Pending requests complete with -ECANCELED.
+void NlSessionDestroy(struct nlsession* pSession);
+
+// The process-wide default session, created on first use. Returns NULL if
+// the socket could not be created.
+struct nlsession* NlDefaultSession(void);
+
+// Port ID of the session's socket.
+uint32_t NlSessionPortId(const struct nlsession* pSession);
+
+// Send requests to the given port instead of the kernel (port 0); for tests,
+// which answer them from a socket of their own.
+void NlSessionSetPeer(struct nlsession* pSession, uint32_t nPortId);
+
+// Send a request without waiting for the reply. The sequence number and port
+// ID are filled in, and NLM_F_REQUEST | NLM_F_ACK are set. The request is
+// copied; it need not outlive the call.
+//
+// Returns the sequence number on success, 0 on failure, in which case the
+// completion is not invoked.
+uint32_t NlSessionSubmit(struct nlsession* pSession, struct nlmsghdr* pReq,
+	FNNLCOMPLETION pfnComplete, void* pContext);
+
+// Send several requests, concatenated in pBuf, with a single sendmsg(). Each
+// request gets its own sequence number and completion, with the context at
+// the same position in ppContexts. The kernel processes and acknowledges the
+// requests in order, and does not stop at the first failure.
+//
+// Returns the number of requests submitted; on failure, -1 is returned and no
+// completion is invoked.
+int NlSessionSubmitBatch(struct nlsession* pSession, char* pBuf, size_t nLen,
+	FNNLCOMPLETION pfnComplete, void* const* ppContexts, size_t nContexts);
+
+// Forget about a pending request; its completion will not be invoked, even
+// if the reply arrives later. Returns true if the request was still pending.
+bool NlSessionCancel(struct nlsession* pSession, uint32_t nSeq);
+
+// Send a request and wait for its completion. Reply data, if any, is copied
+// to pBuf, if given. Returns the number of reply bytes received (0 if pBuf is
+// NULL), or -1 on failure with errno set.
+int NlSessionTransact(struct nlsession* pSession, struct nlmsghdr* pReq, char* pBuf, size_t sizeBuf);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif // __NETLINK_SESSION_H__
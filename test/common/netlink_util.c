@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -9,10 +10,14 @@
 #include <sys/socket.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#include <linux/nexthop.h>
 #include <linux/if_arp.h>
-#include <ifaddrs.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "netlink_util.h"
+#include "netlink_session.h"
+#include "netlink_ifcache.h"
 #include "proc_util.h"
 #include "str_util.h"
 
@@ -31,23 +36,16 @@
 #endif
 // End of CPU=arm
 
-// Normally we would also include net/if.h for the following declaration.
-// However, for some compilers (arm64, rpi) there's a bug which causes iff_ constants
-// to be declared twice, if net/if.h is included before linux/if.h.
-// This workaround avoids this build issue.
-extern unsigned int if_nametoindex (const char *__ifname) __THROW;
+// Interfaces are resolved through the interface cache (netlink_ifcache.h),
+// rather than with if_nametoindex(); net/if.h is not included, as for some
+// compilers (arm64, rpi) it declares the iff_ constants a second time if
+// included before linux/if.h.
 
 #define NL_SEND_BUF_SIZE	1024
 #define NL_RECV_BUF_SIZE	4096
 
 const char szNull[] = "null";
 
-struct nlsock
-{
-	int fd;
-	struct sockaddr_nl addr;
-};
-
 #ifdef DEBUG
 // Output binary data for debugging purpose
 void PrintNlmsgHdr(const char* szDesc, const struct nlmsghdr* pnh, bool bSend)
@@ -109,139 +107,134 @@ void DumpDataExt(const char* szDesc, const char* pData, size_t nLen, bool bSend)
 
 bool GetNetInterfaceName(const char* pDevPath, char* pIfName, size_t size)
 {
-	if (pDevPath == 0)
-		return false;
-
-	bool bPCIe = strncmp(pDevPath, "/dev/mhi_", 9) == 0;
-
-	memset(pIfName, 0, size);
+	return NlIfDeviceToName(pDevPath, pIfName, size);
+}
 
-	struct ifaddrs* ifaddr = NULL;
-	if (getifaddrs(&ifaddr) == -1)
-		return false;
+// All requests go through the process-wide netlink session, which matches
+// replies by sequence number; concurrent callers do not interfere.
+int SendToSocket(const char* szFunc, const char* szInterface, const char* szDesc,
+	const void* pHeader, char* pBuf, ssize_t sizeBuf)
+{
+	struct nlmsghdr* nh = (struct nlmsghdr*)pHeader;
 
-	struct ifaddrs* ifa = ifaddr;
-	while (ifa != NULL && 
-		(strncmp(ifa->ifa_name, "mhi_netdev", 10) != 0 || !bPCIe) &&
-		((strncmp(ifa->ifa_name, "wwan", 4) != 0 &&
-		  strncmp(ifa->ifa_name, "wwp", 3) != 0 &&
-		  strncmp(ifa->ifa_name, "wws", 3) != 0) || bPCIe))
+	struct nlsession* pSession = NlDefaultSession();
+	if (pSession == NULL)
 	{
-		ifa = ifa->ifa_next;
+		dlog(eLOG_ERROR, "%s(%s) %s failed: no netlink session\n", szFunc, szInterface ? szInterface : szNull, szDesc);
+		return -1;
 	}
 
-	if (ifa != NULL && strlen(ifa->ifa_name) < size)
-		strcpy(pIfName, ifa->ifa_name);
-
-	freeifaddrs(ifaddr);
-	
-	return strlen(pIfName) > 0;
-}
+	bool bUseIntBuf = pBuf == 0 || sizeBuf == 0;
+	if (!bUseIntBuf)
+		memset(pBuf, 0, sizeBuf);
 
-bool CreateSocket(const char* szFunc, struct nlsock* s)
-{
-	s->fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE);
-	if (s->fd < 0)
-		dlog(eLOG_ERROR, "%s - Create socket error %d: %s\n", szFunc, errno, strerror(errno));
-	else
-	{
-		memset(&s->addr, 0, sizeof(s->addr));
-		s->addr.nl_family = AF_NETLINK;
-		s->addr.nl_pid = getpid();
+	int nRecv = NlSessionTransact(pSession, nh, bUseIntBuf ? NULL : pBuf, bUseIntBuf ? 0 : (size_t)sizeBuf);
 
 #ifdef DEBUG
-		//DumpData(__FUNCTION__, (const char*)&s->addr, sizeof(s->addr), true);
+	DumpDataExt(szDesc, (const char*)nh, nh->nlmsg_len, true);
+	if (nRecv > 0)
+		DumpDataExt(szDesc, pBuf, nRecv, false);
 #endif
 
-		if (bind(s->fd, (struct sockaddr *)&s->addr, sizeof(s->addr)) < 0)
-		{
-			close(s->fd);
-			dlog(eLOG_ERROR, "%s - Bind socket error %d: %s\n", szFunc, errno, strerror(errno));
-			s->fd = -1;
-		}
-
+	if (nRecv < 0)
+	{
 #ifdef DEBUG
-		//DumpData(__FUNCTION__, (const char*)&s->addr, sizeof(s->addr), false);
+		dlog(eLOG_DEBUG, "%s(%s) %s returns error %d, type %d\n", szFunc, szInterface ? szInterface : szNull, szDesc, -errno, nh->nlmsg_type);
 #endif
+		return -1;
 	}
 
-	return s->fd != -1;
+	return bUseIntBuf ? 0 : nRecv;
 }
 
-int SendToSocket(const char* szFunc, const char* szInterface, const char* szDesc,
-	const struct nlsock* s, const void* pHeader, char* pBuf, ssize_t sizeBuf)
+// Asynchronous variant of the above; the completion runs on the session's
+// receive thread. Returns 0 if the request was submitted, -1 otherwise.
+int SubmitToSocket(const char* szFunc, const char* szInterface, const char* szDesc,
+	const void* pHeader, FNNLCOMPLETION pfnComplete, void* pContext)
 {
 	struct nlmsghdr* nh = (struct nlmsghdr*)pHeader;
-	nh->nlmsg_flags |= (NLM_F_REQUEST | NLM_F_ACK);
-	if (nh->nlmsg_pid == 0)
-		nh->nlmsg_pid = getpid();
-
-#ifdef DEBUG
-	DumpDataExt(szDesc, (const char*)nh, nh->nlmsg_len, true);
-#endif
 
-	if (send(s->fd, (const char*)pHeader, nh->nlmsg_len, 0) == -1)
+	struct nlsession* pSession = NlDefaultSession();
+	if (pSession == NULL || NlSessionSubmit(pSession, nh, pfnComplete, pContext) == 0)
 	{
 		dlog(eLOG_ERROR, "%s(%s) %s failed.  Error %d: %s\n", szFunc, szInterface ? szInterface : szNull, szDesc, errno, strerror(errno));
 		return -1;
 	}
 
-	char intBuf[NL_RECV_BUF_SIZE];
-	bool bUseIntBuf = pBuf == 0 || sizeBuf == 0;
-	if (bUseIntBuf)
-	{
-		pBuf = intBuf;
-		sizeBuf = NL_RECV_BUF_SIZE;
-	}
+#ifdef DEBUG
+	DumpDataExt(szDesc, (const char*)nh, nh->nlmsg_len, true);
+#endif
 
-	memset(pBuf, 0, sizeBuf);
+	return 0;
+}
 
-	int nRecv = 0;
+// Completion for requests nobody waits for; logs the failure as
+// SendToSocket() would have. The context is the heap allocated description.
+static void LogCompletion(int nError, const char* pData, size_t nLen, void* pContext)
+{
+	(void)pData;
+	(void)nLen;
 
-	do
-	{
-		int n = recv(s->fd, pBuf, sizeBuf, 0);
-#ifdef DEBUG
-		DumpDataExt(szDesc, pBuf, n, false);
-#endif
+	char* szDesc = (char*)pContext;
+	if (nError != 0)
+		dlog(eLOG_ERROR, "%s failed.  Error %d: %s\n", szDesc, -nError, strerror(-nError));
 
-		struct nlmsghdr* pnh = (struct nlmsghdr*)pBuf;
-		if (pnh->nlmsg_type == NLMSG_DONE)
-			break;
+	free(szDesc);
+}
 
-		if (pnh->nlmsg_type == NLMSG_ERROR)
-		{
-			struct nlmsgerr* pErr = (struct nlmsgerr*) NLMSG_DATA(pnh);
-			if (pErr->error != 0)
-			{
-#ifdef DEBUG
-				dlog(eLOG_DEBUG, "%s(%s) %s returns error %d, type %d\n", szFunc, szInterface ? szInterface : szNull, szDesc, pErr->error, pErr->msg.nlmsg_type);
-#endif
-				nRecv = -1;
-			}
+// Submit a request without waiting for it, logging the error reply if any.
+static int SubmitLogged(const char* szFunc, const char* szInterface, const char* szDesc, const void* pHeader)
+{
+	if (szInterface == NULL)
+		szInterface = szNull;
 
-			break;
-		}
+	size_t nSize = strlen(szFunc) + strlen(szInterface) + strlen(szDesc) + 4;
+	char* szContext = malloc(nSize);
+	if (szContext != NULL)
+		snprintf(szContext, nSize, "%s(%s) %s", szFunc, szInterface, szDesc);
 
-		// Prepare buffer for next message
-		nRecv += n;
-		pBuf += n;
-		sizeBuf -= n;
-	} while (sizeBuf > 0 &&
-		(s->addr.nl_groups & (RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE)) == 0);	// Logic from Mike's code.  Not sure what this is about
+	if (SubmitToSocket(szFunc, szInterface, szDesc, pHeader, szContext != NULL ? LogCompletion : NULL, szContext) == -1)
+	{
+		free(szContext);
+		return -1;
+	}
 
-	return bUseIntBuf ? 0 : nRecv;
+	return 0;
+}
+
+// Request buffer large enough for any of the messages below
+struct nlreq
+{
+	struct nlmsghdr nh;
+	union
+	{
+		struct ifinfomsg ifi;
+		struct ifaddrmsg ifa;
+		struct rtmsg     rm;
+		struct nhmsg     nhm;
+	};
+	char buf[NL_SEND_BUF_SIZE];
+};
+
+static FNADAPTORSTATE s_pfnAdaptorState = NULL;
+
+void NlSetAdaptorStateProvider(FNADAPTORSTATE pfnProvider)
+{
+	__atomic_store_n(&s_pfnAdaptorState, pfnProvider, __ATOMIC_RELEASE);
 }
 
 // Return IFF_UP | IFF_RUNNING if adapter is up, 0 is not, -1 is the device doesn't exist
 int IsAdaptorUp(const char *szInterface)
 {
+	FNADAPTORSTATE pfnProvider = __atomic_load_n(&s_pfnAdaptorState, __ATOMIC_ACQUIRE);
+	if (pfnProvider != NULL)
+		return pfnProvider(szInterface);
+
 #ifdef DEBUG
-	dlog(eLOG_DEBUG, "%s: is adapter %s(%d) up?\n", __FUNCTION__, szInterface ? szInterface : szNull, szInterface ? if_nametoindex(szInterface) : 0);
+	dlog(eLOG_DEBUG, "%s: is adapter %s(%d) up?\n", __FUNCTION__, szInterface ? szInterface : szNull, NlIfNameToIndex(szInterface));
 #endif
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
+	if (NlDefaultSession() == NULL)
 		return -1;
 
 	struct
@@ -256,16 +249,13 @@ int IsAdaptorUp(const char *szInterface)
 	req.nh.nlmsg_type = RTM_GETLINK;
 
 	req.ifi.ifi_family = AF_UNSPEC;
-	req.ifi.ifi_index = if_nametoindex(szInterface);
+	req.ifi.ifi_index = NlIfNameToIndex(szInterface);
 
 	char buf[NL_RECV_BUF_SIZE];
 
-	int nRecv = SendToSocket(__FUNCTION__, szInterface, "RTM_GETLINK", &s, (void*)&req, buf, sizeof(buf));
+	int nRecv = SendToSocket(__FUNCTION__, szInterface, "RTM_GETLINK", (void*)&req, buf, sizeof(buf));
 	if (nRecv == -1)
-	{
-		close(s.fd);
 		return 0;
-	}
 
 	int nFlags = -1;
 	struct nlmsghdr *pnh = (struct nlmsghdr *)buf;
@@ -283,36 +273,39 @@ int IsAdaptorUp(const char *szInterface)
 		pnh = NLMSG_NEXT(pnh, nRecv);
 	}
 
-	close(s.fd);
-
 	return nFlags;
 }
 
-void UpDownAdaptor(const struct nlsock* s, bool bUp, const char *szInterface)
+static void BuildUpDownAdaptor(struct nlreq* req, bool bUp, const char *szInterface)
 {
-	dlog(eLOG_INFO, "%s adaptor %s(%d)\n", bUp ? "Up" : "Down", szInterface ? szInterface : szNull, szInterface ? if_nametoindex(szInterface) : 0);
+	dlog(eLOG_INFO, "%s adaptor %s(%d)\n", bUp ? "Up" : "Down", szInterface ? szInterface : szNull, NlIfNameToIndex(szInterface));
 
-	struct
-	{
-		struct nlmsghdr  nh;
-		struct ifinfomsg ifi;
-	} req;
+	memset(req, 0, sizeof(*req));
 
-	memset(&req, 0, sizeof(req));
+	req->nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifinfomsg)));
+	req->nh.nlmsg_type = RTM_SETLINK;
 
-	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifinfomsg)));
-	req.nh.nlmsg_type = RTM_SETLINK;
-
-	req.ifi.ifi_family = AF_UNSPEC;
-	req.ifi.ifi_index = if_nametoindex(szInterface);
-	req.ifi.ifi_flags = bUp ? (IFF_UP | IFF_RUNNING) : 0;
-	req.ifi.ifi_change = IFF_UP | IFF_RUNNING;
+	req->ifi.ifi_family = AF_UNSPEC;
+	req->ifi.ifi_index = NlIfNameToIndex(szInterface);
+	req->ifi.ifi_flags = bUp ? (IFF_UP | IFF_RUNNING) : 0;
+	req->ifi.ifi_change = IFF_UP | IFF_RUNNING;
+}
 
-	SendToSocket(__FUNCTION__, szInterface, "Set IFF", s, (void*)&req, 0, 0);
+void UpDownAdaptor(bool bUp, const char *szInterface)
+{
+	struct nlreq req;
+	BuildUpDownAdaptor(&req, bUp, szInterface);
+	SendToSocket(__FUNCTION__, szInterface, "Set IFF", (void*)&req, 0, 0);
 }
 
-const char* UpAdaptorAddresses(const struct nlsock* s, const char* szInterface)
+// Bring up the adaptor and, for alias names of the form parent:child, its
+// parent. Requests are only submitted; the session preserves their order, so
+// callers need not wait before configuring the adaptor. Returns the name of
+// the adaptor to configure.
+const char* UpAdaptorAddresses(const char* szInterface)
 {
+	struct nlreq req;
+
 	char *parentAdaptorName = strstr(szInterface, ":");
 	if (parentAdaptorName != NULL)
 	{
@@ -321,53 +314,54 @@ const char* UpAdaptorAddresses(const struct nlsock* s, const char* szInterface)
 	
 		szInterface = parentAdaptorName + 1;
 
-		UpDownAdaptor(s, true, sztempEthName);
+		BuildUpDownAdaptor(&req, true, sztempEthName);
+		SubmitLogged(__FUNCTION__, sztempEthName, "Set IFF", (void*)&req);
 	}
 
-	UpDownAdaptor(s, true, szInterface);
+	BuildUpDownAdaptor(&req, true, szInterface);
+	SubmitLogged(__FUNCTION__, szInterface, "Set IFF", (void*)&req);
 
 	return szInterface;
 }
 
-void UpDownAdaptorInterface(bool bUp, const char *szInterface)
+void UpAdaptorInterface(const char *szInterface)
 {
-	struct nlsock s;
-	if (CreateSocket(__FUNCTION__, &s))
-	{
-		UpDownAdaptor(&s, bUp, szInterface);
-		close(s.fd);
-	}
+	UpDownAdaptor(true, szInterface);
 }
 
-void UpAdaptorInterface(const char *szInterface)
+void DownAdaptorInterface(const char *szInterface)
 {
-	UpDownAdaptorInterface(true, szInterface);
+	UpDownAdaptor(false, szInterface);
 }
 
-void DownAdaptorInterface(const char *szInterface)
+int UpDownAdaptorInterfaceAsync(bool bUp, const char *szInterface, FNNLCOMPLETION pfnComplete, void* pContext)
 {
-	UpDownAdaptorInterface(false, szInterface);
+	struct nlreq req;
+	BuildUpDownAdaptor(&req, bUp, szInterface);
+	return SubmitToSocket(__FUNCTION__, szInterface, "Set IFF", (void*)&req, pfnComplete, pContext);
 }
 
 void DownAdaptorInterfaces(const char *szInterface, int nType)
 {
-	struct nlsock s;
-	if (CreateSocket(__FUNCTION__, &s))
+	// The secondary interfaces need not be down before the primary one, so
+	// only wait for the last request.
+	struct nlreq req;
+	if (nType == 1)
 	{
-		if (nType == 1)
-		{
-			UpDownAdaptor(&s, false, VLAN_0_NAME);
-			UpDownAdaptor(&s, false, VLAN_1_NAME);
-		}
-		else if (nType == 2)
-		{
-			UpDownAdaptor(&s, false, QMIMUX_0_NAME);
-			UpDownAdaptor(&s, false, QMIMUX_1_NAME);
-		}
-
-		UpDownAdaptor(&s, false, szInterface);
-		close(s.fd);
+		BuildUpDownAdaptor(&req, false, VLAN_0_NAME);
+		SubmitLogged(__FUNCTION__, VLAN_0_NAME, "Set IFF", (void*)&req);
+		BuildUpDownAdaptor(&req, false, VLAN_1_NAME);
+		SubmitLogged(__FUNCTION__, VLAN_1_NAME, "Set IFF", (void*)&req);
 	}
+	else if (nType == 2)
+	{
+		BuildUpDownAdaptor(&req, false, QMIMUX_0_NAME);
+		SubmitLogged(__FUNCTION__, QMIMUX_0_NAME, "Set IFF", (void*)&req);
+		BuildUpDownAdaptor(&req, false, QMIMUX_1_NAME);
+		SubmitLogged(__FUNCTION__, QMIMUX_1_NAME, "Set IFF", (void*)&req);
+	}
+
+	UpDownAdaptor(false, szInterface);
 }
 
 // Add data to rtattr
@@ -404,155 +398,151 @@ int rtattr_addaddr(struct nlmsghdr *nh, int maxlen, int type, const char* addr,
 	return inet_pton(domain, addr, buf) != 0 && rtattr_add(nh, maxlen, type, buf, domain == AF_INET6 ? 16 : 4);
 }
 
-void SetRoute(int domain, const char *szInterface, bool bAdd, const char* dst, int dstprefixlen, const char* gw)
+static void BuildRoute(const char* szFunc, struct nlreq* req, int domain, const char *szInterface, bool bAdd, const char* dst, int dstprefixlen, const char* gw)
 {
-	if (dstprefixlen == 0)
+	// Without a destination, this is the default route.
+	if (dstprefixlen == 0 && dst)
 		dstprefixlen = domain == AF_INET6 ? 128 : 32;
 
 	const char* szDef = "default";
-	dlog(eLOG_INFO, "%s(family %d): route %s %s:%d dev %s(%d) gw %s\n", __FUNCTION__, domain,
+	dlog(eLOG_INFO, "%s(family %d): route %s %s:%d dev %s(%d) gw %s\n", szFunc, domain,
 		bAdd ? "add" : "del",
 		dst ? dst : szDef,
 		dstprefixlen,
 		szInterface ? szInterface : szDef,
-		szInterface ? if_nametoindex(szInterface) : 0,
+		NlIfNameToIndex(szInterface),
 		gw ? gw : szDef);
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
-		return;
-
-	struct
-	{
-		struct nlmsghdr nh;
-		struct rtmsg rm;
-		char buf[NL_SEND_BUF_SIZE];
-	} req;
-
-	memset(&req, 0, sizeof(req));
+	memset(req, 0, sizeof(*req));
 
 	// Initialize request structure
-	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct rtmsg)));
-	req.nh.nlmsg_flags = bAdd ? NLM_F_CREATE : 0;
-	req.nh.nlmsg_type = bAdd ? RTM_NEWROUTE : RTM_DELROUTE;
+	req->nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct rtmsg)));
+	req->nh.nlmsg_flags = bAdd ? NLM_F_CREATE : 0;
+	req->nh.nlmsg_type = bAdd ? RTM_NEWROUTE : RTM_DELROUTE;
 
-	req.rm.rtm_family = domain;
-	req.rm.rtm_dst_len = dstprefixlen;
-	req.rm.rtm_table = RT_TABLE_MAIN;
-	req.rm.rtm_protocol = RTPROT_STATIC;
-	req.rm.rtm_scope = RT_SCOPE_UNIVERSE;
-	req.rm.rtm_type = RTN_UNICAST;
+	req->rm.rtm_family = domain;
+	req->rm.rtm_dst_len = dstprefixlen;
+	req->rm.rtm_table = RT_TABLE_MAIN;
+	req->rm.rtm_protocol = RTPROT_STATIC;
+	req->rm.rtm_scope = RT_SCOPE_UNIVERSE;
+	req->rm.rtm_type = RTN_UNICAST;
 
-	rtattr_addaddr(&req.nh, sizeof(req), RTA_DST, dst, domain);	// Set destination network
-	rtattr_addaddr(&req.nh, sizeof(req), RTA_GATEWAY, gw, domain); // Set gateway
+	rtattr_addaddr(&req->nh, sizeof(*req), RTA_DST, dst, domain);	// Set destination network
+	rtattr_addaddr(&req->nh, sizeof(*req), RTA_GATEWAY, gw, domain); // Set gateway
 
 	if (szInterface)
 	{
 		// Set interface
-		int idx = if_nametoindex(szInterface);
-		rtattr_add(&req.nh, sizeof(req), RTA_OIF, &idx, sizeof(int));
+		int idx = NlIfNameToIndex(szInterface);
+		rtattr_add(&req->nh, sizeof(*req), RTA_OIF, &idx, sizeof(int));
 	}
+}
+
+void SetRoute(int domain, const char *szInterface, bool bAdd, const char* dst, int dstprefixlen, const char* gw)
+{
+	struct nlreq req;
+	BuildRoute(__FUNCTION__, &req, domain, szInterface, bAdd, dst, dstprefixlen, gw);
 
 	// Send message to the netlink
-	SendToSocket(__FUNCTION__, szInterface, "Set Route", &s, (void*)&req, 0, 0);
+	SendToSocket(__FUNCTION__, szInterface, "Set Route", (void*)&req, 0, 0);
+}
 
-	close(s.fd);
+int SetRouteAsync(int domain, const char *szInterface, bool bAdd, const char* dst, int dstprefixlen, const char* gw,
+	FNNLCOMPLETION pfnComplete, void* pContext)
+{
+	struct nlreq req;
+	BuildRoute(__FUNCTION__, &req, domain, szInterface, bAdd, dst, dstprefixlen, gw);
+	return SubmitToSocket(__FUNCTION__, szInterface, "Set Route", (void*)&req, pfnComplete, pContext);
 }
 
-void SetAdaptorAddress(int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen)
+static void BuildAdaptorAddress(const char* szFunc, struct nlreq* req, int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen)
 {
 	if (dstprefixlen == 0)
 		dstprefixlen = domain == AF_INET6 ? 128 : 32;
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
-		return;
-
-	if (bAdd)
-		szInterface = UpAdaptorAddresses(&s, szInterface);
-
-	dlog(eLOG_INFO, "%s(family %d): ip addr %s %s:%d dev %s(%d)\n", __FUNCTION__, domain, bAdd ? "add" : "del",
+	dlog(eLOG_INFO, "%s(family %d): ip addr %s %s:%d dev %s(%d)\n", szFunc, domain, bAdd ? "add" : "del",
 		szIPAddress, dstprefixlen,
-		szInterface ? szInterface : szNull, szInterface ? if_nametoindex(szInterface) : 0);
+		szInterface ? szInterface : szNull, NlIfNameToIndex(szInterface));
 
-	struct
-	{
-		struct nlmsghdr  nh;
-		struct ifaddrmsg ifa;
-		char             buf[NL_SEND_BUF_SIZE];
-	} req;
+	memset(req, 0, sizeof(*req));
 
-	memset(&req, 0, sizeof(req));
+	req->nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifaddrmsg)));
+	req->nh.nlmsg_type = bAdd ? RTM_NEWADDR : RTM_DELADDR;
+	req->nh.nlmsg_flags = bAdd ? (NLM_F_CREATE | NLM_F_REPLACE) : 0;
 
-	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifaddrmsg)));
-	req.nh.nlmsg_type = bAdd ? RTM_NEWADDR : RTM_DELADDR;
-	req.nh.nlmsg_flags = bAdd ? (NLM_F_CREATE | NLM_F_REPLACE) : 0;
+	req->ifa.ifa_family = domain;
+	req->ifa.ifa_prefixlen = dstprefixlen;
+	req->ifa.ifa_scope = RT_SCOPE_UNIVERSE;// 0;
+	req->ifa.ifa_index = NlIfNameToIndex(szInterface);
 
-	req.ifa.ifa_family = domain;
-	req.ifa.ifa_prefixlen = dstprefixlen;
-	req.ifa.ifa_scope = RT_SCOPE_UNIVERSE;// 0;
-	req.ifa.ifa_index = szInterface ? if_nametoindex(szInterface) : 0;
+	rtattr_addaddr(&req->nh, sizeof(*req), IFA_LOCAL, szIPAddress, domain);
+	rtattr_addaddr(&req->nh, sizeof(*req), IFA_ADDRESS, szIPAddress, domain);
+}
 
-	rtattr_addaddr(&req.nh, sizeof(req), IFA_LOCAL, szIPAddress, domain);
-	rtattr_addaddr(&req.nh, sizeof(req), IFA_ADDRESS, szIPAddress, domain);
+void SetAdaptorAddress(int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen)
+{
+	if (bAdd)
+		szInterface = UpAdaptorAddresses(szInterface);
 
-	// Send message to the netlink
-	SendToSocket(__FUNCTION__, szInterface, "Set Adaptor Address", &s, (void*)&req, 0, 0);
+	struct nlreq req;
+	BuildAdaptorAddress(__FUNCTION__, &req, domain, szInterface, bAdd, szIPAddress, dstprefixlen);
 
-	close(s.fd);
+	// Send message to the netlink
+	SendToSocket(__FUNCTION__, szInterface, "Set Adaptor Address", (void*)&req, 0, 0);
 }
 
-void SetAdaptorMtu(const char *szInterface, int mtu)
+int SetAdaptorAddressAsync(int domain, const char *szInterface, bool bAdd, const char *szIPAddress, int dstprefixlen,
+	FNNLCOMPLETION pfnComplete, void* pContext)
 {
-	dlog(eLOG_INFO, "%s(%s:%d) mtu %d\n", __FUNCTION__, szInterface ? szInterface : szNull, szInterface ? if_nametoindex(szInterface) : 0, mtu);
+	if (bAdd)
+		szInterface = UpAdaptorAddresses(szInterface);
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
-		return;
+	struct nlreq req;
+	BuildAdaptorAddress(__FUNCTION__, &req, domain, szInterface, bAdd, szIPAddress, dstprefixlen);
+	return SubmitToSocket(__FUNCTION__, szInterface, "Set Adaptor Address", (void*)&req, pfnComplete, pContext);
+}
 
-	struct
-	{
-		struct nlmsghdr  nh;
-		struct ifinfomsg ifi;
-		char             attrbuf[NL_SEND_BUF_SIZE];
-	} req;
+static void BuildAdaptorMtu(const char* szFunc, struct nlreq* req, const char *szInterface, int mtu)
+{
+	dlog(eLOG_INFO, "%s(%s:%d) mtu %d\n", szFunc, szInterface ? szInterface : szNull, NlIfNameToIndex(szInterface), mtu);
 
-	memset(&req, 0, sizeof(req));
+	memset(req, 0, sizeof(*req));
 
-	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifinfomsg)));
-	req.nh.nlmsg_type = RTM_NEWLINK;
+	req->nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifinfomsg)));
+	req->nh.nlmsg_type = RTM_NEWLINK;
 
-	req.ifi.ifi_family = AF_UNSPEC;
-	req.ifi.ifi_index = if_nametoindex(szInterface);
+	req->ifi.ifi_family = AF_UNSPEC;
+	req->ifi.ifi_index = NlIfNameToIndex(szInterface);
 
-	rtattr_add(&req.nh, sizeof(req), IFLA_MTU, &mtu, sizeof(mtu));
+	rtattr_add(&req->nh, sizeof(*req), IFLA_MTU, &mtu, sizeof(mtu));
+}
 
-	SendToSocket(__FUNCTION__, szInterface, "Set MTU", &s, (void*)&req, 0, 0);
+void SetAdaptorMtu(const char *szInterface, int mtu)
+{
+	struct nlreq req;
+	BuildAdaptorMtu(__FUNCTION__, &req, szInterface, mtu);
+	SendToSocket(__FUNCTION__, szInterface, "Set MTU", (void*)&req, 0, 0);
+}
 
-	close(s.fd);
+int SetAdaptorMtuAsync(const char *szInterface, int mtu, FNNLCOMPLETION pfnComplete, void* pContext)
+{
+	struct nlreq req;
+	BuildAdaptorMtu(__FUNCTION__, &req, szInterface, mtu);
+	return SubmitToSocket(__FUNCTION__, szInterface, "Set MTU", (void*)&req, pfnComplete, pContext);
 }
 
 int AddVlan(const char* szInterface, const char* szVlanInterface, int nVlandId)
 {
 	dlog(eLOG_INFO, "%s(%s:%d) add VLAN %s:%d\n", __FUNCTION__,
-		szInterface ? szInterface : szNull, szInterface ? if_nametoindex(szInterface) : 0, szVlanInterface, nVlandId);
+		szInterface ? szInterface : szNull, NlIfNameToIndex(szInterface), szVlanInterface, nVlandId);
 
-	if (if_nametoindex(szVlanInterface) != 0)
+	if (NlIfNameToIndex(szVlanInterface) != 0)
 	{
 		printf("%s VLAN %s already exist\n", __FUNCTION__, szVlanInterface);
 		return -1;
 	}
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
-		return -1;
-
-	struct
-	{
-		struct nlmsghdr  nh;
-		struct ifinfomsg ifi;
-		char             attrbuf[NL_SEND_BUF_SIZE];
-	} req;
+	struct nlreq req;
 
 	memset(&req, 0, sizeof(req));
 
@@ -563,7 +553,7 @@ int AddVlan(const char* szInterface, const char* szVlanInterface, int nVlandId)
 	req.ifi.ifi_family = AF_UNSPEC;
 	req.ifi.ifi_type = ARPHRD_NETROM;
 
-	int ifcn = if_nametoindex(szInterface);
+	int ifcn = NlIfNameToIndex(szInterface);
 	rtattr_add(&req.nh, sizeof(req), IFLA_LINK, &ifcn, sizeof(ifcn));
 	rtattr_add(&req.nh, sizeof(req), IFLA_IFNAME, szVlanInterface, strlen(szVlanInterface) + 1);
 
@@ -587,33 +577,20 @@ int AddVlan(const char* szInterface, const char* szVlanInterface, int nVlandId)
 	};
 	rtattr_add(&req.nh, sizeof(req), IFLA_LINKINFO, &vlanattr, sizeof(vlanattr));
 
-	int ret = SendToSocket(__FUNCTION__, szInterface, "Add VLAN", &s, (void*)&req, 0, 0);
-
-	close(s.fd);
-
-	return ret;
+	return SendToSocket(__FUNCTION__, szInterface, "Add VLAN", (void*)&req, 0, 0);
 }
 
 int DeleteVlan(const char* szVlanInterface)
 {
 	dlog(eLOG_INFO, "%s delete VLAN %s\n", __FUNCTION__, szVlanInterface);
 
-	if (if_nametoindex(szVlanInterface) == 0)
+	if (NlIfNameToIndex(szVlanInterface) == 0)
 	{
 		dlog(eLOG_WARN, "%s VLAN %s does not exist\n", __FUNCTION__, szVlanInterface);
 		return -1;
 	}
 
-	struct nlsock s;
-	if (!CreateSocket(__FUNCTION__, &s))
-		return -1;
-
-	struct
-	{
-		struct nlmsghdr  nh;
-		struct ifinfomsg ifi;
-		char             attrbuf[NL_SEND_BUF_SIZE];
-	} req;
+	struct nlreq req;
 
 	memset(&req, 0, sizeof(req));
 
@@ -622,15 +599,502 @@ int DeleteVlan(const char* szVlanInterface)
 
 	req.ifi.ifi_family = AF_UNSPEC;
 	req.ifi.ifi_type = ARPHRD_NETROM;
-	req.ifi.ifi_index = if_nametoindex(szVlanInterface);  // According to strace
+	req.ifi.ifi_index = NlIfNameToIndex(szVlanInterface);  // According to strace
+
+	int nRet = SendToSocket(__FUNCTION__, szVlanInterface, "Remove VLAN", (void*)&req, 0, 0);
+
+	// Forget the VLAN now, so that it can be added again before the
+	// notification of its removal is processed.
+	if (nRet != -1)
+		NlIfCacheRemove(req.ifi.ifi_index);
+
+	return nRet;
+}
+
+// Nexthops
+
+int NlSetNexthop(uint32_t nId, int domain, const char* szInterface, const char* gw)
+{
+	int idx = NlIfNameToIndex(szInterface);
+
+	dlog(eLOG_INFO, "%s(family %d): nexthop %u dev %s(%d) gw %s\n", __FUNCTION__, domain, nId,
+		szInterface ? szInterface : szNull, idx, gw ? gw : szNull);
+
+	if (idx == 0)
+		return -1;
 
-	int ret = SendToSocket(__FUNCTION__, szVlanInterface, "Remove VLAN", &s, (void*)&req, 0, 0);
+	struct nlreq req;
+	memset(&req, 0, sizeof(req));
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct nhmsg)));
+	req.nh.nlmsg_type = RTM_NEWNEXTHOP;
+	req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+
+	req.nhm.nh_family = domain;
+	req.nhm.nh_protocol = RTPROT_STATIC;
+
+	rtattr_add(&req.nh, sizeof(req), NHA_ID, &nId, sizeof(nId));
+	rtattr_add(&req.nh, sizeof(req), NHA_OIF, &idx, sizeof(idx));
+	if (gw)
+		rtattr_addaddr(&req.nh, sizeof(req), NHA_GATEWAY, gw, domain);
+
+	return SendToSocket(__FUNCTION__, szInterface, "Set Nexthop", (void*)&req, 0, 0) == -1 ? -1 : 0;
+}
+
+int NlSetNexthopGroup(uint32_t nId, const struct nlnhmember* pMembers, size_t nCount)
+{
+	dlog(eLOG_INFO, "%s: nexthop group %u with %zu members\n", __FUNCTION__, nId, nCount);
+
+	struct nexthop_grp grp[NL_SEND_BUF_SIZE / 2 / sizeof(struct nexthop_grp)];
+	if (nCount == 0 || nCount > sizeof(grp) / sizeof(grp[0]))
+		return -1;
+
+	memset(grp, 0, sizeof(grp));
+	for (size_t i = 0; i < nCount; ++i)
+	{
+		if (pMembers[i].nWeight < 1 || pMembers[i].nWeight > NL_NEXTHOP_MAX_WEIGHT)
+			return -1;
+
+		// The kernel stores the weight less one.
+		grp[i].id = pMembers[i].nId;
+		grp[i].weight = (uint8_t)(pMembers[i].nWeight - 1);
+	}
+
+	struct nlreq req;
+	memset(&req, 0, sizeof(req));
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct nhmsg)));
+	req.nh.nlmsg_type = RTM_NEWNEXTHOP;
+	req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+
+	req.nhm.nh_family = AF_UNSPEC;
+	req.nhm.nh_protocol = RTPROT_STATIC;
+
+	rtattr_add(&req.nh, sizeof(req), NHA_ID, &nId, sizeof(nId));
+	rtattr_add(&req.nh, sizeof(req), NHA_GROUP, grp, (int)(nCount * sizeof(struct nexthop_grp)));
+
+	return SendToSocket(__FUNCTION__, NULL, "Set Nexthop Group", (void*)&req, 0, 0) == -1 ? -1 : 0;
+}
+
+int NlDeleteNexthop(uint32_t nId)
+{
+	dlog(eLOG_INFO, "%s: nexthop %u\n", __FUNCTION__, nId);
+
+	struct nlreq req;
+	memset(&req, 0, sizeof(req));
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct nhmsg)));
+	req.nh.nlmsg_type = RTM_DELNEXTHOP;
+
+	req.nhm.nh_family = AF_UNSPEC;
+
+	rtattr_add(&req.nh, sizeof(req), NHA_ID, &nId, sizeof(nId));
+
+	return SendToSocket(__FUNCTION__, NULL, "Delete Nexthop", (void*)&req, 0, 0) == -1 ? -1 : 0;
+}
+
+int NlSetDefaultRouteNexthop(int domain, uint32_t nTable, uint32_t nMetric, uint32_t nNexthopId)
+{
+	dlog(eLOG_INFO, "%s(family %d): default route table %u metric %u nexthop %u\n", __FUNCTION__,
+		domain, nTable, nMetric, nNexthopId);
+
+	struct nlreq req;
+	memset(&req, 0, sizeof(req));
+
+	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct rtmsg)));
+	req.nh.nlmsg_type = RTM_NEWROUTE;
+	req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+
+	req.rm.rtm_family = domain;
+	req.rm.rtm_table = nTable < 256 ? nTable : RT_TABLE_UNSPEC;
+	req.rm.rtm_protocol = RTPROT_STATIC;
+	req.rm.rtm_scope = RT_SCOPE_UNIVERSE;
+	req.rm.rtm_type = RTN_UNICAST;
+
+	rtattr_add(&req.nh, sizeof(req), RTA_TABLE, &nTable, sizeof(nTable));
+	rtattr_add(&req.nh, sizeof(req), RTA_PRIORITY, &nMetric, sizeof(nMetric));
+	rtattr_add(&req.nh, sizeof(req), RTA_NH_ID, &nNexthopId, sizeof(nNexthopId));
+
+	return SendToSocket(__FUNCTION__, NULL, "Set Default Route", (void*)&req, 0, 0) == -1 ? -1 : 0;
+}
+
+// Batches
+//
+// A batch collects the IP configuration changes for one interface, and
+// applies them with a single sendmsg(). The batch starts with an RTM_GETLINK
+// request, so that the previous MTU and link flags are known in case the
+// batch must be rolled back.
 
-	close(s.fd);
+#define NL_BATCH_MAX_OPS	64
+#define NL_BATCH_BUF_SIZE	(NL_BATCH_MAX_OPS * 128)
+
+// Result of a change that was already in place before the batch
+#define NL_BATCH_PREEXISTING	1
+
+// Replaces the default session for submitting batches, if set
+static FNNLBATCHSUBMIT s_pfnBatchSubmit = NULL;
+
+void NlBatchSetSubmitter(FNNLBATCHSUBMIT pfnSubmit)
+{
+	__atomic_store_n(&s_pfnBatchSubmit, pfnSubmit, __ATOMIC_RELEASE);
+}
+
+struct nlbatchop
+{
+	int nType;		// Request message type
+	size_t nOffset;	// Offset of the request in the batch buffer
+	int nError;
+	struct nlbatch* pBatch;
+};
+
+struct nlbatch
+{
+	char szInterface[IFNAMSIZ];
+
+	char* pBuf;
+	size_t nLen;
+	struct nlbatchop ops[NL_BATCH_MAX_OPS];
+	size_t nOps;
+
+	// Link state before the batch, from the RTM_GETLINK reply
+	bool bHaveLink;
+	unsigned int nPrevFlags;
+	int nPrevMtu;
+
+	// Completion tracking
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	size_t nPending;
+};
+
+static int NlBatchAppend(struct nlbatch* pBatch, const struct nlreq* req)
+{
+	size_t len = NLMSG_ALIGN(req->nh.nlmsg_len);
+	if (pBatch->nOps >= NL_BATCH_MAX_OPS || pBatch->nLen + len > NL_BATCH_BUF_SIZE)
+	{
+		dlog(eLOG_ERROR, "%s(%s) batch is full\n", __FUNCTION__, pBatch->szInterface);
+		return -1;
+	}
+
+	memcpy(pBatch->pBuf + pBatch->nLen, req, req->nh.nlmsg_len);
+
+	struct nlbatchop* op = &pBatch->ops[pBatch->nOps++];
+	op->nType = req->nh.nlmsg_type;
+	op->nOffset = pBatch->nLen;
+	op->nError = 0;
+	op->pBatch = pBatch;
+
+	pBatch->nLen += len;
+	return 0;
+}
+
+struct nlbatch* NlBatchCreate(const char* szInterface)
+{
+	if (szInterface == NULL || strlen(szInterface) >= IFNAMSIZ)
+		return NULL;
+
+	struct nlbatch* pBatch = calloc(1, sizeof(struct nlbatch));
+	if (pBatch == NULL)
+		return NULL;
+
+	pBatch->pBuf = calloc(1, NL_BATCH_BUF_SIZE);
+	if (pBatch->pBuf == NULL)
+	{
+		free(pBatch);
+		return NULL;
+	}
+
+	strcpy(pBatch->szInterface, szInterface);
+	pthread_mutex_init(&pBatch->mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pBatch->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	// Query the current link state first.
+	struct nlreq req;
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ifinfomsg)));
+	req.nh.nlmsg_type = RTM_GETLINK;
+	req.ifi.ifi_family = AF_UNSPEC;
+	req.ifi.ifi_index = NlIfNameToIndex(szInterface);
+	NlBatchAppend(pBatch, &req);
+
+	return pBatch;
+}
+
+void NlBatchFree(struct nlbatch* pBatch)
+{
+	if (pBatch == NULL)
+		return;
+
+	pthread_cond_destroy(&pBatch->cond);
+	pthread_mutex_destroy(&pBatch->mutex);
+	free(pBatch->pBuf);
+	free(pBatch);
+}
+
+int NlBatchSetMtu(struct nlbatch* pBatch, int mtu)
+{
+	struct nlreq req;
+	BuildAdaptorMtu(__FUNCTION__, &req, pBatch->szInterface, mtu);
+	return NlBatchAppend(pBatch, &req);
+}
+
+int NlBatchUpAdaptor(struct nlbatch* pBatch)
+{
+	struct nlreq req;
+	BuildUpDownAdaptor(&req, true, pBatch->szInterface);
+	return NlBatchAppend(pBatch, &req);
+}
+
+int NlBatchAddAddress(struct nlbatch* pBatch, int domain, const char *szIPAddress, int dstprefixlen)
+{
+	struct nlreq req;
+	BuildAdaptorAddress(__FUNCTION__, &req, domain, pBatch->szInterface, true, szIPAddress, dstprefixlen);
+
+	// Only addresses added by this batch are rolled back; pre-existing ones
+	// are reported with EEXIST.
+	req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+	return NlBatchAppend(pBatch, &req);
+}
+
+int NlBatchAddRoute(struct nlbatch* pBatch, int domain, const char* dst, int dstprefixlen, const char* gw)
+{
+	struct nlreq req;
+	BuildRoute(__FUNCTION__, &req, domain, pBatch->szInterface, true, dst, dstprefixlen, gw);
+	req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+	return NlBatchAppend(pBatch, &req);
+}
+
+static void NlBatchParseLink(struct nlbatch* pBatch, const char* pData, size_t nLen)
+{
+	int nRemain = (int)nLen;
+	const struct nlmsghdr* pnh = (const struct nlmsghdr*)pData;
+	for (; NLMSG_OK(pnh, (uint32_t)nRemain); pnh = NLMSG_NEXT(pnh, nRemain))
+	{
+		if (pnh->nlmsg_type != RTM_NEWLINK)
+			continue;
+
+		const struct ifinfomsg* pifi = NLMSG_DATA(pnh);
+		pBatch->bHaveLink = true;
+		pBatch->nPrevFlags = pifi->ifi_flags;
+
+		int nAttrLen = IFLA_PAYLOAD(pnh);
+		const struct rtattr* rta = IFLA_RTA(pifi);
+		for (; RTA_OK(rta, nAttrLen); rta = RTA_NEXT(rta, nAttrLen))
+		{
+			if (rta->rta_type == IFLA_MTU)
+				memcpy(&pBatch->nPrevMtu, RTA_DATA(rta), sizeof(pBatch->nPrevMtu));
+		}
+	}
+}
+
+static void NlBatchCompletion(int nError, const char* pData, size_t nLen, void* pContext)
+{
+	struct nlbatchop* op = (struct nlbatchop*)pContext;
+	struct nlbatch* pBatch = op->pBatch;
+
+	pthread_mutex_lock(&pBatch->mutex);
+	op->nError = nError;
+	if (op->nType == RTM_GETLINK && nError == 0)
+		NlBatchParseLink(pBatch, pData, nLen);
+	if (--pBatch->nPending == 0)
+		pthread_cond_signal(&pBatch->cond);
+	pthread_mutex_unlock(&pBatch->mutex);
+}
+
+// Submit ops [nFirst, nOps) in one message, and wait for all of them.
+// Returns 0 if all were answered, -1 if some timed out, or -ECANCELED if
+// nothing was sent, in which case every op is marked -ECANCELED.
+static int NlBatchSubmitWait(struct nlbatch* pBatch, size_t nFirst)
+{
+	void* ppContexts[NL_BATCH_MAX_OPS];
+	for (size_t i = nFirst; i < pBatch->nOps; ++i)
+		ppContexts[i - nFirst] = &pBatch->ops[i];
+
+	pthread_mutex_lock(&pBatch->mutex);
+	pBatch->nPending = pBatch->nOps - nFirst;
+	pthread_mutex_unlock(&pBatch->mutex);
+
+	// A failed submission invokes no completions.
+	struct nlsession* pSession = NULL;
+	FNNLBATCHSUBMIT pfnSubmit = __atomic_load_n(&s_pfnBatchSubmit, __ATOMIC_ACQUIRE);
+	size_t nOffset = pBatch->ops[nFirst].nOffset;
+	int nSubmitted = -1;
+	if (pfnSubmit)
+	{
+		nSubmitted = pfnSubmit(pBatch->pBuf + nOffset, pBatch->nLen - nOffset,
+			NlBatchCompletion, ppContexts, pBatch->nOps - nFirst);
+	}
+	else if ((pSession = NlDefaultSession()) != NULL)
+	{
+		nSubmitted = NlSessionSubmitBatch(pSession, pBatch->pBuf + nOffset, pBatch->nLen - nOffset,
+			NlBatchCompletion, ppContexts, pBatch->nOps - nFirst);
+	}
+
+	if (nSubmitted < 0)
+	{
+		dlog(eLOG_ERROR, "%s(%s) failed.  Error %d: %s\n", __FUNCTION__, pBatch->szInterface, errno, strerror(errno));
+		for (size_t i = nFirst; i < pBatch->nOps; ++i)
+			pBatch->ops[i].nError = -ECANCELED;
+		return -ECANCELED;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += NL_SESSION_TIMEOUT_MS / 1000;
+	deadline.tv_nsec += (NL_SESSION_TIMEOUT_MS % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&pBatch->mutex);
+	while (pBatch->nPending > 0)
+	{
+		if (pSession == NULL || ret != 0)
+		{
+			// Without a session there is nothing to cancel; the submitter
+			// answers every request. After a timeout, the requests that
+			// could not be cancelled are being completed; wait for them.
+			pthread_cond_wait(&pBatch->cond, &pBatch->mutex);
+		}
+		else if (pthread_cond_timedwait(&pBatch->cond, &pBatch->mutex, &deadline) == ETIMEDOUT)
+		{
+			// Unanswered requests are cancelled, so that their completions
+			// cannot touch the batch any more.
+			pthread_mutex_unlock(&pBatch->mutex);
+			for (size_t i = nFirst; i < pBatch->nOps; ++i)
+			{
+				struct nlmsghdr* pnh = (struct nlmsghdr*)(pBatch->pBuf + pBatch->ops[i].nOffset);
+				if (NlSessionCancel(pSession, pnh->nlmsg_seq))
+				{
+					pthread_mutex_lock(&pBatch->mutex);
+					pBatch->ops[i].nError = -ETIMEDOUT;
+					--pBatch->nPending;
+					pthread_mutex_unlock(&pBatch->mutex);
+				}
+			}
+			pthread_mutex_lock(&pBatch->mutex);
+			ret = -1;
+		}
+	}
+	pthread_mutex_unlock(&pBatch->mutex);
 
 	return ret;
 }
 
+// Build the inverse of every op that took effect, in reverse order.
+static void NlBatchRollback(struct nlbatch* pBatch)
+{
+	size_t nApplied = pBatch->nOps;
+	size_t nFirst = nApplied;
+
+	for (size_t i = nApplied; i-- > 1; )
+	{
+		struct nlbatchop* op = &pBatch->ops[i];
+		if (op->nError != 0)
+			continue;
+
+		struct nlreq req;
+		const struct nlmsghdr* pnh = (const struct nlmsghdr*)(pBatch->pBuf + op->nOffset);
+
+		switch (op->nType)
+		{
+		case RTM_NEWADDR:
+		case RTM_NEWROUTE:
+			memcpy(&req, pnh, pnh->nlmsg_len);
+			req.nh.nlmsg_type = op->nType == RTM_NEWADDR ? RTM_DELADDR : RTM_DELROUTE;
+			req.nh.nlmsg_flags = 0;
+			break;
+
+		case RTM_SETLINK:
+			if (!pBatch->bHaveLink || (pBatch->nPrevFlags & IFF_UP))
+				continue;
+			BuildUpDownAdaptor(&req, false, pBatch->szInterface);
+			break;
+
+		case RTM_NEWLINK:
+			if (!pBatch->bHaveLink || pBatch->nPrevMtu == 0)
+				continue;
+			BuildAdaptorMtu(__FUNCTION__, &req, pBatch->szInterface, pBatch->nPrevMtu);
+			break;
+
+		default:
+			continue;
+		}
+
+		if (NlBatchAppend(pBatch, &req) < 0)
+			break;
+	}
+
+	if (pBatch->nOps == nFirst)
+		return;
+
+	dlog(eLOG_WARN, "%s(%s) rolling back %zu change(s)\n", __FUNCTION__, pBatch->szInterface, pBatch->nOps - nFirst);
+	NlBatchSubmitWait(pBatch, nFirst);
+
+	for (size_t i = nFirst; i < pBatch->nOps; ++i)
+	{
+		if (pBatch->ops[i].nError != 0)
+			dlog(eLOG_ERROR, "%s(%s) rollback of type %d failed: %d\n", __FUNCTION__, pBatch->szInterface,
+				pBatch->ops[i].nType, pBatch->ops[i].nError);
+	}
+
+	// Drop the rollback ops again, so the batch reflects what was requested.
+	pBatch->nOps = nFirst;
+	pBatch->nLen = pBatch->ops[nFirst - 1].nOffset
+		+ NLMSG_ALIGN(((struct nlmsghdr*)(pBatch->pBuf + pBatch->ops[nFirst - 1].nOffset))->nlmsg_len);
+}
+
+int NlBatchApply(struct nlbatch* pBatch)
+{
+	if (pBatch == NULL)
+		return -1;
+
+	dlog(eLOG_INFO, "%s(%s) applying %zu change(s)\n", __FUNCTION__, pBatch->szInterface, pBatch->nOps - 1);
+
+	int ret = NlBatchSubmitWait(pBatch, 0);
+
+	// Nothing was sent, so there is nothing to undo.
+	bool bSent = ret != -ECANCELED;
+
+	// Without the previous link state the batch cannot be undone reliably;
+	// it fails as a whole, and what took effect is rolled back.
+	if (bSent && pBatch->ops[0].nError < 0)
+	{
+		dlog(eLOG_ERROR, "%s(%s) link query failed: %d\n", __FUNCTION__, pBatch->szInterface, pBatch->ops[0].nError);
+		ret = -1;
+	}
+
+	for (size_t i = 1; i < pBatch->nOps; ++i)
+	{
+		struct nlbatchop* op = &pBatch->ops[i];
+
+		// Already present; that is what we wanted, but it is not ours to undo.
+		if (op->nError == -EEXIST && (op->nType == RTM_NEWADDR || op->nType == RTM_NEWROUTE))
+		{
+			op->nError = NL_BATCH_PREEXISTING;
+			continue;
+		}
+
+		if (op->nError < 0)
+		{
+			dlog(eLOG_ERROR, "%s(%s) request of type %d failed: %d\n", __FUNCTION__, pBatch->szInterface, op->nType, op->nError);
+			ret = -1;
+		}
+	}
+
+	if (ret != 0 && bSent)
+		NlBatchRollback(pBatch);
+
+	return ret != 0 ? -1 : 0;
+}
+
 int AddQmiMuxIf(const char* szInterface, int nQmiMuxId)
 {
 	char buf[64];
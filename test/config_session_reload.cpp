@@ -0,0 +1,218 @@
+/*
+ *
+ */
+
+#include "config/session_reloader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager::config;
+
+namespace {
+
+nlohmann::json
+fleet_config(std::size_t sessions)
+{
+  nlohmann::json config;
+  config["modulePath"] = "/dev/cdc-wdm0";
+  for (std::size_t i = 0 ; i < sessions ; ++i) {
+    config["session"][std::to_string(i)] = {
+      { "sessionId", i },
+      { "userName", "user" },
+      { "password", "secret" },
+      { "accessString", "internet.example" },
+      { "authProtocol", "MBIMAuthProtocolChap" },
+      { "ipType", "MBIMContextIPTypeIPv4" },
+      { "useVlan", true },
+      { "vlanName", "vlan." + std::to_string(i) },
+      { "vlanId", 1 + i },
+      { "route", { { "dst", "10.0.0.0" }, { "dstPrefixLength", 8 } } },
+    };
+  }
+  return config;
+}
+
+
+struct temp_config
+{
+  std::string path;
+
+  inline temp_config()
+    : path{"/tmp/config_session_reload." + std::to_string(getpid()) + ".json"}
+  {
+  }
+
+  inline ~temp_config()
+  {
+    std::remove(path.c_str());
+  }
+
+  inline void write(std::string const & contents)
+  {
+    std::ofstream out{path};
+    out << contents;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST(SessionDiff, classifies_changes)
+{
+  auto config = fleet_config(6);
+  auto before = session_table::compile(config);
+  ASSERT_TRUE(diff(before, before).empty());
+  ASSERT_EQ(6, diff(before, before).unchanged);
+
+  config["session"]["0"]["accessString"] = "other.example";
+  config["session"]["1"]["password"] = "changed";
+  config["session"]["2"]["vlanId"] = 100;
+  config["session"]["3"]["route"]["dstPrefixLength"] = 16;
+  config["session"]["4"]["ipType"] = "MBIMContextIPTypeIPv6";
+  config["session"]["4"]["simPin"] = "1234";
+  config["session"].erase("5");
+  config["session"]["new"] = config["session"]["0"];
+  config["session"]["new"]["sessionId"] = 42;
+  // Renaming a session keeps its identity.
+  config["session"]["renamed"] = config["session"]["1"];
+  config["session"].erase("1");
+
+  auto d = diff(before, session_table::compile(config));
+  ASSERT_FALSE(d.empty());
+  ASSERT_FALSE(d.device_changed);
+  ASSERT_EQ(0, d.unchanged);
+
+  ASSERT_EQ(1, d.added.size());
+  ASSERT_EQ(42, d.added[0].session_id);
+  ASSERT_EQ("new", d.added[0].name);
+
+  ASSERT_EQ(1, d.removed.size());
+  ASSERT_EQ(5, d.removed[0].session_id);
+  ASSERT_EQ("5", d.removed[0].name);
+
+  // By session ID
+  ASSERT_EQ(5, d.changed.size());
+  ASSERT_EQ(CHANGE_APN, d.changed[0].changes);
+  ASSERT_EQ(CHANGE_AUTH | CHANGE_NAME, d.changed[1].changes);
+  ASSERT_EQ("renamed", d.changed[1].name);
+  ASSERT_EQ(CHANGE_VLAN, d.changed[2].changes);
+  ASSERT_EQ(CHANGE_ROUTE, d.changed[3].changes);
+  ASSERT_EQ(CHANGE_APN | CHANGE_PIN, d.changed[4].changes);
+
+  config = fleet_config(6);
+  config["modulePath"] = "/dev/cdc-wdm1";
+  d = diff(before, session_table::compile(config));
+  ASSERT_TRUE(d.device_changed);
+  ASSERT_EQ(6, d.unchanged);
+  ASSERT_EQ("0 added, 0 removed, 0 changed, 6 unchanged, device changed", to_string(d));
+}
+
+
+
+TEST(SessionReloader, reloads_changed_sessions)
+{
+  temp_config file;
+  auto config = fleet_config(1000);
+  std::vector<session_diff> reported;
+  session_reloader reloader{file.path, session_table::compile(config),
+      [&reported](nlohmann::json const & document, session_table const & sessions,
+          session_diff const & d)
+      {
+        // The new table is published by the time changes are reported; the
+        // sessions are not kept as a document.
+        ASSERT_EQ(1000, sessions.size());
+        ASSERT_EQ("/dev/cdc-wdm0", document["modulePath"]);
+        ASSERT_FALSE(document.contains("session"));
+        reported.push_back(d);
+      }};
+
+  // Nothing changed, nothing reported.
+  file.write(config.dump());
+  ASSERT_EQ(1000, reloader.reload().unchanged);
+  ASSERT_TRUE(reported.empty());
+
+  config["session"]["500"]["accessString"] = "other.example";
+  file.write(config.dump());
+  auto start = std::chrono::steady_clock::now();
+  auto d = reloader.reload();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(1, d.changed.size());
+  ASSERT_EQ(500, d.changed[0].session_id);
+  ASSERT_EQ(999, d.unchanged);
+  ASSERT_EQ(1, reported.size());
+  ASSERT_EQ("other.example", reloader.sessions()->access_string(*reloader.sessions()->find(500)));
+  // Generously; this is a unit test, not a benchmark.
+  ASSERT_GT(std::chrono::seconds{1}, elapsed);
+}
+
+
+
+TEST(SessionReloader, keeps_running_on_error)
+{
+  temp_config file;
+  auto config = fleet_config(2);
+  bool called = false;
+  session_reloader reloader{file.path, session_table::compile(config),
+      [&called](nlohmann::json const &, session_table const &, session_diff const &)
+      {
+        called = true;
+      }};
+
+  // Unparseable
+  file.write("{ \"session\": ");
+  ASSERT_THROW(reloader.reload(), std::runtime_error);
+
+  // Invalid before it is unparseable
+  file.write("{\"session\":{\"0\":{\"sessionId\":0,\"bogus\":1}");
+  ASSERT_THROW(reloader.reload(), config_error);
+
+  // Invalid
+  config["session"]["1"]["ipType"] = "IPv4";
+  file.write(config.dump());
+  ASSERT_THROW(reloader.reload(), config_error);
+
+  // Gone
+  std::remove(file.path.c_str());
+  ASSERT_THROW(reloader.reload(), std::runtime_error);
+
+  ASSERT_FALSE(called);
+  ASSERT_EQ(2, reloader.sessions()->size());
+  ASSERT_EQ(MBIMContextIPTypeIPv4, reloader.sessions()->ip_type(1));
+}
+
+
+
+TEST(SessionReloader, concurrent_readers)
+{
+  auto config = fleet_config(16);
+  session_reloader reloader{"", session_table::compile(config)};
+
+  std::atomic<bool> done{false};
+  std::thread reader{[&]()
+      {
+        while (!done) {
+          auto sessions = reloader.sessions();
+          // Every version has all sessions, with consistent VLANs.
+          ASSERT_EQ(16, sessions->size());
+          for (std::size_t row = 0 ; row < sessions->size() ; ++row) {
+            ASSERT_EQ(sessions->vlan_id(0) + sessions->session_id(row), sessions->vlan_id(row));
+          }
+        }
+      }};
+
+  for (int round = 0 ; round < 100 ; ++round) {
+    for (std::size_t i = 0 ; i < 16 ; ++i) {
+      config["session"][std::to_string(i)]["vlanId"] = 2 + round + i;
+    }
+    ASSERT_EQ(16, reloader.reload(config).changed.size());
+  }
+  done = true;
+  reader.join();
+}
@@ -0,0 +1,341 @@
+/*
+ *
+ */
+
+#include "config/session_table.h"
+
+#include <sstream>
+
+#include <arpa/inet.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager::config;
+
+namespace {
+
+nlohmann::json
+sample_config()
+{
+  return R"({
+    "modulePath": "/dev/cdc-wdm0",
+    "deviceInterfaceName": "wwan0",
+    "plugin_path": "/usr/lib/linkmanager",
+    "session": {
+      "0": {
+        "sessionId": 0,
+        "userName": "user",
+        "password": "",
+        "accessString": "internet.example",
+        "compression": "MBIMCompressionNone",
+        "authProtocol": "MBIMAuthProtocolChap",
+        "ipType": "MBIMContextIPTypeIPv4",
+        "useVlan": false,
+        "vlanName": "vlan.0",
+        "vlanId": 4094,
+        "simPin": 1234,
+        "routeDst": "8.8.8.0",
+        "routeDstPrefixLength": 24
+      },
+      "1": {
+        "sessionId": 7,
+        "userName": "user",
+        "accessString": "internet.example",
+        "ipType": "MBIMContextIPTypeIPv4v6",
+        "useVlan": true,
+        "vlanName": "vlan.1",
+        "simPin": "0042",
+        "route": {
+          "dst": "2001:db8::",
+          "dstPrefixLength": 32
+        }
+      }
+    }
+  })"_json;
+}
+
+
+/**
+ * The path of the error compiling a configuration, or "" if it compiles.
+ * Streaming the configuration must fail in the same place.
+ */
+std::string
+error_path(nlohmann::json const & config)
+{
+  std::string streamed;
+  try {
+    std::istringstream in{config.dump()};
+    nlohmann::json rest;
+    session_table::compile(in, rest);
+  } catch (config_error const & err) {
+    streamed = err.path();
+  }
+
+  try {
+    session_table::compile(config);
+  } catch (config_error const & err) {
+    EXPECT_EQ(err.path(), streamed);
+    return err.path();
+  }
+  EXPECT_EQ("", streamed);
+  return {};
+}
+
+
+session_table
+stream(std::string const & text, nlohmann::json & rest)
+{
+  std::istringstream in{text};
+  return session_table::compile(in, rest);
+}
+
+
+/**
+ * As above, with one setting of the sample's first session replaced.
+ */
+std::string
+error_path(std::string const & key, nlohmann::json const & value)
+{
+  auto config = sample_config();
+  config["session"]["0"][key] = value;
+  return error_path(config);
+}
+
+} // anonymous namespace
+
+
+TEST(SessionTable, compiles_sessions)
+{
+  auto table = session_table::compile(sample_config());
+  ASSERT_EQ(2, table.size());
+  ASSERT_EQ("/dev/cdc-wdm0", table.module_path());
+  ASSERT_EQ("wwan0", table.interface_name());
+
+  ASSERT_EQ("0", table.name(0));
+  ASSERT_EQ(0, table.session_id(0));
+  ASSERT_EQ("user", table.user_name(0));
+  ASSERT_EQ("", table.password(0));
+  ASSERT_EQ("internet.example", table.access_string(0));
+  ASSERT_EQ(MBIMCompressionNone, table.compression(0));
+  ASSERT_EQ(MBIMAuthProtocolChap, table.auth_protocol(0));
+  ASSERT_EQ(MBIMContextIPTypeIPv4, table.ip_type(0));
+  ASSERT_FALSE(table.use_vlan(0));
+  ASSERT_EQ("vlan.0", table.vlan_name(0));
+  ASSERT_EQ(4094, table.vlan_id(0));
+  ASSERT_EQ("1234", table.sim_pin(0));
+  ASSERT_EQ(AF_INET, table.route_family(0));
+  ASSERT_EQ("8.8.8.0", table.route_dst(0));
+  ASSERT_EQ(24, table.route_prefix_length(0));
+
+  ASSERT_EQ("1", table.name(1));
+  ASSERT_EQ(7, table.session_id(1));
+  ASSERT_EQ(MBIMAuthProtocolNone, table.auth_protocol(1));
+  ASSERT_EQ(MBIMContextIPTypeIPv4v6, table.ip_type(1));
+  ASSERT_TRUE(table.use_vlan(1));
+  ASSERT_EQ(0, table.vlan_id(1));
+  ASSERT_EQ("0042", table.sim_pin(1));
+  ASSERT_EQ(AF_INET6, table.route_family(1));
+  ASSERT_EQ("2001:db8::", table.route_dst(1));
+  ASSERT_EQ(32, table.route_prefix_length(1));
+
+  ASSERT_EQ(0, table.find(0));
+  ASSERT_EQ(1, table.find(7));
+  ASSERT_FALSE(table.find(1));
+}
+
+
+
+TEST(SessionTable, settings_round_trip)
+{
+  auto table = session_table::compile(sample_config());
+  for (std::size_t row = 0 ; row < table.size() ; ++row) {
+    auto settings = table.settings(row);
+    nlohmann::json config;
+    config["session"][std::string{table.name(row)}] = settings;
+
+    auto again = session_table::compile(config);
+    ASSERT_EQ(1, again.size());
+    ASSERT_EQ(settings, again.settings(0));
+    ASSERT_EQ(table.session_id(row), again.session_id(0));
+    ASSERT_EQ(table.auth_protocol(row), again.auth_protocol(0));
+    ASSERT_EQ(table.sim_pin(row), again.sim_pin(0));
+    ASSERT_EQ(table.route_dst(row), again.route_dst(0));
+  }
+  ASSERT_EQ("MBIMContextIPTypeIPv4v6", table.settings(1)["ipType"]);
+  ASSERT_EQ(32, table.settings(1)["route"]["dstPrefixLength"]);
+}
+
+
+
+TEST(SessionTable, shares_strings)
+{
+  auto config = sample_config();
+  auto single = session_table::compile(config);
+
+  for (int i = 2 ; i < 100 ; ++i) {
+    auto session = config["session"]["1"];
+    session["sessionId"] = 100 + i;
+    config["session"][std::to_string(i)] = session;
+  }
+  auto table = session_table::compile(config);
+  ASSERT_EQ(100, table.size());
+  ASSERT_EQ("internet.example", table.access_string(99));
+
+  // Only the session names are new.
+  std::size_t names = 0;
+  for (int i = 2 ; i < 100 ; ++i) {
+    names += std::to_string(i).size();
+  }
+  ASSERT_EQ(single.arena_size() + names, table.arena_size());
+}
+
+
+
+TEST(SessionTable, defaults)
+{
+  auto table = session_table::compile(R"({
+    "session": { "a": { "sessionId": 3 } }
+  })"_json);
+  ASSERT_EQ(1, table.size());
+  ASSERT_EQ("", table.module_path());
+  ASSERT_EQ("", table.access_string(0));
+  ASSERT_EQ(MBIMCompressionNone, table.compression(0));
+  ASSERT_EQ(MBIMAuthProtocolNone, table.auth_protocol(0));
+  ASSERT_EQ(MBIMContextIPTypeDefault, table.ip_type(0));
+  ASSERT_FALSE(table.use_vlan(0));
+  ASSERT_EQ("", table.sim_pin(0));
+  ASSERT_EQ(AF_UNSPEC, table.route_family(0));
+
+  // A route without prefix length is a host route.
+  table = session_table::compile(R"({
+    "session": { "a": { "sessionId": 3, "routeDst": "10.0.0.1" } }
+  })"_json);
+  ASSERT_EQ(32, table.route_prefix_length(0));
+
+  ASSERT_TRUE(session_table::compile("{}"_json).empty());
+}
+
+
+
+TEST(SessionTable, rejects_invalid)
+{
+  ASSERT_EQ("", error_path(sample_config()));
+
+  ASSERT_EQ("session/0/ipType", error_path("ipType", "IPv4"));
+  ASSERT_EQ("session/0/compression", error_path("compression", 1));
+  ASSERT_EQ("session/0/authProtocol", error_path("authProtocol", "MBIMAuthProtocolNone "));
+  ASSERT_EQ("session/0/sessionId", error_path("sessionId", -1));
+  ASSERT_EQ("session/0/sessionId", error_path("sessionId", "0"));
+  ASSERT_EQ("session/0/sessionId", error_path("sessionId", 4294967296ull));
+  ASSERT_EQ("session/0/accessString",
+      error_path("accessString", std::string(MBIM_ACCESS_STRING_MAX_LEN + 1, 'a')));
+  ASSERT_EQ("", error_path("accessString", std::string(MBIM_ACCESS_STRING_MAX_LEN, 'a')));
+  ASSERT_EQ("session/0/vlanName", error_path("vlanName", "a-very-long-vlan-name"));
+  ASSERT_EQ("session/0/vlanId", error_path("vlanId", 4095));
+  ASSERT_EQ("session/0/useVlan", error_path("useVlan", "false"));
+  ASSERT_EQ("session/0/simPin", error_path("simPin", 12));
+  ASSERT_EQ("session/0/simPin", error_path("simPin", "12a4"));
+  ASSERT_EQ("session/0/route", error_path("routeDst", "8.8.8"));
+  ASSERT_EQ("session/0/route", error_path("routeDstPrefixLength", 33));
+  ASSERT_EQ("session/0/usrName", error_path("usrName", "user"));
+  ASSERT_EQ("session/0/route/gateway", error_path("route", R"({ "gateway": "8.8.8.8" })"_json));
+
+  // Duplicate session ID
+  ASSERT_EQ("session/1/sessionId", error_path("sessionId", 7));
+
+  auto config = sample_config();
+  config["session"]["1"].erase("sessionId");
+  ASSERT_EQ("session/1/sessionId", error_path(config));
+
+  config = sample_config();
+  config["session"]["0"].erase("vlanName");
+  config["session"]["0"]["useVlan"] = true;
+  ASSERT_EQ("session/0/vlanName", error_path(config));
+
+  config = sample_config();
+  config["session"] = nlohmann::json::array();
+  ASSERT_EQ("session", error_path(config));
+
+  config = sample_config();
+  config["modulePath"] = 0;
+  ASSERT_EQ("modulePath", error_path(config));
+}
+
+
+
+TEST(SessionTable, streams_sessions)
+{
+  auto config = sample_config();
+  config["plugin_path"] = R"([ "/usr/lib/linkmanager", { "nested": [ 1, 2.5, null ] } ])"_json;
+  auto expected = session_table::compile(config);
+
+  // Sessions out of name order, and other keys around them.
+  auto text = R"({
+    "plugin_path": [ "/usr/lib/linkmanager", { "nested": [ 1, 2.5, null ] } ],
+    "session": {
+      "1": )" + config["session"]["1"].dump() + R"(,
+      "0": )" + config["session"]["0"].dump() + R"(
+    },
+    "deviceInterfaceName": "wwan0",
+    "modulePath": "/dev/cdc-wdm0"
+  })";
+  nlohmann::json rest;
+  auto table = stream(text, rest);
+
+  config.erase("session");
+  ASSERT_EQ(config, rest);
+
+  ASSERT_EQ(expected.size(), table.size());
+  ASSERT_EQ(expected.module_path(), table.module_path());
+  ASSERT_EQ(expected.interface_name(), table.interface_name());
+  for (std::size_t row = 0 ; row < expected.size() ; ++row) {
+    ASSERT_EQ(expected.name(row), table.name(row));
+    ASSERT_EQ(expected.session_id(row), table.session_id(row));
+    ASSERT_EQ(expected.access_string(row), table.access_string(row));
+    ASSERT_EQ(expected.ip_type(row), table.ip_type(row));
+    ASSERT_EQ(expected.use_vlan(row), table.use_vlan(row));
+    ASSERT_EQ(expected.vlan_name(row), table.vlan_name(row));
+    ASSERT_EQ(expected.sim_pin(row), table.sim_pin(row));
+    ASSERT_EQ(expected.route_family(row), table.route_family(row));
+    ASSERT_EQ(expected.route_dst(row), table.route_dst(row));
+    ASSERT_EQ(expected.route_prefix_length(row), table.route_prefix_length(row));
+  }
+  ASSERT_EQ(1, table.find(7));
+
+  ASSERT_TRUE(stream("{}", rest).empty());
+  ASSERT_EQ("{}"_json, rest);
+}
+
+
+
+TEST(SessionTable, streaming_rejects_invalid)
+{
+  nlohmann::json rest;
+  auto path = [&rest](std::string const & text) -> std::string
+  {
+    try {
+      stream(text, rest);
+    } catch (config_error const & err) {
+      return err.path();
+    }
+    return "compiled";
+  };
+
+  // Where documents keep the last of duplicate keys, streams reject them.
+  ASSERT_EQ("session/a", path(R"({ "session": {
+      "a": { "sessionId": 1 }, "b": { "sessionId": 2 }, "a": { "sessionId": 3 } } })"));
+  ASSERT_EQ("session", path(R"({ "session": {}, "session": {} })"));
+
+  ASSERT_EQ("", path("[]"));
+  ASSERT_EQ("", path("42"));
+  ASSERT_EQ("session/a/route/dst", path(R"({ "session": {
+      "a": { "sessionId": 1, "route": { "dst": [ "10.0.0.1" ] } } } })"));
+  ASSERT_EQ("session/a/userName", path(R"({ "session": {
+      "a": { "sessionId": 1, "userName": { "first": "x" } } } })"));
+  ASSERT_EQ("modulePath", path(R"({ "modulePath": [] })"));
+
+  // Not JSON at all
+  ASSERT_THROW(stream("", rest), nlohmann::json::exception);
+  ASSERT_THROW(stream(R"({ "session": { "a": )", rest), nlohmann::json::exception);
+  ASSERT_THROW(stream("{} {}", rest), nlohmann::json::exception);
+}
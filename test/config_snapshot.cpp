@@ -0,0 +1,250 @@
+/*
+ *
+ */
+
+#include "config/snapshot.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager::config;
+
+namespace {
+
+nlohmann::json
+fleet_config(std::size_t sessions)
+{
+  nlohmann::json config;
+  config["modulePath"] = "/dev/cdc-wdm0";
+  config["deviceInterfaceName"] = "wwan0";
+  config["controlSocket"] = "/run/linkmanager.sock";
+  for (std::size_t i = 0 ; i < sessions ; ++i) {
+    config["session"]["s" + std::to_string(i)] = {
+      { "sessionId", i },
+      { "userName", "user" },
+      { "password", "secret" },
+      { "accessString", "apn" + std::to_string(i % 4) + ".example" },
+      { "authProtocol", "MBIMAuthProtocolChap" },
+      { "ipType", "MBIMContextIPTypeIPv4v6" },
+      { "useVlan", i % 2 == 0 },
+      { "vlanName", "vlan." + std::to_string(i) },
+      { "vlanId", 1 + i },
+      { "route", { { "dst", "2001:db8::" }, { "dstPrefixLength", 32 } } },
+    };
+  }
+  config["session"]["s0"]["simPin"] = "1234";
+  return config;
+}
+
+
+struct temp_files
+{
+  std::string source;
+  std::string image;
+
+  inline temp_files()
+    : source{"/tmp/config_snapshot." + std::to_string(getpid()) + ".json"}
+    , image{source + ".snapshot"}
+  {
+  }
+
+  inline ~temp_files()
+  {
+    std::remove(source.c_str());
+    std::remove(image.c_str());
+  }
+
+  inline void write(nlohmann::json const & config)
+  {
+    std::ofstream out{source};
+    out << config.dump(2);
+  }
+
+  inline std::string read_image() const
+  {
+    std::ifstream in{image, std::ios::binary};
+    return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  }
+
+  inline void write_image(std::string const & contents) const
+  {
+    std::ofstream out{image, std::ios::binary | std::ios::trunc};
+    out << contents;
+  }
+};
+
+
+void
+expect_same(session_table const & expected, session_table const & actual)
+{
+  ASSERT_EQ(expected.size(), actual.size());
+  ASSERT_EQ(expected.module_path(), actual.module_path());
+  ASSERT_EQ(expected.interface_name(), actual.interface_name());
+  for (std::size_t row = 0 ; row < expected.size() ; ++row) {
+    ASSERT_EQ(expected.name(row), actual.name(row));
+    ASSERT_EQ(expected.session_id(row), actual.session_id(row));
+    ASSERT_EQ(expected.user_name(row), actual.user_name(row));
+    ASSERT_EQ(expected.password(row), actual.password(row));
+    ASSERT_EQ(expected.access_string(row), actual.access_string(row));
+    ASSERT_EQ(expected.auth_protocol(row), actual.auth_protocol(row));
+    ASSERT_EQ(expected.ip_type(row), actual.ip_type(row));
+    ASSERT_EQ(expected.use_vlan(row), actual.use_vlan(row));
+    ASSERT_EQ(expected.vlan_name(row), actual.vlan_name(row));
+    ASSERT_EQ(expected.vlan_id(row), actual.vlan_id(row));
+    ASSERT_EQ(expected.sim_pin(row), actual.sim_pin(row));
+    ASSERT_EQ(expected.route_family(row), actual.route_family(row));
+    ASSERT_EQ(expected.route_dst(row), actual.route_dst(row));
+    ASSERT_EQ(expected.route_prefix_length(row), actual.route_prefix_length(row));
+    ASSERT_EQ(row, actual.find(actual.session_id(row)));
+  }
+}
+
+} // anonymous namespace
+
+
+TEST(ConfigSnapshot, round_trip)
+{
+  temp_files files;
+  auto config = fleet_config(100);
+  files.write(config);
+
+  compiled_config compiled{config, session_table::compile(config)};
+  compiled.document.erase("session");
+  ASSERT_TRUE(snapshot::save(files.image, files.source, compiled));
+
+  auto loaded = snapshot::load(files.image, files.source);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ(compiled.document, loaded->document);
+  ASSERT_FALSE(loaded->document.contains("session"));
+  expect_same(compiled.sessions, loaded->sessions);
+}
+
+
+
+TEST(ConfigSnapshot, stale_source)
+{
+  temp_files files;
+  auto config = fleet_config(10);
+  files.write(config);
+  snapshot::load_or_compile(files.source, files.image);
+  ASSERT_TRUE(snapshot::load(files.image, files.source));
+
+  // Changing the source makes the snapshot stale, and the next start parses
+  // and saves again.
+  config["session"]["s3"]["accessString"] = "changed.example";
+  files.write(config);
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+
+  auto compiled = snapshot::load_or_compile(files.source, files.image);
+  ASSERT_EQ("changed.example", compiled.sessions.access_string(*compiled.sessions.find(3)));
+  auto loaded = snapshot::load(files.image, files.source);
+  ASSERT_TRUE(loaded);
+  ASSERT_EQ("changed.example", loaded->sessions.access_string(*loaded->sessions.find(3)));
+
+  // No source, no snapshot either.
+  std::remove(files.source.c_str());
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+}
+
+
+
+TEST(ConfigSnapshot, rejects_damaged)
+{
+  temp_files files;
+  files.write(fleet_config(10));
+  snapshot::load_or_compile(files.source, files.image);
+  auto image = files.read_image();
+  ASSERT_LT(64, image.size());
+
+  // Payload damage is caught by the checksum.
+  auto damaged = image;
+  damaged[image.size() / 2] ^= 0x40;
+  files.write_image(damaged);
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+
+  // As is truncation, by the size.
+  files.write_image(image.substr(0, image.size() - 8));
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+  files.write_image(image.substr(0, 16));
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+  files.write_image("");
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+
+  // Another format version.
+  damaged = image;
+  damaged[8] = static_cast<char>(snapshot::VERSION + 1);
+  files.write_image(damaged);
+  ASSERT_FALSE(snapshot::load(files.image, files.source));
+
+  // Falling back still works.
+  files.write_image(image.substr(0, 100));
+  auto compiled = snapshot::load_or_compile(files.source, files.image);
+  ASSERT_EQ(10, compiled.sessions.size());
+  ASSERT_EQ(image, files.read_image());
+}
+
+
+
+TEST(ConfigSnapshot, load_or_compile)
+{
+  temp_files files;
+  auto config = fleet_config(3);
+  files.write(config);
+
+  // Without a snapshot path, nothing is saved.
+  auto compiled = snapshot::load_or_compile(files.source, "");
+  ASSERT_EQ(3, compiled.sessions.size());
+  ASSERT_EQ("/run/linkmanager.sock", compiled.document["controlSocket"]);
+  ASSERT_FALSE(compiled.document.contains("session"));
+  ASSERT_TRUE(files.read_image().empty());
+
+  compiled = snapshot::load_or_compile(files.source, files.image);
+  ASSERT_FALSE(files.read_image().empty());
+  auto loaded = snapshot::load_or_compile(files.source, files.image);
+  ASSERT_EQ(compiled.document, loaded.document);
+  expect_same(compiled.sessions, loaded.sessions);
+
+  // Errors are the source's.
+  config["session"]["s1"]["vlanId"] = 5000;
+  files.write(config);
+  ASSERT_THROW(snapshot::load_or_compile(files.source, files.image), config_error);
+  files.write_image("");
+  std::ofstream{files.source} << "{ \"session\": ";
+  ASSERT_THROW(snapshot::load_or_compile(files.source, files.image), std::runtime_error);
+  std::remove(files.source.c_str());
+  ASSERT_THROW(snapshot::load_or_compile(files.source, files.image), std::runtime_error);
+}
+
+
+
+TEST(ConfigSnapshot, load_document)
+{
+  temp_files files;
+  auto config = fleet_config(3);
+  config["session"]["s1"]["vlanId"] = 5000;
+  files.write(config);
+
+  // Invalid sessions leave the rest of the configuration.
+  ASSERT_THROW(snapshot::load_or_compile(files.source, ""), config_error);
+  auto document = snapshot::load_document(files.source);
+  ASSERT_EQ("/run/linkmanager.sock", document["controlSocket"]);
+  ASSERT_FALSE(document.contains("session"));
+
+  // Invalid sessions may be found before the text turns out not to be JSON.
+  std::ofstream{files.source} << "{\"session\":{\"0\":{\"sessionId\":0,\"bogus\":1}";
+  ASSERT_THROW(snapshot::load_or_compile(files.source, ""), config_error);
+  ASSERT_THROW(snapshot::load_document(files.source), std::runtime_error);
+
+  // A root that is not an object is no configuration at all.
+  std::ofstream{files.source} << "[]";
+  ASSERT_THROW(snapshot::load_or_compile(files.source, ""), config_error);
+  ASSERT_THROW(snapshot::load_document(files.source), std::runtime_error);
+
+  std::remove(files.source.c_str());
+  ASSERT_THROW(snapshot::load_document(files.source), std::runtime_error);
+}
@@ -0,0 +1,142 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimCapture.h
+ */
+#ifndef __MBIM_CAPTURE_H__
+#define __MBIM_CAPTURE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBIM_CAPTURE_DEFAULT_SLOTS  1024    /**< Fragments kept by default. */
+#define MBIM_CAPTURE_DEFAULT_SNAPLEN 4096   /**< Bytes kept of each fragment by default. */
+
+/**
+ * \ingroup litembim
+ *
+ * Direction of a captured fragment.
+ */
+typedef enum
+{
+    MBIM_CAPTURE_SENT = 0,      /**< Host to function. */
+    MBIM_CAPTURE_RECEIVED = 1,  /**< Function to host. */
+} MBIM_CAPTURE_DIRECTION;
+
+/**
+ * \ingroup litembim
+ *
+ *  A record of the most recent MBIM control fragments sent and received by
+ *  one or more transports (see MbimTransport_AttachCapture), kept in memory
+ *  and written out as a pcapng file on demand or when a transport fails.
+ *
+ *  Recording a fragment takes a timestamp, claims the next slot of a ring
+ *  allocated up front with an atomic increment, and copies the fragment
+ *  into it; no lock is taken and nothing is formatted. When the ring is
+ *  full, the oldest fragments are overwritten. The transaction ID, and the
+ *  device service UUID of first fragments, are part of the captured bytes.
+ *
+ *  Fragments are written with the Linux usbmon link type, as the control
+ *  transfers carrying them: SEND_ENCAPSULATED_COMMAND for sent fragments,
+ *  GET_ENCAPSULATED_RESPONSE for received ones. Wireshark decodes them as
+ *  MBIM with the mbim.control_decode_unknown_itf preference enabled, as
+ *  the capture does not contain the device's descriptors. Each attached
+ *  transport appears as its own USB device address.
+ *
+ *  \param  pRing
+ *          - slotCount slots of slotSize bytes.
+ *
+ *  \param  slotCount
+ *          - Number of slots, a power of two.
+ *
+ *  \param  slotSize
+ *          - Size of a slot: a header followed by up to snapLength bytes.
+ *
+ *  \param  snapLength
+ *          - Bytes kept of each fragment; the rest is truncated.
+ *
+ *  \param  head
+ *          - Sequence number of the next fragment to record. Updated
+ *            atomically.
+ *
+ *  \param  devices
+ *          - Number of transports attached so far. Updated atomically.
+ *
+ *  \param  pErrorDumpPath
+ *          - File to dump to when an attached transport reports an error,
+ *            or NULL.
+ */
+typedef struct MbimCapture
+{
+    uint8_t* pRing;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint32_t snapLength;
+    uint64_t head;
+    uint32_t devices;
+    char* pErrorDumpPath;
+} MbimCapture;
+
+/**
+ * \ingroup litembim
+ *
+ * Allocate the ring.
+ *
+ * @param[in] pThis           The primary object of this call.
+ * @param[in] slotCount       Number of fragments kept, rounded up to a power of two.
+ *                            0 selects MBIM_CAPTURE_DEFAULT_SLOTS.
+ * @param[in] snapLength      Bytes kept of each fragment.
+ *                            0 selects MBIM_CAPTURE_DEFAULT_SNAPLEN.
+ * @param[in] errorDumpPath   File to dump to when an attached transport
+ *                            reports an error, or NULL.
+ *
+ * @return 0 on success, < 0 on failure.
+ */
+int MbimCapture_Initialize(MbimCapture* pThis, uint32_t slotCount, uint32_t snapLength,
+    const char* errorDumpPath);
+
+/**
+ * \ingroup litembim
+ *
+ * Free the ring. No transport may have it attached.
+ *
+ * @param[in] pThis      The primary object of this call.
+ */
+void MbimCapture_Destroy(MbimCapture* pThis);
+
+/**
+ * \ingroup litembim
+ *
+ * Record a fragment. May be called from any thread.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] device     USB device address to record the fragment under.
+ * @param[in] direction  Whether the fragment was sent or received.
+ * @param[in] pFragment  The fragment, starting with its MBIM header.
+ * @param[in] length     Length of the fragment.
+ */
+void MbimCapture_Record(MbimCapture* pThis, uint8_t device, MBIM_CAPTURE_DIRECTION direction,
+    const uint8_t* pFragment, uint32_t length);
+
+/**
+ * \ingroup litembim
+ *
+ * Write the fragments in the ring to a pcapng file, oldest first. Fragments
+ * may be recorded meanwhile; those overwritten while being written out are
+ * left out.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] path       File to create or replace.
+ *
+ * @return Number of fragments written, < 0 on failure.
+ */
+int MbimCapture_Dump(MbimCapture* pThis, const char* path);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_CAPTURE_H__
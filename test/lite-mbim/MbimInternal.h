@@ -0,0 +1,188 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimInternal.h
+ *
+ * MBIM control message layouts and byte order helpers, for use by the
+ * transport layer only. All messages are little endian on the wire.
+ */
+#ifndef __MBIM_INTERNAL_H__
+#define __MBIM_INTERNAL_H__
+
+#include <stdint.h>
+#include <endian.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBIM_OPEN_MSG_TYPE              0x00000001
+#define MBIM_CLOSE_MSG_TYPE             0x00000002
+#define MBIM_COMMAND_MSG_TYPE           0x00000003
+#define MBIM_HOST_ERROR_MSG_TYPE        0x00000004
+#define MBIM_OPEN_DONE_MSG_TYPE         0x80000001
+#define MBIM_CLOSE_DONE_MSG_TYPE        0x80000002
+#define MBIM_COMMAND_DONE_MSG_TYPE      0x80000003
+#define MBIM_FUNCTION_ERROR_MSG_TYPE    0x80000004
+#define MBIM_INDICATE_STATUS_MSG_TYPE   0x80000007
+
+typedef struct
+{
+    uint32_t MessageType;
+    uint32_t MessageLength;
+    uint32_t TransactionId;
+} MBIM_MESSAGE_HEADER;
+
+typedef struct
+{
+    uint32_t TotalFragments;
+    uint32_t CurrentFragment;
+} MBIM_FRAGMENT_HEADER;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    uint32_t MaxControlTransfer;
+} MBIM_OPEN_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    uint32_t Status;
+} MBIM_OPEN_DONE_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+} MBIM_CLOSE_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    uint32_t Status;
+} MBIM_CLOSE_DONE_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    MBIM_FRAGMENT_HEADER FragmentHeader;
+    uint8_t DeviceServiceId[16];
+    uint32_t CID;
+    uint32_t CommandType;
+    uint32_t InformationBufferLength;
+} MBIM_COMMAND_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    MBIM_FRAGMENT_HEADER FragmentHeader;
+    uint8_t DeviceServiceId[16];
+    uint32_t CID;
+    uint32_t Status;
+    uint32_t InformationBufferLength;
+} MBIM_COMMAND_DONE_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    MBIM_FRAGMENT_HEADER FragmentHeader;
+    uint8_t DeviceServiceId[16];
+    uint32_t CID;
+    uint32_t InformationBufferLength;
+} MBIM_INDICATE_STATUS_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    MBIM_FRAGMENT_HEADER FragmentHeader;
+} MBIM_FRAGMENT_MSG;
+
+typedef struct
+{
+    MBIM_MESSAGE_HEADER MessageHeader;
+    uint32_t ErrorStatusCode;
+} MBIM_FUNCTION_ERROR_MSG;
+
+/*
+ * Convert between wire and host byte order, in place. The conversion is its
+ * own inverse, so the same helpers serve both directions.
+ */
+static inline void MBIM_MESSAGE_HEADER_SWAP_BYTES(MBIM_MESSAGE_HEADER* pHeader)
+{
+    pHeader->MessageType = le32toh(pHeader->MessageType);
+    pHeader->MessageLength = le32toh(pHeader->MessageLength);
+    pHeader->TransactionId = le32toh(pHeader->TransactionId);
+}
+
+static inline void MBIM_FRAGMENT_HEADER_SWAP_BYTES(MBIM_FRAGMENT_HEADER* pHeader)
+{
+    pHeader->TotalFragments = le32toh(pHeader->TotalFragments);
+    pHeader->CurrentFragment = le32toh(pHeader->CurrentFragment);
+}
+
+static inline void MBIM_OPEN_MSG_SWAP_BYTES(MBIM_OPEN_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    pMsg->MaxControlTransfer = le32toh(pMsg->MaxControlTransfer);
+}
+
+static inline void MBIM_OPEN_DONE_MSG_SWAP_BYTES(MBIM_OPEN_DONE_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    pMsg->Status = le32toh(pMsg->Status);
+}
+
+static inline void MBIM_CLOSE_MSG_SWAP_BYTES(MBIM_CLOSE_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+}
+
+static inline void MBIM_CLOSE_DONE_MSG_SWAP_BYTES(MBIM_CLOSE_DONE_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    pMsg->Status = le32toh(pMsg->Status);
+}
+
+static inline void MBIM_COMMAND_MSG_SWAP_BYTES(MBIM_COMMAND_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    MBIM_FRAGMENT_HEADER_SWAP_BYTES(&pMsg->FragmentHeader);
+    pMsg->CID = le32toh(pMsg->CID);
+    pMsg->CommandType = le32toh(pMsg->CommandType);
+    pMsg->InformationBufferLength = le32toh(pMsg->InformationBufferLength);
+}
+
+static inline void MBIM_COMMAND_DONE_MSG_SWAP_BYTES(MBIM_COMMAND_DONE_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    MBIM_FRAGMENT_HEADER_SWAP_BYTES(&pMsg->FragmentHeader);
+    pMsg->CID = le32toh(pMsg->CID);
+    pMsg->Status = le32toh(pMsg->Status);
+    pMsg->InformationBufferLength = le32toh(pMsg->InformationBufferLength);
+}
+
+static inline void MBIM_INDICATE_STATUS_MSG_SWAP_BYTES(MBIM_INDICATE_STATUS_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    MBIM_FRAGMENT_HEADER_SWAP_BYTES(&pMsg->FragmentHeader);
+    pMsg->CID = le32toh(pMsg->CID);
+    pMsg->InformationBufferLength = le32toh(pMsg->InformationBufferLength);
+}
+
+static inline void MBIM_FRAGMENT_MSG_SWAP_BYTES(MBIM_FRAGMENT_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    MBIM_FRAGMENT_HEADER_SWAP_BYTES(&pMsg->FragmentHeader);
+}
+
+static inline void MBIM_FUNCTION_ERROR_MSG_SWAP_BYTES(MBIM_FUNCTION_ERROR_MSG* pMsg)
+{
+    MBIM_MESSAGE_HEADER_SWAP_BYTES(&pMsg->MessageHeader);
+    pMsg->ErrorStatusCode = le32toh(pMsg->ErrorStatusCode);
+}
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_INTERNAL_H__
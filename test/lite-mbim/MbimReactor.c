@@ -0,0 +1,257 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimReactor.c
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "MbimReactor.h"
+#include "MbimLogging.h"
+
+#define MBIM_REACTOR_SHUTDOWN_KEY UINT64_MAX  /**< Epoll key of the shutdown pipe. */
+
+struct MbimReactorSlot
+{
+    int fd;                     // -1 if the slot is free.
+    uint32_t generation;        // Incremented on detaching.
+    MBIM_REACTOR_READ_CALLBACK pCallback;
+    void* pContext;
+    bool busy;                  // A thread is running the callback.
+};
+
+static uint64_t MakeKey(uint32_t slot, uint32_t generation)
+{
+    return ((uint64_t)generation << 32) | slot;
+}
+
+static int Arm(MbimReactor* pThis, int op, uint32_t slot)
+{
+    struct epoll_event event;
+
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = MakeKey(slot, pThis->pSlots[slot].generation);
+    return epoll_ctl(pThis->epollFd, op, pThis->pSlots[slot].fd, &event);
+}
+
+static void* ReactorThreadFunc(void* arg)
+{
+    MbimReactor* pThis = (MbimReactor*)arg;
+    struct epoll_event event;
+    struct MbimReactorSlot* pSlot;
+    uint32_t slot, generation;
+    int ret;
+
+    while (true)
+    {
+        ret = epoll_wait(pThis->epollFd, &event, 1, -1);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            litembim_log(LOG_ERR, "%s: epoll_wait failed, errno: %d", __FUNCTION__, errno);
+            break;
+        }
+        if (ret == 0)
+        {
+            continue;
+        }
+        if (event.data.u64 == MBIM_REACTOR_SHUTDOWN_KEY)
+        {
+            break;
+        }
+
+        slot = (uint32_t)event.data.u64;
+        generation = (uint32_t)(event.data.u64 >> 32);
+
+        pthread_mutex_lock(&pThis->lock);
+        pSlot = &pThis->pSlots[slot];
+        if (pSlot->fd < 0 || pSlot->generation != generation)
+        {
+            // Detached since the event was fetched.
+            pthread_mutex_unlock(&pThis->lock);
+            continue;
+        }
+        pSlot->busy = true;
+        pthread_mutex_unlock(&pThis->lock);
+
+        ret = pSlot->pCallback(pSlot->pContext);
+
+        pthread_mutex_lock(&pThis->lock);
+        pSlot->busy = false;
+        if (ret == 0 && pSlot->generation == generation && Arm(pThis, EPOLL_CTL_MOD, slot) < 0)
+        {
+            litembim_log(LOG_ERR, "%s: cannot re-arm fd %d, errno: %d", __FUNCTION__, pSlot->fd, errno);
+        }
+        pthread_cond_broadcast(&pThis->idle);
+        pthread_mutex_unlock(&pThis->lock);
+    }
+
+    return NULL;
+}
+
+static void CloseFds(MbimReactor* pThis)
+{
+    if (pThis->epollFd >= 0)
+    {
+        close(pThis->epollFd);
+        pThis->epollFd = -1;
+    }
+    if (pThis->shutdownPipe[0] >= 0)
+    {
+        close(pThis->shutdownPipe[0]);
+        close(pThis->shutdownPipe[1]);
+        pThis->shutdownPipe[0] = pThis->shutdownPipe[1] = -1;
+    }
+}
+
+static void StopThreads(MbimReactor* pThis, uint32_t count)
+{
+    uint8_t shutdown = 1;
+    uint32_t i;
+
+    if (write(pThis->shutdownPipe[1], &shutdown, sizeof(shutdown)) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot signal reactor threads, errno: %d", __FUNCTION__, errno);
+    }
+    for (i = 0; i < count; i++)
+    {
+        pthread_join(pThis->pThreads[i], NULL);
+    }
+}
+
+static void CleanUp(MbimReactor* pThis)
+{
+    CloseFds(pThis);
+    pthread_cond_destroy(&pThis->idle);
+    pthread_mutex_destroy(&pThis->lock);
+    free(pThis->pThreads);
+    free(pThis->pSlots);
+    pThis->pThreads = NULL;
+    pThis->pSlots = NULL;
+}
+
+int MbimReactor_Initialize(MbimReactor* pThis, uint32_t threadCount, uint32_t maxAttached)
+{
+    struct epoll_event event;
+    uint32_t i;
+
+    pThis->epollFd = -1;
+    pThis->shutdownPipe[0] = pThis->shutdownPipe[1] = -1;
+    pThis->threadCount = 0;
+    pThis->maxAttached = maxAttached;
+    pthread_mutex_init(&pThis->lock, NULL);
+    pthread_cond_init(&pThis->idle, NULL);
+
+    pThis->pThreads = calloc(threadCount, sizeof(pthread_t));
+    pThis->pSlots = calloc(maxAttached, sizeof(struct MbimReactorSlot));
+    if (threadCount == 0 || maxAttached == 0 || pThis->pThreads == NULL || pThis->pSlots == NULL)
+    {
+        litembim_log(LOG_ERR, "%s: cannot allocate %u threads and %u slots", __FUNCTION__,
+            threadCount, maxAttached);
+        CleanUp(pThis);
+        return -1;
+    }
+    for (i = 0; i < maxAttached; i++)
+    {
+        pThis->pSlots[i].fd = -1;
+    }
+
+    pThis->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (pThis->epollFd < 0 || pipe(pThis->shutdownPipe) < 0 ||
+        fcntl(pThis->shutdownPipe[0], F_SETFD, FD_CLOEXEC) < 0 ||
+        fcntl(pThis->shutdownPipe[1], F_SETFD, FD_CLOEXEC) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot create epoll instance, errno: %d", __FUNCTION__, errno);
+        CleanUp(pThis);
+        return -1;
+    }
+
+    // Level-triggered, so that every thread sees it.
+    event.events = EPOLLIN;
+    event.data.u64 = MBIM_REACTOR_SHUTDOWN_KEY;
+    if (epoll_ctl(pThis->epollFd, EPOLL_CTL_ADD, pThis->shutdownPipe[0], &event) < 0)
+    {
+        litembim_log(LOG_ERR, "%s: cannot watch shutdown pipe, errno: %d", __FUNCTION__, errno);
+        CleanUp(pThis);
+        return -1;
+    }
+
+    for (i = 0; i < threadCount; i++)
+    {
+        if (pthread_create(&pThis->pThreads[i], NULL, ReactorThreadFunc, pThis) != 0)
+        {
+            litembim_log(LOG_ERR, "%s: pthread_create failed", __FUNCTION__);
+            StopThreads(pThis, i);
+            CleanUp(pThis);
+            return -1;
+        }
+    }
+    pThis->threadCount = threadCount;
+
+    return 0;
+}
+
+void MbimReactor_ShutDown(MbimReactor* pThis)
+{
+    StopThreads(pThis, pThis->threadCount);
+    CleanUp(pThis);
+}
+
+int MbimReactor_Attach(MbimReactor* pThis, int fd, MBIM_REACTOR_READ_CALLBACK pCallback,
+    void* pContext, uint32_t* pSlot)
+{
+    uint32_t i;
+    int ret = -1;
+
+    pthread_mutex_lock(&pThis->lock);
+    for (i = 0; i < pThis->maxAttached; i++)
+    {
+        struct MbimReactorSlot* pEntry = &pThis->pSlots[i];
+        if (pEntry->fd >= 0)
+        {
+            continue;
+        }
+        pEntry->fd = fd;
+        pEntry->pCallback = pCallback;
+        pEntry->pContext = pContext;
+        pEntry->busy = false;
+        ret = Arm(pThis, EPOLL_CTL_ADD, i);
+        if (ret < 0)
+        {
+            litembim_log(LOG_ERR, "%s: cannot watch fd %d, errno: %d", __FUNCTION__, fd, errno);
+            pEntry->fd = -1;
+        }
+        *pSlot = i;
+        break;
+    }
+    pthread_mutex_unlock(&pThis->lock);
+
+    if (i == pThis->maxAttached)
+    {
+        litembim_log(LOG_ERR, "%s: all %u slots in use", __FUNCTION__, pThis->maxAttached);
+    }
+    return ret;
+}
+
+void MbimReactor_Detach(MbimReactor* pThis, uint32_t slot)
+{
+    struct MbimReactorSlot* pEntry = &pThis->pSlots[slot];
+
+    pthread_mutex_lock(&pThis->lock);
+    pEntry->generation++;
+    epoll_ctl(pThis->epollFd, EPOLL_CTL_DEL, pEntry->fd, NULL);
+    while (pEntry->busy)
+    {
+        pthread_cond_wait(&pThis->idle, &pThis->lock);
+    }
+    pEntry->fd = -1;
+    pthread_mutex_unlock(&pThis->lock);
+}
@@ -0,0 +1,127 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimReactor.h
+ */
+#ifndef __MBIM_REACTOR_H__
+#define __MBIM_REACTOR_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \ingroup litembim
+ *
+ * Called on a reactor thread when a descriptor is readable.
+ *
+ * @param[in] pContext   Context given to MbimReactor_Attach.
+ *
+ * @return 0 to keep watching the descriptor, < 0 to stop watching it until
+ *         it is detached.
+ */
+typedef int (*MBIM_REACTOR_READ_CALLBACK)(void* pContext);
+
+/**
+ * \ingroup litembim
+ *
+ *  One or more I/O threads servicing the devices of many MBIM transports,
+ *  instead of each transport running a read thread of its own (see
+ *  MbimTransport_InitializeShared).
+ *
+ *  Descriptors are watched with epoll in one-shot mode, so a descriptor is
+ *  serviced by one thread at a time, and its messages are handled in the
+ *  order they arrive. Attached descriptors are kept in a table of slots
+ *  allocated up front; the epoll events carry the slot index and a
+ *  generation, so that events already fetched for a descriptor that has
+ *  since been detached are recognized and ignored.
+ *
+ *  \param  epollFd
+ *          - The epoll instance.
+ *
+ *  \param  shutdownPipe
+ *          - Written to signal the threads to terminate; it then stays
+ *            readable, which wakes all of them.
+ *
+ *  \param  pThreads
+ *          - The I/O threads, threadCount entries.
+ *
+ *  \param  pSlots
+ *          - Attached descriptors, maxAttached entries.
+ *
+ *  \param  lock
+ *          - Protects the slots.
+ *
+ *  \param  idle
+ *          - Signalled when a slot's callback returns.
+ */
+typedef struct MbimReactor
+{
+    int epollFd;
+    int shutdownPipe[2];
+    pthread_t* pThreads;
+    uint32_t threadCount;
+    struct MbimReactorSlot* pSlots;
+    uint32_t maxAttached;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+} MbimReactor;
+
+/**
+ * \ingroup litembim
+ *
+ * Create the epoll instance and start the I/O threads.
+ *
+ * @param[in] pThis        The primary object of this call.
+ * @param[in] threadCount  Number of I/O threads; 1 unless devices are many and busy.
+ * @param[in] maxAttached  Maximum number of descriptors attached at a time.
+ *
+ * @return 0 on success, < 0 on failure.
+ */
+int MbimReactor_Initialize(MbimReactor* pThis, uint32_t threadCount, uint32_t maxAttached);
+
+/**
+ * \ingroup litembim
+ *
+ * Stop the I/O threads. All descriptors must have been detached.
+ *
+ * @param[in] pThis      The primary object of this call.
+ */
+void MbimReactor_ShutDown(MbimReactor* pThis);
+
+/**
+ * \ingroup litembim
+ *
+ * Start watching a descriptor.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] fd         Descriptor to watch for readability.
+ * @param[in] pCallback  Called on an I/O thread whenever fd is readable.
+ * @param[in] pContext   Passed to pCallback.
+ * @param[out] pSlot     Handle for MbimReactor_Detach.
+ *
+ * @return 0 on success, < 0 if all slots are in use or fd cannot be watched.
+ */
+int MbimReactor_Attach(MbimReactor* pThis, int fd, MBIM_REACTOR_READ_CALLBACK pCallback,
+    void* pContext, uint32_t* pSlot);
+
+/**
+ * \ingroup litembim
+ *
+ * Stop watching a descriptor. Once this returns, its callback is not
+ * running and will not be called again. Must not be called from the
+ * descriptor's own callback.
+ *
+ * @param[in] pThis      The primary object of this call.
+ * @param[in] slot       Handle returned by MbimReactor_Attach.
+ */
+void MbimReactor_Detach(MbimReactor* pThis, uint32_t slot);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_REACTOR_H__
@@ -0,0 +1,160 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimTransactionTable.c
+ */
+#include <stdlib.h>
+#include "MbimTransactionTable.h"
+
+// Fibonacci hashing spreads IDs over the table even if they are not
+// handed out sequentially.
+#define MBIM_TRANSACTION_HASH_MULTIPLIER 2654435769u
+
+static inline uint32_t SlotIndex(const MbimTransactionTable* pThis, uint32_t transactionId)
+{
+    return (uint32_t)(transactionId * MBIM_TRANSACTION_HASH_MULTIPLIER) >> pThis->shift;
+}
+
+static inline uint32_t NextSlot(const MbimTransactionTable* pThis, uint32_t index)
+{
+    return (index + 1) & (pThis->capacity - 1);
+}
+
+int MbimTransactionTable_Initialize(MbimTransactionTable* pThis, uint32_t maxTransactions)
+{
+    uint32_t capacity = 2;
+    uint32_t bits = 1;
+
+    if (maxTransactions == 0)
+    {
+        maxTransactions = MBIM_DEFAULT_MAX_TRANSACTIONS;
+    }
+    if (maxTransactions > 0x40000000)
+    {
+        return -1;
+    }
+
+    // Keep the load factor at or below one half.
+    while (capacity < maxTransactions * 2)
+    {
+        capacity <<= 1;
+        bits++;
+    }
+
+    pThis->pSlots = calloc(capacity, sizeof(MbimTransactionSlot));
+    if (pThis->pSlots == NULL)
+    {
+        return -1;
+    }
+    pThis->capacity = capacity;
+    pThis->shift = 32 - bits;
+    pThis->count = 0;
+    pThis->maxCount = maxTransactions;
+
+    return 0;
+}
+
+void MbimTransactionTable_Destroy(MbimTransactionTable* pThis)
+{
+    free(pThis->pSlots);
+    pThis->pSlots = NULL;
+    pThis->capacity = 0;
+    pThis->count = 0;
+    pThis->maxCount = 0;
+}
+
+int MbimTransactionTable_Insert(MbimTransactionTable* pThis, MbimTransaction* pTransaction)
+{
+    uint32_t transactionId = pTransaction->transactionId;
+    uint32_t index;
+
+    if (transactionId == 0 || pThis->count >= pThis->maxCount)
+    {
+        return -1;
+    }
+
+    index = SlotIndex(pThis, transactionId);
+    while (pThis->pSlots[index].transactionId != 0)
+    {
+        if (pThis->pSlots[index].transactionId == transactionId)
+        {
+            return -1;
+        }
+        index = NextSlot(pThis, index);
+    }
+
+    pThis->pSlots[index].transactionId = transactionId;
+    pThis->pSlots[index].pTransaction = pTransaction;
+    pThis->count++;
+
+    return 0;
+}
+
+MbimTransaction* MbimTransactionTable_Find(MbimTransactionTable* pThis, uint32_t transactionId)
+{
+    uint32_t index;
+
+    if (transactionId == 0 || pThis->count == 0)
+    {
+        return NULL;
+    }
+
+    index = SlotIndex(pThis, transactionId);
+    while (pThis->pSlots[index].transactionId != 0)
+    {
+        if (pThis->pSlots[index].transactionId == transactionId)
+        {
+            return pThis->pSlots[index].pTransaction;
+        }
+        index = NextSlot(pThis, index);
+    }
+
+    return NULL;
+}
+
+MbimTransaction* MbimTransactionTable_Remove(MbimTransactionTable* pThis, uint32_t transactionId)
+{
+    MbimTransaction* pRemovedTransaction;
+    uint32_t index;
+    uint32_t next;
+
+    if (transactionId == 0 || pThis->count == 0)
+    {
+        return NULL;
+    }
+
+    index = SlotIndex(pThis, transactionId);
+    while (pThis->pSlots[index].transactionId != transactionId)
+    {
+        if (pThis->pSlots[index].transactionId == 0)
+        {
+            return NULL;
+        }
+        index = NextSlot(pThis, index);
+    }
+
+    pRemovedTransaction = pThis->pSlots[index].pTransaction;
+    pThis->count--;
+
+    // Shift the rest of the probe sequence back, so that no entry ends up
+    // behind an empty slot as seen from its home slot.
+    next = NextSlot(pThis, index);
+    while (pThis->pSlots[next].transactionId != 0)
+    {
+        uint32_t home = SlotIndex(pThis, pThis->pSlots[next].transactionId);
+
+        // The entry at next may move to index unless its home slot lies
+        // cyclically in (index, next].
+        if (((next - home) & (pThis->capacity - 1)) >= ((next - index) & (pThis->capacity - 1)))
+        {
+            pThis->pSlots[index] = pThis->pSlots[next];
+            index = next;
+        }
+        next = NextSlot(pThis, next);
+    }
+
+    pThis->pSlots[index].transactionId = 0;
+    pThis->pSlots[index].pTransaction = NULL;
+
+    return pRemovedTransaction;
+}
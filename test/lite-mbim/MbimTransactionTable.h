@@ -0,0 +1,132 @@
+/**
+ * \ingroup litembim
+ *
+ * \file MbimTransactionTable.h
+ */
+#ifndef __MBIM_TRANSACTION_TABLE_H__
+#define __MBIM_TRANSACTION_TABLE_H__
+
+#include <stdint.h>
+#include "MbimTransaction.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBIM_DEFAULT_MAX_TRANSACTIONS 64  /**< Outstanding transactions per transport, unless configured otherwise. */
+
+/**
+ * \ingroup litembim
+ *
+ *  One slot of the transaction table. The transaction ID is kept next to
+ *  the pointer so that probing never has to touch the transaction itself.
+ *  A transaction ID of 0 marks an empty slot; MBIM never uses it.
+ */
+typedef struct MbimTransactionSlot
+{
+    uint32_t transactionId;
+    MbimTransaction* pTransaction;
+} MbimTransactionSlot;
+
+/**
+ * \ingroup litembim
+ *
+ *  Outstanding transactions, keyed by transaction ID.
+ *
+ *  This is an open addressing hash table with linear probing. All slots are
+ *  allocated up front, for a fixed maximum number of outstanding
+ *  transactions; the table is kept at most half full, so that lookups,
+ *  insertions and removals take constant time. Removal shifts subsequent
+ *  entries back rather than leaving tombstones, so the table does not
+ *  degrade over time.
+ *
+ *  The table does no locking of its own.
+ *
+ *  \param  pSlots
+ *          - Slot array, capacity entries.
+ *
+ *  \param  capacity
+ *          - Number of slots; a power of two.
+ *
+ *  \param  shift
+ *          - Right shift reducing a 32 bit hash to a slot index.
+ *
+ *  \param  count
+ *          - Number of transactions in the table.
+ *
+ *  \param  maxCount
+ *          - Maximum number of transactions in the table.
+ */
+typedef struct MbimTransactionTable
+{
+    MbimTransactionSlot* pSlots;
+    uint32_t capacity;
+    uint32_t shift;
+    uint32_t count;
+    uint32_t maxCount;
+} MbimTransactionTable;
+
+/**
+ * \ingroup litembim
+ *
+ * Allocate the table.
+ *
+ * @param[in] pThis            The primary object of this call.
+ * @param[in] maxTransactions  Maximum number of outstanding transactions.
+ *                             0 selects MBIM_DEFAULT_MAX_TRANSACTIONS.
+ *
+ * @return 0 on success, < 0 on failure.
+ */
+int MbimTransactionTable_Initialize(MbimTransactionTable* pThis, uint32_t maxTransactions);
+
+/**
+ * \ingroup litembim
+ *
+ * Free the table. Transactions still in it are forgotten.
+ *
+ * @param[in] pThis      The primary object of this call.
+ */
+void MbimTransactionTable_Destroy(MbimTransactionTable* pThis);
+
+/**
+ * \ingroup litembim
+ *
+ * Add a transaction, keyed by its transactionId.
+ *
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] pTransaction  Transaction to be added.
+ *
+ * @return 0 on success, < 0 if the table is full, or a transaction with the
+ *         same ID is already outstanding.
+ */
+int MbimTransactionTable_Insert(MbimTransactionTable* pThis, MbimTransaction* pTransaction);
+
+/**
+ * \ingroup litembim
+ *
+ * Look up a transaction.
+ *
+ * @param[in] pThis          The primary object of this call.
+ * @param[in] transactionId  ID of transaction to be found.
+ *
+ * @return The transaction, or NULL if there is none with that ID.
+ */
+MbimTransaction* MbimTransactionTable_Find(MbimTransactionTable* pThis, uint32_t transactionId);
+
+/**
+ * \ingroup litembim
+ *
+ * Remove a transaction.
+ *
+ * @param[in] pThis          The primary object of this call.
+ * @param[in] transactionId  ID of transaction to be removed.
+ *
+ * @return The removed transaction, or NULL if there is none with that ID.
+ */
+MbimTransaction* MbimTransactionTable_Remove(MbimTransactionTable* pThis, uint32_t transactionId);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif //__MBIM_TRANSACTION_TABLE_H__
@@ -11,6 +11,11 @@
 #include <pthread.h>
 #include "MbimIndicator.h"
 #include "MbimTransaction.h"
+#include "MbimTransactionTable.h"
+#include "MbimSlabPool.h"
+#include "MbimReactor.h"
+#include "MbimCapture.h"
+#include "MbimTimerWheel.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,8 +26,10 @@ extern "C" {
 
 #define MBIM_MAX_CIDS 64  /**< Max CIDs per device service. Chosen with some head-room. Current max is 25. */
 
-// TODO: determine at runtime by quering USB descriptor or ioctl to driver.
-#define MBIM_MAX_CTRL_TRANSFER 4096  /**< This value should be determined at run-time. */
+#define MBIM_MAX_CTRL_TRANSFER 4096  /**< Maximum control transfer if the driver cannot report it. */
+#define MBIM_MIN_CTRL_TRANSFER 64    /**< Smallest maximum control transfer MBIM allows. */
+
+#define MBIM_REASSEMBLY_BUFFERS 4  /**< Multi-fragment messages which may be assembled at the same time. */
 
 
 #define MBIM_COMMAND_TYPE_QUERY 0  /**< MBIM query command */	
@@ -35,6 +42,8 @@ extern "C" {
 #define MBIM_STATUS_WRITE_FAILURE   23  /**< The operation failed because of a write failure. */
 #define MBIM_STATUS_CUSTOM_BUILD_FAILURE   0xfffffff0  /**< Failed to build a command payload. */
 #define MBIM_STATUS_CUSTOM_PARSE_FAILURE   0xfffffff1  /**< Failed to parse a response/indication payload. */
+#define MBIM_STATUS_CUSTOM_CANCELLED   0xfffffff2  /**< The transaction was cancelled before a response arrived. */
+#define MBIM_STATUS_CUSTOM_TIMEOUT   0xfffffff3  /**< No response arrived before the transaction's deadline. */
 
 /**
  * \ingroup litembim
@@ -101,23 +110,69 @@ typedef void (*MBIM_TRANSPORT_ERR_CALLBACK)(void * pErrCallbackContext, MBIM_TRA
  *          - Provides mutual exclusion for write operations. 
  *
  *  \param  readThread
- *          - Thread responsible for reading from device. 
+ *          - Thread responsible for reading from device, unless the device
+ *            is serviced by a shared reactor.
+ *
+ *  \param  pReactor
+ *          - Reactor servicing the device, or NULL if the transport runs
+ *            its own read thread.
+ *
+ *  \param  reactorSlot
+ *          - The device's slot in pReactor.
+ *
+ *  \param  timerSlot
+ *          - The timer's slot in pReactor.
  *
  *  \param  transactionId
  *          - MBIM transaction ID. 
  *            Upper limit 0xffffffff. Never 0. Increments for each transaction.
- *             
- *  \param  transactionIdLock
- *          - Mutex to make transactionId access thread-safe. 
+ *            Updated atomically.
+ *
+ *  \param  transactionTable
+ *          - Outstanding transactions, keyed by transaction ID.
  *
- *  \param  transactionList
- *          - Head of linked list of outstanding transactions. 
+ *  \param  transactionTableLock
+ *          - Provides thread safety for the transaction table, the timer
+ *            wheel and the timer.
  *
- *  \param  transactionListLock
- *          - Provides thread safety for the transaction list.
+ *  \param  timerWheel
+ *          - Deadlines of the outstanding transactions that have one.
+ *
+ *  \param  timerFd
+ *          - timerfd armed for the wheel's next expiry, read by the read
+ *            thread or pReactor along with the device.
+ *
+ *  \param  timerArmed
+ *          - Time the timer is armed for, in milliseconds of
+ *            CLOCK_MONOTONIC; UINT64_MAX if disarmed.
+ *
+ *  \param  dispatchLock
+ *          - Held by the read thread while it completes a transaction, so
+ *            that a cancelled transaction's callback is never running once
+ *            MbimTransport_CancelTransaction returns.
  *             
- *  \param  pIncomingMessage
- *          - Private workspace to assemble incoming information fragments.
+ *  \param  maxControlTransfer
+ *          - Largest MBIM message the device accepts or sends, as reported
+ *            by the cdc-wdm driver; MBIM_MAX_CTRL_TRANSFER otherwise.
+ *
+ *  \param  pFrame
+ *          - Buffer of maxControlTransfer bytes in which outgoing fragments
+ *            are assembled. Protected by writeLock.
+ *
+ *  \param  reassemblyPool
+ *          - Buffers to assemble multi-fragment messages in, each
+ *            maxExpectedInformationLength bytes. Used by the read thread only.
+ *
+ *  \param  pIncomingMessages
+ *          - Private state of the multi-fragment messages being assembled,
+ *            MBIM_REASSEMBLY_BUFFERS entries.
+ *
+ *  \param  pReadBuffer
+ *          - Buffer of maxControlTransfer bytes which the device is read
+ *            into; messages are handled in place.
+ *
+ *  \param  readBufferUsed
+ *          - Bytes of an incomplete message at the start of pReadBuffer.
  *             
  *  \param  indicatorList
  *          - Head of linked list of indicators which are called when MBIM indications 
@@ -131,6 +186,12 @@ typedef void (*MBIM_TRANSPORT_ERR_CALLBACK)(void * pErrCallbackContext, MBIM_TRA
  * 
  *  \param  pErrCallbackContext
  *          - User context for MbimTransport error callback
+ *
+ *  \param  pCapture
+ *          - Capture recording the fragments sent and received, or NULL.
+ *
+ *  \param  captureDevice
+ *          - USB device address the fragments are recorded under.
  *             
  */
 typedef struct MbimTransport
@@ -144,15 +205,28 @@ typedef struct MbimTransport
 #endif
     pthread_mutex_t writeLock;  // Protect write operations.
     pthread_t readThread;
+    MbimReactor* pReactor;
+    uint32_t reactorSlot;
+    uint32_t timerSlot;
     uint32_t transactionId;
-    pthread_mutex_t transactionIdLock;
-    MbimTransaction* transactionList;       // Head of list of outstanding transactions.
-    pthread_mutex_t transactionListLock;
-    struct MultiFragmentMessage* pIncomingMessage; // Workspace to assemble incoming fragments.
+    MbimTransactionTable transactionTable;  // Outstanding transactions.
+    pthread_mutex_t transactionTableLock;
+    MbimTimerWheel timerWheel;
+    int timerFd;
+    uint64_t timerArmed;
+    pthread_mutex_t dispatchLock;
+    uint32_t maxControlTransfer;
+    uint8_t* pFrame;    // Outgoing fragment under construction.
+    MbimSlabPool reassemblyPool;
+    struct MultiFragmentMessage* pIncomingMessages; // Messages being assembled.
+    uint8_t* pReadBuffer;
+    uint32_t readBufferUsed;
     MbimIndicator* indicatorList;       // Head of list of indicators.
     pthread_mutex_t indicatorListLock;
     MBIM_TRANSPORT_ERR_CALLBACK pErrCallback;
     void * pErrCallbackContext;
+    MbimCapture* pCapture;
+    uint8_t captureDevice;
 	int initRetry;
 	time_t timeOut;
 } MbimTransport;
@@ -168,11 +242,59 @@ typedef struct MbimTransport
  *       
  * @return 0 on success, < 0 on failure. 
  * 
- * @note   maxExpectedInformationLength is used to allocate a buffer for assembling fragments for
- *         incoming command responses and indications.
+ * @note   maxExpectedInformationLength is the size of the buffers in which multi-fragment
+ *         command responses and indications are assembled; single-fragment ones are
+ *         delivered without being copied.
 */
 int MbimTransport_Initialize(MbimTransport* pThis, char *devicePath, uint32_t maxExpectedInformationLength);
 
+/**
+ * \ingroup litembim
+ * 
+ * Initialize this MBIM transport object, with room for a given number of
+ * outstanding transactions.
+ * 
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] devicePath    Absolute path to device.
+ * @param[in] maxExpectedInformationLength  Maximum expected length of information content.
+ * @param[in] maxTransactions  Maximum number of outstanding transactions. 
+ *                             0 selects MBIM_DEFAULT_MAX_TRANSACTIONS.
+ *       
+ * @return 0 on success, < 0 on failure. 
+ * 
+ * @note   Transaction tracking is allocated up front. MbimTransport_SendCommand fails
+ *         while maxTransactions transactions are outstanding.
+*/
+int MbimTransport_InitializeEx(MbimTransport* pThis, char *devicePath, uint32_t maxExpectedInformationLength,
+    uint32_t maxTransactions);
+
+/**
+ * \ingroup litembim
+ * 
+ * Initialize this MBIM transport object, with its device serviced by a
+ * reactor shared with other transports rather than by a read thread of its
+ * own.
+ * 
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] devicePath    Absolute path to device.
+ * @param[in] maxExpectedInformationLength  Maximum expected length of information content.
+ * @param[in] maxTransactions  Maximum number of outstanding transactions. 
+ *                             0 selects MBIM_DEFAULT_MAX_TRANSACTIONS.
+ * @param[in] pReactor      Initialized reactor, which must outlive the transport.
+ *                          NULL gives the transport a read thread of its own, as
+ *                          with MbimTransport_InitializeEx.
+ *       
+ * @return 0 on success, < 0 on failure. 
+ * 
+ * @note   Done callbacks and indicators then run on the reactor's threads, and
+ *         must not block, since other devices wait for them. In particular,
+ *         MbimTransport_ExecuteCommandSynchronously must not be called from
+ *         them. Each transport takes two of the reactor's slots, one for its
+ *         device and one for its timer.
+*/
+int MbimTransport_InitializeShared(MbimTransport* pThis, char *devicePath,
+    uint32_t maxExpectedInformationLength, uint32_t maxTransactions, MbimReactor* pReactor);
+
 /**
  * \ingroup litembim
  * 
@@ -198,6 +320,7 @@ void MbimTransport_ShutDown(MbimTransport* pThis);
  * @return 0 on success, < 0 on failure. 
  *
  * @note pTransaction must have been initialized with MbimTransaction_Initialize prior to this call.
+ *       It fails if the maximum number of transactions are already outstanding.
  * 
 */
 int MbimTransport_SendCommand( 
@@ -210,6 +333,39 @@ int MbimTransport_SendCommand(
                             MbimTransaction* pTransaction
 						  );
 
+/**
+ * \ingroup litembim
+ * 
+ * Send a MBIM command to the device and return immediately. If no response
+ * arrives within timeoutMs, the transaction is removed and its done callback
+ * invoked with MBIM_STATUS_CUSTOM_TIMEOUT, on the read thread or reactor.
+ * 
+ * @param[in] pThis         The primary object of this call.
+ * @param[in] deviceServiceId Device service UUID which is recipient of command.
+ * @param[in] cid   Command ID (CID) which is specific to that device service.
+ * @param[in] commandType 1 = set, 0 = get.
+ * @param[in] informationBuffer  Buffer of information content.
+ * @param[in] informationBufferLength Size in bytes of information content.
+ * @param[in] pTransaction Transaction object which will track the command/response.
+ * @param[in] timeoutMs  Milliseconds to wait for the response; 0 waits indefinitely,
+ *                       as MbimTransport_SendCommand does.
+ *       
+ * @return 0 on success, < 0 on failure. 
+ *
+ * @note Deadlines are kept in a timer wheel with a resolution of one millisecond,
+ *       so any number of transactions may have one without a thread waiting for each.
+*/
+int MbimTransport_SendCommandWithTimeout(
+    MbimTransport* pThis,
+    const uint8_t* deviceServiceId,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MbimTransaction* pTransaction,
+    uint32_t timeoutMs
+);
+
 /**
  * \ingroup litembim
  * 
@@ -287,6 +443,8 @@ typedef uint32_t (*MBIM_PARSE_CALLBACK)(
  *         Any other MBIM_STATUS_xxx as reported by the device.
  *
  * @note The caller is required to handle any parsing errors in the context of pParseCallback.
+ *       pParseCallback runs on the transport's read thread while the caller is blocked, and parses
+ *       the response in place, without it being copied.
  */
 uint32_t MbimTransport_ExecuteCommandSynchronously(
 	MbimTransport* pTransport,
@@ -300,6 +458,41 @@ uint32_t MbimTransport_ExecuteCommandSynchronously(
 	time_t timeout
 );
 
+/**
+ * Send a MBIM command and wait for its response, for at most a number of
+ * milliseconds.
+ * 
+ * @param[in] pTransport    The primary object of this call.
+ * @param[in] deviceService Device service UUID which is recipient of command.
+ * @param[in] cid   Command ID (CID) which is specific to that device service.
+ * @param[in] commandType 1 = set, 0 = get.
+ * @param[in] informationBuffer  Buffer of information content.
+ * @param[in] informationBufferLength Size in bytes of information content.
+ * @param[in] pParseCallback User supplied callback. This is called only if function returns MBIM_STATUS_SUCCESS.
+ * @param[in] pParseCallbackContext Context for user supplied callback.
+ * @param[in] timeoutMs Milliseconds to wait for the response; 0 waits indefinitely.
+ *       
+ * @return MBIM_STATUS_SUCCESS on success, 
+ *         MBIM_STATUS_WRITE_FAILURE on failure to send command,
+ *         MBIM_STATUS_CUSTOM_TIMEOUT on response timeout,
+ *         Any other MBIM_STATUS_xxx as reported by the device.
+ *
+ * @note The deadline is enforced by the transport's timer wheel (see
+ *       MbimTransport_SendCommandWithTimeout); the caller only waits for the
+ *       transaction to complete one way or the other.
+ */
+uint32_t MbimTransport_ExecuteCommandWithTimeout(
+    MbimTransport* pTransport,
+    const uint8_t* deviceService,
+    uint32_t cid,
+    uint32_t commandType,
+    uint8_t* informationBuffer,
+    uint16_t informationBufferLength,
+    MBIM_PARSE_CALLBACK pParseCallback,
+    void* pParseCallbackContext,
+    uint32_t timeoutMs
+);
+
 /**
  * \ingroup litembim
  * 
@@ -320,6 +513,23 @@ void MbimTransport_RegisterErrCallback(
     void * pErrCallbackContext
 );
 
+/**
+ * \ingroup litembim
+ *
+ * Record every fragment sent to and received from the device in a capture.
+ * If the capture has an error dump path, it is dumped there whenever the
+ * transport reports an error.
+ *
+ * @param[in]   pThis       The primary object of this call.
+ * @param[in]   pCapture    The capture, which may be shared by several
+ *                          transports. NULL to stop recording.
+ *
+ * @return      None
+ *
+ * @note   The capture must stay valid until the transport is shut down.
+ */
+void MbimTransport_AttachCapture(MbimTransport* pThis, MbimCapture* pCapture);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
@@ -0,0 +1,157 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <condition_variable>
+
+#include <gtest/gtest.h>
+
+#include "mbim_fake_modem.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+
+
+TEST(MbimAsync, future)
+{
+  fake_modem modem;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  auto radio = async.submit(radio_state_query());
+  ASSERT_EQ(std::future_status::ready, radio.wait_for(TIMEOUT));
+  auto state = radio.get();
+  ASSERT_EQ(MBIMRadioOn, state.hw);
+  ASSERT_EQ(MBIMRadioOn, state.sw);
+  ASSERT_EQ(0, async.outstanding());
+}
+
+
+
+TEST(MbimAsync, callback_error_status)
+{
+  fake_modem modem;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool done = false;
+  std::uint32_t status = 0;
+
+  async.submit(pin_query(), [&](std::uint32_t st, pin_state const &)
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        status = st;
+        done = true;
+        cond.notify_one();
+      });
+
+  std::unique_lock<std::mutex> lock{mutex};
+  ASSERT_TRUE(cond.wait_for(lock, TIMEOUT, [&] { return done; }));
+  ASSERT_EQ(STATUS_NOT_SUPPORTED, status);
+}
+
+
+
+TEST(MbimAsync, pipelined_poll)
+{
+  // The modem answers only once all six queries are in flight.
+  fake_modem modem;
+  modem.hold = 6;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  auto poll = poll_status(async, 1);
+
+  ASSERT_EQ(std::future_status::ready, poll.ip.wait_for(TIMEOUT));
+  ASSERT_EQ(MBIMRadioOn, poll.radio.get().sw);
+
+  auto packet = poll.packet.get();
+  ASSERT_EQ(MBIMPacketServiceStateAttached, packet.state);
+  ASSERT_EQ(50000000, packet.uplink_speed);
+  ASSERT_EQ(150000000, packet.downlink_speed);
+
+  auto connection = poll.connection.get();
+  ASSERT_EQ(1, connection.session_id);
+  ASSERT_EQ(MBIMActivationStateActivated, connection.activation_state);
+
+  try {
+    poll.registration.get();
+    FAIL() << "expected mbim_error";
+  } catch (mbim_error const & err) {
+    ASSERT_EQ(STATUS_NOT_SUPPORTED, err.status());
+  }
+  ASSERT_THROW(poll.subscriber.get(), mbim_error);
+  ASSERT_THROW(poll.ip.get(), mbim_error);
+}
+
+
+
+TEST(MbimAsync, cancel)
+{
+  fake_modem modem;
+  modem.ignore_cid = CID_RADIO_STATE;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  auto cmd = radio_state_query();
+  std::uint32_t status = 0;
+  auto id = async.submit(cmd, [&](std::uint32_t st, radio_state const &)
+      {
+        status = st;
+      });
+  ASSERT_EQ(1, async.outstanding());
+
+  ASSERT_TRUE(async.cancel(id));
+  ASSERT_EQ(MBIM_STATUS_CUSTOM_CANCELLED, status);
+  ASSERT_EQ(0, async.outstanding());
+  ASSERT_FALSE(async.cancel(id));
+
+  // Destroying the async transport cancels the rest.
+  std::future<radio_state> pending;
+  {
+    async_transport other{tr.t};
+    pending = other.submit(cmd);
+  }
+  ASSERT_EQ(std::future_status::ready, pending.wait_for(std::chrono::seconds{0}));
+  ASSERT_THROW(pending.get(), mbim_error);
+}
+
+
+
+TEST(MbimAsync, batch_send_failure)
+{
+  fake_modem modem;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  // Every command of the batch fails to send, and is completed as such.
+  tr.t.devRemoved = true;
+  command_batch batch{async};
+  auto radio = batch.add(radio_state_query());
+  auto packet = batch.add(packet_service_query());
+  auto ids = batch.submit();
+  tr.t.devRemoved = false;
+
+  ASSERT_EQ(2, ids.size());
+  ASSERT_EQ(0, ids[0]);
+  ASSERT_EQ(0, ids[1]);
+  ASSERT_EQ(0, async.outstanding());
+  ASSERT_EQ(std::future_status::ready, radio.wait_for(std::chrono::seconds{0}));
+  ASSERT_EQ(std::future_status::ready, packet.wait_for(std::chrono::seconds{0}));
+  try {
+    radio.get();
+    FAIL() << "expected mbim_error";
+  } catch (mbim_error const & err) {
+    ASSERT_EQ(MBIM_STATUS_WRITE_FAILURE, err.status());
+  }
+  ASSERT_THROW(packet.get(), mbim_error);
+}
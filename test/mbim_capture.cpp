@@ -0,0 +1,258 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr auto TIMEOUT = 5s;
+
+// MbimInternal.h is private to the transport.
+static constexpr std::uint32_t COMMAND_MSG = 0x00000003;
+static constexpr std::uint32_t COMMAND_DONE_MSG = 0x80000003;
+
+struct capture_guard
+{
+  MbimCapture c;
+
+  inline capture_guard(std::uint32_t slots, std::uint32_t snap_length,
+      char const * error_dump_path = nullptr)
+  {
+    if (MbimCapture_Initialize(&c, slots, snap_length, error_dump_path) < 0) {
+      throw std::runtime_error{"MbimCapture_Initialize failed"};
+    }
+  }
+
+  inline ~capture_guard()
+  {
+    MbimCapture_Destroy(&c);
+  }
+};
+
+
+/**
+ * A packet of a pcapng file, with its usbmon header split off.
+ */
+struct packet
+{
+  std::uint64_t             timestamp;
+  std::uint32_t             original_length;
+  char                      type;
+  std::uint8_t              epnum;
+  std::uint8_t              devnum;
+  std::uint8_t              setup[8];
+  std::uint32_t             length;
+  std::vector<std::uint8_t> data;
+};
+
+
+template <typename T>
+T
+read_at(std::vector<std::uint8_t> const & file, std::size_t offset)
+{
+  T value;
+  std::memcpy(&value, file.data() + offset, sizeof(value));
+  return value;
+}
+
+
+/**
+ * Check the pcapng file's headers, and return its packets.
+ */
+std::vector<packet>
+read_pcapng(std::string const & path)
+{
+  std::ifstream in{path, std::ios::binary};
+  std::vector<std::uint8_t> file{std::istreambuf_iterator<char>{in}, {}};
+  std::vector<packet> packets;
+
+  EXPECT_EQ(0x0A0D0D0Au, read_at<std::uint32_t>(file, 0));
+  EXPECT_EQ(0x1A2B3C4Du, read_at<std::uint32_t>(file, 8));
+  std::size_t offset = read_at<std::uint32_t>(file, 4);
+
+  EXPECT_EQ(1u, read_at<std::uint32_t>(file, offset));
+  EXPECT_EQ(220, read_at<std::uint16_t>(file, offset + 8));
+  // if_tsresol: nanoseconds.
+  EXPECT_EQ(9, read_at<std::uint16_t>(file, offset + 16));
+  EXPECT_EQ(9, file[offset + 20]);
+  offset += read_at<std::uint32_t>(file, offset + 4);
+
+  while (offset < file.size()) {
+    auto type = read_at<std::uint32_t>(file, offset);
+    auto length = read_at<std::uint32_t>(file, offset + 4);
+    EXPECT_EQ(6u, type);
+    EXPECT_EQ(length, read_at<std::uint32_t>(file, offset + length - 4));
+
+    packet p;
+    p.timestamp = std::uint64_t{read_at<std::uint32_t>(file, offset + 12)} << 32
+      | read_at<std::uint32_t>(file, offset + 16);
+    auto captured = read_at<std::uint32_t>(file, offset + 20);
+    p.original_length = read_at<std::uint32_t>(file, offset + 24);
+
+    auto usb = offset + 28;
+    p.type = static_cast<char>(file[usb + 8]);
+    p.epnum = file[usb + 10];
+    p.devnum = file[usb + 11];
+    std::memcpy(p.setup, file.data() + usb + 40, sizeof(p.setup));
+    p.length = read_at<std::uint32_t>(file, usb + 32);
+    p.data.assign(file.begin() + usb + 64, file.begin() + usb + captured);
+    packets.push_back(std::move(p));
+
+    offset += length;
+  }
+  EXPECT_EQ(file.size(), offset);
+  return packets;
+}
+
+
+std::string
+temp_path(char const * name)
+{
+  return std::string{"/tmp/"} + name + "." + std::to_string(getpid()) + ".pcapng";
+}
+
+} // anonymous namespace
+
+
+TEST(MbimCapture, keeps_most_recent)
+{
+  capture_guard capture{3, 16};
+  ASSERT_EQ(4, capture.c.slotCount);
+
+  std::uint8_t fragment[32];
+  for (std::uint8_t i = 0 ; i < 10 ; ++i) {
+    std::fill(std::begin(fragment), std::end(fragment), i);
+    MbimCapture_Record(&capture.c, 1, MBIM_CAPTURE_SENT, fragment, 12 + i);
+  }
+
+  auto path = temp_path("keeps_most_recent");
+  ASSERT_EQ(4, MbimCapture_Dump(&capture.c, path.c_str()));
+  auto packets = read_pcapng(path);
+  std::remove(path.c_str());
+
+  ASSERT_EQ(4, packets.size());
+  for (std::uint8_t i = 0 ; i < 4 ; ++i) {
+    auto const & p = packets[i];
+    std::uint32_t length = 12 + 6 + i;
+    ASSERT_EQ('S', p.type);
+    ASSERT_EQ(0x21, p.setup[0]);
+    ASSERT_EQ(length, p.length);
+    ASSERT_EQ(64 + length, p.original_length);
+    // Truncated to the snap length.
+    ASSERT_EQ(std::vector<std::uint8_t>(std::min(length, 16u), 6 + i), p.data);
+    if (i > 0) {
+      ASSERT_LE(packets[i - 1].timestamp, p.timestamp);
+    }
+  }
+}
+
+
+
+TEST(MbimCapture, records_transactions)
+{
+  capture_guard capture{0, 0};
+  mbim_simulator sim;
+  sim.start();
+  MbimTransport t;
+  std::memset(&t, 0, sizeof(t));
+  ASSERT_EQ(0, MbimTransport_Initialize(&t, sim.path(), 4096));
+  MbimTransport_AttachCapture(&t, &capture.c);
+  {
+    async_transport async{t};
+    auto future = async.submit(radio_state_query());
+    ASSERT_EQ(std::future_status::ready, future.wait_for(TIMEOUT));
+  }
+  MbimTransport_ShutDown(&t);
+
+  auto path = temp_path("records_transactions");
+  // The command, its response, and the MBIM_CLOSE_MSG and its response.
+  ASSERT_EQ(4, MbimCapture_Dump(&capture.c, path.c_str()));
+  auto packets = read_pcapng(path);
+  std::remove(path.c_str());
+
+  // A command goes out as a SEND_ENCAPSULATED_COMMAND, and its response
+  // comes in as a GET_ENCAPSULATED_RESPONSE.
+  ASSERT_EQ(6, packets.size());
+  auto const & command = packets[0];
+  ASSERT_EQ('S', command.type);
+  ASSERT_EQ(0x00, command.epnum);
+  ASSERT_EQ(0x21, command.setup[0]);
+  ASSERT_EQ(0x00, command.setup[1]);
+  ASSERT_EQ(1, command.devnum);
+  ASSERT_EQ(command.length, read_at<std::uint32_t>(command.data, 4));
+  ASSERT_EQ(COMMAND_MSG, read_at<std::uint32_t>(command.data, 0));
+  ASSERT_EQ(0, std::memcmp(BasicConnectDeviceService_Uuid(), command.data.data() + 20,
+      MBIM_UUID_SIZE));
+
+  ASSERT_EQ('S', packets[1].type);
+  ASSERT_EQ(0xA1, packets[1].setup[0]);
+  ASSERT_EQ(0x01, packets[1].setup[1]);
+  ASSERT_TRUE(packets[1].data.empty());
+
+  auto const & response = packets[2];
+  ASSERT_EQ('C', response.type);
+  ASSERT_EQ(0x80, response.epnum);
+  ASSERT_EQ(COMMAND_DONE_MSG, read_at<std::uint32_t>(response.data, 0));
+  ASSERT_EQ(read_at<std::uint32_t>(command.data, 8), read_at<std::uint32_t>(response.data, 8));
+  ASSERT_LE(command.timestamp, response.timestamp);
+}
+
+
+
+TEST(MbimCapture, dumps_on_error)
+{
+  auto path = temp_path("dumps_on_error");
+  std::remove(path.c_str());
+  capture_guard capture{0, 0, path.c_str()};
+  auto sim = std::make_unique<mbim_simulator>();
+  sim->start();
+  MbimTransport t;
+  std::memset(&t, 0, sizeof(t));
+  ASSERT_EQ(0, MbimTransport_Initialize(&t, sim->path(), 4096));
+  MbimTransport_AttachCapture(&t, &capture.c);
+  std::atomic<bool> failed{false};
+  MbimTransport_RegisterErrCallback(&t,
+      [](void * context, MBIM_TRANSPORT_ERR_INFO)
+      {
+        *static_cast<std::atomic<bool> *>(context) = true;
+      }, &failed);
+  {
+    async_transport async{t};
+    auto future = async.submit(radio_state_query());
+    ASSERT_EQ(std::future_status::ready, future.wait_for(TIMEOUT));
+  }
+
+  // The device goes away; the capture is dumped before the error is
+  // reported.
+  sim.reset();
+  auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+  while (!failed && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_TRUE(failed);
+  auto packets = read_pcapng(path);
+  MbimTransport_ShutDown(&t);
+  std::remove(path.c_str());
+
+  ASSERT_EQ(3, packets.size());
+  ASSERT_EQ(COMMAND_MSG, read_at<std::uint32_t>(packets[0].data, 0));
+  ASSERT_EQ(COMMAND_DONE_MSG, read_at<std::uint32_t>(packets[2].data, 0));
+}
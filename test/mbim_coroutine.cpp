@@ -0,0 +1,186 @@
+/*
+ *
+ */
+
+#include "mbim/bring_up.h"
+
+#include <linkmanager/reactor.h>
+
+#include <gtest/gtest.h>
+
+#include "mbim_fake_modem.h"
+
+using namespace linkmanager;
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+/**
+ * A modem that answers everything bring-up asks for.
+ */
+struct ready_modem : public fake_modem
+{
+  inline ready_modem()
+  {
+    replies[CID_DEVICE_SERVICE_SUBSCRIBE_LIST] = {MBIM_STATUS_SUCCESS, {0}};
+    replies[CID_PIN] = {MBIM_STATUS_SUCCESS, {MBIMPinTypeNone, MBIMPinStateUnlocked, 0}};
+    replies[CID_REGISTER_STATE] = {MBIM_STATUS_SUCCESS,
+      {0, MBIMRegisterStateHome, MBIMRegisterModeAutomatic, 0x20, 1, 0, 0, 0, 0, 0, 0, 0}};
+    replies[CID_IP_CONFIGURATION] = {MBIM_STATUS_SUCCESS, std::vector<std::uint32_t>(15, 0)};
+  }
+};
+
+
+/**
+ * Run bring-up for each context on one loop, returning the exception each
+ * bring-up exited with.
+ */
+std::vector<std::exception_ptr>
+run_bring_up(reactor & loop, std::vector<coroutine_context *> const & contexts,
+    bring_up_parameters const & params,
+    std::vector<bring_up_result> * results = nullptr)
+{
+  std::vector<std::exception_ptr> errors(contexts.size());
+  if (results) {
+    results->resize(contexts.size());
+  }
+  std::size_t remaining = contexts.size();
+
+  for (std::size_t i = 0 ; i < contexts.size() ; ++i) {
+    auto p = params;
+    p.session_id = static_cast<std::uint32_t>(i);
+    spawn(loop, bring_up(*contexts[i], p),
+        std::function<void (std::exception_ptr, bring_up_result)>{
+          [&, i](std::exception_ptr error, bring_up_result result)
+          {
+            errors[i] = error;
+            if (results) {
+              (*results)[i] = std::move(result);
+            }
+            if (!--remaining) {
+              loop.stop();
+            }
+          }});
+  }
+
+  auto guard = loop.add_timer(TIMEOUT, {}, [&loop]() { loop.stop(); });
+  loop.run();
+  loop.remove(guard);
+  EXPECT_EQ(0, remaining);
+  return errors;
+}
+
+} // anonymous namespace
+
+
+TEST(MbimCoroutine, many_modems_one_thread)
+{
+  static constexpr std::size_t MODEMS = 8;
+
+  std::vector<std::unique_ptr<ready_modem>> modems;
+  std::vector<std::unique_ptr<transport>> transports;
+  std::vector<std::unique_ptr<async_transport>> asyncs;
+  std::vector<std::unique_ptr<coroutine_context>> contexts;
+  std::vector<coroutine_context *> ptrs;
+
+  reactor loop;
+  for (std::size_t i = 0 ; i < MODEMS ; ++i) {
+    modems.push_back(std::make_unique<ready_modem>());
+    modems.back()->start();
+    transports.push_back(std::make_unique<transport>(*modems.back()));
+    asyncs.push_back(std::make_unique<async_transport>(transports.back()->t));
+    contexts.push_back(std::make_unique<coroutine_context>(*asyncs.back(), loop));
+    ptrs.push_back(contexts.back().get());
+  }
+
+  std::vector<bring_up_result> results;
+  auto errors = run_bring_up(loop, ptrs, {}, &results);
+
+  for (std::size_t i = 0 ; i < MODEMS ; ++i) {
+    ASSERT_FALSE(errors[i]);
+    ASSERT_EQ(MBIMRegisterStateHome, results[i].registration.state);
+    ASSERT_EQ(MBIMPacketServiceStateAttached, results[i].packet.state);
+    ASSERT_EQ(i, results[i].connection.session_id);
+    ASSERT_EQ(i, results[i].ip.session_id);
+    ASSERT_EQ(0, contexts[i]->outstanding());
+  }
+
+  // Contexts go before the transports they use.
+  contexts.clear();
+  asyncs.clear();
+  transports.clear();
+}
+
+
+
+TEST(MbimCoroutine, command_timeout)
+{
+  ready_modem modem;
+  modem.ignore_cid = CID_CONNECT;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+  reactor loop;
+  coroutine_context ctx{async, loop};
+
+  bring_up_parameters params;
+  params.command_timeout = 50ms;
+  auto errors = run_bring_up(loop, {&ctx}, params);
+
+  try {
+    std::rethrow_exception(errors[0]);
+  } catch (mbim_error const & err) {
+    ASSERT_EQ(MBIM_STATUS_READ_FAILURE, err.status());
+  }
+  ASSERT_EQ(0, ctx.outstanding());
+  ASSERT_EQ(0, async.outstanding());
+  ASSERT_EQ(0, tr.t.transactionTable.count);
+}
+
+
+
+TEST(MbimCoroutine, registration_timeout)
+{
+  ready_modem modem;
+  modem.replies[CID_REGISTER_STATE].info[1] = MBIMRegisterStateSearching;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+  reactor loop;
+  coroutine_context ctx{async, loop};
+
+  bring_up_parameters params;
+  params.register_timeout = 100ms;
+  params.register_poll_interval = 20ms;
+  auto errors = run_bring_up(loop, {&ctx}, params);
+
+  ASSERT_THROW(std::rethrow_exception(errors[0]), std::runtime_error);
+  ASSERT_EQ(0, ctx.outstanding());
+}
+
+
+
+TEST(MbimCoroutine, cancel)
+{
+  ready_modem modem;
+  modem.replies[CID_REGISTER_STATE].info[1] = MBIMRegisterStateSearching;
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+  reactor loop;
+  coroutine_context ctx{async, loop};
+
+  // Cancel while bring-up waits for registration.
+  loop.add_timer(50ms, {}, [&ctx]() { ctx.cancel(); });
+  auto errors = run_bring_up(loop, {&ctx}, {});
+
+  try {
+    std::rethrow_exception(errors[0]);
+  } catch (mbim_error const & err) {
+    ASSERT_EQ(MBIM_STATUS_CUSTOM_CANCELLED, err.status());
+  }
+  ASSERT_EQ(0, ctx.outstanding());
+  ASSERT_EQ(0, async.outstanding());
+}
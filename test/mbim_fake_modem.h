@@ -0,0 +1,303 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_TEST_MBIM_FAKE_MODEM_H
+#define LINKMANAGER_TEST_MBIM_FAKE_MODEM_H
+
+#include "lite-mbim/MbimTransport.h"
+#include "lite-mbim/BasicConnectDeviceService.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace test {
+
+// Basic Connect CIDs
+static constexpr std::uint32_t CID_SUBSCRIBER_READY_STATUS = 2;
+static constexpr std::uint32_t CID_RADIO_STATE = 3;
+static constexpr std::uint32_t CID_PIN = 4;
+static constexpr std::uint32_t CID_REGISTER_STATE = 9;
+static constexpr std::uint32_t CID_PACKET_SERVICE = 10;
+static constexpr std::uint32_t CID_SIGNAL_STATE = 11;
+static constexpr std::uint32_t CID_CONNECT = 12;
+static constexpr std::uint32_t CID_IP_CONFIGURATION = 15;
+static constexpr std::uint32_t CID_DEVICE_SERVICE_SUBSCRIBE_LIST = 19;
+
+static constexpr std::uint32_t STATUS_NOT_SUPPORTED = 9;
+
+static constexpr auto TIMEOUT = std::chrono::seconds{5};
+
+
+inline void
+put32(std::vector<std::uint8_t> & buf, std::uint32_t value)
+{
+  for (int i = 0 ; i < 4 ; ++i) {
+    buf.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+
+
+inline std::uint32_t
+get32(std::uint8_t const * buf)
+{
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16)
+    | (static_cast<std::uint32_t>(buf[3]) << 24);
+}
+
+
+/**
+ * A modem on the master side of a pty. It answers open and close, and
+ * commands from the `replies` table; commands without an entry fail with
+ * STATUS_NOT_SUPPORTED. For connect and IP configuration, the first word of
+ * the reply is replaced with the session ID of the request.
+ *
+ * Command responses are held back until `hold` commands have been received,
+ * so that a caller waiting for each response before sending the next command
+ * never gets one. Commands with `ignore_cid` are never answered.
+ *
+ * If `max_transfer` is set, responses are split into fragments of at most
+ * that many bytes, and the fragments of all held responses are sent
+ * interleaved, together with those of `indication` if it is set.
+ */
+struct fake_modem
+{
+  int             master = -1;
+  int             slave = -1;
+  char            name[64] = {};
+  std::thread     thread;
+
+  struct reply
+  {
+    std::uint32_t               status = MBIM_STATUS_SUCCESS;
+    std::vector<std::uint32_t>  info;
+  };
+
+  std::map<std::uint32_t, reply>  replies;
+  std::size_t                     hold = 1;
+  std::uint32_t                   ignore_cid = 0;
+  std::size_t                     max_transfer = 0;
+  std::vector<std::uint32_t>      indication;
+
+  inline fake_modem()
+  {
+    replies[CID_RADIO_STATE] = {MBIM_STATUS_SUCCESS, {MBIMRadioOn, MBIMRadioOn}};
+    replies[CID_PACKET_SERVICE] = {MBIM_STATUS_SUCCESS,
+      {0, MBIMPacketServiceStateAttached, 0x20, 50000000, 0, 150000000, 0}};
+    replies[CID_CONNECT] = {MBIM_STATUS_SUCCESS,
+      {0, MBIMActivationStateActivated, 0, MBIMContextIPTypeIPv4, 0, 0, 0, 0, 0}};
+
+    if (openpty(&master, &slave, name, nullptr, nullptr) < 0) {
+      throw std::runtime_error{"openpty failed"};
+    }
+    for (int fd : {master, slave}) {
+      termios t;
+      tcgetattr(fd, &t);
+      cfmakeraw(&t);
+      tcsetattr(fd, TCSANOW, &t);
+    }
+  }
+
+  inline ~fake_modem()
+  {
+    // Reads on the master fail once no slave is open any longer; the
+    // transport is expected to have closed its end already.
+    close(slave);
+    if (thread.joinable()) {
+      thread.join();
+    }
+    close(master);
+  }
+
+  inline void start()
+  {
+    thread = std::thread{[this] { run(); }};
+  }
+
+  inline void send(std::vector<std::uint8_t> msg)
+  {
+    auto length = static_cast<std::uint32_t>(msg.size());
+    for (int i = 0 ; i < 4 ; ++i) {
+      msg[4 + i] = static_cast<std::uint8_t>(length >> (8 * i));
+    }
+    if (write(master, msg.data(), msg.size()) != static_cast<ssize_t>(msg.size())) {
+      throw std::runtime_error{"write failed"};
+    }
+  }
+
+  /**
+   * Split a command done or indicate status message into fragments of at
+   * most max_transfer bytes.
+   */
+  inline std::vector<std::vector<std::uint8_t>> fragment(std::vector<std::uint8_t> const & msg)
+  {
+    static constexpr std::size_t FRAGMENT_HEADER = 20;
+    std::size_t const first = max_transfer;
+    std::size_t const next = max_transfer - FRAGMENT_HEADER;
+    std::size_t const total = msg.size() <= first ? 1 : 1 + (msg.size() - first + next - 1) / next;
+
+    std::vector<std::vector<std::uint8_t>> fragments;
+    std::size_t offset = std::min(first, msg.size());
+    fragments.emplace_back(msg.begin(), msg.begin() + static_cast<std::ptrdiff_t>(offset));
+    for (std::size_t i = 1 ; i < total ; ++i) {
+      auto n = std::min(next, msg.size() - offset);
+      std::vector<std::uint8_t> frag;
+      put32(frag, get32(msg.data()));
+      put32(frag, 0);
+      put32(frag, get32(msg.data() + 8));
+      put32(frag, static_cast<std::uint32_t>(total));
+      put32(frag, static_cast<std::uint32_t>(i));
+      frag.insert(frag.end(), msg.begin() + static_cast<std::ptrdiff_t>(offset),
+          msg.begin() + static_cast<std::ptrdiff_t>(offset + n));
+      fragments.push_back(std::move(frag));
+      offset += n;
+    }
+    for (std::size_t i = 0 ; i < 4 ; ++i) {
+      fragments[0][12 + i] = static_cast<std::uint8_t>(total >> (8 * i));
+    }
+    return fragments;
+  }
+
+  inline void send_all(std::vector<std::vector<std::uint8_t>> msgs)
+  {
+    if (!max_transfer) {
+      for (auto & msg : msgs) {
+        send(std::move(msg));
+      }
+      return;
+    }
+
+    if (!indication.empty()) {
+      std::vector<std::uint8_t> msg;
+      put32(msg, 0x80000007); // indicate status
+      put32(msg, 0);
+      put32(msg, 0);
+      put32(msg, 1);
+      put32(msg, 0);
+      auto uuid = BasicConnectDeviceService_Uuid();
+      msg.insert(msg.end(), uuid, uuid + MBIM_UUID_SIZE);
+      put32(msg, CID_SIGNAL_STATE);
+      put32(msg, static_cast<std::uint32_t>(indication.size() * 4));
+      for (auto v : indication) {
+        put32(msg, v);
+      }
+      msgs.push_back(std::move(msg));
+    }
+
+    // Round robin over the fragments of all messages.
+    std::vector<std::vector<std::vector<std::uint8_t>>> fragmented;
+    for (auto const & msg : msgs) {
+      fragmented.push_back(fragment(msg));
+    }
+    for (std::size_t i = 0 ; ; ++i) {
+      bool sent = false;
+      for (auto & fragments : fragmented) {
+        if (i < fragments.size()) {
+          send(std::move(fragments[i]));
+          sent = true;
+        }
+      }
+      if (!sent) {
+        break;
+      }
+    }
+  }
+
+  inline std::vector<std::uint8_t> response(std::uint8_t const * cmd)
+  {
+    auto cid = get32(cmd + 36);
+
+    reply r{STATUS_NOT_SUPPORTED, {}};
+    auto iter = replies.find(cid);
+    if (iter != replies.end()) {
+      r = iter->second;
+    }
+    if ((cid == CID_CONNECT || cid == CID_IP_CONFIGURATION) && !r.info.empty()) {
+      r.info[0] = get32(cmd + 48);
+    }
+
+    std::vector<std::uint8_t> msg;
+    put32(msg, 0x80000003); // command done
+    put32(msg, 0);
+    put32(msg, get32(cmd + 8));
+    put32(msg, 1);
+    put32(msg, 0);
+    msg.insert(msg.end(), cmd + 20, cmd + 36);
+    put32(msg, cid);
+    put32(msg, r.status);
+    put32(msg, static_cast<std::uint32_t>(r.info.size() * 4));
+    for (auto v : r.info) {
+      put32(msg, v);
+    }
+    return msg;
+  }
+
+  inline void run()
+  {
+    std::vector<std::uint8_t> buf;
+    std::vector<std::vector<std::uint8_t>> held;
+    std::uint8_t chunk[4096];
+
+    for (;;) {
+      auto r = read(master, chunk, sizeof(chunk));
+      if (r <= 0) {
+        return;
+      }
+      buf.insert(buf.end(), chunk, chunk + r);
+
+      while (buf.size() >= 12 && get32(buf.data() + 4) <= buf.size()) {
+        auto type = get32(buf.data());
+        auto length = get32(buf.data() + 4);
+
+        if (type == 1 || type == 2) { // open, close
+          std::vector<std::uint8_t> msg;
+          put32(msg, type | 0x80000000);
+          put32(msg, 0);
+          put32(msg, get32(buf.data() + 8));
+          put32(msg, MBIM_STATUS_SUCCESS);
+          send(msg);
+        }
+        else if (type == 3 && get32(buf.data() + 36) != ignore_cid) {
+          held.push_back(response(buf.data()));
+          if (held.size() >= hold) {
+            send_all(std::move(held));
+            held.clear();
+          }
+        }
+
+        buf.erase(buf.begin(), buf.begin() + length);
+      }
+    }
+  }
+};
+
+
+struct transport
+{
+  MbimTransport t;
+
+  inline explicit transport(fake_modem & modem)
+  {
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_Initialize(&t, modem.name, 4096) < 0) {
+      throw std::runtime_error{"MbimTransport_Initialize failed"};
+    }
+  }
+
+  inline ~transport()
+  {
+    MbimTransport_ShutDown(&t);
+  }
+};
+
+} // namespace test
+
+#endif // guard
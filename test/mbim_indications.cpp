@@ -0,0 +1,145 @@
+/*
+ *
+ */
+
+#include "mbim/indications.h"
+
+#include <linkmanager/reactor.h>
+
+#include <gtest/gtest.h>
+
+#include "mbim_fake_modem.h"
+
+using namespace linkmanager;
+using namespace linkmanager::mbim;
+using namespace test;
+
+namespace {
+
+/**
+ * Run the loop until the tasks posted so far are done.
+ */
+void
+run_posted(reactor & loop)
+{
+  loop.post([&loop]() { loop.stop(); });
+  loop.run();
+}
+
+} // anonymous namespace
+
+
+TEST(MbimIndications, by_cid_and_wildcard)
+{
+  reactor loop;
+  indication_dispatcher dispatcher;
+  auto service = BasicConnectDeviceService_Uuid();
+
+  std::vector<indication> exact, any;
+  dispatcher.subscribe(service, CID_SIGNAL_STATE, loop,
+      [&exact](indication const & ind) { exact.push_back(ind); });
+  dispatcher.subscribe(service, indication_dispatcher::ANY_CID, loop,
+      [&any](indication const & ind) { any.push_back(ind); });
+
+  std::uint8_t info[] = {1, 2, 3, 4};
+  dispatcher.dispatch(service, CID_SIGNAL_STATE, info, sizeof(info));
+  dispatcher.dispatch(service, CID_REGISTER_STATE, info, 2);
+
+  // Nothing runs on the read thread.
+  ASSERT_TRUE(exact.empty());
+  ASSERT_TRUE(any.empty());
+
+  run_posted(loop);
+
+  ASSERT_EQ(1, exact.size());
+  ASSERT_EQ(CID_SIGNAL_STATE, exact[0].cid);
+  ASSERT_EQ(std::vector<std::uint8_t>(info, info + 4), *exact[0].payload);
+  ASSERT_TRUE(std::equal(service, service + MBIM_UUID_SIZE, exact[0].service.begin()));
+
+  ASSERT_EQ(2, any.size());
+  ASSERT_EQ(CID_SIGNAL_STATE, any[0].cid);
+  ASSERT_EQ(CID_REGISTER_STATE, any[1].cid);
+  ASSERT_EQ(2, any[1].payload->size());
+
+  // Subscribers share the payload.
+  ASSERT_EQ(exact[0].payload.get(), any[0].payload.get());
+}
+
+
+
+TEST(MbimIndications, unsubscribe)
+{
+  reactor loop;
+  indication_dispatcher dispatcher;
+  auto service = BasicConnectDeviceService_Uuid();
+
+  int count = 0;
+  auto id = dispatcher.subscribe(service, CID_SIGNAL_STATE, loop,
+      [&count](indication const &) { ++count; });
+
+  std::uint8_t info[] = {1, 2, 3, 4};
+  dispatcher.dispatch(service, CID_SIGNAL_STATE, info, sizeof(info));
+
+  // Queued, but not yet delivered.
+  ASSERT_TRUE(dispatcher.unsubscribe(id));
+  ASSERT_FALSE(dispatcher.unsubscribe(id));
+  dispatcher.dispatch(service, CID_SIGNAL_STATE, info, sizeof(info));
+  run_posted(loop);
+
+  ASSERT_EQ(0, count);
+}
+
+
+
+TEST(MbimIndications, full_queue_drops)
+{
+  reactor loop;
+  indication_dispatcher dispatcher;
+  auto service = BasicConnectDeviceService_Uuid();
+
+  std::vector<std::uint8_t> seen;
+  dispatcher.subscribe(service, CID_SIGNAL_STATE, loop,
+      [&seen](indication const & ind) { seen.push_back((*ind.payload)[0]); }, 4);
+
+  for (std::uint8_t i = 0 ; i < 10 ; ++i) {
+    dispatcher.dispatch(service, CID_SIGNAL_STATE, &i, 1);
+  }
+  ASSERT_EQ(6, dispatcher.dropped());
+
+  run_posted(loop);
+  ASSERT_EQ((std::vector<std::uint8_t>{0, 1, 2, 3}), seen);
+}
+
+
+
+TEST(MbimIndications, stalled_subscriber_does_not_stall_responses)
+{
+  static constexpr int COMMANDS = 50;
+  static constexpr std::size_t QUEUE = 16;
+
+  fake_modem modem;
+  modem.max_transfer = 4096;
+  modem.indication = {1, 2, 3};
+  modem.start();
+  transport tr{modem};
+  indication_dispatcher dispatcher{tr.t};
+
+  // The loop never runs, so the subscriber never drains its queue.
+  reactor loop;
+  int count = 0;
+  dispatcher.subscribe(BasicConnectDeviceService_Uuid(), CID_SIGNAL_STATE, loop,
+      [&count](indication const &) { ++count; }, QUEUE);
+
+  for (int i = 0 ; i < COMMANDS ; ++i) {
+    ASSERT_EQ(MBIM_STATUS_SUCCESS, MbimTransport_ExecuteCommandSynchronously(&tr.t,
+          BasicConnectDeviceService_Uuid(), CID_RADIO_STATE, MBIM_COMMAND_TYPE_QUERY,
+          nullptr, 0, nullptr, nullptr, 5));
+  }
+
+  // Each response comes with an indication; the last may still be on its
+  // way.
+  ASSERT_LE(COMMANDS - 1 - QUEUE, dispatcher.dropped());
+
+  run_posted(loop);
+  ASSERT_EQ(QUEUE, count);
+}
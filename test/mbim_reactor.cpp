@@ -0,0 +1,160 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr auto TIMEOUT = 5s;
+
+struct reactor_guard
+{
+  MbimReactor r;
+
+  inline reactor_guard(std::uint32_t threads, std::uint32_t max_attached)
+  {
+    if (MbimReactor_Initialize(&r, threads, max_attached) < 0) {
+      throw std::runtime_error{"MbimReactor_Initialize failed"};
+    }
+  }
+
+  inline ~reactor_guard()
+  {
+    MbimReactor_ShutDown(&r);
+  }
+};
+
+
+struct shared_transport
+{
+  mbim_simulator  sim;
+  MbimTransport   t;
+
+  inline shared_transport(MbimReactor & reactor, simulator_config const & config = {})
+    : sim{config}
+  {
+    sim.start();
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_InitializeShared(&t, sim.path(), 4096, 0, &reactor) < 0) {
+      throw std::runtime_error{"MbimTransport_InitializeShared failed"};
+    }
+  }
+
+  inline ~shared_transport()
+  {
+    MbimTransport_ShutDown(&t);
+  }
+};
+
+
+template <typename T>
+T
+get(std::future<T> future)
+{
+  if (future.wait_for(TIMEOUT) != std::future_status::ready) {
+    throw std::runtime_error{"timed out"};
+  }
+  return future.get();
+}
+
+} // anonymous namespace
+
+
+TEST(MbimReactor, services_many_transports)
+{
+  for (std::uint32_t threads : {1, 2}) {
+    // Each transport takes a slot for its device and one for its timer.
+    reactor_guard reactor{threads, 16};
+
+    std::vector<std::unique_ptr<shared_transport>> modems;
+    for (int i = 0 ; i < 8 ; ++i) {
+      modems.push_back(std::make_unique<shared_transport>(reactor.r));
+    }
+
+    // Too many.
+    simulator_config config;
+    mbim_simulator sim{config};
+    sim.start();
+    MbimTransport t;
+    std::memset(&t, 0, sizeof(t));
+    ASSERT_GT(0, MbimTransport_InitializeShared(&t, sim.path(), 4096, 0, &reactor.r));
+
+    std::vector<std::unique_ptr<async_transport>> asyncs;
+    std::vector<std::future<connect_state>> futures;
+    for (auto & modem : modems) {
+      asyncs.push_back(std::make_unique<async_transport>(modem->t));
+      for (std::uint32_t session = 0 ; session < 16 ; ++session) {
+        futures.push_back(asyncs.back()->submit(connect_query(session)));
+      }
+    }
+    for (std::size_t i = 0 ; i < futures.size() ; ++i) {
+      ASSERT_EQ(i % 16, get(std::move(futures[i])).session_id);
+    }
+
+    // Each device can be taken away on its own.
+    asyncs.pop_back();
+    modems.pop_back();
+    ASSERT_EQ(MBIMRadioOn, get(asyncs[0]->submit(radio_state_query())).sw);
+  }
+}
+
+
+
+TEST(MbimReactor, fragmented_messages)
+{
+  reactor_guard reactor{1, 2};
+  simulator_config config;
+  config.max_transfer = 64;
+  shared_transport modem{reactor.r, config};
+  async_transport async{modem.t};
+
+  ASSERT_EQ(L"001010123456789", get(async.submit(subscriber_ready_query())).subscriber_id);
+}
+
+
+
+TEST(MbimReactor, detach_during_indication_storm)
+{
+  reactor_guard reactor{2, 4};
+  simulator_config config;
+  config.storm_interval = 100us;
+  config.storm_burst = 20;
+
+  for (int i = 0 ; i < 5 ; ++i) {
+    std::atomic<int> count{0};
+    auto modem = std::make_unique<shared_transport>(reactor.r, config);
+    MbimIndicator indicator;
+    MbimIndicator_Initialize(&indicator,
+        [](std::uint8_t *, std::uint32_t, std::uint8_t *, std::uint32_t, void * context)
+        {
+          ++*static_cast<std::atomic<int> *>(context);
+        }, &count);
+    MbimTransport_AttachIndicator(&modem->t, &indicator);
+
+    auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+    while (count < 50 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_LE(50, count);
+
+    // Shut down with indications still arriving; none may be delivered
+    // afterwards.
+    modem.reset();
+    auto after = count.load();
+    std::this_thread::sleep_for(5ms);
+    ASSERT_EQ(after, count);
+  }
+}
@@ -0,0 +1,175 @@
+/*
+ *
+ */
+
+#include "mbim/session_store.h"
+
+#include <arpa/inet.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager::mbim;
+
+namespace {
+
+ip_configuration
+ip_config(std::uint32_t session_id, std::size_t addresses, std::size_t dns_servers)
+{
+  ip_configuration config;
+  config.session_id = session_id;
+  config.ipv4_available = MBIM_IPV4_CONFIGURATION_AVAILABLE_ADDRESS
+    | MBIM_IPV4_CONFIGURATION_AVAILABLE_GATEWAY
+    | MBIM_IPV4_CONFIGURATION_AVAILABLE_DNS
+    | MBIM_IPV4_CONFIGURATION_AVAILABLE_MTU;
+  config.ipv6_available = MBIM_IPV6_CONFIGURATION_AVAILABLE_MTU;
+  for (std::size_t i = 0 ; i < addresses ; ++i) {
+    MBIM_IPV4_ELEMENT element{24, { { 10, std::uint8_t(session_id), std::uint8_t(i), 1 } }};
+    config.ipv4_addresses.push_back(element);
+    MBIM_IPV6_ELEMENT element6{64, {}};
+    element6.Address.value[0] = 0x20;
+    element6.Address.value[15] = std::uint8_t(i);
+    config.ipv6_addresses.push_back(element6);
+  }
+  for (std::size_t i = 0 ; i < dns_servers ; ++i) {
+    config.ipv4_dns_servers.push_back({ { 8, 8, std::uint8_t(i), 8 } });
+  }
+  config.ipv4_gateway = { { 10, std::uint8_t(session_id), 0, 254 } };
+  config.ipv4_mtu = 1428;
+  config.ipv6_mtu = 1280;
+  return config;
+}
+
+
+std::vector<session_route>
+routes(std::size_t count)
+{
+  std::vector<session_route> ret(count);
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    ret[i].dst.family = AF_INET;
+    ret[i].dst.length = 24;
+    ret[i].dst.bytes = { 192, 168, std::uint8_t(i), 0 };
+  }
+  return ret;
+}
+
+} // anonymous namespace
+
+
+TEST(SessionStore, stores_sessions)
+{
+  session_store store;
+  ASSERT_EQ(0, store.add(3));
+  ASSERT_EQ(1, store.add(7));
+  ASSERT_EQ(0, store.add(3));
+  ASSERT_EQ(2, store.size());
+  ASSERT_EQ(1, store.find(7));
+  ASSERT_FALSE(store.find(4));
+  ASSERT_EQ(7, store.state(1).session_id);
+
+  // No limits to the lists.
+  store.set_ip_configuration(1, ip_config(7, 10, 6));
+  auto r = routes(20);
+  store.set_routes(1, r.data(), r.size());
+
+  ASSERT_EQ(10, store.ipv4_addresses(1).size());
+  ASSERT_EQ(10, store.ipv6_addresses(1).size());
+  ASSERT_EQ(6, store.ipv4_dns_servers(1).size());
+  ASSERT_TRUE(store.ipv6_dns_servers(1).empty());
+  ASSERT_EQ(20, store.routes(1).size());
+  ASSERT_EQ(9, store.ipv4_addresses(1)[9].Address.value[2]);
+  ASSERT_EQ(19, store.routes(1)[19].dst.bytes[2]);
+  ASSERT_EQ(254, store.ipv4_gateway(1).value[3]);
+  ASSERT_EQ(1428, store.state(1).mtu);
+
+  // The other session is untouched.
+  ASSERT_TRUE(store.ipv4_addresses(0).empty());
+  ASSERT_TRUE(store.routes(0).empty());
+  ASSERT_EQ(0, store.state(0).mtu);
+
+  // Deactivation clears the IP configuration, but not the routes.
+  connect_state state;
+  state.session_id = 7;
+  state.activation_state = MBIMActivationStateDeactivated;
+  store.set_connect_state(1, state);
+  ASSERT_EQ(MBIMActivationStateDeactivated, store.state(1).activation_state);
+  ASSERT_TRUE(store.ipv4_addresses(1).empty());
+  ASSERT_EQ(0, store.ipv4_available(1));
+  ASSERT_EQ(0, store.state(1).mtu);
+  ASSERT_EQ(20, store.routes(1).size());
+}
+
+
+
+TEST(SessionStore, reconnect_reuses_space)
+{
+  session_store store;
+  for (std::uint32_t id = 0 ; id < 8 ; ++id) {
+    store.add(id);
+    store.set_ip_configuration(id, ip_config(id, 2, 2));
+  }
+  auto memory = store.memory_size();
+  auto addresses = store.ipv4_addresses(5).begin();
+
+  // Reconnecting, with the same or fewer addresses, stays in place.
+  for (int round = 0 ; round < 100 ; ++round) {
+    for (std::uint32_t id = 0 ; id < 8 ; ++id) {
+      store.clear_ip_configuration(id);
+      store.set_ip_configuration(id, ip_config(id, 1 + round % 2, 2));
+    }
+  }
+  ASSERT_EQ(memory, store.memory_size());
+  ASSERT_EQ(addresses, store.ipv4_addresses(5).begin());
+  ASSERT_EQ(2, store.ipv4_addresses(5).size());
+}
+
+
+
+TEST(SessionStore, compacts_outgrown_space)
+{
+  session_store store;
+  for (std::uint32_t id = 0 ; id < 4 ; ++id) {
+    store.add(id);
+    auto r = routes(2);
+    store.set_routes(id, r.data(), r.size());
+  }
+
+  // Growing one session at a time leaves holes, which are compacted away.
+  for (std::size_t count = 3 ; count < 50 ; ++count) {
+    for (std::uint32_t id = 0 ; id < 4 ; ++id) {
+      auto r = routes(count);
+      r[0].dst.bytes[3] = std::uint8_t(id);
+      store.set_routes(id, r.data(), r.size());
+    }
+  }
+  for (std::uint32_t id = 0 ; id < 4 ; ++id) {
+    auto list = store.routes(id);
+    ASSERT_EQ(49, list.size());
+    ASSERT_EQ(id, list[0].dst.bytes[3]);
+    ASSERT_EQ(48, list[48].dst.bytes[2]);
+  }
+  // Compaction keeps holes to at most half of the arena.
+  ASSERT_GE(4 * 4 * 49 * sizeof(session_route) + 1024, store.memory_size());
+}
+
+
+
+TEST(SessionStore, footprint)
+{
+  // Hot state packs four sessions into a cache line.
+  ASSERT_EQ(16, sizeof(session_state));
+
+  // A typical session: an address and a gateway per family, two DNS
+  // servers, one route.
+  session_store store;
+  for (std::uint32_t id = 0 ; id < 64 ; ++id) {
+    store.add(id);
+    store.set_ip_configuration(id, ip_config(id, 1, 2));
+    auto r = routes(1);
+    store.set_routes(id, r.data(), r.size());
+  }
+  ASSERT_GT(512 * 64, store.memory_size());
+
+  store.reset();
+  ASSERT_EQ(0, store.size());
+  ASSERT_FALSE(store.find(3));
+}
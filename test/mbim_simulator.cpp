@@ -0,0 +1,225 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr auto TIMEOUT = 5s;
+
+struct sim_transport
+{
+  MbimTransport t;
+
+  inline explicit sim_transport(mbim_simulator & sim)
+  {
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_Initialize(&t, sim.path(), 4096) < 0) {
+      throw std::runtime_error{"MbimTransport_Initialize failed"};
+    }
+  }
+
+  inline ~sim_transport()
+  {
+    MbimTransport_ShutDown(&t);
+  }
+};
+
+
+template <typename T>
+T
+get(std::future<T> future)
+{
+  if (future.wait_for(TIMEOUT) != std::future_status::ready) {
+    throw std::runtime_error{"timed out"};
+  }
+  return future.get();
+}
+
+
+template <typename T>
+std::uint32_t
+status_of(std::future<T> future)
+{
+  try {
+    get(std::move(future));
+  } catch (mbim_error const & err) {
+    return err.status();
+  }
+  return MBIM_STATUS_SUCCESS;
+}
+
+} // anonymous namespace
+
+
+TEST(MbimSimulator, bring_up)
+{
+  simulator_config config;
+  config.pin = "1234";
+  config.register_delay = 50ms;
+  config.max_transfer = 64; // Fragment everything with strings in it.
+  mbim_simulator sim{config};
+  sim.start();
+  sim_transport tr{sim};
+  async_transport async{tr.t};
+
+  ASSERT_EQ(MBIMSubscriberReadyStateDeviceLocked,
+      get(async.submit(subscriber_ready_query())).state);
+  ASSERT_EQ(MBIMPinStateLocked, get(async.submit(pin_query())).state);
+  ASSERT_EQ(MBIM_STATUS_FAILURE,
+      status_of(async.submit(pin_set(MBIMPinTypePin1, MBIMPinOperationEnter, L"0000"))));
+  ASSERT_EQ(MBIMPinStateUnlocked,
+      get(async.submit(pin_set(MBIMPinTypePin1, MBIMPinOperationEnter, L"1234"))).state);
+
+  auto ready = get(async.submit(subscriber_ready_query()));
+  ASSERT_EQ(MBIMSubscriberReadyStateInitialized, ready.state);
+  ASSERT_EQ(L"001010123456789", ready.subscriber_id);
+
+  // Attaching fails until registered.
+  ASSERT_EQ(MBIMRegisterStateSearching, get(async.submit(register_state_query())).state);
+  ASSERT_EQ(MBIM_STATUS_FAILURE,
+      status_of(async.submit(packet_service_set(MBIMPacketServiceActionAttach))));
+  std::this_thread::sleep_for(60ms);
+  auto reg = get(async.submit(register_state_query()));
+  ASSERT_EQ(MBIMRegisterStateHome, reg.state);
+  ASSERT_EQ(L"Simulated", reg.provider_name);
+
+  ASSERT_EQ(MBIMPacketServiceStateAttached,
+      get(async.submit(packet_service_set(MBIMPacketServiceActionAttach))).state);
+
+  connect_parameters params;
+  params.access_string = L"internet";
+  auto conn = get(async.submit(connect_set(7, params)));
+  ASSERT_EQ(7, conn.session_id);
+  ASSERT_EQ(MBIMActivationStateActivated, conn.activation_state);
+  ASSERT_EQ(MBIMContextIPTypeIPv4, conn.ip_type);
+
+  auto ip = get(async.submit(ip_configuration_query(7)));
+  ASSERT_EQ(7, ip.session_id);
+  ASSERT_EQ(1, ip.ipv4_addresses.size());
+  ASSERT_EQ(24, ip.ipv4_addresses[0].OnLinkPrefixLength);
+  ASSERT_EQ(7, ip.ipv4_addresses[0].Address.value[1]);
+  ASSERT_EQ(1, ip.ipv4_gateway.value[3]);
+  ASSERT_EQ(1, ip.ipv4_dns_servers.size());
+  ASSERT_EQ(1500, ip.ipv4_mtu);
+
+  params.command = MBIMActivationCommandDeactivate;
+  ASSERT_EQ(MBIMActivationStateDeactivated,
+      get(async.submit(connect_set(7, params))).activation_state);
+  ASSERT_EQ(MBIM_STATUS_FAILURE, status_of(async.submit(ip_configuration_query(7))));
+}
+
+
+
+TEST(MbimSimulator, latency)
+{
+  simulator_config config;
+  config.latency = 20ms;
+  mbim_simulator sim{config};
+  sim.start();
+  sim_transport tr{sim};
+  async_transport async{tr.t};
+
+  auto start = std::chrono::steady_clock::now();
+  get(async.submit(radio_state_query()));
+  ASSERT_LE(20ms, std::chrono::steady_clock::now() - start);
+}
+
+
+
+TEST(MbimSimulator, errors_and_drops)
+{
+  simulator_config config;
+  config.error_rate = 0.5;
+  config.drop_rate = 0.2;
+  mbim_simulator sim{config};
+  sim.start();
+  sim_transport tr{sim};
+  async_transport async{tr.t};
+
+  // Stay below the transport's limit of outstanding transactions.
+  static constexpr std::size_t COMMANDS = 50;
+  std::vector<std::future<radio_state>> futures;
+  for (std::size_t i = 0 ; i < COMMANDS ; ++i) {
+    futures.push_back(async.submit(radio_state_query()));
+  }
+
+  // Wait for all answers the simulator is going to give.
+  auto const & stats = sim.stats();
+  auto ready = [&futures]()
+  {
+    return std::count_if(futures.begin(), futures.end(), [](auto const & future)
+        {
+          return future.wait_for(0s) == std::future_status::ready;
+        });
+  };
+  auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+  while ((stats.commands < COMMANDS
+        || ready() < static_cast<std::ptrdiff_t>(COMMANDS - stats.dropped))
+      && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+
+  std::size_t failed = 0, unanswered = 0;
+  for (auto & future : futures) {
+    if (future.wait_for(0s) != std::future_status::ready) {
+      ++unanswered;
+    }
+    else if (status_of(std::move(future)) == MBIM_STATUS_FAILURE) {
+      ++failed;
+    }
+  }
+
+  ASSERT_EQ(COMMANDS, stats.commands);
+  ASSERT_EQ(stats.dropped, unanswered);
+  ASSERT_EQ(stats.errors, failed);
+  ASSERT_LT(0, unanswered);
+  ASSERT_LT(unanswered, failed);
+}
+
+
+
+TEST(MbimSimulator, indication_storm)
+{
+  simulator_config config;
+  config.storm_interval = 1ms;
+  config.storm_burst = 10;
+  mbim_simulator sim{config};
+  sim.start();
+  sim_transport tr{sim};
+
+  std::atomic<int> count{0};
+  MbimIndicator indicator;
+  MbimIndicator_Initialize(&indicator,
+      [](std::uint8_t *, std::uint32_t cid, std::uint8_t *, std::uint32_t length, void * context)
+      {
+        if (cid == 11 && length == 20) {
+          ++*static_cast<std::atomic<int> *>(context);
+        }
+      }, &count);
+  MbimTransport_AttachIndicator(&tr.t, &indicator);
+
+  auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+  while (count < 100 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  MbimTransport_DetachIndicator(&tr.t, &indicator);
+  ASSERT_LE(100, count);
+
+  // Commands still get through.
+  async_transport async{tr.t};
+  ASSERT_EQ(MBIMRadioOn, get(async.submit(radio_state_query())).sw);
+}
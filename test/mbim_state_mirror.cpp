@@ -0,0 +1,188 @@
+/*
+ *
+ */
+
+#include "mbim/state_mirror.h"
+
+#include <linkmanager/reactor.h>
+
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager;
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr auto TIMEOUT = 5s;
+
+/**
+ * A simulated modem with a transport, and a mirror of its state updated on
+ * a loop thread of its own.
+ */
+struct mirrored_modem
+{
+  mbim_simulator        sim;
+  MbimTransport         t;
+  reactor               loop;
+  std::thread           thread;
+  std::unique_ptr<async_transport>        async;
+  std::unique_ptr<indication_dispatcher>  dispatcher;
+  std::unique_ptr<state_mirror>           mirror;
+
+  inline explicit mirrored_modem(simulator_config const & config = {})
+    : sim{config}
+  {
+    sim.start();
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_Initialize(&t, sim.path(), 4096) < 0) {
+      throw std::runtime_error{"MbimTransport_Initialize failed"};
+    }
+    async = std::make_unique<async_transport>(t);
+    dispatcher = std::make_unique<indication_dispatcher>(t);
+    mirror = std::make_unique<state_mirror>(*async, *dispatcher, loop);
+    thread = std::thread{[this]() { loop.run(); }};
+  }
+
+  inline ~mirrored_modem()
+  {
+    loop.post([this]() { mirror.reset(); loop.stop(); });
+    thread.join();
+    dispatcher.reset();
+    async.reset();
+    MbimTransport_ShutDown(&t);
+  }
+
+  /**
+   * Wait until the mirrored state satisfies the predicate.
+   */
+  template <typename P>
+  inline bool wait_for(P && pred)
+  {
+    auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+    while (!pred(*mirror->read())) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    return true;
+  }
+};
+
+
+template <typename T>
+T
+get(std::future<T> future)
+{
+  if (future.wait_for(TIMEOUT) != std::future_status::ready) {
+    throw std::runtime_error{"timed out"};
+  }
+  return future.get();
+}
+
+} // anonymous namespace
+
+
+TEST(MbimStateMirror, primed_by_queries)
+{
+  mirrored_modem modem;
+  ASSERT_FALSE(modem.mirror->is_powered_on());
+  ASSERT_EQ(0, modem.mirror->read()->version);
+
+  modem.mirror->start();
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state)
+      {
+        return state.powered_on() && state.registered()
+          && state.packet.state == MBIMPacketServiceStateDetached;
+      }));
+  ASSERT_EQ(L"Simulated", modem.mirror->read()->registration.provider_name);
+}
+
+
+
+TEST(MbimStateMirror, follows_indications)
+{
+  mirrored_modem modem;
+  modem.mirror->start();
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state) { return state.registered(); }));
+
+  get(modem.async->submit(packet_service_set(MBIMPacketServiceActionAttach)));
+  get(modem.async->submit(connect_set(3, connect_parameters{})));
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state)
+      {
+        return state.attached() && state.is_active(3) && state.ip.count(3) > 0;
+      }));
+  {
+    auto state = modem.mirror->read();
+    ASSERT_EQ(1, state->ip.at(3).ipv4_addresses.size());
+    ASSERT_EQ(3, state->ip.at(3).ipv4_addresses[0].Address.value[1]);
+  }
+  ASSERT_TRUE(modem.mirror->is_active(3));
+  ASSERT_FALSE(modem.mirror->is_active(4));
+
+  // Switching the radio off tears everything down.
+  get(modem.async->submit(radio_state_set(MBIMRadioOff)));
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state)
+      {
+        return !state.powered_on() && !state.registered() && !state.attached()
+          && state.sessions.empty() && state.ip.empty();
+      }));
+  ASSERT_FALSE(modem.mirror->is_powered_on());
+  ASSERT_FALSE(modem.mirror->is_active(3));
+}
+
+
+
+TEST(MbimStateMirror, reads_do_not_touch_modem)
+{
+  mirrored_modem modem;
+  modem.mirror->start({5});
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state) { return state.registered(); }));
+
+  // Let the remaining priming queries complete.
+  std::this_thread::sleep_for(20ms);
+  auto commands = modem.sim.stats().commands.load();
+  for (int i = 0 ; i < 1000 ; ++i) {
+    ASSERT_TRUE(modem.mirror->is_powered_on());
+    ASSERT_FALSE(modem.mirror->is_active(5));
+  }
+  ASSERT_EQ(commands, modem.sim.stats().commands);
+}
+
+
+
+TEST(MbimStateMirror, later_queries_correct_indicated_state)
+{
+  mirrored_modem modem;
+  modem.mirror->start();
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state) { return state.powered_on(); }));
+
+  get(modem.async->submit(radio_state_set(MBIMRadioOff)));
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state) { return !state.powered_on(); }));
+
+  // The radio is switched on again without an indication.
+  std::vector<MbimEventEntry> entries(1);
+  auto service = BasicConnectDeviceService_Uuid();
+  std::copy(service, service + MBIM_UUID_SIZE, entries[0].DeviceServiceId);
+  entries[0].CidCount = 1;
+  entries[0].Cids[0] = packet_service_query().cid;
+  std::promise<void> subscribed;
+  modem.async->submit_raw(device_service_subscribe(entries),
+      [&subscribed](std::uint32_t, std::uint8_t *, std::uint32_t) { subscribed.set_value(); });
+  get(subscribed.get_future());
+  get(modem.async->submit(radio_state_set(MBIMRadioOn)));
+  std::this_thread::sleep_for(20ms);
+  ASSERT_FALSE(modem.mirror->is_powered_on());
+
+  // A query sent after the indication is applied.
+  modem.mirror->refresh();
+  ASSERT_TRUE(modem.wait_for([](modem_state const & state) { return state.powered_on(); }));
+}
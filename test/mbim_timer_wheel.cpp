@@ -0,0 +1,241 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sim/mbim_simulator.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+using namespace std::chrono_literals;
+
+namespace {
+
+static constexpr auto TIMEOUT = 5s;
+
+inline MbimTransaction
+make_transaction(std::uint32_t id, std::uint64_t deadline)
+{
+  MbimTransaction trans{};
+  trans.transactionId = id;
+  trans.deadline = deadline;
+  return trans;
+}
+
+
+std::vector<std::uint32_t>
+ids(MbimTransaction * list)
+{
+  std::vector<std::uint32_t> result;
+  for ( ; list ; list = list->pNext) {
+    result.push_back(list->transactionId);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+
+struct sim_transport
+{
+  mbim_simulator  sim;
+  MbimTransport   t;
+
+  inline explicit sim_transport(simulator_config const & config, MbimReactor * reactor = nullptr)
+    : sim{config}
+  {
+    sim.start();
+    std::memset(&t, 0, sizeof(t));
+    if (MbimTransport_InitializeShared(&t, sim.path(), 4096, 1024, reactor) < 0) {
+      throw std::runtime_error{"MbimTransport_InitializeShared failed"};
+    }
+  }
+
+  inline ~sim_transport()
+  {
+    MbimTransport_ShutDown(&t);
+  }
+};
+
+
+/**
+ * Submit commands that are never answered, and check that each times out
+ * no earlier than its deadline, and not much later.
+ */
+void
+expect_timeouts(sim_transport & tr, std::size_t count)
+{
+  async_transport async{tr.t};
+  std::vector<std::future<radio_state>> futures;
+  std::vector<std::chrono::steady_clock::time_point> deadlines;
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    auto timeout = std::chrono::milliseconds{10 + i % 40};
+    deadlines.push_back(std::chrono::steady_clock::now() + timeout);
+    futures.push_back(async.submit(radio_state_query(), timeout));
+  }
+
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    ASSERT_EQ(std::future_status::ready, futures[i].wait_for(TIMEOUT));
+    ASSERT_LE(deadlines[i], std::chrono::steady_clock::now());
+    try {
+      futures[i].get();
+      FAIL() << "command " << i << " did not time out";
+    } catch (mbim_error const & err) {
+      ASSERT_EQ(MBIM_STATUS_CUSTOM_TIMEOUT, err.status());
+    }
+  }
+
+  // The slots have been reclaimed.
+  ASSERT_EQ(0, tr.t.transactionTable.count);
+  ASSERT_EQ(0, async.outstanding());
+}
+
+} // anonymous namespace
+
+
+TEST(MbimTimerWheel, expires_on_time)
+{
+  MbimTimerWheel wheel;
+  MbimTimerWheel_Initialize(&wheel, 1000);
+  ASSERT_EQ(UINT64_MAX, MbimTimerWheel_NextExpiry(&wheel));
+
+  // One deadline for each level, one past, and one beyond the top level.
+  std::vector<MbimTransaction> transactions = {
+    make_transaction(1, 1010),
+    make_transaction(2, 1000 + 100),
+    make_transaction(3, 1000 + 10000),
+    make_transaction(4, 1000 + 1000000),
+    make_transaction(5, 500),
+    make_transaction(6, 1000 + (std::uint64_t{1} << 30)),
+  };
+  for (auto & trans : transactions) {
+    MbimTimerWheel_Add(&wheel, &trans);
+  }
+  ASSERT_EQ(6, wheel.count);
+  ASSERT_EQ(1001, MbimTimerWheel_NextExpiry(&wheel));
+
+  ASSERT_EQ(std::vector<std::uint32_t>{5}, ids(MbimTimerWheel_Advance(&wheel, 1001)));
+  ASSERT_EQ(1010, MbimTimerWheel_NextExpiry(&wheel));
+  ASSERT_TRUE(ids(MbimTimerWheel_Advance(&wheel, 1009)).empty());
+  ASSERT_EQ(std::vector<std::uint32_t>{1}, ids(MbimTimerWheel_Advance(&wheel, 1010)));
+  ASSERT_TRUE(ids(MbimTimerWheel_Advance(&wheel, 1099)).empty());
+  ASSERT_EQ(std::vector<std::uint32_t>{2}, ids(MbimTimerWheel_Advance(&wheel, 1100)));
+  ASSERT_TRUE(ids(MbimTimerWheel_Advance(&wheel, 10999)).empty());
+  ASSERT_EQ(std::vector<std::uint32_t>{3}, ids(MbimTimerWheel_Advance(&wheel, 11000)));
+  ASSERT_TRUE(ids(MbimTimerWheel_Advance(&wheel, 1000999)).empty());
+  ASSERT_EQ(std::vector<std::uint32_t>{4}, ids(MbimTimerWheel_Advance(&wheel, 1001000)));
+  ASSERT_TRUE(ids(MbimTimerWheel_Advance(&wheel, 1000 + (std::uint64_t{1} << 30) - 1)).empty());
+  ASSERT_EQ(std::vector<std::uint32_t>{6},
+      ids(MbimTimerWheel_Advance(&wheel, 1000 + (std::uint64_t{1} << 30))));
+  ASSERT_EQ(0, wheel.count);
+  ASSERT_EQ(UINT64_MAX, MbimTimerWheel_NextExpiry(&wheel));
+}
+
+
+
+TEST(MbimTimerWheel, matches_reference)
+{
+  std::mt19937 rng{1};
+  std::uniform_int_distribution<std::uint64_t> delay{1, 300000};
+  std::uniform_int_distribution<std::uint64_t> step{1, 5000};
+  std::bernoulli_distribution remove{0.2};
+
+  MbimTimerWheel wheel;
+  std::uint64_t now = 123456789;
+  MbimTimerWheel_Initialize(&wheel, now);
+
+  std::vector<MbimTransaction> transactions(2000);
+  std::vector<bool> pending(transactions.size());
+  for (std::uint32_t i = 0 ; i < transactions.size() ; ++i) {
+    transactions[i] = make_transaction(i, now + delay(rng));
+    MbimTimerWheel_Add(&wheel, &transactions[i]);
+    pending[i] = true;
+  }
+
+  while (wheel.count > 0) {
+    // Never advanced past a deadline without stopping at it.
+    auto next = MbimTimerWheel_NextExpiry(&wheel);
+    ASSERT_GT(next, now);
+    now = std::min(now + step(rng), next);
+
+    std::vector<std::uint32_t> expected;
+    for (std::uint32_t i = 0 ; i < transactions.size() ; ++i) {
+      if (pending[i] && transactions[i].deadline <= now) {
+        expected.push_back(i);
+        pending[i] = false;
+      }
+    }
+    ASSERT_EQ(expected, ids(MbimTimerWheel_Advance(&wheel, now)));
+
+    for (std::uint32_t i = 0 ; i < transactions.size() ; ++i) {
+      if (pending[i] && remove(rng)) {
+        MbimTimerWheel_Remove(&wheel, &transactions[i]);
+        pending[i] = false;
+      }
+    }
+  }
+}
+
+
+
+TEST(MbimTimerWheel, times_out_transactions)
+{
+  simulator_config config;
+  config.drop_rate = 1;
+  sim_transport tr{config};
+  expect_timeouts(tr, 1000);
+}
+
+
+
+TEST(MbimTimerWheel, answered_before_timeout)
+{
+  sim_transport tr{simulator_config{}};
+  async_transport async{tr.t};
+  auto future = async.submit(radio_state_query(), 1000ms);
+  ASSERT_EQ(std::future_status::ready, future.wait_for(TIMEOUT));
+  ASSERT_EQ(MBIMRadioOn, future.get().sw);
+  ASSERT_EQ(0, tr.t.timerWheel.count);
+}
+
+
+
+TEST(MbimTimerWheel, times_out_on_reactor)
+{
+  MbimReactor reactor;
+  ASSERT_EQ(0, MbimReactor_Initialize(&reactor, 1, 4));
+  {
+    simulator_config config;
+    config.drop_rate = 1;
+    sim_transport a{config, &reactor};
+    sim_transport b{config, &reactor};
+    expect_timeouts(a, 100);
+    expect_timeouts(b, 100);
+  }
+  MbimReactor_ShutDown(&reactor);
+}
+
+
+
+TEST(MbimTimerWheel, synchronous_timeout)
+{
+  simulator_config config;
+  config.drop_rate = 1;
+  sim_transport tr{config};
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(MBIM_STATUS_CUSTOM_TIMEOUT, MbimTransport_ExecuteCommandWithTimeout(&tr.t,
+      BasicConnectDeviceService_Uuid(), radio_state_query().cid, MBIM_COMMAND_TYPE_QUERY,
+      nullptr, 0, nullptr, nullptr, 50));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_LE(50ms, elapsed);
+  ASSERT_GT(TIMEOUT, elapsed);
+  ASSERT_EQ(0, tr.t.transactionTable.count);
+}
@@ -0,0 +1,137 @@
+/*
+ *
+ */
+
+#include "lite-mbim/MbimTransactionTable.h"
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+struct table
+{
+  MbimTransactionTable t;
+
+  inline explicit table(std::uint32_t max)
+  {
+    if (MbimTransactionTable_Initialize(&t, max) < 0) {
+      throw std::bad_alloc{};
+    }
+  }
+
+  inline ~table()
+  {
+    MbimTransactionTable_Destroy(&t);
+  }
+};
+
+
+inline MbimTransaction
+make_transaction(std::uint32_t id)
+{
+  MbimTransaction trans{};
+  trans.transactionId = id;
+  return trans;
+}
+
+} // anonymous namespace
+
+
+TEST(MbimTransactionTable, default_capacity)
+{
+  table tab{0};
+  ASSERT_EQ(MBIM_DEFAULT_MAX_TRANSACTIONS, tab.t.maxCount);
+  ASSERT_GE(tab.t.capacity, 2 * tab.t.maxCount);
+}
+
+
+
+TEST(MbimTransactionTable, insert_find_remove)
+{
+  table tab{4};
+  auto a = make_transaction(1);
+  auto b = make_transaction(2);
+
+  ASSERT_EQ(0, MbimTransactionTable_Insert(&tab.t, &a));
+  ASSERT_EQ(0, MbimTransactionTable_Insert(&tab.t, &b));
+  ASSERT_EQ(2, tab.t.count);
+
+  ASSERT_EQ(&a, MbimTransactionTable_Find(&tab.t, 1));
+  ASSERT_EQ(&b, MbimTransactionTable_Find(&tab.t, 2));
+  ASSERT_EQ(nullptr, MbimTransactionTable_Find(&tab.t, 3));
+
+  ASSERT_EQ(&a, MbimTransactionTable_Remove(&tab.t, 1));
+  ASSERT_EQ(nullptr, MbimTransactionTable_Find(&tab.t, 1));
+  ASSERT_EQ(nullptr, MbimTransactionTable_Remove(&tab.t, 1));
+  ASSERT_EQ(&b, MbimTransactionTable_Find(&tab.t, 2));
+  ASSERT_EQ(1, tab.t.count);
+}
+
+
+
+TEST(MbimTransactionTable, rejects_invalid)
+{
+  table tab{2};
+  auto zero = make_transaction(0);
+  auto a = make_transaction(7);
+  auto dup = make_transaction(7);
+  auto b = make_transaction(8);
+  auto c = make_transaction(9);
+
+  // ID 0 is reserved, and IDs are unique.
+  ASSERT_LT(MbimTransactionTable_Insert(&tab.t, &zero), 0);
+  ASSERT_EQ(0, MbimTransactionTable_Insert(&tab.t, &a));
+  ASSERT_LT(MbimTransactionTable_Insert(&tab.t, &dup), 0);
+
+  // The table is full at the configured maximum.
+  ASSERT_EQ(0, MbimTransactionTable_Insert(&tab.t, &b));
+  ASSERT_LT(MbimTransactionTable_Insert(&tab.t, &c), 0);
+
+  MbimTransactionTable_Remove(&tab.t, 7);
+  ASSERT_EQ(0, MbimTransactionTable_Insert(&tab.t, &c));
+}
+
+
+
+TEST(MbimTransactionTable, random_operations)
+{
+  // Compare against a map under a random mix of operations, so that
+  // removals from the middle of probe sequences are exercised.
+  table tab{64};
+  std::vector<MbimTransaction> storage;
+  for (std::uint32_t i = 0 ; i < 512 ; ++i) {
+    storage.push_back(make_transaction(i + 1));
+  }
+
+  std::map<std::uint32_t, MbimTransaction *> reference;
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<std::uint32_t> dist{1, 512};
+
+  for (int op = 0 ; op < 100000 ; ++op) {
+    auto id = dist(gen);
+    auto iter = reference.find(id);
+    if (iter == reference.end()) {
+      auto ret = MbimTransactionTable_Insert(&tab.t, &storage[id - 1]);
+      if (reference.size() < 64) {
+        ASSERT_EQ(0, ret);
+        reference[id] = &storage[id - 1];
+      }
+      else {
+        ASSERT_LT(ret, 0);
+      }
+    }
+    else {
+      ASSERT_EQ(iter->second, MbimTransactionTable_Remove(&tab.t, id));
+      reference.erase(iter);
+    }
+
+    ASSERT_EQ(reference.size(), tab.t.count);
+    for (auto const & [key, value] : reference) {
+      ASSERT_EQ(value, MbimTransactionTable_Find(&tab.t, key));
+    }
+  }
+}
@@ -0,0 +1,174 @@
+/*
+ *
+ */
+
+#include "mbim/async.h"
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+
+#include "mbim_fake_modem.h"
+
+using namespace linkmanager::mbim;
+using namespace test;
+
+namespace {
+
+std::vector<std::uint32_t>
+sequence(std::size_t count, std::uint32_t first)
+{
+  std::vector<std::uint32_t> words(count);
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    words[i] = first + static_cast<std::uint32_t>(i);
+  }
+  return words;
+}
+
+
+bool
+is_sequence(std::uint8_t const * buf, std::uint32_t length, std::size_t count,
+    std::uint32_t first)
+{
+  if (length != count * 4) {
+    return false;
+  }
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    if (get32(buf + 4 * i) != first + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+struct indication_check
+{
+  std::atomic<int>  good{0};
+  std::atomic<int>  bad{0};
+};
+
+
+void
+on_indication(std::uint8_t *, std::uint32_t cid, std::uint8_t * buf, std::uint32_t length,
+    void * context)
+{
+  auto check = static_cast<indication_check *>(context);
+  if (cid == CID_SIGNAL_STATE && is_sequence(buf, length, 300, 1000)) {
+    ++check->good;
+  }
+  else {
+    ++check->bad;
+  }
+}
+
+} // anonymous namespace
+
+
+TEST(MbimSlabPool, alloc_free)
+{
+  MbimSlabPool pool;
+  ASSERT_EQ(0, MbimSlabPool_Initialize(&pool, 100, 3));
+  ASSERT_EQ(128, pool.bufferSize);
+
+  std::uint8_t * bufs[3];
+  for (auto & buf : bufs) {
+    buf = MbimSlabPool_Alloc(&pool);
+    ASSERT_NE(nullptr, buf);
+    ASSERT_EQ(0, reinterpret_cast<std::uintptr_t>(buf) % MBIM_SLAB_POOL_ALIGNMENT);
+  }
+  ASSERT_EQ(nullptr, MbimSlabPool_Alloc(&pool));
+
+  MbimSlabPool_Free(&pool, bufs[1]);
+  ASSERT_EQ(bufs[1], MbimSlabPool_Alloc(&pool));
+
+  MbimSlabPool_Destroy(&pool);
+}
+
+
+
+TEST(MbimTransport, control_transfer_fallback)
+{
+  fake_modem modem;
+  modem.start();
+  transport tr{modem};
+
+  // A pty is no cdc-wdm device.
+  ASSERT_EQ(MBIM_MAX_CTRL_TRANSFER, tr.t.maxControlTransfer);
+}
+
+
+
+TEST(MbimTransport, interleaved_fragments)
+{
+  fake_modem modem;
+  modem.max_transfer = 256;
+  modem.replies[CID_REGISTER_STATE] = {MBIM_STATUS_SUCCESS, sequence(600, 1)};
+  modem.indication = sequence(300, 1000);
+  modem.start();
+  transport tr{modem};
+
+  indication_check check;
+  MbimIndicator indicator;
+  MbimIndicator_Initialize(&indicator, on_indication, &check);
+  MbimTransport_AttachIndicator(&tr.t, &indicator);
+
+  // The response is parsed in place, on the read thread.
+  auto parse = [](std::uint8_t * buf, std::uint32_t length, void *) -> std::uint32_t
+  {
+    return is_sequence(buf, length, 600, 1) ? MBIM_STATUS_SUCCESS : MBIM_STATUS_FAILURE;
+  };
+  for (int i = 0 ; i < 3 ; ++i) {
+    ASSERT_EQ(MBIM_STATUS_SUCCESS, MbimTransport_ExecuteCommandSynchronously(&tr.t,
+          BasicConnectDeviceService_Uuid(), CID_REGISTER_STATE, MBIM_COMMAND_TYPE_QUERY,
+          nullptr, 0, parse, nullptr, 5));
+  }
+
+  MbimTransport_DetachIndicator(&tr.t, &indicator);
+  ASSERT_EQ(3, check.good);
+  ASSERT_EQ(0, check.bad);
+}
+
+
+
+TEST(MbimTransport, reassembly_exhausted)
+{
+  static constexpr std::size_t COMMANDS = MBIM_REASSEMBLY_BUFFERS + 2;
+
+  fake_modem modem;
+  modem.max_transfer = 256;
+  modem.hold = COMMANDS;
+  modem.replies[CID_REGISTER_STATE] = {MBIM_STATUS_SUCCESS, sequence(200, 1)};
+  modem.start();
+  transport tr{modem};
+  async_transport async{tr.t};
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<std::uint32_t> statuses;
+
+  command cmd;
+  cmd.service = BasicConnectDeviceService_Uuid();
+  cmd.cid = CID_REGISTER_STATE;
+  for (std::size_t i = 0 ; i < COMMANDS ; ++i) {
+    async.submit_raw(cmd, [&](std::uint32_t status, std::uint8_t * buf, std::uint32_t length)
+        {
+          if (status == MBIM_STATUS_SUCCESS && !is_sequence(buf, length, 200, 1)) {
+            status = MBIM_STATUS_FAILURE;
+          }
+          std::lock_guard<std::mutex> lock{mutex};
+          statuses.push_back(status);
+          cond.notify_all();
+        });
+  }
+
+  std::unique_lock<std::mutex> lock{mutex};
+  ASSERT_TRUE(cond.wait_for(lock, TIMEOUT, [&] { return statuses.size() == COMMANDS; }));
+
+  // All responses are interleaved; the oldest ones give way to the newer.
+  ASSERT_EQ(MBIM_REASSEMBLY_BUFFERS,
+      std::count(statuses.begin(), statuses.end(), MBIM_STATUS_SUCCESS));
+  ASSERT_EQ(COMMANDS - MBIM_REASSEMBLY_BUFFERS,
+      std::count(statuses.begin(), statuses.end(), MBIM_STATUS_READ_FAILURE));
+  ASSERT_EQ(0, tr.t.transactionTable.count);
+}
@@ -74,6 +74,31 @@ TEST(ModuleRegistry, register_test_module_double_name_failure)
 
 
 
+TEST(ModuleRegistry, snapshot_versions)
+{
+  auto mod = std::make_shared<test_module>();
+  module_registry mr;
+
+  {
+    auto snap = mr.snapshot();
+    ASSERT_EQ(0, snap->version);
+    ASSERT_EQ(0, snap->size());
+  }
+
+  ASSERT_NO_THROW(mr.register_module(mod, "b"));
+  ASSERT_NO_THROW(mr.register_module(mod, "a"));
+
+  auto snap = mr.snapshot();
+  ASSERT_EQ(2, snap->version);
+  ASSERT_EQ(2, snap->size());
+  ASSERT_EQ("a", snap->entries[0].name);
+  ASSERT_EQ("b", snap->entries[1].name);
+  ASSERT_EQ(mod, snap->find("a"));
+  ASSERT_FALSE(snap->find("c"));
+}
+
+
+
 TEST(ModuleRegistry, register_test_module_name_override)
 {
   auto mod = std::make_shared<test_module>();
@@ -0,0 +1,448 @@
+/*
+ *
+ */
+
+#include "net/egress_scheduler.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <linkmanager/api/modules.h>
+#include <linkmanager/reactor.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+using namespace linkmanager::net;
+
+namespace {
+
+class test_device : public api::modules::device
+{
+public:
+  inline test_device(std::string name, std::uint64_t capacity_bps,
+      std::chrono::microseconds rtt = {})
+    : m_name{name}
+  {
+    m_metrics.capacity_bps = capacity_bps;
+    m_metrics.rtt = rtt;
+  }
+
+  std::string name() const override
+  {
+    return m_name;
+  }
+
+  bool is_up() const override
+  {
+    return m_up;
+  }
+
+  void set_updown(bool new_state) override
+  {
+    m_up = new_state;
+  }
+
+  network_list get_networks() const override
+  {
+    return {};
+  }
+
+  metrics get_metrics() const override
+  {
+    return m_metrics;
+  }
+
+  std::string m_name;
+  bool        m_up = true;
+  metrics     m_metrics;
+};
+
+
+class test_link : public api::modules::link
+{
+public:
+  std::string name() const override
+  {
+    return "egress_test_link";
+  }
+
+  bool configure(nlohmann::json const &) override
+  {
+    return true;
+  }
+
+  bool is_active() const override
+  {
+    return m_active;
+  }
+
+  void set_active(bool new_status, activation_callback cb) override
+  {
+    m_active = new_status;
+    cb(*this, m_active);
+  }
+
+  device_list devices() const override
+  {
+    return m_devices;
+  }
+
+  bool        m_active = true;
+  device_list m_devices;
+};
+
+
+class test_module : public api::modules::link_module
+{
+public:
+  std::string name() const override
+  {
+    return "egress_test_module";
+  }
+
+  bool is_powered_on() const override
+  {
+    return true;
+  }
+
+  bool set_powered_on(bool) override
+  {
+    return true;
+  }
+
+  link_list links() const override
+  {
+    return m_links;
+  }
+
+  link_list m_links;
+};
+
+
+/**
+ * Records what would be programmed into the kernel.
+ */
+struct test_nexthops : public nexthop_table
+{
+  bool set_nexthop(std::uint32_t id, int, std::string const & device,
+      address const & gateway) override
+  {
+    nexthops[id] = {device, gateway};
+    ++calls;
+    return true;
+  }
+
+  bool set_group(std::uint32_t id, std::vector<weighted_nexthop> const & members) override
+  {
+    ++calls;
+    ++group_updates;
+    if (fail_group) {
+      fail_group = false;
+      return false;
+    }
+    group_id = id;
+    group = members;
+    return true;
+  }
+
+  bool set_default_route(int, std::uint32_t table, std::uint32_t, std::uint32_t nexthop_id) override
+  {
+    ++calls;
+    ++route_updates;
+    route_table = table;
+    route_nexthop = nexthop_id;
+    return true;
+  }
+
+  bool remove(std::uint32_t id) override
+  {
+    ++calls;
+    if (id == group_id) {
+      group_id = 0;
+      group.clear();
+      route_nexthop = 0;
+      return true;
+    }
+    return nexthops.erase(id) > 0;
+  }
+
+  std::uint16_t weight_of(std::string const & device) const
+  {
+    for (auto const & m : group) {
+      auto iter = nexthops.find(m.id);
+      if (iter != nexthops.end() && iter->second.first == device) {
+        return m.weight;
+      }
+    }
+    return 0;
+  }
+
+  std::map<std::uint32_t, std::pair<std::string, address>> nexthops;
+  std::uint32_t               group_id = 0;
+  std::vector<weighted_nexthop>   group;
+  std::uint32_t               route_table = 0;
+  std::uint32_t               route_nexthop = 0;
+  bool                        fail_group = false;
+  int                         calls = 0;
+  int                         group_updates = 0;
+  int                         route_updates = 0;
+};
+
+
+/**
+ * Feed interfaces with a default route to the link monitor.
+ */
+struct interfaces
+{
+  std::vector<char> buf;
+
+  void link(int index, char const * name, unsigned flags, std::uint16_t type = RTM_NEWLINK)
+  {
+    auto & ifi = begin<ifinfomsg>(type);
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = index;
+    ifi.ifi_flags = flags;
+    attribute(IFLA_IFNAME, name, ::strlen(name) + 1);
+  }
+
+  void default_route(int index, char const * gateway)
+  {
+    auto & rtm = begin<rtmsg>(RTM_NEWROUTE);
+    rtm.rtm_family = AF_INET;
+    rtm.rtm_table = RT_TABLE_MAIN;
+    rtm.rtm_type = RTN_UNICAST;
+    std::uint8_t bytes[4];
+    ::inet_pton(AF_INET, gateway, bytes);
+    attribute(RTA_GATEWAY, bytes, sizeof(bytes));
+    std::uint32_t oif = static_cast<std::uint32_t>(index);
+    attribute(RTA_OIF, &oif, sizeof(oif));
+  }
+
+  void process(link_monitor & monitor)
+  {
+    monitor.process(buf.data(), buf.size());
+    buf.clear();
+  }
+
+private:
+  template <typename T>
+  T & begin(std::uint16_t type)
+  {
+    m_start = buf.size();
+    buf.resize(buf.size() + NLMSG_SPACE(sizeof(T)));
+    header()->nlmsg_len = NLMSG_LENGTH(sizeof(T));
+    header()->nlmsg_type = type;
+    return *reinterpret_cast<T *>(buf.data() + m_start + NLMSG_HDRLEN);
+  }
+
+  void attribute(std::uint16_t type, void const * data, std::size_t size)
+  {
+    auto offset = m_start + NLMSG_ALIGN(header()->nlmsg_len);
+    buf.resize(offset + RTA_SPACE(size));
+    auto rta = reinterpret_cast<rtattr *>(buf.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(size));
+    ::memcpy(buf.data() + offset + RTA_LENGTH(0), data, size);
+    header()->nlmsg_len = static_cast<std::uint32_t>(offset + RTA_LENGTH(size) - m_start);
+  }
+
+  nlmsghdr * header()
+  {
+    return reinterpret_cast<nlmsghdr *>(buf.data() + m_start);
+  }
+
+  std::size_t m_start = 0;
+};
+
+static constexpr unsigned UP = IFF_UP | IFF_RUNNING;
+
+
+struct NetEgressScheduler : public ::testing::Test
+{
+  reactor                       loop;
+  link_monitor                  monitor{loop};
+  module_registry               registry;
+  std::shared_ptr<test_module>  mod = std::make_shared<test_module>();
+  std::shared_ptr<test_link>    link = std::make_shared<test_link>();
+  test_nexthops                 nexthops;
+  interfaces                    ifaces;
+
+  void SetUp() override
+  {
+    mod->m_links.push_back(link);
+    registry.register_module(mod);
+  }
+
+  std::shared_ptr<test_device> add_device(int index, char const * name,
+      std::uint64_t capacity_bps, std::chrono::microseconds rtt = {})
+  {
+    auto dev = std::make_shared<test_device>(name, capacity_bps, rtt);
+    link->m_devices.push_back(dev);
+    ifaces.link(index, name, UP);
+    ifaces.process(monitor);
+    return dev;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST_F(NetEgressScheduler, weighs_devices_by_metrics)
+{
+  using namespace std::chrono_literals;
+
+  auto wwan0 = add_device(5, "wwan0", 100'000'000, 20ms);
+  auto wwan1 = add_device(6, "wwan1", 50'000'000, 20ms);
+  // Twice the reference round trip time halves the weight.
+  auto wwan2 = add_device(7, "wwan2", 100'000'000, 100ms);
+  ifaces.default_route(5, "10.0.0.1");
+  ifaces.process(monitor);
+
+  egress_scheduler::options opts;
+  opts.reference_rtt = 50ms;
+  egress_scheduler sched{loop, registry, monitor, nexthops, opts};
+  sched.update();
+
+  ASSERT_EQ(3, sched.members().size());
+  ASSERT_EQ(3, nexthops.nexthops.size());
+  ASSERT_EQ(opts.group_id, nexthops.group_id);
+  ASSERT_EQ(opts.group_id, nexthops.route_nexthop);
+  ASSERT_EQ(254, nexthops.route_table);
+  ASSERT_EQ(256, nexthops.weight_of("wwan0"));
+  ASSERT_EQ(128, nexthops.weight_of("wwan1"));
+  ASSERT_EQ(128, nexthops.weight_of("wwan2"));
+
+  // Gateways come from the interfaces' default routes; others are on-link.
+  ASSERT_EQ("10.0.0.1/32", sched.members()[0].gateway.to_string());
+  ASSERT_EQ(AF_UNSPEC, sched.members()[1].gateway.family);
+
+  // Small changes are noise; nothing is programmed.
+  auto calls = nexthops.calls;
+  wwan1->m_metrics.capacity_bps = 52'000'000;
+  sched.update();
+  ASSERT_EQ(calls, nexthops.calls);
+
+  // Larger ones replace the group, but neither the nexthops nor the route.
+  wwan1->m_metrics.capacity_bps = 100'000'000;
+  sched.update();
+  ASSERT_EQ(calls + 1, nexthops.calls);
+  ASSERT_EQ(2, nexthops.group_updates);
+  ASSERT_EQ(1, nexthops.route_updates);
+  ASSERT_EQ(256, nexthops.weight_of("wwan1"));
+
+  // Devices that do not know their capacity are taken as average.
+  wwan0->m_metrics = {};
+  wwan2->m_metrics.capacity_bps = 300'000'000;
+  sched.update();
+  ASSERT_EQ(256, nexthops.weight_of("wwan0"));
+  ASSERT_EQ(128, nexthops.weight_of("wwan1"));
+  ASSERT_EQ(192, nexthops.weight_of("wwan2"));
+}
+
+
+
+TEST_F(NetEgressScheduler, follows_devices)
+{
+  auto wwan0 = add_device(5, "wwan0", 100'000'000);
+  add_device(6, "wwan1", 100'000'000);
+
+  egress_scheduler::options opts;
+  {
+    egress_scheduler sched{loop, registry, monitor, nexthops, opts};
+    sched.update();
+    ASSERT_EQ(2, nexthops.group.size());
+    auto wwan1_id = sched.members()[1].id;
+
+    // An interface going down leaves the group, and its nexthop is removed.
+    ifaces.link(6, "wwan1", IFF_UP);
+    ifaces.process(monitor);
+    sched.update();
+    ASSERT_EQ(1, nexthops.group.size());
+    ASSERT_EQ(0, nexthops.nexthops.count(wwan1_id));
+
+    // So does a device that is down, or of an inactive link; without
+    // members, the group goes, and the route with it.
+    wwan0->m_up = false;
+    sched.update();
+    ASSERT_EQ(0, nexthops.group_id);
+    ASSERT_TRUE(nexthops.nexthops.empty());
+    ASSERT_TRUE(sched.members().empty());
+
+    // Coming back, the route is added anew; the returning interface gets a
+    // fresh nexthop.
+    wwan0->m_up = true;
+    ifaces.link(6, "wwan1", UP);
+    ifaces.process(monitor);
+    sched.update();
+    ASSERT_EQ(2, nexthops.group.size());
+    ASSERT_EQ(2, nexthops.route_updates);
+    ASSERT_NE(wwan1_id, sched.members()[1].id);
+
+    link->m_active = false;
+    sched.update();
+    ASSERT_EQ(0, nexthops.group_id);
+    link->m_active = true;
+    sched.update();
+  }
+
+  // The scheduler withdraws everything it programmed.
+  ASSERT_EQ(0, nexthops.group_id);
+  ASSERT_TRUE(nexthops.nexthops.empty());
+}
+
+
+
+TEST_F(NetEgressScheduler, reprograms_after_failure)
+{
+  add_device(5, "wwan0", 100'000'000);
+
+  egress_scheduler::options opts;
+  egress_scheduler sched{loop, registry, monitor, nexthops, opts};
+
+  nexthops.fail_group = true;
+  sched.update();
+  ASSERT_EQ(0, nexthops.group_id);
+  ASSERT_EQ(0, nexthops.route_updates);
+
+  // Even without changes, the next update programs it all.
+  sched.update();
+  ASSERT_EQ(opts.group_id, nexthops.group_id);
+  ASSERT_EQ(1, nexthops.route_updates);
+  ASSERT_EQ(1, nexthops.group.size());
+
+  // Nonsense
+  opts.family = AF_UNIX;
+  ASSERT_THROW((egress_scheduler{loop, registry, monitor, nexthops, opts}),
+      std::invalid_argument);
+}
+
+
+
+TEST_F(NetEgressScheduler, restores_route_after_flap)
+{
+  add_device(5, "wwan0", 100'000'000);
+
+  egress_scheduler::options opts;
+  egress_scheduler sched{loop, registry, monitor, nexthops, opts};
+  sched.start();
+  ASSERT_EQ(1, nexthops.route_updates);
+
+  // The only device goes down and comes back before the scheduler gets to
+  // look; the kernel took the group and the route with its nexthop.
+  nexthops.remove(opts.group_id);
+  nexthops.nexthops.clear();
+  ifaces.link(5, "wwan0", IFF_UP);
+  ifaces.process(monitor);
+  ifaces.link(5, "wwan0", UP);
+  ifaces.process(monitor);
+
+  sched.update();
+  ASSERT_EQ(1, nexthops.nexthops.size());
+  ASSERT_EQ(opts.group_id, nexthops.group_id);
+  ASSERT_EQ(2, nexthops.route_updates);
+  ASSERT_EQ(opts.group_id, nexthops.route_nexthop);
+}
@@ -0,0 +1,308 @@
+/*
+ *
+ */
+
+#include "net/link_monitor.h"
+#include "common/netlink_util.h"
+#include "common/netlink_ifcache.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <linkmanager/reactor.h>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+using namespace linkmanager::net;
+
+namespace {
+
+/**
+ * Builds a buffer of rtnetlink messages, as read from the socket.
+ */
+struct messages
+{
+  std::vector<char> buf;
+
+  template <typename T>
+  T & begin(std::uint16_t type)
+  {
+    m_start = buf.size();
+    buf.resize(buf.size() + NLMSG_SPACE(sizeof(T)));
+    auto nh = header();
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(T));
+    nh->nlmsg_type = type;
+    return *reinterpret_cast<T *>(buf.data() + m_start + NLMSG_HDRLEN);
+  }
+
+  void attribute(std::uint16_t type, void const * data, std::size_t size)
+  {
+    auto offset = m_start + NLMSG_ALIGN(header()->nlmsg_len);
+    buf.resize(offset + RTA_SPACE(size));
+    auto rta = reinterpret_cast<rtattr *>(buf.data() + offset);
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(size));
+    ::memcpy(buf.data() + offset + RTA_LENGTH(0), data, size);
+    header()->nlmsg_len = static_cast<std::uint32_t>(offset + RTA_LENGTH(size) - m_start);
+  }
+
+  void attribute(std::uint16_t type, std::uint32_t value)
+  {
+    attribute(type, &value, sizeof(value));
+  }
+
+  void address_attribute(std::uint16_t type, char const * text)
+  {
+    std::uint8_t bytes[4];
+    ::inet_pton(AF_INET, text, bytes);
+    attribute(type, bytes, sizeof(bytes));
+  }
+
+  messages & link(std::uint16_t type, int index, char const * name, unsigned flags)
+  {
+    auto & ifi = begin<ifinfomsg>(type);
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = index;
+    ifi.ifi_flags = flags;
+    attribute(IFLA_IFNAME, name, ::strlen(name) + 1);
+    attribute(IFLA_MTU, 1500);
+    return *this;
+  }
+
+  messages & addr(std::uint16_t type, int index, char const * local, std::uint8_t prefix_length)
+  {
+    auto & ifa = begin<ifaddrmsg>(type);
+    ifa.ifa_family = AF_INET;
+    ifa.ifa_index = static_cast<std::uint32_t>(index);
+    ifa.ifa_prefixlen = prefix_length;
+    address_attribute(IFA_LOCAL, local);
+    return *this;
+  }
+
+  messages & route(std::uint16_t type, int index, char const * dst, std::uint8_t dst_len,
+      char const * gateway, unsigned flags = 0)
+  {
+    auto & rtm = begin<rtmsg>(type);
+    rtm.rtm_family = AF_INET;
+    rtm.rtm_dst_len = dst_len;
+    rtm.rtm_table = RT_TABLE_MAIN;
+    rtm.rtm_type = RTN_UNICAST;
+    rtm.rtm_flags = flags;
+    address_attribute(RTA_DST, dst);
+    if (gateway) {
+      address_attribute(RTA_GATEWAY, gateway);
+    }
+    attribute(RTA_OIF, static_cast<std::uint32_t>(index));
+    return *this;
+  }
+
+  void process(link_monitor & monitor)
+  {
+    monitor.process(buf.data(), buf.size());
+    buf.clear();
+  }
+
+private:
+  nlmsghdr * header()
+  {
+    return reinterpret_cast<nlmsghdr *>(buf.data() + m_start);
+  }
+
+  std::size_t m_start = 0;
+};
+
+static constexpr unsigned UP = IFF_UP | IFF_RUNNING;
+
+} // anonymous namespace
+
+
+TEST(NetLinkMonitor, tracks_interfaces)
+{
+  reactor loop;
+  link_monitor monitor{loop};
+
+  std::vector<link_event> events;
+  std::vector<link_event> other;
+  monitor.subscribe("", [&events](link_event const & ev) { events.push_back(ev); });
+  monitor.subscribe("wwan1", [&other](link_event const & ev) { other.push_back(ev); });
+
+  messages msgs;
+  msgs.link(RTM_NEWLINK, 5, "wwan0", UP).process(monitor);
+  ASSERT_EQ(2, events.size());
+  ASSERT_EQ(link_event::LINK_ADDED, events[0].type);
+  ASSERT_EQ(link_event::LINK_UP, events[1].type);
+  ASSERT_EQ("wwan0", events[1].name);
+  ASSERT_EQ(int(UP), monitor.adaptor_state("wwan0"));
+  ASSERT_EQ(-1, monitor.adaptor_state("wwan1"));
+  {
+    auto table = monitor.read();
+    ASSERT_EQ(1, table->interfaces.size());
+    ASSERT_EQ(1500, table->find(5)->mtu);
+    ASSERT_EQ(table->find(5), table->find("wwan0"));
+  }
+
+  // Addresses and routes; cloned routes are not tracked.
+  events.clear();
+  msgs.addr(RTM_NEWADDR, 5, "10.0.0.2", 24).process(monitor);
+  msgs.route(RTM_NEWROUTE, 5, "192.168.1.0", 24, "10.0.0.1").process(monitor);
+  msgs.route(RTM_NEWROUTE, 5, "192.168.2.7", 32, nullptr, RTM_F_CLONED).process(monitor);
+  ASSERT_EQ(2, events.size());
+  ASSERT_EQ(link_event::ADDRESS_ADDED, events[0].type);
+  ASSERT_EQ("10.0.0.2/24", events[0].addr.to_string());
+  ASSERT_EQ(link_event::ROUTE_ADDED, events[1].type);
+  ASSERT_EQ("192.168.1.0/24", events[1].rt.dst.to_string());
+  ASSERT_EQ("10.0.0.1/32", events[1].rt.gateway.to_string());
+  {
+    auto table = monitor.read();
+    ASSERT_EQ(1, table->find(5)->addresses.size());
+    ASSERT_EQ(1, table->find(5)->routes.size());
+  }
+
+  // A changed gateway replaces the route.
+  events.clear();
+  msgs.route(RTM_NEWROUTE, 5, "192.168.1.0", 24, "10.0.0.3").process(monitor);
+  ASSERT_EQ(2, events.size());
+  ASSERT_EQ(link_event::ROUTE_REMOVED, events[0].type);
+  ASSERT_EQ(link_event::ROUTE_ADDED, events[1].type);
+  ASSERT_EQ(1, monitor.read()->find(5)->routes.size());
+
+  // Down, and gone
+  events.clear();
+  msgs.link(RTM_NEWLINK, 5, "wwan0", IFF_UP).process(monitor);
+  ASSERT_EQ(1, events.size());
+  ASSERT_EQ(link_event::LINK_DOWN, events[0].type);
+  ASSERT_EQ(IFF_UP, monitor.adaptor_state("wwan0"));
+
+  msgs.link(RTM_DELLINK, 5, "wwan0", 0).process(monitor);
+  ASSERT_EQ(2, events.size());
+  ASSERT_EQ(link_event::LINK_REMOVED, events[1].type);
+  ASSERT_EQ(-1, monitor.adaptor_state("wwan0"));
+  ASSERT_TRUE(monitor.read()->interfaces.empty());
+
+  // The other subscriber is for another interface.
+  ASSERT_TRUE(other.empty());
+}
+
+
+
+TEST(NetLinkMonitor, publishes_once_per_read)
+{
+  reactor loop;
+  link_monitor monitor{loop};
+
+  std::vector<link_event> events;
+  auto id = monitor.subscribe("", [&events](link_event const & ev) { events.push_back(ev); });
+
+  auto version = monitor.read()->version;
+  messages msgs;
+  msgs.link(RTM_NEWLINK, 3, "eth0", 0)
+    .link(RTM_NEWLINK, 4, "eth1", UP)
+    .link(RTM_NEWLINK, 3, "eth0", UP)
+    .addr(RTM_NEWADDR, 3, "10.1.0.1", 16)
+    .addr(RTM_DELADDR, 3, "10.1.0.1", 16)
+    .process(monitor);
+
+  // One version, with interfaces sorted by index; changes that cancel out
+  // are not reported.
+  {
+    auto table = monitor.read();
+    ASSERT_EQ(version + 1, table->version);
+    ASSERT_EQ(2, table->interfaces.size());
+    ASSERT_EQ(3, table->interfaces[0].index);
+    ASSERT_TRUE(table->interfaces[0].addresses.empty());
+  }
+  ASSERT_EQ(4, events.size());
+  for (auto const & ev : events) {
+    ASSERT_TRUE(ev.type == link_event::LINK_ADDED || ev.type == link_event::LINK_UP);
+  }
+
+  monitor.unsubscribe(id);
+  msgs.link(RTM_DELLINK, 4, "eth1", 0).process(monitor);
+  ASSERT_EQ(4, events.size());
+}
+
+
+
+TEST(NetLinkMonitor, forgets_flushed_routes)
+{
+  reactor loop;
+  link_monitor monitor{loop};
+
+  std::vector<link_event> events;
+  monitor.subscribe("", [&events](link_event const & ev) { events.push_back(ev); });
+
+  messages msgs;
+  msgs.link(RTM_NEWLINK, 5, "wwan0", UP)
+    .addr(RTM_NEWADDR, 5, "10.0.0.2", 24)
+    .route(RTM_NEWROUTE, 5, "0.0.0.0", 0, "10.0.0.1")
+    .process(monitor);
+  ASSERT_EQ(1, monitor.read()->find(5)->routes.size());
+
+  // Losing the carrier keeps the routes.
+  msgs.link(RTM_NEWLINK, 5, "wwan0", IFF_UP).process(monitor);
+  ASSERT_EQ(1, monitor.read()->find(5)->routes.size());
+
+  // Taking the interface down flushes them, without a word from the kernel.
+  events.clear();
+  msgs.link(RTM_NEWLINK, 5, "wwan0", 0).process(monitor);
+  ASSERT_TRUE(monitor.read()->find(5)->routes.empty());
+  ASSERT_EQ(1, events.size());
+  ASSERT_EQ(link_event::ROUTE_REMOVED, events[0].type);
+
+  // As does removing the last address.
+  msgs.link(RTM_NEWLINK, 5, "wwan0", UP)
+    .route(RTM_NEWROUTE, 5, "0.0.0.0", 0, "10.0.0.1")
+    .process(monitor);
+  ASSERT_EQ(1, monitor.read()->find(5)->routes.size());
+
+  events.clear();
+  msgs.addr(RTM_DELADDR, 5, "10.0.0.2", 24).process(monitor);
+  ASSERT_TRUE(monitor.read()->find(5)->routes.empty());
+  ASSERT_EQ(2, events.size());
+  ASSERT_EQ(link_event::ADDRESS_REMOVED, events[0].type);
+  ASSERT_EQ(link_event::ROUTE_REMOVED, events[1].type);
+}
+
+
+
+TEST(NetLinkMonitor, dumps_on_start)
+{
+  reactor loop;
+  link_monitor monitor{loop};
+  ASSERT_TRUE(monitor.start());
+
+  // The loopback interface exists in every network namespace.
+  auto index = static_cast<int>(::if_nametoindex("lo"));
+  ASSERT_NE(0, index);
+  {
+    auto table = monitor.read();
+    auto lo = table->find("lo");
+    ASSERT_NE(nullptr, lo);
+    ASSERT_EQ(index, lo->index);
+    ASSERT_TRUE(lo->flags & IFF_LOOPBACK);
+  }
+
+  {
+    // IsAdaptorUp() and interface lookups are answered from the table.
+    link_monitor provider{loop};
+    ASSERT_TRUE(provider.start());
+    provider.provide_interface_state();
+    ASSERT_EQ(monitor.adaptor_state("lo"), IsAdaptorUp("lo"));
+    ASSERT_EQ(-1, IsAdaptorUp("no-such-interface"));
+    ASSERT_TRUE(NlIfCacheLoaded());
+    ASSERT_EQ(index, NlIfNameToIndex("lo"));
+
+    // Changes reach the cache.
+    messages msgs;
+    msgs.link(RTM_NEWLINK, 9999, "fake0", UP).process(provider);
+    ASSERT_EQ(9999, NlIfNameToIndex("fake0"));
+    msgs.link(RTM_DELLINK, 9999, "fake0", 0).process(provider);
+    ASSERT_EQ(0, NlIfNameToIndex("fake0"));
+  }
+  // ... until the monitor is gone.
+  ASSERT_FALSE(NlIfCacheLoaded());
+}
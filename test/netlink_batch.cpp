@@ -0,0 +1,209 @@
+/*
+ *
+ */
+
+#include "common/netlink_util.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/rtnetlink.h>
+
+#include <functional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+/**
+ * Stands in for the kernel: records the requests of each submission, and
+ * answers them at once with the error the test chooses.
+ */
+struct fake_kernel
+{
+  std::vector<std::vector<std::uint16_t>>       submissions;
+  std::function<int (nlmsghdr const *)>         error = [](nlmsghdr const *) { return 0; };
+  int                                           failed_submits = 0;
+};
+
+fake_kernel * kernel = nullptr;
+
+
+/**
+ * The reply to RTM_GETLINK: the link is down, with an MTU of 1500.
+ */
+std::vector<char>
+link_reply()
+{
+  std::vector<char> buf(NLMSG_SPACE(sizeof(ifinfomsg)) + RTA_SPACE(sizeof(std::uint32_t)));
+  auto nh = reinterpret_cast<nlmsghdr *>(buf.data());
+  nh->nlmsg_len = static_cast<std::uint32_t>(buf.size());
+  nh->nlmsg_type = RTM_NEWLINK;
+
+  auto rta = reinterpret_cast<rtattr *>(buf.data() + NLMSG_SPACE(sizeof(ifinfomsg)));
+  rta->rta_type = IFLA_MTU;
+  rta->rta_len = RTA_LENGTH(sizeof(std::uint32_t));
+  std::uint32_t mtu = 1500;
+  ::memcpy(RTA_DATA(rta), &mtu, sizeof(mtu));
+  return buf;
+}
+
+
+extern "C" int
+fake_submit(char * buf, std::size_t len, FNNLCOMPLETION complete,
+    void * const * contexts, std::size_t count)
+{
+  if (kernel->failed_submits > 0) {
+    --kernel->failed_submits;
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  std::vector<nlmsghdr const *> requests;
+  int remain = static_cast<int>(len);
+  for (auto nh = reinterpret_cast<nlmsghdr const *>(buf) ;
+      NLMSG_OK(nh, static_cast<std::uint32_t>(remain)) ; nh = NLMSG_NEXT(nh, remain))
+  {
+    requests.push_back(nh);
+  }
+  if (requests.size() != count) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  kernel->submissions.emplace_back();
+  for (std::size_t i = 0 ; i < count ; ++i) {
+    kernel->submissions.back().push_back(requests[i]->nlmsg_type);
+    if (requests[i]->nlmsg_type == RTM_GETLINK && kernel->error(requests[i]) == 0) {
+      auto reply = link_reply();
+      complete(0, reply.data(), reply.size(), contexts[i]);
+    }
+    else {
+      complete(kernel->error(requests[i]), nullptr, 0, contexts[i]);
+    }
+  }
+  return static_cast<int>(count);
+}
+
+
+struct NetlinkBatch : public ::testing::Test
+{
+  fake_kernel fake;
+
+  void SetUp() override
+  {
+    kernel = &fake;
+    NlBatchSetSubmitter(fake_submit);
+  }
+
+  void TearDown() override
+  {
+    NlBatchSetSubmitter(nullptr);
+    kernel = nullptr;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST_F(NetlinkBatch, applies_in_one_submission)
+{
+  auto batch = NlBatchCreate("fake0");
+  ASSERT_NE(nullptr, batch);
+  ASSERT_EQ(0, NlBatchSetMtu(batch, 1400));
+  ASSERT_EQ(0, NlBatchUpAdaptor(batch));
+  ASSERT_EQ(0, NlBatchAddAddress(batch, AF_INET, "10.0.0.2", 24));
+  ASSERT_EQ(0, NlBatchAddRoute(batch, AF_INET, nullptr, 0, "10.0.0.1"));
+
+  ASSERT_EQ(0, NlBatchApply(batch));
+  ASSERT_EQ(1, fake.submissions.size());
+  ASSERT_EQ(5, fake.submissions[0].size());
+  ASSERT_EQ(RTM_GETLINK, fake.submissions[0][0]);
+  NlBatchFree(batch);
+
+  // The batch holds a limited number of changes.
+  batch = NlBatchCreate("fake0");
+  int ret = 0;
+  for (int i = 0 ; i < 100 && ret == 0 ; ++i) {
+    ret = NlBatchAddAddress(batch, AF_INET, "10.0.0.2", 24);
+  }
+  ASSERT_EQ(-1, ret);
+  NlBatchFree(batch);
+}
+
+
+
+TEST_F(NetlinkBatch, rolls_back_what_took_effect)
+{
+  // The route fails, and one address exists already.
+  int addresses = 0;
+  fake.error = [&addresses](nlmsghdr const * nh)
+  {
+    if (nh->nlmsg_type == RTM_NEWROUTE) {
+      return -EINVAL;
+    }
+    if (nh->nlmsg_type == RTM_NEWADDR && addresses++ == 1) {
+      return -EEXIST;
+    }
+    return 0;
+  };
+
+  auto batch = NlBatchCreate("fake0");
+  NlBatchSetMtu(batch, 1400);
+  NlBatchUpAdaptor(batch);
+  NlBatchAddAddress(batch, AF_INET, "10.0.0.2", 24);
+  NlBatchAddAddress(batch, AF_INET, "10.0.1.2", 24);
+  NlBatchAddRoute(batch, AF_INET, nullptr, 0, "10.0.0.1");
+
+  ASSERT_EQ(-1, NlBatchApply(batch));
+  NlBatchFree(batch);
+
+  // In reverse: the address that was added, the link taken down again as it
+  // was, and the previous MTU.
+  ASSERT_EQ(2, fake.submissions.size());
+  std::vector<std::uint16_t> expected = { RTM_DELADDR, RTM_SETLINK, RTM_NEWLINK };
+  ASSERT_EQ(expected, fake.submissions[1]);
+}
+
+
+
+TEST_F(NetlinkBatch, fails_without_the_link_state)
+{
+  fake.error = [](nlmsghdr const * nh)
+  {
+    return nh->nlmsg_type == RTM_GETLINK ? -ENODEV : 0;
+  };
+
+  auto batch = NlBatchCreate("fake0");
+  NlBatchSetMtu(batch, 1400);
+  NlBatchUpAdaptor(batch);
+  NlBatchAddAddress(batch, AF_INET, "10.0.0.2", 24);
+
+  ASSERT_EQ(-1, NlBatchApply(batch));
+  NlBatchFree(batch);
+
+  // The address is removed again; the previous link state is unknown, so
+  // the link is left as it is.
+  ASSERT_EQ(2, fake.submissions.size());
+  std::vector<std::uint16_t> expected = { RTM_DELADDR };
+  ASSERT_EQ(expected, fake.submissions[1]);
+}
+
+
+
+TEST_F(NetlinkBatch, undoes_nothing_that_was_not_sent)
+{
+  fake.failed_submits = 1;
+
+  auto batch = NlBatchCreate("fake0");
+  NlBatchSetMtu(batch, 1400);
+  NlBatchUpAdaptor(batch);
+  NlBatchAddAddress(batch, AF_INET, "10.0.0.2", 24);
+
+  ASSERT_EQ(-1, NlBatchApply(batch));
+  NlBatchFree(batch);
+
+  // No rollback was sent, though it could have been.
+  ASSERT_TRUE(fake.submissions.empty());
+}
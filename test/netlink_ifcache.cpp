@@ -0,0 +1,107 @@
+/*
+ *
+ */
+
+#include "common/netlink_ifcache.h"
+
+#include <string.h>
+#include <net/if.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+nlifentry
+entry(int index, char const * name)
+{
+  nlifentry ret{};
+  ret.nIndex = index;
+  ::strncpy(ret.szName, name, sizeof(ret.szName) - 1);
+  return ret;
+}
+
+
+/**
+ * The cache is process-wide; leave it as found.
+ */
+struct NetlinkIfCache : public ::testing::Test
+{
+  void TearDown() override
+  {
+    NlIfCacheClear();
+  }
+};
+
+} // anonymous namespace
+
+
+TEST_F(NetlinkIfCache, resolves_from_memory)
+{
+  // Updates before loading are ignored.
+  NlIfCacheSet(900, "fake0");
+  ASSERT_FALSE(NlIfCacheLoaded());
+  ASSERT_EQ(0, NlIfNameToIndex("fake0"));
+
+  // Interfaces that do not exist in the system resolve once cached, either
+  // way.
+  nlifentry entries[] = { entry(902, "fake2"), entry(900, "fake0"), entry(901, "fake1") };
+  NlIfCacheLoad(entries, 3);
+  ASSERT_TRUE(NlIfCacheLoaded());
+  ASSERT_EQ(900, NlIfNameToIndex("fake0"));
+  ASSERT_EQ(902, NlIfNameToIndex("fake2"));
+  ASSERT_EQ(0, NlIfNameToIndex(nullptr));
+
+  char name[NL_IFNAMSIZ];
+  ASSERT_STREQ("fake1", NlIfIndexToName(901, name));
+
+  // Renames, additions and removals
+  NlIfCacheSet(901, "renamed1");
+  NlIfCacheSet(899, "fake9");
+  NlIfCacheRemove(902);
+  ASSERT_EQ(901, NlIfNameToIndex("renamed1"));
+  ASSERT_EQ(0, NlIfNameToIndex("fake1"));
+  ASSERT_STREQ("fake9", NlIfIndexToName(899, name));
+  ASSERT_EQ(0, NlIfNameToIndex("fake2"));
+  ASSERT_EQ(nullptr, NlIfIndexToName(902, name));
+
+  // Names that are not cached are still asked for.
+  auto lo = ::if_nametoindex("lo");
+  ASSERT_EQ(lo, NlIfNameToIndex("lo"));
+
+  NlIfCacheClear();
+  ASSERT_FALSE(NlIfCacheLoaded());
+  ASSERT_EQ(0, NlIfNameToIndex("fake0"));
+}
+
+
+
+TEST_F(NetlinkIfCache, keeps_device_interfaces)
+{
+  nlifentry entries[] = { entry(1, "lo"), entry(7, "wwan1"), entry(5, "wwan0"),
+    entry(6, "mhi_netdev0") };
+  NlIfCacheLoad(entries, 4);
+
+  // The first interface of the matching kind
+  char name[NL_IFNAMSIZ];
+  ASSERT_TRUE(NlIfDeviceToName("/dev/cdc-wdm0", name, sizeof(name)));
+  ASSERT_STREQ("wwan0", name);
+  ASSERT_TRUE(NlIfDeviceToName("/dev/mhi_MBIM", name, sizeof(name)));
+  ASSERT_STREQ("mhi_netdev0", name);
+
+  // The interface stays with the device when renamed, and even if another
+  // one would come first now.
+  NlIfCacheSet(5, "wwp0s20u1");
+  NlIfCacheSet(2, "wwan9");
+  ASSERT_TRUE(NlIfDeviceToName("/dev/cdc-wdm0", name, sizeof(name)));
+  ASSERT_STREQ("wwp0s20u1", name);
+
+  // Until it is removed
+  NlIfCacheRemove(5);
+  ASSERT_TRUE(NlIfDeviceToName("/dev/cdc-wdm0", name, sizeof(name)));
+  ASSERT_STREQ("wwan9", name);
+
+  // Too small a buffer
+  char small[4];
+  ASSERT_FALSE(NlIfDeviceToName("/dev/cdc-wdm0", small, sizeof(small)));
+  ASSERT_FALSE(NlIfDeviceToName(nullptr, name, sizeof(name)));
+}
@@ -0,0 +1,252 @@
+/*
+ *
+ */
+
+#include "common/netlink_session.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/rtnetlink.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+/**
+ * Stands in for the kernel: a netlink socket of its own, to which the
+ * session sends its requests, and from which the test answers them.
+ */
+struct fake_kernel
+{
+  int fd = -1;
+  std::uint32_t port = 0;
+
+  fake_kernel()
+  {
+    fd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    socklen_t addrlen = sizeof(addr);
+    if (fd >= 0
+        && ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0
+        && ::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addrlen) == 0)
+    {
+      port = addr.nl_pid;
+    }
+  }
+
+  ~fake_kernel()
+  {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  /**
+   * Receive the next request; returns its header.
+   */
+  nlmsghdr
+  receive()
+  {
+    char buf[4096];
+    nlmsghdr nh{};
+    auto n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n >= static_cast<ssize_t>(sizeof(nh))) {
+      ::memcpy(&nh, buf, sizeof(nh));
+    }
+    return nh;
+  }
+
+  /**
+   * Send a message to the session's port.
+   */
+  void
+  send(std::uint32_t to, std::vector<char> const & message)
+  {
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = to;
+    ASSERT_EQ(static_cast<ssize_t>(message.size()),
+        ::sendto(fd, message.data(), message.size(), 0,
+          reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+  }
+};
+
+
+/**
+ * A message of the given type and size, answering the request.
+ */
+std::vector<char>
+reply(nlmsghdr const & request, std::uint16_t type, std::size_t size)
+{
+  std::vector<char> buf(size);
+  auto nh = reinterpret_cast<nlmsghdr *>(buf.data());
+  nh->nlmsg_len = static_cast<std::uint32_t>(size);
+  nh->nlmsg_type = type;
+  nh->nlmsg_seq = request.nlmsg_seq;
+  nh->nlmsg_pid = request.nlmsg_pid;
+  return buf;
+}
+
+
+/**
+ * The final ACK to the request, with the given error.
+ */
+std::vector<char>
+ack(nlmsghdr const & request, int error)
+{
+  auto buf = reply(request, NLMSG_ERROR, NLMSG_SPACE(sizeof(nlmsgerr)));
+  auto err = reinterpret_cast<nlmsgerr *>(buf.data() + NLMSG_HDRLEN);
+  err->error = error;
+  err->msg = request;
+  return buf;
+}
+
+
+/**
+ * Completions received, by context.
+ */
+struct completions
+{
+  struct result
+  {
+    int error;
+    std::size_t length;
+  };
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::map<void *, result> results;
+
+  bool
+  wait_for(std::size_t count)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    return cond.wait_for(lock, std::chrono::seconds(2),
+        [&] { return results.size() >= count; });
+  }
+};
+
+completions * received = nullptr;
+
+
+extern "C" void
+record(int error, char const *, std::size_t length, void * context)
+{
+  std::lock_guard<std::mutex> lock(received->mutex);
+  received->results[context] = { error, length };
+  received->cond.notify_all();
+}
+
+
+nlmsghdr
+getlink_request()
+{
+  nlmsghdr nh{};
+  nh.nlmsg_len = NLMSG_LENGTH(0);
+  nh.nlmsg_type = RTM_GETLINK;
+  return nh;
+}
+
+
+struct NetlinkSession : public ::testing::Test
+{
+  fake_kernel kernel;
+  completions done;
+  nlsession * session = nullptr;
+
+  void SetUp() override
+  {
+    ASSERT_NE(0, kernel.port);
+    session = NlSessionCreate(0, nullptr, nullptr);
+    ASSERT_NE(nullptr, session);
+    NlSessionSetPeer(session, kernel.port);
+    received = &done;
+  }
+
+  void TearDown() override
+  {
+    NlSessionDestroy(session);
+    received = nullptr;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST_F(NetlinkSession, completes_by_sequence_number)
+{
+  int first_context = 0;
+  int second_context = 0;
+
+  auto first = getlink_request();
+  auto second = getlink_request();
+  auto first_seq = NlSessionSubmit(session, &first, record, &first_context);
+  auto second_seq = NlSessionSubmit(session, &second, record, &second_context);
+  ASSERT_NE(0, first_seq);
+  ASSERT_NE(0, second_seq);
+  ASSERT_NE(first_seq, second_seq);
+
+  auto first_request = kernel.receive();
+  auto second_request = kernel.receive();
+  ASSERT_EQ(first_seq, first_request.nlmsg_seq);
+  ASSERT_EQ(second_seq, second_request.nlmsg_seq);
+  ASSERT_EQ(NlSessionPortId(session), first_request.nlmsg_pid);
+
+  // Answer out of order; a reply nobody asked for is dropped.
+  auto stray = second_request;
+  stray.nlmsg_seq = second_seq + 100;
+  kernel.send(NlSessionPortId(session), ack(stray, -EIO));
+  kernel.send(NlSessionPortId(session), ack(second_request, -ENODEV));
+  kernel.send(NlSessionPortId(session), reply(first_request, RTM_NEWLINK, NLMSG_SPACE(sizeof(ifinfomsg))));
+  kernel.send(NlSessionPortId(session), ack(first_request, 0));
+
+  ASSERT_TRUE(done.wait_for(2));
+  std::lock_guard<std::mutex> lock(done.mutex);
+  ASSERT_EQ(2, done.results.size());
+  ASSERT_EQ(-ENODEV, done.results[&second_context].error);
+  ASSERT_EQ(0, done.results[&second_context].length);
+  ASSERT_EQ(0, done.results[&first_context].error);
+  ASSERT_EQ(NLMSG_SPACE(sizeof(ifinfomsg)), done.results[&first_context].length);
+}
+
+
+TEST_F(NetlinkSession, transact_times_out)
+{
+  auto request = getlink_request();
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(-1, NlSessionTransact(session, &request, nullptr, 0));
+  ASSERT_EQ(ETIMEDOUT, errno);
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+      std::chrono::milliseconds(NL_SESSION_TIMEOUT_MS));
+
+  // The request was cancelled; its late reply is dropped.
+  auto received_request = kernel.receive();
+  ASSERT_EQ(request.nlmsg_seq, received_request.nlmsg_seq);
+  kernel.send(NlSessionPortId(session), ack(received_request, 0));
+}
+
+
+TEST_F(NetlinkSession, truncated_reply_completes_at_once)
+{
+  int context = 0;
+  auto request = getlink_request();
+  auto seq = NlSessionSubmit(session, &request, record, &context);
+  ASSERT_NE(0, seq);
+
+  // Larger than the session's receive buffer
+  auto received_request = kernel.receive();
+  kernel.send(NlSessionPortId(session), reply(received_request, RTM_NEWLINK, 40000));
+
+  ASSERT_TRUE(done.wait_for(1));
+  std::lock_guard<std::mutex> lock(done.mutex);
+  ASSERT_EQ(-EMSGSIZE, done.results[&context].error);
+}
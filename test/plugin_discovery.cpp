@@ -0,0 +1,180 @@
+/*
+ *
+ */
+
+#include <linkmanager/plugin_discovery.h>
+
+#include <unistd.h>
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+namespace fs = std::filesystem;
+
+// See runner.cpp for how accessing the command line works.
+extern char const * cli_name;
+
+namespace {
+
+inline fs::path
+test_plugin()
+{
+  return fs::absolute(fs::path(cli_name).parent_path()) / "libtest_plugin.so";
+}
+
+
+/**
+ * Scratch directory, removed again at the end of the test.
+ */
+struct scratch_dir
+{
+  fs::path path;
+
+  inline scratch_dir()
+    : path{fs::temp_directory_path() / ("linkmanager-test-"
+        + std::to_string(::getpid()) + "-"
+        + ::testing::UnitTest::GetInstance()->current_test_info()->name())}
+  {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+
+  inline ~scratch_dir()
+  {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+
+  inline fs::path add_plugin(std::string const & name) const
+  {
+    fs::copy_file(test_plugin(), path / name);
+    return path / name;
+  }
+
+  inline fs::path add_text(std::string const & name, std::string const & content) const
+  {
+    std::ofstream out{path / name, std::ios::trunc};
+    out << content;
+    return path / name;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST(PluginDiscovery, elf_check)
+{
+  ASSERT_TRUE(elf_exports_symbol(test_plugin(), PLUGIN_INIT_SYMBOL));
+  ASSERT_FALSE(elf_exports_symbol(test_plugin(), "no_such_symbol"));
+
+  // The test executable is an ELF file, but not a plugin.
+  ASSERT_FALSE(elf_exports_symbol(cli_name, PLUGIN_INIT_SYMBOL));
+
+  scratch_dir dir;
+  ASSERT_FALSE(elf_exports_symbol(dir.add_text("foo.so", "\x7f" "ELF garbage"),
+        PLUGIN_INIT_SYMBOL));
+  ASSERT_FALSE(elf_exports_symbol(dir.path / "missing.so", PLUGIN_INIT_SYMBOL));
+}
+
+
+
+TEST(PluginDiscovery, sorted_results)
+{
+  scratch_dir dir;
+  dir.add_plugin("c_plugin.so");
+  dir.add_plugin("a_plugin.so");
+  dir.add_text("README", "not a plugin");
+  dir.add_plugin("b_plugin.so");
+
+  auto found = discover_plugins(dir.path, nullptr, 3);
+  ASSERT_EQ(3, found.size());
+  ASSERT_EQ(dir.path / "a_plugin.so", found[0]);
+  ASSERT_EQ(dir.path / "b_plugin.so", found[1]);
+  ASSERT_EQ(dir.path / "c_plugin.so", found[2]);
+
+  auto handles = open_plugins(found, 2);
+  ASSERT_EQ(3, handles.size());
+  for (auto h : handles) {
+    ASSERT_NE(nullptr, h);
+  }
+}
+
+
+
+TEST(PluginDiscovery, index_round_trip)
+{
+  scratch_dir dir;
+  auto plugin = dir.add_plugin("a_plugin.so");
+  auto text = dir.add_text("README", "not a plugin");
+  auto index_file = dir.path / "index";
+
+  plugin_index index;
+  auto found = discover_plugins(dir.path, &index);
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(2, index.size());
+  ASSERT_TRUE(index.save(index_file));
+
+  plugin_index loaded;
+  loaded.load(index_file);
+  ASSERT_EQ(2, loaded.size());
+
+  plugin_index::key k{
+    fs::last_write_time(plugin).time_since_epoch().count(),
+    fs::file_size(plugin),
+  };
+  ASSERT_EQ(1, loaded.lookup(plugin.string(), k));
+
+  // Changed files are unknown.
+  k.size += 1;
+  ASSERT_EQ(-1, loaded.lookup(plugin.string(), k));
+
+  k = plugin_index::key{
+    fs::last_write_time(text).time_since_epoch().count(),
+    fs::file_size(text),
+  };
+  ASSERT_EQ(0, loaded.lookup(text.string(), k));
+}
+
+
+
+TEST(PluginDiscovery, index_is_trusted)
+{
+  scratch_dir dir;
+  auto text = dir.add_text("README", "not a plugin");
+
+  // Mark the text file as a plugin in the index; discovery must not look at
+  // the file again.
+  plugin_index index;
+  index.update(text.string(), plugin_index::key{
+      fs::last_write_time(text).time_since_epoch().count(),
+      fs::file_size(text),
+  }, true);
+
+  auto found = discover_plugins(dir.path, &index);
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(text, found[0]);
+
+  // Once the file changes, it is inspected again.
+  dir.add_text("README", "still not a plugin");
+  found = discover_plugins(dir.path, &index);
+  ASSERT_TRUE(found.empty());
+}
+
+
+
+TEST(PluginDiscovery, index_prunes_deleted_files)
+{
+  scratch_dir dir;
+  auto plugin = dir.add_plugin("a_plugin.so");
+  dir.add_plugin("b_plugin.so");
+
+  plugin_index index;
+  ASSERT_EQ(2, discover_plugins(dir.path, &index).size());
+  ASSERT_EQ(2, index.size());
+
+  fs::remove(plugin);
+  ASSERT_EQ(1, discover_plugins(dir.path, &index).size());
+  ASSERT_EQ(1, index.size());
+}
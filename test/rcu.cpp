@@ -0,0 +1,110 @@
+/*
+ *
+ */
+
+#include <linkmanager/rcu.h>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+
+namespace {
+
+static constexpr std::uint64_t MAGIC = 0xfeedc0dedeadbeefULL;
+
+/**
+ * Poisons itself on destruction, so that readers can detect use after free
+ * (at least often enough to make the test meaningful).
+ */
+struct poisoned
+{
+  std::uint64_t magic = MAGIC;
+  std::uint64_t value = 0;
+
+  inline explicit poisoned(std::uint64_t v)
+    : value{v}
+  {
+  }
+
+  inline ~poisoned()
+  {
+    magic = 0;
+  }
+};
+
+} // anonymous namespace
+
+
+TEST(RCU, read_initial)
+{
+  rcu_cell<int> cell{std::make_unique<int>(42)};
+  auto guard = cell.read();
+  ASSERT_EQ(42, *guard);
+}
+
+
+
+TEST(RCU, publish)
+{
+  rcu_cell<int> cell{std::make_unique<int>(1)};
+  cell.publish(std::make_unique<int>(2));
+  ASSERT_EQ(2, *cell.read());
+}
+
+
+
+TEST(RCU, guard_keeps_old_value)
+{
+  rcu_cell<poisoned> cell{std::make_unique<poisoned>(1)};
+
+  std::thread writer;
+  {
+    auto guard = cell.read();
+    writer = std::thread{[&cell]() { cell.publish(std::make_unique<poisoned>(2)); }};
+
+    // The writer cannot complete while we hold the guard.
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    ASSERT_EQ(MAGIC, guard->magic);
+    ASSERT_EQ(1, guard->value);
+  }
+  writer.join();
+  ASSERT_EQ(2, cell.read()->value);
+}
+
+
+
+TEST(RCU, concurrent_readers)
+{
+  rcu_cell<poisoned> cell{std::make_unique<poisoned>(0)};
+  std::atomic<bool> done = false;
+  std::atomic<std::size_t> errors = 0;
+
+  std::vector<std::thread> readers;
+  for (int i = 0 ; i < 4 ; ++i) {
+    readers.emplace_back([&]()
+        {
+          std::uint64_t last = 0;
+          while (!done) {
+            auto guard = cell.read();
+            if (guard->magic != MAGIC || guard->value < last) {
+              ++errors;
+            }
+            last = guard->value;
+          }
+        });
+  }
+
+  for (std::uint64_t v = 1 ; v <= 1000 ; ++v) {
+    cell.publish(std::make_unique<poisoned>(v));
+  }
+  done = true;
+  for (auto & r : readers) {
+    r.join();
+  }
+
+  ASSERT_EQ(0, errors);
+  ASSERT_EQ(1000, cell.read()->value);
+}
@@ -0,0 +1,170 @@
+/*
+ *
+ */
+
+#include <linkmanager/reactor.h>
+
+#include <unistd.h>
+#include <signal.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+using namespace std::chrono_literals;
+
+TEST(Reactor, construct_empty)
+{
+  reactor r;
+  ASSERT_EQ(0, r.size());
+  ASSERT_EQ(0, r.run_once(0ms));
+}
+
+
+
+TEST(Reactor, fd_readable)
+{
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+
+  reactor r;
+  int calls = 0;
+  auto h = r.add_fd(fds[0], api::event_loop::IO_READ,
+      [&calls](int fd, std::uint32_t events)
+      {
+        ASSERT_TRUE(events & api::event_loop::IO_READ);
+        char c;
+        ASSERT_EQ(1, ::read(fd, &c, 1));
+        ++calls;
+      });
+  ASSERT_NE(api::event_loop::INVALID_HANDLE, h);
+  ASSERT_EQ(1, r.size());
+
+  ASSERT_EQ(0, r.run_once(0ms));
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ASSERT_EQ(1, r.run_once(100ms));
+  ASSERT_EQ(1, calls);
+
+  r.remove(h);
+  ASSERT_EQ(0, r.size());
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ASSERT_EQ(0, r.run_once(0ms));
+  ASSERT_EQ(1, calls);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+
+
+TEST(Reactor, oneshot_timer)
+{
+  reactor r;
+  int calls = 0;
+  auto h = r.add_timer(1ms, 0ms, [&calls]() { ++calls; });
+  ASSERT_NE(api::event_loop::INVALID_HANDLE, h);
+
+  ASSERT_EQ(1, r.run_once(1000ms));
+  ASSERT_EQ(1, calls);
+
+  // One-shot timers remove themselves.
+  ASSERT_EQ(0, r.size());
+}
+
+
+
+TEST(Reactor, periodic_timer_stop)
+{
+  reactor r;
+  int calls = 0;
+  r.add_timer(1ms, 1ms, [&]()
+      {
+        if (++calls == 3) {
+          r.stop();
+        }
+      });
+
+  r.run();
+  ASSERT_EQ(3, calls);
+  ASSERT_EQ(1, r.size());
+
+  auto stats = r.stats();
+  ASSERT_EQ(3, stats.dispatched);
+  ASSERT_GE(stats.wakeups, 3);
+  ASSERT_GE(stats.max_latency, stats.mean_latency());
+}
+
+
+
+TEST(Reactor, remove_from_callback)
+{
+  reactor r;
+  int calls = 0;
+  api::event_loop::handle h = api::event_loop::INVALID_HANDLE;
+  h = r.add_timer(1ms, 1ms, [&]()
+      {
+        ++calls;
+        r.remove(h);
+      });
+
+  ASSERT_EQ(1, r.run_once(1000ms));
+  ASSERT_EQ(0, r.size());
+  ASSERT_EQ(0, r.run_once(10ms));
+  ASSERT_EQ(1, calls);
+}
+
+
+
+TEST(Reactor, post_from_other_thread)
+{
+  reactor r;
+  std::thread::id ran_on;
+
+  std::thread t{[&r, &ran_on]()
+    {
+      r.post([&r, &ran_on]()
+          {
+            ran_on = std::this_thread::get_id();
+            r.stop();
+          });
+    }};
+
+  r.run();
+  t.join();
+  ASSERT_EQ(std::this_thread::get_id(), ran_on);
+}
+
+
+
+TEST(Reactor, stop_before_run)
+{
+  reactor r;
+  r.stop();
+  r.run();
+}
+
+
+
+TEST(Reactor, signals)
+{
+  reactor r;
+  int received = 0;
+  auto h = r.add_signals({SIGUSR1}, [&](int signo)
+      {
+        received = signo;
+        r.stop();
+      });
+  ASSERT_NE(api::event_loop::INVALID_HANDLE, h);
+
+  ::raise(SIGUSR1);
+  r.run();
+  ASSERT_EQ(SIGUSR1, received);
+
+  r.remove(h);
+
+  sigset_t mask;
+  ::sigemptyset(&mask);
+  ::sigaddset(&mask, SIGUSR1);
+  ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+}
@@ -0,0 +1,85 @@
+/*
+ *
+ */
+
+/**
+ * Standalone MBIM modem simulator.
+ *
+ * Prints the path of the simulated device, which can be used wherever a
+ * /dev/cdc-wdm* path is expected, then runs until interrupted.
+ */
+
+#include <csignal>
+#include <iostream>
+
+#include <clipp.h>
+
+#include "mbim_simulator.h"
+
+int main(int argc, char **argv)
+{
+  using namespace clipp;
+
+  test::simulator_config config;
+  bool help = false;
+  long latency = 0, jitter = 0, storm_interval = 0, register_delay = 0;
+
+  auto cli = (
+      (option("--latency") & value("USEC", latency))
+        .doc("Response latency in microseconds."),
+      (option("--jitter") & value("USEC", jitter))
+        .doc("Random additional response latency of up to USEC microseconds."),
+      (option("--max-transfer") & value("BYTES", config.max_transfer))
+        .doc("Fragment responses and indications larger than BYTES (default: 4096)."),
+      (option("--error-rate") & value("FRACTION", config.error_rate))
+        .doc("Fraction of commands failing."),
+      (option("--drop-rate") & value("FRACTION", config.drop_rate))
+        .doc("Fraction of commands never answered."),
+      (option("--storm-interval") & value("USEC", storm_interval))
+        .doc("Send signal state indications every USEC microseconds."),
+      (option("--storm-burst") & value("COUNT", config.storm_burst))
+        .doc("Indications per storm interval (default: 1)."),
+      (option("--register-delay") & value("MSEC", register_delay))
+        .doc("Time until network registration in milliseconds."),
+      (option("--pin") & value("PIN", config.pin))
+        .doc("Lock the SIM with this PIN."),
+      (option("--seed") & value("SEED", config.seed))
+        .doc("Random seed."),
+      option("--help", "-?")
+        .set(help)
+        .doc("Display this help.")
+  );
+
+  if (!parse(argc, argv, cli) || help) {
+    std::cerr << make_man_page(cli, argv[0]);
+    return 1;
+  }
+  config.latency = std::chrono::microseconds{latency};
+  config.jitter = std::chrono::microseconds{jitter};
+  config.storm_interval = std::chrono::microseconds{storm_interval};
+  config.register_delay = std::chrono::milliseconds{register_delay};
+
+  // Block the signals before any thread is started, so they can be waited
+  // for below.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  test::mbim_simulator sim{config};
+  sim.start();
+  std::cout << sim.path() << std::endl;
+
+  int sig;
+  sigwait(&signals, &sig);
+  sim.stop();
+
+  auto const & stats = sim.stats();
+  std::cerr << "commands: " << stats.commands
+    << ", responses: " << stats.responses
+    << ", errors: " << stats.errors
+    << ", dropped: " << stats.dropped
+    << ", indications: " << stats.indications << std::endl;
+  return 0;
+}
@@ -0,0 +1,799 @@
+/*
+ *
+ */
+#include "mbim_simulator.h"
+
+#include "lite-mbim/MbimTransport.h"
+#include "lite-mbim/BasicConnectDeviceService.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace test {
+
+namespace {
+
+// Message types
+static constexpr std::uint32_t OPEN_MSG = 1;
+static constexpr std::uint32_t CLOSE_MSG = 2;
+static constexpr std::uint32_t COMMAND_MSG = 3;
+static constexpr std::uint32_t DONE_FLAG = 0x80000000;
+static constexpr std::uint32_t INDICATE_STATUS_MSG = 0x80000007;
+
+// Basic Connect CIDs
+static constexpr std::uint32_t CID_SUBSCRIBER_READY_STATUS = 2;
+static constexpr std::uint32_t CID_RADIO_STATE = 3;
+static constexpr std::uint32_t CID_PIN = 4;
+static constexpr std::uint32_t CID_REGISTER_STATE = 9;
+static constexpr std::uint32_t CID_PACKET_SERVICE = 10;
+static constexpr std::uint32_t CID_SIGNAL_STATE = 11;
+static constexpr std::uint32_t CID_CONNECT = 12;
+static constexpr std::uint32_t CID_IP_CONFIGURATION = 15;
+static constexpr std::uint32_t CID_DEVICE_SERVICE_SUBSCRIBE_LIST = 19;
+
+static constexpr std::uint32_t STATUS_NO_DEVICE_SUPPORT = 9;
+
+static constexpr std::size_t COMMAND_HEADER = 48;
+static constexpr std::size_t FRAGMENT_HEADER = 20;
+static constexpr std::size_t MAX_MESSAGE = 1 << 20;
+
+static constexpr std::uint32_t DATA_CLASS_LTE = 0x20;
+static constexpr std::uint32_t CELLULAR_CLASS_GSM = 1;
+
+
+inline void
+put32(std::vector<std::uint8_t> & buf, std::uint32_t value)
+{
+  for (int i = 0 ; i < 4 ; ++i) {
+    buf.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+
+
+inline void
+set32(std::vector<std::uint8_t> & buf, std::size_t pos, std::uint32_t value)
+{
+  for (std::size_t i = 0 ; i < 4 ; ++i) {
+    buf[pos + i] = static_cast<std::uint8_t>(value >> (8 * i));
+  }
+}
+
+
+inline std::uint32_t
+get32(std::uint8_t const * buf)
+{
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16)
+    | (static_cast<std::uint32_t>(buf[3]) << 24);
+}
+
+
+/**
+ * Append a string as UTF-16LE to the data buffer of an information
+ * buffer, and fill in its offset/size pair at `field`.
+ */
+void
+put_string(std::vector<std::uint8_t> & info, std::size_t field, std::string const & str)
+{
+  if (str.empty()) {
+    return;
+  }
+  set32(info, field, static_cast<std::uint32_t>(info.size()));
+  set32(info, field + 4, static_cast<std::uint32_t>(str.size() * 2));
+  for (auto c : str) {
+    info.push_back(static_cast<std::uint8_t>(c));
+    info.push_back(0);
+  }
+  while (info.size() % 4) {
+    info.push_back(0);
+  }
+}
+
+
+/**
+ * Read a UTF-16LE string given by the offset/size pair at `field`; only
+ * ASCII is expected.
+ */
+std::string
+get_string(std::uint8_t const * info, std::uint32_t length, std::size_t field)
+{
+  auto offset = get32(info + field);
+  auto size = get32(info + field + 4);
+  if (offset > length || size > length - offset) {
+    return {};
+  }
+  std::string str;
+  for (std::uint32_t i = 0 ; i + 1 < size ; i += 2) {
+    str.push_back(static_cast<char>(info[offset + i]));
+  }
+  return str;
+}
+
+} // anonymous namespace
+
+
+
+mbim_simulator::mbim_simulator(simulator_config const & config)
+  : m_config{config}
+  , m_random{config.seed}
+{
+  m_config.max_transfer = std::max<std::size_t>(m_config.max_transfer, MBIM_MIN_CTRL_TRANSFER);
+  m_max_transfer = m_config.max_transfer;
+  m_pin_locked = !m_config.pin.empty();
+
+  if (openpty(&m_master, &m_slave, m_name, nullptr, nullptr) < 0) {
+    throw std::runtime_error{"openpty failed"};
+  }
+  for (int fd : {m_master, m_slave}) {
+    termios t;
+    tcgetattr(fd, &t);
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+  m_stop = eventfd(0, EFD_CLOEXEC);
+  if (m_stop < 0) {
+    close(m_master);
+    close(m_slave);
+    throw std::runtime_error{"eventfd failed"};
+  }
+}
+
+
+
+mbim_simulator::~mbim_simulator()
+{
+  stop();
+  close(m_stop);
+  close(m_slave);
+  close(m_master);
+}
+
+
+
+void
+mbim_simulator::start()
+{
+  m_ready_since = clock_type::now();
+  m_next_storm = m_ready_since + m_config.storm_interval;
+  m_thread = std::thread{[this]() { run(); }};
+}
+
+
+
+void
+mbim_simulator::stop()
+{
+  if (!m_thread.joinable()) {
+    return;
+  }
+  std::uint64_t one = 1;
+  auto ret [[maybe_unused]] = write(m_stop, &one, sizeof(one));
+  m_thread.join();
+}
+
+
+
+void
+mbim_simulator::run()
+{
+  message input;
+  std::uint8_t chunk[4096];
+
+  for (;;) {
+    auto now = clock_type::now();
+
+    if (m_config.storm_interval.count() > 0 && now >= m_next_storm) {
+      for (std::size_t i = 0 ; i < m_config.storm_burst ; ++i) {
+        message info;
+        put32(info, 10 + m_random() % 21);  // RSSI
+        put32(info, 99);                    // Error rate unknown
+        put32(info, 0);
+        put32(info, 0xffffffff);
+        put32(info, 0xffffffff);
+        indicate(CID_SIGNAL_STATE, info, now);
+      }
+      // Do not try to catch up after falling behind.
+      m_next_storm = std::max(m_next_storm + m_config.storm_interval, now);
+    }
+
+    if (!m_registered_indicated && registered(now)) {
+      m_registered_indicated = true;
+      indicate_if_subscribed(CID_REGISTER_STATE, register_state_info(now), now);
+    }
+
+    flush(now);
+
+    // Sleep until the next message or event is due.
+    std::optional<clock_type::time_point> wake;
+    if (!m_scheduled.empty()) {
+      wake = m_scheduled.top().due;
+    }
+    if (m_config.storm_interval.count() > 0) {
+      wake = wake ? std::min(*wake, m_next_storm) : m_next_storm;
+    }
+    if (!m_registered_indicated && m_radio_on && !m_pin_locked) {
+      auto at = m_ready_since + m_config.register_delay;
+      wake = wake ? std::min(*wake, at) : at;
+    }
+
+    timespec ts{};
+    timespec * timeout = nullptr;
+    if (wake) {
+      auto delay = std::max(*wake - now, clock_type::duration::zero());
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+      ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+      ts.tv_nsec = static_cast<long>(ns % 1000000000);
+      timeout = &ts;
+    }
+
+    pollfd fds[2] = {
+      {m_master, static_cast<short>(POLLIN | (m_output.empty() ? 0 : POLLOUT)), 0},
+      {m_stop, POLLIN, 0},
+    };
+    if (ppoll(fds, 2, timeout, nullptr) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    if (fds[1].revents) {
+      return;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      auto r = read(m_master, chunk, sizeof(chunk));
+      if (r > 0) {
+        input.insert(input.end(), chunk, chunk + r);
+      }
+
+      while (input.size() >= 12) {
+        auto length = get32(input.data() + 4);
+        if (length < 12 || length > MAX_MESSAGE) {
+          input.clear();
+          break;
+        }
+        if (input.size() < length) {
+          break;
+        }
+        handle(message(input.begin(), input.begin() + length));
+        input.erase(input.begin(), input.begin() + length);
+      }
+    }
+
+    if ((fds[0].revents & POLLOUT) && !m_output.empty()) {
+      auto r = write(m_master, m_output.data(), m_output.size());
+      if (r > 0) {
+        m_output.erase(m_output.begin(), m_output.begin() + r);
+      }
+    }
+  }
+}
+
+
+
+void
+mbim_simulator::handle(message const & msg)
+{
+  auto type = get32(msg.data());
+  auto transaction_id = get32(msg.data() + 8);
+
+  switch (type) {
+    case OPEN_MSG:
+    case CLOSE_MSG:
+      {
+        if (type == OPEN_MSG && msg.size() >= 16) {
+          m_max_transfer = std::clamp<std::size_t>(get32(msg.data() + 12),
+              MBIM_MIN_CTRL_TRANSFER, m_config.max_transfer);
+          m_fragments.clear();
+        }
+        message done;
+        put32(done, type | DONE_FLAG);
+        put32(done, 16);
+        put32(done, transaction_id);
+        put32(done, MBIM_STATUS_SUCCESS);
+        schedule(std::move(done), clock_type::now());
+      }
+      break;
+
+    case COMMAND_MSG:
+      {
+        if (msg.size() < FRAGMENT_HEADER) {
+          break;
+        }
+        auto total = get32(msg.data() + 12);
+        auto current = get32(msg.data() + 16);
+        if (total <= 1) {
+          handle_command(transaction_id, msg);
+          break;
+        }
+
+        if (current == 0) {
+          m_fragments[transaction_id] = command_fragments{total, 1, msg};
+          break;
+        }
+        auto iter = m_fragments.find(transaction_id);
+        if (iter == m_fragments.end()) {
+          break;
+        }
+        auto & frags = iter->second;
+        if (current != frags.next) {
+          m_fragments.erase(iter);
+          break;
+        }
+        frags.msg.insert(frags.msg.end(), msg.begin() + FRAGMENT_HEADER, msg.end());
+        if (++frags.next == frags.total) {
+          auto cmd = std::move(frags.msg);
+          m_fragments.erase(iter);
+          handle_command(transaction_id, cmd);
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+
+void
+mbim_simulator::handle_command(std::uint32_t transaction_id, message const & cmd)
+{
+  if (cmd.size() < COMMAND_HEADER) {
+    return;
+  }
+  ++m_stats.commands;
+
+  std::uniform_real_distribution<double> uniform{0.0, 1.0};
+  if (uniform(m_random) < m_config.drop_rate) {
+    ++m_stats.dropped;
+    return;
+  }
+
+  auto const service = cmd.data() + 20;
+  auto const cid = get32(cmd.data() + 36);
+  auto const set = get32(cmd.data() + 40) == MBIM_COMMAND_TYPE_SET;
+  auto const length = std::min<std::uint32_t>(get32(cmd.data() + 44),
+      static_cast<std::uint32_t>(cmd.size() - COMMAND_HEADER));
+
+  auto due = clock_type::now() + m_config.latency;
+  if (m_config.jitter.count() > 0) {
+    due += std::chrono::microseconds{static_cast<std::int64_t>(
+        uniform(m_random) * static_cast<double>(m_config.jitter.count()))};
+  }
+
+  message reply;
+  std::uint32_t status;
+  if (uniform(m_random) < m_config.error_rate) {
+    ++m_stats.errors;
+    status = MBIM_STATUS_FAILURE;
+  }
+  else if (std::memcmp(service, BasicConnectDeviceService_Uuid(), MBIM_UUID_SIZE) != 0) {
+    status = STATUS_NO_DEVICE_SUPPORT;
+  }
+  else {
+    status = basic_connect(cid, set, cmd.data() + COMMAND_HEADER, length, reply, due);
+  }
+
+  message done;
+  put32(done, COMMAND_MSG | DONE_FLAG);
+  put32(done, 0);
+  put32(done, transaction_id);
+  put32(done, 1);
+  put32(done, 0);
+  done.insert(done.end(), service, service + MBIM_UUID_SIZE);
+  put32(done, cid);
+  put32(done, status);
+  put32(done, static_cast<std::uint32_t>(reply.size()));
+  done.insert(done.end(), reply.begin(), reply.end());
+
+  ++m_stats.responses;
+  // Indications caused by the command were scheduled first, but for the
+  // same time; make the response go out before them.
+  schedule(std::move(done), due - std::chrono::nanoseconds{1});
+}
+
+
+
+std::uint32_t
+mbim_simulator::basic_connect(std::uint32_t cid, bool set, std::uint8_t const * info,
+    std::uint32_t length, message & reply, clock_type::time_point due)
+{
+  auto const now = clock_type::now();
+
+  switch (cid) {
+    case CID_DEVICE_SERVICE_SUBSCRIBE_LIST:
+      if (!set) {
+        put32(reply, 0);
+        return MBIM_STATUS_SUCCESS;
+      }
+      if (length < 4) {
+        return MBIM_STATUS_INVALID_PARAMETERS;
+      }
+      m_subscribe_all = false;
+      m_subscribed_cids.clear();
+      for (std::uint32_t i = 0 ; i < get32(info) && 12 + 8 * i <= length ; ++i) {
+        auto offset = get32(info + 4 + 8 * i);
+        if (offset > length || length - offset < MBIM_UUID_SIZE + 4) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        auto element = info + offset;
+        if (std::memcmp(element, BasicConnectDeviceService_Uuid(), MBIM_UUID_SIZE) != 0) {
+          continue;
+        }
+        auto count = get32(element + MBIM_UUID_SIZE);
+        if (count == 0) {
+          m_subscribe_all = true;
+        }
+        for (std::uint32_t j = 0 ; j < count && offset + 20 + 4 * (j + 1) <= length ; ++j) {
+          m_subscribed_cids.insert(get32(element + 20 + 4 * j));
+        }
+      }
+      reply.assign(info, info + length);
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_SUBSCRIBER_READY_STATUS:
+      reply.resize(28, 0);
+      set32(reply, 0, m_pin_locked ? MBIMSubscriberReadyStateDeviceLocked
+          : MBIMSubscriberReadyStateInitialized);
+      put_string(reply, 4, "001010123456789");
+      put_string(reply, 12, "8949000000000000001");
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_RADIO_STATE:
+      if (set) {
+        if (length < 4) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        bool on = get32(info) == MBIMRadioOn;
+        if (on && !m_radio_on) {
+          m_ready_since = now;
+          m_registered_indicated = false;
+          m_radio_on = true;
+          indicate_if_subscribed(CID_RADIO_STATE, radio_state_info(), due);
+        }
+        else if (!on && m_radio_on) {
+          m_radio_on = false;
+          m_registered_indicated = false;
+          indicate_if_subscribed(CID_RADIO_STATE, radio_state_info(), due);
+          indicate_if_subscribed(CID_REGISTER_STATE, register_state_info(now), due);
+          detach(due);
+        }
+      }
+      reply = radio_state_info();
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_PIN:
+      if (set) {
+        if (length < 24) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        if (get32(info + 4) != MBIMPinOperationEnter) {
+          reply = pin_info();
+          return MBIM_STATUS_FAILURE;
+        }
+        if (m_pin_locked) {
+          if (get_string(info, length, 8) != m_config.pin || m_pin_attempts == 0) {
+            if (m_pin_attempts > 0) {
+              --m_pin_attempts;
+            }
+            reply = pin_info();
+            return MBIM_STATUS_FAILURE;
+          }
+          m_pin_locked = false;
+          m_pin_attempts = 3;
+          m_ready_since = now;
+        }
+      }
+      reply = pin_info();
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_REGISTER_STATE:
+      reply = register_state_info(now);
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_PACKET_SERVICE:
+      if (set) {
+        if (length < 4) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        if (get32(info) == MBIMPacketServiceActionAttach) {
+          if (!registered(now)) {
+            reply = packet_service_info();
+            return MBIM_STATUS_FAILURE;
+          }
+          if (!m_attached) {
+            m_attached = true;
+            indicate_if_subscribed(CID_PACKET_SERVICE, packet_service_info(), due);
+          }
+        }
+        else {
+          detach(due);
+        }
+      }
+      reply = packet_service_info();
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_CONNECT:
+      {
+        if (length < 4 || (set && length < 60)) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        auto session_id = get32(info);
+        if (set) {
+          if (get32(info + 4) == MBIMActivationCommandActivate) {
+            if (!m_attached) {
+              reply = connect_info(session_id);
+              return MBIM_STATUS_FAILURE;
+            }
+            session s;
+            s.ip_type = get32(info + 40);
+            if (s.ip_type == MBIMContextIPTypeDefault) {
+              s.ip_type = MBIMContextIPTypeIPv4;
+            }
+            std::memcpy(s.context_type, info + 44, sizeof(s.context_type));
+            m_sessions[session_id] = s;
+            indicate_if_subscribed(CID_CONNECT, connect_info(session_id), due);
+            indicate_if_subscribed(CID_IP_CONFIGURATION, ip_configuration_info(session_id),
+                due);
+          }
+          else if (m_sessions.erase(session_id) > 0) {
+            indicate_if_subscribed(CID_CONNECT, connect_info(session_id), due);
+          }
+        }
+        reply = connect_info(session_id);
+      }
+      return MBIM_STATUS_SUCCESS;
+
+    case CID_IP_CONFIGURATION:
+      {
+        if (length < 4) {
+          return MBIM_STATUS_INVALID_PARAMETERS;
+        }
+        auto session_id = get32(info);
+        if (set || m_sessions.find(session_id) == m_sessions.end()) {
+          return MBIM_STATUS_FAILURE;
+        }
+        reply = ip_configuration_info(session_id);
+      }
+      return MBIM_STATUS_SUCCESS;
+
+    default:
+      return STATUS_NO_DEVICE_SUPPORT;
+  }
+}
+
+
+
+bool
+mbim_simulator::registered(clock_type::time_point now) const
+{
+  return m_radio_on && !m_pin_locked && now - m_ready_since >= m_config.register_delay;
+}
+
+
+
+bool
+mbim_simulator::subscribed(std::uint32_t cid) const
+{
+  return m_subscribe_all || m_subscribed_cids.count(cid) > 0;
+}
+
+
+
+void
+mbim_simulator::indicate(std::uint32_t cid, message const & info, clock_type::time_point due)
+{
+  message msg;
+  put32(msg, INDICATE_STATUS_MSG);
+  put32(msg, 0);
+  put32(msg, 0);
+  put32(msg, 1);
+  put32(msg, 0);
+  auto service = BasicConnectDeviceService_Uuid();
+  msg.insert(msg.end(), service, service + MBIM_UUID_SIZE);
+  put32(msg, cid);
+  put32(msg, static_cast<std::uint32_t>(info.size()));
+  msg.insert(msg.end(), info.begin(), info.end());
+
+  ++m_stats.indications;
+  schedule(std::move(msg), due);
+}
+
+
+
+void
+mbim_simulator::indicate_if_subscribed(std::uint32_t cid, message const & info,
+    clock_type::time_point due)
+{
+  if (subscribed(cid)) {
+    indicate(cid, info, due);
+  }
+}
+
+
+
+void
+mbim_simulator::detach(clock_type::time_point due)
+{
+  auto sessions = std::move(m_sessions);
+  m_sessions.clear();
+  for (auto const & [id, _] : sessions) {
+    indicate_if_subscribed(CID_CONNECT, connect_info(id), due);
+  }
+  if (m_attached) {
+    m_attached = false;
+    indicate_if_subscribed(CID_PACKET_SERVICE, packet_service_info(), due);
+  }
+}
+
+
+
+void
+mbim_simulator::schedule(message msg, clock_type::time_point due)
+{
+  m_scheduled.push(outgoing{due, m_sequence++, std::move(msg)});
+}
+
+
+
+void
+mbim_simulator::flush(clock_type::time_point now)
+{
+  while (!m_scheduled.empty() && m_scheduled.top().due <= now) {
+    auto const & msg = m_scheduled.top().msg;
+
+    // Command done and indicate status messages have fragment headers;
+    // open and close done messages always fit.
+    auto const next = m_max_transfer - FRAGMENT_HEADER;
+    std::size_t total = 1;
+    if (msg.size() > m_max_transfer) {
+      total += (msg.size() - m_max_transfer + next - 1) / next;
+    }
+
+    std::size_t offset = std::min(msg.size(), m_max_transfer);
+    auto first = m_output.size();
+    m_output.insert(m_output.end(), msg.begin(), msg.begin() + static_cast<std::ptrdiff_t>(offset));
+    set32(m_output, first + 4, static_cast<std::uint32_t>(offset));
+    if (total > 1) {
+      set32(m_output, first + 12, static_cast<std::uint32_t>(total));
+    }
+
+    for (std::size_t i = 1 ; i < total ; ++i) {
+      auto n = std::min(next, msg.size() - offset);
+      put32(m_output, get32(msg.data()));
+      put32(m_output, static_cast<std::uint32_t>(FRAGMENT_HEADER + n));
+      put32(m_output, get32(msg.data() + 8));
+      put32(m_output, static_cast<std::uint32_t>(total));
+      put32(m_output, static_cast<std::uint32_t>(i));
+      m_output.insert(m_output.end(), msg.begin() + static_cast<std::ptrdiff_t>(offset),
+          msg.begin() + static_cast<std::ptrdiff_t>(offset + n));
+      offset += n;
+    }
+
+    m_scheduled.pop();
+  }
+}
+
+
+
+mbim_simulator::message
+mbim_simulator::radio_state_info() const
+{
+  message info;
+  put32(info, MBIMRadioOn);
+  put32(info, m_radio_on ? MBIMRadioOn : MBIMRadioOff);
+  return info;
+}
+
+
+
+mbim_simulator::message
+mbim_simulator::pin_info() const
+{
+  message info;
+  put32(info, m_pin_locked ? MBIMPinTypePin1 : MBIMPinTypeNone);
+  put32(info, m_pin_locked ? MBIMPinStateLocked : MBIMPinStateUnlocked);
+  put32(info, m_pin_locked ? m_pin_attempts : 0);
+  return info;
+}
+
+
+
+mbim_simulator::message
+mbim_simulator::register_state_info(clock_type::time_point now) const
+{
+  message info(48, 0);
+  set32(info, 8, MBIMRegisterModeAutomatic);
+  if (registered(now)) {
+    set32(info, 4, MBIMRegisterStateHome);
+    set32(info, 12, DATA_CLASS_LTE);
+    set32(info, 16, CELLULAR_CLASS_GSM);
+    put_string(info, 20, "00101");
+    put_string(info, 28, "Simulated");
+  }
+  else {
+    set32(info, 4, (m_radio_on && !m_pin_locked) ? MBIMRegisterStateSearching
+        : MBIMRegisterStateDeregistered);
+  }
+  return info;
+}
+
+
+
+mbim_simulator::message
+mbim_simulator::packet_service_info() const
+{
+  message info;
+  put32(info, 0);
+  put32(info, m_attached ? MBIMPacketServiceStateAttached : MBIMPacketServiceStateDetached);
+  put32(info, m_attached ? DATA_CLASS_LTE : 0);
+  put32(info, m_attached ? 50000000 : 0);     // Uplink, 64 bits
+  put32(info, 0);
+  put32(info, m_attached ? 150000000 : 0);    // Downlink, 64 bits
+  put32(info, 0);
+  return info;
+}
+
+
+
+mbim_simulator::message
+mbim_simulator::connect_info(std::uint32_t session_id) const
+{
+  auto iter = m_sessions.find(session_id);
+
+  message info;
+  put32(info, session_id);
+  put32(info, iter != m_sessions.end() ? MBIMActivationStateActivated
+      : MBIMActivationStateDeactivated);
+  put32(info, MBIMVoiceCallStateNone);
+  put32(info, iter != m_sessions.end() ? iter->second.ip_type
+      : static_cast<std::uint32_t>(MBIMContextIPTypeDefault));
+  if (iter != m_sessions.end()) {
+    info.insert(info.end(), iter->second.context_type,
+        iter->second.context_type + sizeof(iter->second.context_type));
+  }
+  else {
+    info.resize(info.size() + MBIM_UUID_SIZE, 0);
+  }
+  put32(info, 0);
+  return info;
+}
+
+
+mbim_simulator::message
+mbim_simulator::ip_configuration_info(std::uint32_t session_id) const
+{
+  message info;
+  std::uint8_t const net = static_cast<std::uint8_t>(session_id);
+
+  info.resize(60, 0);
+  set32(info, 0, session_id);
+  set32(info, 4, MBIM_IPV4_CONFIGURATION_AVAILABLE_ADDRESS
+      | MBIM_IPV4_CONFIGURATION_AVAILABLE_GATEWAY
+      | MBIM_IPV4_CONFIGURATION_AVAILABLE_DNS
+      | MBIM_IPV4_CONFIGURATION_AVAILABLE_MTU);
+  set32(info, 12, 1);      // Address
+  set32(info, 16, 60);
+  set32(info, 28, 68);     // Gateway
+  set32(info, 36, 1);      // DNS server
+  set32(info, 40, 72);
+  set32(info, 52, 1500);   // MTU
+  put32(info, 24);
+  info.insert(info.end(), {10, net, 0, 2});
+  info.insert(info.end(), {10, net, 0, 1});
+  info.insert(info.end(), {10, net, 0, 53});
+  return info;
+}
+
+} // namespace test
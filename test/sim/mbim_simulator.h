@@ -0,0 +1,191 @@
+/*
+ *
+ */
+#ifndef LINKMANAGER_TEST_SIM_MBIM_SIMULATOR_H
+#define LINKMANAGER_TEST_SIM_MBIM_SIMULATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace test {
+
+/**
+ * Behaviour of a simulated modem.
+ */
+struct simulator_config
+{
+  // Time between receiving a command and sending its response; each
+  // response is delayed by an additional random amount of up to `jitter`,
+  // so responses may overtake each other.
+  std::chrono::microseconds   latency{0};
+  std::chrono::microseconds   jitter{0};
+
+  // Largest message the simulated function sends; longer responses and
+  // indications are fragmented.
+  std::size_t                 max_transfer = 4096;
+
+  // Fraction of commands failing with MBIM_STATUS_FAILURE, and of commands
+  // that are never answered.
+  double                      error_rate = 0;
+  double                      drop_rate = 0;
+
+  // Unsolicited signal state indications: `storm_burst` of them every
+  // `storm_interval`. An interval of zero disables the storm.
+  std::chrono::microseconds   storm_interval{0};
+  std::size_t                 storm_burst = 1;
+
+  // Time from the radio being switched on (and the SIM unlocked) until the
+  // modem registers with the network.
+  std::chrono::milliseconds   register_delay{0};
+
+  // If set, the SIM starts out locked with this PIN1.
+  std::string                 pin;
+
+  std::uint32_t               seed = 1;
+};
+
+
+/**
+ * A simulated MBIM function on the master side of a pty.
+ *
+ * Point an MbimTransport at path(), and it speaks MBIM control messages
+ * to the simulator as it would to a cdc-wdm device. The simulator answers
+ * open and close, and implements the Basic Connect CIDs the transport
+ * library has codecs for: device service subscribe list, subscriber ready
+ * status, radio state, PIN, register state, packet service, connect and IP
+ * configuration. State changes are indicated to the host as a modem would,
+ * whether caused by the network or by the host's own commands.
+ * Fragmented commands are reassembled; other device services are answered
+ * with MBIM_STATUS_NO_DEVICE_SUPPORT.
+ *
+ * Activated sessions get the IPv4 address 10.<session>.0.2/24, gateway
+ * 10.<session>.0.1, DNS server 10.<session>.0.53 and an MTU of 1500.
+ *
+ * All work happens on one thread, started by start().
+ */
+class mbim_simulator
+{
+public:
+  struct statistics
+  {
+    std::atomic<std::uint64_t>  commands{0};
+    std::atomic<std::uint64_t>  responses{0};
+    std::atomic<std::uint64_t>  errors{0};
+    std::atomic<std::uint64_t>  dropped{0};
+    std::atomic<std::uint64_t>  indications{0};
+  };
+
+  explicit mbim_simulator(simulator_config const & config = {});
+  ~mbim_simulator();
+
+  mbim_simulator(mbim_simulator const &) = delete;
+  mbim_simulator & operator=(mbim_simulator const &) = delete;
+
+  void start();
+  void stop();
+
+  /**
+   * Device path for MbimTransport_Initialize().
+   */
+  inline char * path()
+  {
+    return m_name;
+  }
+
+  inline statistics const & stats() const
+  {
+    return m_stats;
+  }
+
+private:
+  using clock_type = std::chrono::steady_clock;
+  using message = std::vector<std::uint8_t>;
+
+  struct outgoing
+  {
+    clock_type::time_point  due;
+    std::uint64_t           sequence;
+    message                 msg;
+
+    inline bool operator>(outgoing const & other) const
+    {
+      return due != other.due ? due > other.due : sequence > other.sequence;
+    }
+  };
+
+  struct command_fragments
+  {
+    std::uint32_t total = 0;
+    std::uint32_t next = 0;
+    message       msg;
+  };
+
+  struct session
+  {
+    std::uint32_t ip_type = 0;
+    std::uint8_t  context_type[16] = {};
+  };
+
+  void run();
+  void handle(message const & msg);
+  void handle_command(std::uint32_t transaction_id, message const & cmd);
+  std::uint32_t basic_connect(std::uint32_t cid, bool set, std::uint8_t const * info,
+      std::uint32_t length, message & reply, clock_type::time_point due);
+
+  bool registered(clock_type::time_point now) const;
+  bool subscribed(std::uint32_t cid) const;
+
+  void indicate(std::uint32_t cid, message const & info, clock_type::time_point due);
+  void indicate_if_subscribed(std::uint32_t cid, message const & info,
+      clock_type::time_point due);
+  void detach(clock_type::time_point due);
+  void schedule(message msg, clock_type::time_point due);
+  void flush(clock_type::time_point now);
+
+  message radio_state_info() const;
+  message pin_info() const;
+  message register_state_info(clock_type::time_point now) const;
+  message packet_service_info() const;
+  message connect_info(std::uint32_t session_id) const;
+  message ip_configuration_info(std::uint32_t session_id) const;
+
+  simulator_config            m_config;
+  int                         m_master = -1;
+  int                         m_slave = -1;
+  int                         m_stop = -1;
+  char                        m_name[64] = {};
+  std::thread                 m_thread;
+  statistics                  m_stats;
+
+  // Simulator thread only
+  std::mt19937                m_random;
+  std::uint64_t               m_sequence = 0;
+  std::priority_queue<outgoing, std::vector<outgoing>, std::greater<outgoing>> m_scheduled;
+  message                     m_output;
+  std::size_t                 m_max_transfer = 0;
+  std::map<std::uint32_t, command_fragments> m_fragments;
+  clock_type::time_point      m_next_storm;
+
+  // Modem state
+  bool                        m_radio_on = true;
+  clock_type::time_point      m_ready_since;
+  bool                        m_pin_locked = false;
+  std::uint32_t               m_pin_attempts = 3;
+  bool                        m_registered_indicated = false;
+  bool                        m_attached = false;
+  std::map<std::uint32_t, session> m_sessions;  // Activated sessions
+  bool                        m_subscribe_all = true;
+  std::set<std::uint32_t>     m_subscribed_cids;
+};
+
+} // namespace test
+
+#endif // guard
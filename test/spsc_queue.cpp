@@ -0,0 +1,82 @@
+/*
+ *
+ */
+
+#include <linkmanager/spsc_queue.h>
+
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using namespace linkmanager;
+
+
+TEST(SPSCQueue, capacity_rounded_up)
+{
+  spsc_queue<int> queue{5};
+  ASSERT_EQ(8, queue.capacity());
+
+  for (int i = 0 ; i < 8 ; ++i) {
+    int v = i;
+    ASSERT_TRUE(queue.push(std::move(v)));
+  }
+  int v = 8;
+  ASSERT_FALSE(queue.push(std::move(v)));
+  ASSERT_EQ(8, queue.size());
+
+  for (int i = 0 ; i < 8 ; ++i) {
+    ASSERT_TRUE(queue.pop(v));
+    ASSERT_EQ(i, v);
+  }
+  ASSERT_FALSE(queue.pop(v));
+}
+
+
+
+TEST(SPSCQueue, pop_releases_element)
+{
+  spsc_queue<std::shared_ptr<int>> queue{2};
+  auto value = std::make_shared<int>(1);
+  auto copy = value;
+  ASSERT_TRUE(queue.push(std::move(copy)));
+
+  std::shared_ptr<int> out;
+  ASSERT_TRUE(queue.pop(out));
+  out.reset();
+  ASSERT_EQ(1, value.use_count());
+}
+
+
+
+TEST(SPSCQueue, producer_consumer)
+{
+  static constexpr std::size_t COUNT = 100000;
+  spsc_queue<std::size_t> queue{64};
+
+  std::thread producer{[&queue]()
+    {
+      for (std::size_t i = 0 ; i < COUNT ; ) {
+        auto v = i;
+        if (queue.push(std::move(v))) {
+          ++i;
+        }
+        else {
+          std::this_thread::yield();
+        }
+      }
+    }};
+
+  std::size_t expected = 0;
+  while (expected < COUNT) {
+    std::size_t v;
+    if (queue.pop(v)) {
+      ASSERT_EQ(expected, v);
+      ++expected;
+    }
+    else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+}